@@ -0,0 +1,173 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/biquad_filter.h"
+
+#include <algorithm>
+#include <cmath>
+
+#include <boost/assert.hpp>
+
+#include "base/simd.h"
+
+namespace mjmech {
+namespace base {
+
+Biquad Biquad::OnePole(double half_life_s, double rate_hz) {
+  const double alpha = std::pow(0.5, 1.0 / (rate_hz * half_life_s));
+  Biquad result;
+  result.b0 = 1.0 - alpha;
+  result.a1 = -alpha;
+  return result;
+}
+
+Biquad Biquad::LowPass(double cutoff_hz, double q, double rate_hz) {
+  const double w0 = 2.0 * M_PI * cutoff_hz / rate_hz;
+  const double cos_w0 = std::cos(w0);
+  const double alpha = std::sin(w0) / (2.0 * q);
+  const double a0 = 1.0 + alpha;
+
+  Biquad result;
+  result.b0 = (1.0 - cos_w0) / 2.0 / a0;
+  result.b1 = (1.0 - cos_w0) / a0;
+  result.b2 = result.b0;
+  result.a1 = -2.0 * cos_w0 / a0;
+  result.a2 = (1.0 - alpha) / a0;
+  return result;
+}
+
+Biquad Biquad::Notch(double center_hz, double q, double rate_hz) {
+  const double w0 = 2.0 * M_PI * center_hz / rate_hz;
+  const double cos_w0 = std::cos(w0);
+  const double alpha = std::sin(w0) / (2.0 * q);
+  const double a0 = 1.0 + alpha;
+
+  Biquad result;
+  result.b0 = 1.0 / a0;
+  result.b1 = -2.0 * cos_w0 / a0;
+  result.b2 = result.b0;
+  result.a1 = result.b1;
+  result.a2 = (1.0 - alpha) / a0;
+  return result;
+}
+
+Biquad Biquad::Derivative(double rate_hz) {
+  Biquad result;
+  result.b0 = rate_hz;
+  result.b1 = -rate_hz;
+  return result;
+}
+
+std::vector<Biquad> FilterConfig::Design(double rate_hz) const {
+  std::vector<Biquad> result;
+  if (half_life_s > 0.0) {
+    result.push_back(Biquad::OnePole(half_life_s, rate_hz));
+  }
+  if (lowpass_hz > 0.0) {
+    result.push_back(Biquad::LowPass(lowpass_hz, lowpass_q, rate_hz));
+  }
+  if (notch_hz > 0.0) {
+    result.push_back(Biquad::Notch(notch_hz, notch_q, rate_hz));
+  }
+  if (derivative) {
+    result.push_back(Biquad::Derivative(rate_hz));
+  }
+  return result;
+}
+
+template <typename Scalar>
+BasicBiquadFilterBank<Scalar>::BasicBiquadFilterBank(
+    const std::vector<std::vector<Biquad>>& channels)
+    : channels_(channels.size()) {
+  constexpr int kLanes = simd::Traits<Scalar>::kLanes;
+
+  for (const auto& channel : channels) {
+    sections_ = std::max<int>(sections_, channel.size());
+  }
+  stride_ = (channels_ + kLanes - 1) / kLanes * kLanes;
+
+  const size_t size = sections_ * stride_;
+  b0_.assign(size, 1);
+  b1_.assign(size, 0);
+  b2_.assign(size, 0);
+  a1_.assign(size, 0);
+  a2_.assign(size, 0);
+  s1_.assign(size, 0);
+  s2_.assign(size, 0);
+  buffer_.assign(stride_, 0);
+
+  for (int c = 0; c < channels_; c++) {
+    for (size_t s = 0; s < channels[c].size(); s++) {
+      const auto& biquad = channels[c][s];
+      const int i = s * stride_ + c;
+      b0_[i] = biquad.b0;
+      b1_[i] = biquad.b1;
+      b2_[i] = biquad.b2;
+      a1_[i] = biquad.a1;
+      a2_[i] = biquad.a2;
+    }
+  }
+}
+
+template <typename Scalar>
+void BasicBiquadFilterBank<Scalar>::Reset(int channel, Scalar input) {
+  BOOST_ASSERT(channel >= 0 && channel < channels_);
+
+  Scalar x = input;
+  for (int s = 0; s < sections_; s++) {
+    const int i = s * stride_ + channel;
+    const Scalar y =
+        (b0_[i] + b1_[i] + b2_[i]) / (1 + a1_[i] + a2_[i]) * x;
+    s2_[i] = b2_[i] * x - a2_[i] * y;
+    s1_[i] = b1_[i] * x - a1_[i] * y + s2_[i];
+    x = y;
+  }
+}
+
+template <typename Scalar>
+void BasicBiquadFilterBank<Scalar>::Process(
+    const Scalar* input, Scalar* output) {
+  constexpr int kLanes = simd::Traits<Scalar>::kLanes;
+
+  std::copy(input, input + channels_, buffer_.begin());
+
+  Scalar* const x = buffer_.data();
+  for (int s = 0; s < sections_; s++) {
+    const int offset = s * stride_;
+    for (int c = 0; c < stride_; c += kLanes) {
+      const int i = offset + c;
+      const auto in = simd::Load(x + c);
+      const auto s1 = simd::Load(&s1_[i]);
+      const auto s2 = simd::Load(&s2_[i]);
+      const auto b0 = simd::Load(&b0_[i]);
+      const auto b1 = simd::Load(&b1_[i]);
+      const auto b2 = simd::Load(&b2_[i]);
+      const auto a1 = simd::Load(&a1_[i]);
+      const auto a2 = simd::Load(&a2_[i]);
+
+      const auto out = b0 * in + s1;
+      simd::Store(&s1_[i], b1 * in - a1 * out + s2);
+      simd::Store(&s2_[i], b2 * in - a2 * out);
+      simd::Store(x + c, out);
+    }
+  }
+
+  std::copy(buffer_.begin(), buffer_.begin() + channels_, output);
+}
+
+template class BasicBiquadFilterBank<double>;
+template class BasicBiquadFilterBank<float>;
+
+}
+}
@@ -0,0 +1,134 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <vector>
+
+#include "mjlib/base/visitor.h"
+
+namespace mjmech {
+namespace base {
+
+/// The coefficients of one second order section, normalized so that
+/// a0 == 1:
+///
+///   y[n] = b0 x[n] + b1 x[n-1] + b2 x[n-2] - a1 y[n-1] - a2 y[n-2]
+struct Biquad {
+  double b0 = 1.0;
+  double b1 = 0.0;
+  double b2 = 0.0;
+  double a1 = 0.0;
+  double a2 = 0.0;
+
+  double dc_gain() const { return (b0 + b1 + b2) / (1.0 + a1 + a2); }
+
+  /// The exponential filter y = alpha * y + (1 - alpha) * x, where
+  /// alpha is chosen so that a step is half complete after
+  /// @p half_life_s.
+  static Biquad OnePole(double half_life_s, double rate_hz);
+
+  /// These follow the "Audio EQ Cookbook" by Robert Bristow-Johnson.
+  /// A @p q of 1/sqrt(2) gives a Butterworth low pass.
+  static Biquad LowPass(double cutoff_hz, double q, double rate_hz);
+  static Biquad Notch(double center_hz, double q, double rate_hz);
+
+  /// The first difference, scaled to units per second.
+  static Biquad Derivative(double rate_hz);
+};
+
+/// Describes the conditioning for one signal.  Every stage which is
+/// enabled is applied in the order listed here.
+struct FilterConfig {
+  /// A one pole exponential filter, disabled when 0.
+  double half_life_s = 0.0;
+
+  /// A second order low pass, disabled when 0.
+  double lowpass_hz = 0.0;
+  double lowpass_q = 0.7071;
+
+  /// A notch, disabled when 0.
+  double notch_hz = 0.0;
+  double notch_q = 2.0;
+
+  /// Output the rate of change of the filtered signal.
+  bool derivative = false;
+
+  std::vector<Biquad> Design(double rate_hz) const;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(half_life_s));
+    a->Visit(MJ_NVP(lowpass_hz));
+    a->Visit(MJ_NVP(lowpass_q));
+    a->Visit(MJ_NVP(notch_hz));
+    a->Visit(MJ_NVP(notch_q));
+    a->Visit(MJ_NVP(derivative));
+  }
+};
+
+/// Run a cascade of biquads for each of several channels at once.
+///
+/// All coefficients are fixed at construction.  Channels are laid out
+/// across SIMD lanes, so the whole bank costs about the same as
+/// filtering one or two signals with scalar code.  Channels with
+/// fewer sections than the longest are padded with pass through
+/// sections.
+///
+/// Coefficients are always designed in double precision.  @p Scalar
+/// selects the precision of the state and arithmetic.  float has
+/// twice as many lanes, and is the only vectorized option on 32 bit
+/// ARM.
+template <typename Scalar>
+class BasicBiquadFilterBank {
+ public:
+  BasicBiquadFilterBank() {}
+  explicit BasicBiquadFilterBank(
+      const std::vector<std::vector<Biquad>>& channels);
+
+  int channels() const { return channels_; }
+
+  /// Put @p channel in the steady state for a constant @p input.
+  void Reset(int channel, Scalar input);
+
+  /// Filter one sample for every channel.  Both arrays must have
+  /// channels() elements.
+  void Process(const Scalar* input, Scalar* output);
+
+ private:
+  int channels_ = 0;
+  int sections_ = 0;
+
+  // Padded to a multiple of the SIMD width.
+  int stride_ = 0;
+
+  // Each of these is sections_ x stride_, section major.
+  std::vector<Scalar> b0_;
+  std::vector<Scalar> b1_;
+  std::vector<Scalar> b2_;
+  std::vector<Scalar> a1_;
+  std::vector<Scalar> a2_;
+
+  // Transposed direct form II state, also sections_ x stride_.
+  std::vector<Scalar> s1_;
+  std::vector<Scalar> s2_;
+
+  std::vector<Scalar> buffer_;
+};
+
+typedef BasicBiquadFilterBank<double> BiquadFilterBank;
+typedef BasicBiquadFilterBank<float> BiquadFilterBankf;
+
+}
+}
@@ -14,12 +14,17 @@
 
 #pragma once
 
+#include <vector>
+
 namespace mjmech {
 namespace base {
 /// A dumb circular buffer which is based on a std::vector.  Thus it
 /// has the property that in steady state no allocations are required,
 /// unlike std::list, but actually works with move-only objects,
 /// unlike boost::circular buffer as of boost 1.55.
+///
+/// It does still reallocate when it fills.  Where that is not
+/// acceptable, use RingBuffer from ring_buffer.h.
 template <typename T>
 class circular_buffer {
  public:
@@ -28,27 +33,30 @@ class circular_buffer {
   void push_back(T&& value) {
     if (full()) { resize(data_.size() * 2); }
     data_[insert_] = std::move(value);
-    insert_ = (insert_ + 1) % data_.size();
+    insert_ = wrap(insert_ + 1);
   }
 
   void pop_front() {
-    remove_ = (remove_ + 1) % data_.size();
+    remove_ = wrap(remove_ + 1);
   }
 
   T& front() { return data_[remove_]; }
   const T& front() const { return data_[remove_]; }
 
-  T& back() { return data_[insert_]; }
-  const T& back() const { return data_[insert_]; }
+  T& back() { return data_[wrap(insert_ - 1)]; }
+  const T& back() const { return data_[wrap(insert_ - 1)]; }
 
   bool empty() const { return insert_ == remove_; }
   bool full() const {
-    return ((insert_ + 1) % data_.size()) == remove_;
+    return wrap(insert_ + 1) == remove_;
   }
 
   size_t capacity() const { return data_.size() - 1; }
 
  private:
+  // The size is always a power of two.
+  size_t wrap(size_t index) const { return index & (data_.size() - 1); }
+
   void resize(size_t size) {
     std::vector<T> new_data(size);
     size_t new_offset = 0;
@@ -65,7 +73,6 @@ class circular_buffer {
   std::vector<T> data_;
   size_t insert_ = 0;
   size_t remove_ = 0;
-  size_t size_ = 0;
 };
 }
 }
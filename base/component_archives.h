@@ -15,10 +15,13 @@
 #pragma once
 
 #include <map>
+#include <set>
 
 #include "mjlib/base/clipp_archive.h"
 
+#include "base/coroutine.h"
 #include "base/handler_util.h"
+#include "base/startup_tracer.h"
 
 
 namespace mjmech {
@@ -50,13 +53,30 @@ struct EnableArchive {
 };
 
 struct StartArchive {
-  StartArchive(mjlib::io::ErrorCallback handler)
-      : joiner(std::make_shared<ErrorHandlerJoiner>(std::move(handler))) {}
+  struct Options {
+    /// If set, the start of each component is recorded as a phase.
+    StartupTracer* tracer = nullptr;
+
+    /// These components are not started.
+    std::set<std::string> skip;
+
+    /// If non-empty, only these components are started.  At least
+    /// one must exist, or the callback is never called.
+    std::set<std::string> only;
+
+    Options() {}
+  };
+
+  StartArchive(mjlib::io::ErrorCallback handler,
+               const Options& options = Options())
+      : joiner(std::make_shared<ErrorHandlerJoiner>(std::move(handler))),
+        options(options) {}
 
   template <typename Serializable>
   static void Start(Serializable* serializable,
-                    mjlib::io::ErrorCallback callback) {
-    StartArchive archive(std::move(callback));
+                    mjlib::io::ErrorCallback callback,
+                    const Options& options = Options()) {
+    StartArchive archive(std::move(callback), options);
     archive.Accept(serializable);
   }
 
@@ -74,16 +94,93 @@ struct StartArchive {
   template <typename T>
   auto Helper(const char* name, T* value, int)
       -> decltype((*value)->AsyncStart(mjlib::io::ErrorCallback())) {
-    (*value)->AsyncStart(
-        joiner->Wrap(std::string("starting: '") + name + "'"));
+    if (options.skip.count(name)) { return; }
+    if (!options.only.empty() && !options.only.count(name)) { return; }
+
+    auto callback = joiner->Wrap(std::string("starting: '") + name + "'");
+    if (options.tracer) {
+      callback = options.tracer->Wrap(std::string("start.") + name,
+                                      std::move(callback));
+    }
+    (*value)->AsyncStart(std::move(callback));
   }
 
   template <typename T>
   void Helper(const char*, T*, long) {}
 
   std::shared_ptr<ErrorHandlerJoiner> joiner;
+  const Options options;
 };
 
+#ifdef MJMECH_COROUTINES
+/// Start every component, as StartArchive does, but co_await gives
+/// the first error.
+///
+/// Unlike StartArchive, this waits for every component to finish
+/// starting even after one fails, since their callbacks refer to the
+/// awaiting coroutine's frame.  In exchange, no joiner needs to be
+/// allocated.
+template <typename Serializable>
+class StartAwaiter {
+ public:
+  explicit StartAwaiter(Serializable* serializable)
+      : serializable_(serializable) {}
+
+  StartAwaiter(const StartAwaiter&) = delete;
+  StartAwaiter& operator=(const StartAwaiter&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    // This one stands for the visit itself, so that components which
+    // finish immediately cannot resume us before all have started.
+    outstanding_ = 1;
+    serializable_->Serialize(this);
+    Complete({}, nullptr);
+  }
+
+  mjlib::base::error_code await_resume() { return ec_; }
+
+  template <typename NameValuePair>
+  void Visit(const NameValuePair& pair) {
+    Helper(pair.name(), pair.value(), 0);
+  }
+
+ private:
+  template <typename T>
+  auto Helper(const char* name, T* value, int)
+      -> decltype((*value)->AsyncStart(mjlib::io::ErrorCallback())) {
+    outstanding_++;
+    (*value)->AsyncStart([this, name](const mjlib::base::error_code& ec) {
+        Complete(ec, name);
+      });
+  }
+
+  template <typename T>
+  void Helper(const char*, T*, long) {}
+
+  void Complete(const mjlib::base::error_code& ec, const char* name) {
+    if (ec && !ec_) {
+      ec_ = ec;
+      ec_.Append(std::string("starting: '") + name + "'");
+    }
+    outstanding_--;
+    if (outstanding_ == 0) { handle_.resume(); }
+  }
+
+  Serializable* const serializable_;
+  std::coroutine_handle<> handle_;
+  int outstanding_ = 0;
+  mjlib::base::error_code ec_;
+};
+
+template <typename Serializable>
+StartAwaiter<Serializable> AwaitStart(Serializable* serializable) {
+  return StartAwaiter<Serializable>(serializable);
+}
+#endif
+
 class ClippComponentArchive {
  public:
   template <typename T>
@@ -14,20 +14,27 @@
 
 #include "context_full.h"
 
+#include "base/cpu_affinity.h"
+
 namespace mjmech {
 namespace base {
 
 Context::Context()
-    : telemetry_log(std::make_unique<mjlib::telemetry::FileWriter>([]() {
+    : startup_tracer(std::make_unique<StartupTracer>()),
+      telemetry_log(std::make_unique<mjlib::telemetry::FileWriter>([]() {
           mjlib::telemetry::FileWriter::Options options;
           options.blocking = false;
           return options;
         }())),
       remote_debug(std::make_unique<TelemetryRemoteDebugServer>(executor)),
+      telemetry_stream(std::make_unique<TelemetryStreamPublisher>(executor)),
       telemetry_registry(std::make_unique<TelemetryRegistry>(
-                             context, telemetry_log.get(), remote_debug.get())),
+                             context, telemetry_log.get(), remote_debug.get(),
+                             telemetry_stream.get())),
       factory(std::make_unique<mjlib::io::StreamFactory>(executor))
 {
+  // Record this before anything has a chance to pin the main thread.
+  ProcessAffinity();
 }
 
 Context::~Context() {}
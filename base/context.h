@@ -27,8 +27,10 @@
 namespace mjmech {
 namespace base {
 
+class StartupTracer;
 class TelemetryRemoteDebugServer;
 class TelemetryRegistry;
+class TelemetryStreamPublisher;
 
 struct Context : boost::noncopyable {
   Context();
@@ -37,8 +39,11 @@ struct Context : boost::noncopyable {
   boost::asio::io_context context;
   mjlib::io::RealtimeExecutor rt_executor{context.get_executor()};
   boost::asio::any_io_executor executor{rt_executor};
+  // This is first, so that it times everything else.
+  std::unique_ptr<StartupTracer> startup_tracer;
   std::unique_ptr<mjlib::telemetry::FileWriter> telemetry_log;
   std::unique_ptr<TelemetryRemoteDebugServer> remote_debug;
+  std::unique_ptr<TelemetryStreamPublisher> telemetry_stream;
   std::unique_ptr<TelemetryRegistry> telemetry_registry;
   std::unique_ptr<mjlib::io::StreamFactory> factory;
 };
@@ -19,5 +19,7 @@
 
 #include "mjlib/io/stream_factory.h"
 
+#include "startup_tracer.h"
 #include "telemetry_registry.h"
 #include "telemetry_remote_debug_server.h"
+#include "telemetry_stream_publisher.h"
@@ -0,0 +1,261 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+/// C++20 coroutine support for the callback based asynchronous
+/// operations used throughout, so that a sequence of operations can
+/// be written as a loop.  This is only available when the toolchain
+/// supports coroutines, in which case MJMECH_COROUTINES is defined.
+/// See --config=coroutines in .bazelrc.
+
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define MJMECH_COROUTINES 1
+#endif
+
+#ifdef MJMECH_COROUTINES
+
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <new>
+#include <optional>
+#include <utility>
+
+#include "mjlib/base/error_code.h"
+#include "mjlib/io/async_types.h"
+
+namespace mjmech {
+namespace base {
+
+/// Allocates coroutine frames from per-thread free lists, so that
+/// once a coroutine of a given size has run, running another does not
+/// touch the heap.  Frames larger than the largest size class are
+/// passed through to the global allocator.
+class FramePool {
+ public:
+  static void* Allocate(size_t size) {
+    const size_t size_class = SizeClass(size);
+    if (size_class >= kNumClasses) { return ::operator new(size); }
+
+    auto& head = free_[size_class];
+    if (head) {
+      Node* result = head;
+      head = head->next;
+      return result;
+    }
+    return ::operator new((size_class + 1) * kGranularity);
+  }
+
+  static void Free(void* ptr, size_t size) {
+    const size_t size_class = SizeClass(size);
+    if (size_class >= kNumClasses) {
+      ::operator delete(ptr);
+      return;
+    }
+
+    Node* node = static_cast<Node*>(ptr);
+    node->next = free_[size_class];
+    free_[size_class] = node;
+  }
+
+ private:
+  static constexpr size_t kGranularity = 64;
+  static constexpr size_t kNumClasses = 32;
+
+  static size_t SizeClass(size_t size) {
+    return (size + kGranularity - 1) / kGranularity - 1;
+  }
+
+  struct Node {
+    Node* next;
+  };
+
+  static inline thread_local Node* free_[kNumClasses] = {};
+};
+
+template <typename T>
+class Task;
+
+namespace detail {
+struct PromiseBase {
+  static void* operator new(size_t size) { return FramePool::Allocate(size); }
+  static void operator delete(void* ptr, size_t size) {
+    FramePool::Free(ptr, size);
+  }
+
+  std::suspend_always initial_suspend() noexcept { return {}; }
+
+  struct FinalAwaiter {
+    bool await_ready() noexcept { return false; }
+
+    template <typename Promise>
+    std::coroutine_handle<> await_suspend(
+        std::coroutine_handle<Promise> handle) noexcept {
+      auto continuation = handle.promise().continuation;
+      return continuation ? continuation : std::noop_coroutine();
+    }
+
+    void await_resume() noexcept {}
+  };
+
+  FinalAwaiter final_suspend() noexcept { return {}; }
+
+  void unhandled_exception() { exception = std::current_exception(); }
+
+  std::coroutine_handle<> continuation;
+  std::exception_ptr exception;
+};
+
+template <typename T>
+struct Promise : PromiseBase {
+  Task<T> get_return_object();
+  void return_value(T value) { result.emplace(std::move(value)); }
+
+  T get() {
+    if (exception) { std::rethrow_exception(exception); }
+    return std::move(*result);
+  }
+
+  std::optional<T> result;
+};
+
+template <>
+struct Promise<void> : PromiseBase {
+  Task<void> get_return_object();
+  void return_void() {}
+
+  void get() {
+    if (exception) { std::rethrow_exception(exception); }
+  }
+};
+}
+
+/// A coroutine which starts when first awaited, and resumes its
+/// awaiter when it finishes.  Exceptions propagate to the awaiter.
+template <typename T = void>
+class Task {
+ public:
+  using promise_type = detail::Promise<T>;
+  using Handle = std::coroutine_handle<promise_type>;
+
+  explicit Task(Handle handle) : handle_(handle) {}
+  Task(Task&& rhs) : handle_(std::exchange(rhs.handle_, {})) {}
+  Task& operator=(Task&& rhs) {
+    if (this != &rhs) {
+      if (handle_) { handle_.destroy(); }
+      handle_ = std::exchange(rhs.handle_, {});
+    }
+    return *this;
+  }
+  ~Task() {
+    if (handle_) { handle_.destroy(); }
+  }
+
+  Task(const Task&) = delete;
+  Task& operator=(const Task&) = delete;
+
+  bool await_ready() const noexcept { return false; }
+
+  std::coroutine_handle<> await_suspend(
+      std::coroutine_handle<> continuation) noexcept {
+    handle_.promise().continuation = continuation;
+    return handle_;
+  }
+
+  T await_resume() { return handle_.promise().get(); }
+
+ private:
+  Handle handle_;
+};
+
+namespace detail {
+template <typename T>
+Task<T> Promise<T>::get_return_object() {
+  return Task<T>(Task<T>::Handle::from_promise(*this));
+}
+
+inline Task<void> Promise<void>::get_return_object() {
+  return Task<void>(Task<void>::Handle::from_promise(*this));
+}
+
+/// A coroutine which starts immediately and frees itself when done.
+struct Detached {
+  struct promise_type : PromiseBase {
+    Detached get_return_object() { return {}; }
+    std::suspend_never initial_suspend() noexcept { return {}; }
+    std::suspend_never final_suspend() noexcept { return {}; }
+    void return_void() {}
+    // Errors are expected to be reported as error codes.  Anything
+    // thrown is a bug, so fail the same way a throwing callback would.
+    void unhandled_exception() { std::terminate(); }
+  };
+};
+
+inline Detached RunDetached(Task<mjlib::base::error_code> task,
+                            mjlib::io::ErrorCallback callback) {
+  auto ec = co_await task;
+  callback(ec);
+}
+}
+
+/// Run @p task until its first suspension, and call @p callback with
+/// its result when it finishes.  This is the bridge from callback
+/// style code into a coroutine.
+inline void Spawn(Task<mjlib::base::error_code> task,
+                  mjlib::io::ErrorCallback callback) {
+  detail::RunDetached(std::move(task), std::move(callback));
+}
+
+/// Await any operation which completes through an
+/// mjlib::io::ErrorCallback.  @p initiator is called with the
+/// callback to pass to the operation, and co_await gives the error.
+///
+/// The callback only holds a pointer, so fits in the small buffer of
+/// the callback type and does not allocate.
+template <typename Initiator>
+class ErrorAwaitable {
+ public:
+  explicit ErrorAwaitable(Initiator initiator)
+      : initiator_(std::move(initiator)) {}
+
+  bool await_ready() const noexcept { return false; }
+
+  void await_suspend(std::coroutine_handle<> handle) {
+    handle_ = handle;
+    // The operation may complete, and destroy this, before the
+    // initiator returns, so nothing may follow it.
+    initiator_([this](const mjlib::base::error_code& ec) {
+        ec_ = ec;
+        handle_.resume();
+      });
+  }
+
+  mjlib::base::error_code await_resume() { return ec_; }
+
+ private:
+  Initiator initiator_;
+  std::coroutine_handle<> handle_;
+  mjlib::base::error_code ec_;
+};
+
+template <typename Initiator>
+ErrorAwaitable<Initiator> AwaitError(Initiator initiator) {
+  return ErrorAwaitable<Initiator>(std::move(initiator));
+}
+
+}
+}
+
+#endif
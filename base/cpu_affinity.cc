@@ -0,0 +1,52 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/cpu_affinity.h"
+
+#include "mjlib/base/system_error.h"
+
+namespace mjmech {
+namespace base {
+
+const cpu_set_t& ProcessAffinity() {
+  static const cpu_set_t result = []() {
+    cpu_set_t cpuset = {};
+    mjlib::base::system_error::throw_if(
+        ::sched_getaffinity(0, sizeof(cpuset), &cpuset) < 0,
+        "getting affinity");
+    return cpuset;
+  }();
+  return result;
+}
+
+bool IsProcessCpu(int cpu) {
+  if (cpu < 0 || cpu >= CPU_SETSIZE) { return false; }
+  return CPU_ISSET(cpu, &ProcessAffinity());
+}
+
+mjlib::base::error_code SetThreadAffinity(int cpu) {
+  cpu_set_t cpuset = ProcessAffinity();
+  if (cpu >= 0) {
+    CPU_ZERO(&cpuset);
+    CPU_SET(cpu, &cpuset);
+  }
+
+  if (::sched_setaffinity(0, sizeof(cpuset), &cpuset) < 0) {
+    return mjlib::base::error_code::syserrno("setting affinity");
+  }
+  return {};
+}
+
+}
+}
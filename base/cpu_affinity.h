@@ -0,0 +1,42 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <sched.h>
+
+#include "mjlib/base/error_code.h"
+
+namespace mjmech {
+namespace base {
+
+/// The CPUs this process was allowed to run on before any thread
+/// pinned itself.  It is recorded the first time this is called,
+/// which Context does when it is constructed.
+const cpu_set_t& ProcessAffinity();
+
+/// Return true if @p cpu is one of ProcessAffinity().
+bool IsProcessCpu(int cpu);
+
+/// Pin the calling thread to @p cpu, or if it is negative, let it run
+/// anywhere in ProcessAffinity().
+///
+/// Threads inherit the affinity of the thread that creates them, and
+/// components which start after rt.cpu_affinity has been applied are
+/// created from the control thread.  So any worker that does not
+/// belong on the control CPU should call this when it starts.
+mjlib::base::error_code SetThreadAffinity(int cpu = -1);
+
+}
+}
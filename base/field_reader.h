@@ -0,0 +1,117 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <type_traits>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+namespace mjmech {
+namespace base {
+
+/// Reads one numeric field, named by its dotted path through
+/// Serialize, from instances of a serializable type, for instance
+/// "state.robot.tip_pitch_deg" from HoverbotControl::Status.
+///
+/// The path is resolved once, to an offset within the type, so each
+/// Read is just a load.  Only fields stored inline can be found, so
+/// not elements of vectors.  Enumerations are not numeric here.
+class FieldReader {
+ public:
+  FieldReader() {}
+
+  /// Return a reader which is not valid() if @p path does not name an
+  /// arithmetic field of T.
+  template <typename T>
+  static FieldReader Find(const std::string& path) {
+    T instance = {};
+    Archive archive(path);
+    archive.Accept(&instance);
+    if (!archive.found) { return {}; }
+
+    FieldReader result;
+    result.offset_ =
+        reinterpret_cast<const char*>(archive.found) -
+        reinterpret_cast<const char*>(&instance);
+    result.read_ = archive.read;
+    return result;
+  }
+
+  bool valid() const { return read_ != nullptr; }
+
+  /// @p object must be of the type this was found in.
+  double Read(const void* object) const {
+    return read_(reinterpret_cast<const char*>(object) + offset_);
+  }
+
+ private:
+  using ReadFunction = double (*)(const void*);
+
+  template <typename T>
+  static double ReadAs(const void* field) {
+    return static_cast<double>(*static_cast<const T*>(field));
+  }
+
+  struct Archive {
+    Archive(const std::string& path) {
+      boost::split(names, path, boost::is_any_of("."));
+    }
+
+    template <typename T>
+    Archive& Accept(T* value) {
+      value->Serialize(this);
+      return *this;
+    }
+
+    template <typename NameValuePair>
+    void Visit(const NameValuePair& pair) {
+      if (found || depth >= names.size() || names[depth] != pair.name()) {
+        return;
+      }
+      Helper(pair.value(), 0);
+    }
+
+    template <typename T>
+    auto Helper(T* value, int) -> decltype(value->Serialize(this)) {
+      if (depth + 1 == names.size()) { return; }
+      depth++;
+      value->Serialize(this);
+      depth--;
+    }
+
+    template <typename T>
+    void Helper(T* value, long) {
+      if constexpr (std::is_arithmetic_v<T>) {
+        if (depth + 1 != names.size()) { return; }
+        found = value;
+        read = &FieldReader::ReadAs<T>;
+      }
+    }
+
+    std::vector<std::string> names;
+    size_t depth = 0;
+    const void* found = nullptr;
+    ReadFunction read = nullptr;
+  };
+
+  std::ptrdiff_t offset_ = 0;
+  ReadFunction read_ = nullptr;
+};
+
+}
+}
@@ -0,0 +1,109 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/file_watcher.h"
+
+#include <sys/inotify.h>
+
+#include <map>
+#include <utility>
+
+#include <boost/asio/posix/stream_descriptor.hpp>
+
+#include "mjlib/base/fail.h"
+#include "mjlib/base/system_error.h"
+
+namespace mjmech {
+namespace base {
+
+class FileWatcher::Impl {
+ public:
+  Impl(const boost::asio::any_io_executor& executor,
+       const std::vector<std::string>& filenames,
+       Handler handler)
+      : stream_(executor),
+        handler_(std::move(handler)) {
+    const int fd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    mjlib::base::system_error::throw_if(fd < 0, "inotify_init1");
+    stream_.assign(fd);
+
+    std::map<std::string, int> directories;
+    for (const auto& filename : filenames) {
+      const auto slash = filename.rfind('/');
+      const std::string directory =
+          slash == std::string::npos ? "." :
+          slash == 0 ? "/" :
+          filename.substr(0, slash);
+      const std::string name =
+          slash == std::string::npos ? filename : filename.substr(slash + 1);
+
+      auto it = directories.find(directory);
+      if (it == directories.end()) {
+        const int wd = ::inotify_add_watch(
+            fd, directory.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO);
+        mjlib::base::system_error::throw_if(
+            wd < 0, "watching '" + directory + "'");
+        it = directories.insert({directory, wd}).first;
+      }
+      names_[{it->second, name}] = filename;
+    }
+
+    StartRead();
+  }
+
+  void StartRead() {
+    stream_.async_read_some(
+        boost::asio::buffer(buffer_, sizeof(buffer_)),
+        [this](const mjlib::base::error_code& ec, std::size_t size) {
+          if (ec == boost::asio::error::operation_aborted) { return; }
+          mjlib::base::FailIf(ec);
+          HandleRead(size);
+        });
+  }
+
+  void HandleRead(std::size_t size) {
+    // The kernel only returns whole events.
+    std::size_t offset = 0;
+    while (offset + sizeof(inotify_event) <= size) {
+      const auto* event =
+          reinterpret_cast<const inotify_event*>(buffer_ + offset);
+      offset += sizeof(inotify_event) + event->len;
+
+      if (event->len == 0) { continue; }
+      const auto it = names_.find({event->wd, std::string(event->name)});
+      if (it == names_.end()) { continue; }
+      handler_(it->second);
+    }
+
+    StartRead();
+  }
+
+  boost::asio::posix::stream_descriptor stream_;
+  Handler handler_;
+
+  // (watch descriptor, name in directory) -> filename
+  std::map<std::pair<int, std::string>, std::string> names_;
+
+  alignas(inotify_event) char buffer_[4096] = {};
+};
+
+FileWatcher::FileWatcher(const boost::asio::any_io_executor& executor,
+                         const std::vector<std::string>& filenames,
+                         Handler handler)
+    : impl_(std::make_unique<Impl>(executor, filenames, std::move(handler))) {}
+
+FileWatcher::~FileWatcher() {}
+
+}
+}
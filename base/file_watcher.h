@@ -0,0 +1,50 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/noncopyable.hpp>
+
+namespace mjmech {
+namespace base {
+
+/// Calls a handler each time one of a set of files has been
+/// rewritten, using inotify.
+///
+/// Editors often save by writing a new file and renaming it over the
+/// old one, so the containing directories are watched rather than
+/// the files themselves.
+class FileWatcher : boost::noncopyable {
+ public:
+  /// Called with the name exactly as it was passed in.
+  using Handler = std::function<void (const std::string& filename)>;
+
+  FileWatcher(const boost::asio::any_io_executor&,
+              const std::vector<std::string>& filenames,
+              Handler);
+  ~FileWatcher();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -14,6 +14,9 @@
 
 #include "base/fit_plane.h"
 
+#include <cmath>
+#include <random>
+
 #include <Eigen/Dense>
 
 namespace mjmech {
@@ -35,5 +38,84 @@ Plane FitPlane(const std::vector<Eigen::Vector3d>& points) {
   return Plane{result(0), result(1), result(2)};
 }
 
+Plane PlaneFitter::Fit() const {
+  // Both decompositions are fixed size, so do not allocate.  The
+  // Cholesky solve is several times faster, but only the orthogonal
+  // one gives a sensible answer for degenerate point sets.
+  const Eigen::LDLT<Eigen::Matrix3d> ldlt(ata_);
+  const Eigen::Vector3d result =
+      (ldlt.info() == Eigen::Success && ldlt.rcond() > 1e-12) ?
+      Eigen::Vector3d(ldlt.solve(atb_)) :
+      Eigen::Vector3d(ata_.completeOrthogonalDecomposition().solve(atb_));
+  return Plane{
+    result(0),
+    result(1),
+    result(2) + origin_.z() - result(0) * origin_.x() -
+        result(1) * origin_.y()};
+}
+
+namespace {
+bool IsInlier(const Plane& plane, const Eigen::Vector3d& p, double threshold) {
+  return std::abs(p.z() - (plane.a * p.x() + plane.b * p.y() + plane.c)) <=
+      threshold;
+}
+
+int CountInliers(const std::vector<Eigen::Vector3d>& points,
+                 const Plane& plane, double threshold) {
+  int result = 0;
+  for (const auto& p : points) {
+    if (IsInlier(plane, p, threshold)) { result++; }
+  }
+  return result;
+}
+}
+
+Plane FitPlaneRansac(const std::vector<Eigen::Vector3d>& points,
+                     const RansacOptions& options,
+                     int* inliers) {
+  if (points.size() < 3) {
+    if (inliers) { *inliers = static_cast<int>(points.size()); }
+    return FitPlane(points);
+  }
+
+  std::mt19937 rng(options.seed);
+  std::uniform_int_distribution<size_t> pick(0, points.size() - 1);
+
+  // Start from the fit to everything, so that a set with no outliers
+  // needs no lucky samples.
+  Plane best;
+  {
+    PlaneFitter fitter(points.front());
+    for (const auto& p : points) { fitter.Add(p); }
+    best = fitter.Fit();
+  }
+  int best_count = CountInliers(points, best, options.inlier_threshold);
+
+  for (int i = 0; i < options.iterations; i++) {
+    PlaneFitter fitter(points.front());
+    for (int j = 0; j < 3; j++) { fitter.Add(points[pick(rng)]); }
+    const Plane candidate = fitter.Fit();
+
+    const int count =
+        CountInliers(points, candidate, options.inlier_threshold);
+    if (count > best_count) {
+      best = candidate;
+      best_count = count;
+    }
+  }
+
+  PlaneFitter fitter(points.front());
+  int count = 0;
+  for (const auto& p : points) {
+    if (IsInlier(best, p, options.inlier_threshold)) {
+      fitter.Add(p);
+      count++;
+    }
+  }
+  if (inliers) { *inliers = count; }
+
+  return count >= 3 ? fitter.Fit() : best;
+}
+
 }
 }
@@ -14,6 +14,7 @@
 
 #pragma once
 
+#include <cstdint>
 #include <vector>
 
 #include <Eigen/Core>
@@ -30,7 +31,77 @@ struct Plane {
   double c = 0.0;
 };
 
+/// Solve the least squares problem with an SVD of the full point
+/// matrix.  This is the most accurate option, but its cost grows with
+/// the number of points and it allocates.
 Plane FitPlane(const std::vector<Eigen::Vector3d>& points);
 
+/// Accumulates the least squares normal equations for a plane one
+/// point at a time.  Points may be removed again, which makes a
+/// sliding window as cheap as adding the newest point and removing
+/// the oldest.  Nothing here allocates, and Fit() is constant time.
+///
+/// The moments are accumulated relative to @p origin.  When the points
+/// are far from zero, choosing an origin near them keeps the removal
+/// of points from losing precision.
+class PlaneFitter {
+ public:
+  explicit PlaneFitter(const Eigen::Vector3d& origin = Eigen::Vector3d::Zero())
+      : origin_(origin) {}
+
+  void Add(const Eigen::Vector3d& point) { Update(point, 1.0); }
+  void Remove(const Eigen::Vector3d& point) { Update(point, -1.0); }
+
+  void Clear() {
+    ata_.setZero();
+    atb_.setZero();
+    count_ = 0;
+  }
+
+  int64_t size() const { return count_; }
+
+  /// Return the least squares plane through the current points.  When
+  /// they do not determine a plane, for instance fewer than 3 or all
+  /// on one line, this returns the minimum norm solution relative to
+  /// the origin.  That still fits the points, but only matches
+  /// FitPlane when the origin is zero.
+  Plane Fit() const;
+
+ private:
+  void Update(const Eigen::Vector3d& point, double sign) {
+    const Eigen::Vector3d p = point - origin_;
+    const Eigen::Vector3d row(p.x(), p.y(), 1.0);
+    ata_.noalias() += sign * row * row.transpose();
+    atb_ += sign * p.z() * row;
+    count_ += (sign > 0.0) ? 1 : -1;
+  }
+
+  Eigen::Vector3d origin_;
+  Eigen::Matrix3d ata_ = Eigen::Matrix3d::Zero();
+  Eigen::Vector3d atb_ = Eigen::Vector3d::Zero();
+  int64_t count_ = 0;
+};
+
+struct RansacOptions {
+  int iterations = 50;
+
+  /// Points whose z is within this of a candidate plane count as
+  /// inliers to it.
+  double inlier_threshold = 0.01;
+
+  uint32_t seed = 0;
+};
+
+/// Fit a plane to points which may include many outliers.  Each
+/// iteration fits an exact plane through 3 random points and counts
+/// its inliers.  The result is the least squares fit to the inliers
+/// of the best candidate.  If @p inliers is non-null, it is set to the
+/// number of those.
+///
+/// With fewer than 3 points, this is the same as FitPlane.
+Plane FitPlaneRansac(const std::vector<Eigen::Vector3d>& points,
+                     const RansacOptions& options = {},
+                     int* inliers = nullptr);
+
 }
 }
@@ -16,6 +16,7 @@
 
 #include <list>
 #include <memory>
+#include <utility>
 
 #include "mjlib/base/error_code.h"
 #include "mjlib/io/async_types.h"
@@ -71,5 +72,26 @@ class ErrorHandlerJoiner
   std::list<bool> outstanding_;
   LogRef log_;
 };
+
+/// Lets handlers posted from other threads outlive the object that
+/// posts them.  Wrap them with one of these, owned by that object,
+/// and they do nothing once it has been destroyed.
+///
+/// The check is only race free if this is destroyed on the same
+/// executor the wrapped handlers run on.
+class HandlerLifetime {
+ public:
+  template <typename Handler>
+  auto Wrap(Handler handler) const {
+    return [alive = std::weak_ptr<int>(alive_),
+            handler = std::move(handler)](auto&&... args) mutable {
+      if (alive.expired()) { return; }
+      handler(std::forward<decltype(args)>(args)...);
+    };
+  }
+
+ private:
+  std::shared_ptr<int> alive_ = std::make_shared<int>(0);
+};
 }
 }
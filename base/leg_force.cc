@@ -14,8 +14,13 @@
 
 #include "base/leg_force.h"
 
+#include <algorithm>
+#include <cmath>
+
 #include <fmt/format.h>
 
+#include <Eigen/Dense>
+
 #include <unsupported/Eigen/LevenbergMarquardt>
 #include <unsupported/Eigen/NumericalDiff>
 
@@ -26,6 +31,12 @@ namespace mjmech {
 namespace base {
 
 namespace {
+// Weights for each term of the residual.
+constexpr double kYWeight = 10.0;
+constexpr double kSumWeight = 1e6;
+// Just some small value.
+constexpr double kBalanceWeight = 0.001;
+
 struct LegFunctor : public Eigen::DenseFunctor<double> {
   LegFunctor(const std::vector<Eigen::Vector2d>& legs)
       : Eigen::DenseFunctor<double>(legs.size(), 5 + legs.size()),
@@ -42,35 +53,72 @@ struct LegFunctor : public Eigen::DenseFunctor<double> {
 
     for (size_t i = 0; i < legs_.size(); i++) {
       fvec(0) += legs_[i].x() * x(i);
-      fvec(1) += 10 * legs_[i].y() * x(i);
+      fvec(1) += kYWeight * legs_[i].y() * x(i);
       fvec(2) += x(i);
       if (x(i) < 0.0) { fvec(3) = x(i); }
       if (x(i) > 1.0) { fvec(4) = x(i); }
 
-      fvec(5 + i) = balance_ratio_ * (x(i) - (1.0 / legs_.size()));
+      fvec(5 + i) = kBalanceWeight * (x(i) - (1.0 / legs_.size()));
+    }
+
+    fvec(2) *= kSumWeight;
+
+    return 0;
+  }
+
+  int df(const Eigen::VectorXd& x, Eigen::MatrixXd& fjac) const {
+    fjac.setZero();
+
+    // The bound penalties only depend on the last leg to violate
+    // them, as above.
+    int below = -1;
+    int above = -1;
+
+    for (size_t i = 0; i < legs_.size(); i++) {
+      fjac(0, i) = legs_[i].x();
+      fjac(1, i) = kYWeight * legs_[i].y();
+      fjac(2, i) = kSumWeight;
+      if (x(i) < 0.0) { below = i; }
+      if (x(i) > 1.0) { above = i; }
+      fjac(5 + i, i) = kBalanceWeight;
     }
 
-    fvec(2) *= 1e6;
+    if (below >= 0) { fjac(3, below) = 1.0; }
+    if (above >= 0) { fjac(4, above) = 1.0; }
 
     return 0;
   }
 
   std::vector<Eigen::Vector2d> legs_;
-  // Just some small value.
-  const double balance_ratio_ = 0.001;
 };
+
+template <typename Functor>
+void Minimize(Functor& functor, Eigen::VectorXd* solution) {
+  Eigen::LevenbergMarquardt<Functor> lm{functor};
+  lm.minimize(*solution);
+}
 }
 
-std::vector<double> OptimizeLegForce(const std::vector<Eigen::Vector2d>& legs) {
+std::vector<double> OptimizeLegForce(const std::vector<Eigen::Vector2d>& legs,
+                                     const LegForceOptions& options) {
   if (legs.size() == 0) { return {}; }
   if (legs.size() == 1) { return { 1.0 }; }
 
-  Eigen::VectorXd solution(legs.size());
+  Eigen::VectorXd solution =
+      Eigen::VectorXd::Constant(legs.size(), 1.0 / legs.size());
+  if (options.initial.size() == legs.size()) {
+    for (size_t i = 0; i < legs.size(); i++) {
+      solution(i) = options.initial[i];
+    }
+  }
 
   LegFunctor lf{legs};
-  Eigen::NumericalDiff<LegFunctor> nf{lf};
-  Eigen::LevenbergMarquardt<Eigen::NumericalDiff<LegFunctor>> lm{nf};
-  lm.minimize(solution);
+  if (options.numerical_jacobian) {
+    Eigen::NumericalDiff<LegFunctor> nf{lf};
+    Minimize(nf, &solution);
+  } else {
+    Minimize(lf, &solution);
+  }
 
   std::vector<double> result;
   for (size_t i = 0; i < legs.size(); i++) {
@@ -80,5 +128,161 @@ std::vector<double> OptimizeLegForce(const std::vector<Eigen::Vector2d>& legs) {
   return result;
 }
 
+namespace {
+constexpr int kMaxLegs = LegForceOptimizer::kMaxLegs;
+
+using Matrix = Eigen::Matrix<double, Eigen::Dynamic, Eigen::Dynamic, 0,
+                             kMaxLegs + 1, kMaxLegs + 1>;
+using Vector = Eigen::Matrix<double, Eigen::Dynamic, 1, 0, kMaxLegs + 1, 1>;
+}
+
+LegForceOptimizer::LegForceOptimizer() {
+  result_.reserve(kMaxLegs);
+  at_zero_.reserve(kMaxLegs);
+}
+
+void LegForceOptimizer::Reset() {
+  result_.clear();
+  at_zero_.clear();
+}
+
+const std::vector<double>& LegForceOptimizer::Optimize(
+    const std::vector<Eigen::Vector2d>& legs) {
+  const int n = legs.size();
+  iterations_ = 0;
+
+  if (n == 0) {
+    Reset();
+    return result_;
+  }
+
+  if (n > kMaxLegs) {
+    LegForceOptions options;
+    if (static_cast<int>(result_.size()) == n) { options.initial = result_; }
+    result_ = OptimizeLegForce(legs, options);
+    at_zero_.clear();
+    return result_;
+  }
+
+  // Minimize 1/2 x'Hx - g'x subject to sum(x) == 1 and x >= 0, which
+  // also keeps every x <= 1.  The objective is the same residual as
+  // LegFunctor, less the terms which are now constraints.
+  Matrix H(n, n);
+  Vector g(n);
+  {
+    Vector a(n);
+    Vector b(n);
+    for (int i = 0; i < n; i++) {
+      a(i) = legs[i].x();
+      b(i) = kYWeight * legs[i].y();
+    }
+    H.noalias() = a * a.transpose();
+    H.noalias() += b * b.transpose();
+    H.diagonal().array() += kBalanceWeight * kBalanceWeight;
+    g.setConstant(kBalanceWeight * kBalanceWeight / n);
+  }
+
+  // Start from the previous solution if there is one, making sure it
+  // is feasible for the new problem.
+  Vector x(n);
+  if (static_cast<int>(result_.size()) == n &&
+      static_cast<int>(at_zero_.size()) == n) {
+    double total = 0.0;
+    for (int i = 0; i < n; i++) {
+      x(i) = at_zero_[i] ? 0.0 : std::max(0.0, result_[i]);
+      total += x(i);
+    }
+    if (total > 0.0) {
+      x /= total;
+    } else {
+      x.setConstant(1.0 / n);
+    }
+  } else {
+    x.setConstant(1.0 / n);
+  }
+  at_zero_.resize(n);
+  for (int i = 0; i < n; i++) { at_zero_[i] = (x(i) == 0.0); }
+
+  // Each iteration either adds or removes one leg from the active
+  // set, so this bound is generous.
+  const int max_iterations = 4 * n + 10;
+
+  while (iterations_ < max_iterations) {
+    iterations_++;
+
+    // Solve the equality constrained problem over the free legs:
+    //
+    //  [ H_ff 1 ] [ x_f ]   [ g_f ]
+    //  [ 1'   0 ] [ mu  ] = [ 1   ]
+    int free_count = 0;
+    int free_index[kMaxLegs] = {};
+    for (int i = 0; i < n; i++) {
+      if (!at_zero_[i]) { free_index[free_count++] = i; }
+    }
+
+    Matrix kkt(free_count + 1, free_count + 1);
+    Vector rhs(free_count + 1);
+    for (int r = 0; r < free_count; r++) {
+      for (int c = 0; c < free_count; c++) {
+        kkt(r, c) = H(free_index[r], free_index[c]);
+      }
+      kkt(r, free_count) = 1.0;
+      kkt(free_count, r) = 1.0;
+      rhs(r) = g(free_index[r]);
+    }
+    kkt(free_count, free_count) = 0.0;
+    rhs(free_count) = 1.0;
+
+    const Vector solution = kkt.partialPivLu().solve(rhs);
+    const double mu = solution(free_count);
+
+    // How far we would need to go to reach it.
+    double step = 1.0;
+    int blocking = -1;
+    bool moved = false;
+    for (int r = 0; r < free_count; r++) {
+      const int i = free_index[r];
+      const double p = solution(r) - x(i);
+      if (std::abs(p) > 1e-12) { moved = true; }
+      if (p < 0.0 && -x(i) / p < step) {
+        step = -x(i) / p;
+        blocking = i;
+      }
+    }
+
+    if (moved) {
+      for (int r = 0; r < free_count; r++) {
+        const int i = free_index[r];
+        x(i) += step * (solution(r) - x(i));
+      }
+      if (blocking >= 0) {
+        x(blocking) = 0.0;
+        at_zero_[blocking] = true;
+        continue;
+      }
+    }
+
+    // We are now at the optimum for this active set.  A leg can leave
+    // the set if its multiplier says the objective would improve.
+    const Vector gradient = H * x - g;
+    int release = -1;
+    double most_negative = -1e-12;
+    for (int i = 0; i < n; i++) {
+      if (!at_zero_[i]) { continue; }
+      const double multiplier = gradient(i) + mu;
+      if (multiplier < most_negative) {
+        most_negative = multiplier;
+        release = i;
+      }
+    }
+    if (release < 0) { break; }
+    at_zero_[release] = false;
+  }
+
+  result_.resize(n);
+  for (int i = 0; i < n; i++) { result_[i] = x(i); }
+  return result_;
+}
+
 }
 }
@@ -21,10 +21,54 @@
 namespace mjmech {
 namespace base {
 
+struct LegForceOptions {
+  /// If non-empty, start from this solution instead of an equal split.
+  /// Passing the result for the previous cycle usually saves most of
+  /// the iterations.
+  std::vector<double> initial;
+
+  /// Differentiate the residuals numerically instead of analytically.
+  /// This is only useful for comparison.
+  bool numerical_jacobian = false;
+};
+
 /// Given the leg X/Y positions in the M frame, return a ratio of
 /// force to apply which minimizes the amount of angular acceleration
 /// incurred.
-std::vector<double> OptimizeLegForce(const std::vector<Eigen::Vector2d>&);
+///
+/// This solves with Levenberg-Marquardt, and treats the constraint
+/// that the ratios sum to 1 and lie in [0, 1] as penalties.
+std::vector<double> OptimizeLegForce(const std::vector<Eigen::Vector2d>&,
+                                     const LegForceOptions& = {});
+
+/// Solves the same problem as OptimizeLegForce as a quadratic program
+/// with an active set method.  The ratios sum to exactly 1, and are
+/// never negative.
+///
+/// Each call starts from the previous solution and its active set, so
+/// when the legs move only a little between calls, most calls need a
+/// single linear solve.  Up to kMaxLegs, nothing here allocates.
+/// Beyond that, this falls back to OptimizeLegForce.
+class LegForceOptimizer {
+ public:
+  static constexpr int kMaxLegs = 8;
+
+  LegForceOptimizer();
+
+  /// The returned reference is valid until the next call.
+  const std::vector<double>& Optimize(const std::vector<Eigen::Vector2d>&);
+
+  /// Forget the previous solution.
+  void Reset();
+
+  /// The number of linear solves in the most recent call.
+  int iterations() const { return iterations_; }
+
+ private:
+  std::vector<double> result_;
+  std::vector<bool> at_zero_;
+  int iterations_ = 0;
+};
 
 }
 }
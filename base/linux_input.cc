@@ -17,6 +17,7 @@
 #include <linux/input.h>
 
 #include <boost/asio/posix/stream_descriptor.hpp>
+#include <boost/date_time/posix_time/posix_time.hpp>
 #include <boost/asio/post.hpp>
 
 #include <fmt/format.h>
@@ -35,6 +36,10 @@ class LinuxInput::Impl : boost::noncopyable {
 
   struct input_event input_event_;
 
+  // Enough for a full report from any reasonable gamepad.
+  static constexpr size_t kMaxBatch = 64;
+  struct input_event input_events_[kMaxBatch] = {};
+
   std::map<int, AbsInfo> abs_info_;
 };
 
@@ -195,6 +200,55 @@ void LinuxInput::AsyncRead(Event* event, mjlib::io::ErrorCallback handler) {
       });
 }
 
+void LinuxInput::AsyncReadSome(std::vector<Event>* events,
+                               mjlib::io::ErrorCallback handler) {
+  impl_->stream_.async_read_some(
+      boost::asio::buffer(impl_->input_events_, sizeof(impl_->input_events_)),
+      [events, handler=std::move(handler), this] (
+          mjlib::base::error_code ec, std::size_t size) mutable {
+        if (ec) {
+          ec.Append("reading input events");
+          boost::asio::post(
+              impl_->executor_,
+              std::bind(std::move(handler), ec));
+          return;
+        }
+
+        if ((size % sizeof(struct input_event)) != 0) {
+          boost::asio::post(
+              impl_->executor_,
+              std::bind(
+                  std::move(handler),
+                  mjlib::base::error_code::einval("short read for input event")));
+          return;
+        }
+
+        const size_t count = size / sizeof(struct input_event);
+        events->resize(count);
+        for (size_t i = 0; i < count; i++) {
+          const auto& input_event = impl_->input_events_[i];
+          auto& event = (*events)[i];
+          event.time =
+              boost::posix_time::from_time_t(input_event.time.tv_sec) +
+              boost::posix_time::microseconds(input_event.time.tv_usec);
+          event.ev_type = input_event.type;
+          event.code = input_event.code;
+          event.value = input_event.value;
+
+          if (event.ev_type == EV_ABS) {
+            auto it = impl_->abs_info_.find(event.code);
+            if (it != impl_->abs_info_.end()) {
+              it->second.value = event.value;
+            }
+          }
+        }
+
+        boost::asio::post(
+            impl_->executor_,
+            std::bind(std::move(handler), mjlib::base::error_code()));
+      });
+}
+
 void LinuxInput::cancel() {
   impl_->stream_.cancel();
 }
@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <vector>
+
 #include <boost/asio/any_io_executor.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/dynamic_bitset.hpp>
@@ -21,6 +23,8 @@
 
 #include "mjlib/io/async_types.h"
 
+#include "base/coroutine.h"
+
 namespace mjmech {
 namespace base {
 /// Support reading events from a linux input device.
@@ -87,6 +91,22 @@ class LinuxInput : boost::noncopyable {
   /// and @p event must be valid until the handler is invoked.
   void AsyncRead(Event* event, mjlib::io::ErrorCallback handler);
 
+  /// Read all events which are currently available, up to some
+  /// maximum, with a single system call.  @p events is cleared and
+  /// then filled, and must be valid until @p handler is invoked.  The
+  /// handler is invoked once per batch using boost::asio::post.
+  void AsyncReadSome(std::vector<Event>* events,
+                     mjlib::io::ErrorCallback handler);
+
+#ifdef MJMECH_COROUTINES
+  /// The same as AsyncRead, but co_await gives the error.
+  auto AwaitRead(Event* event) {
+    return AwaitError([this, event](mjlib::io::ErrorCallback handler) {
+        AsyncRead(event, std::move(handler));
+      });
+  }
+#endif
+
   /// Cancel all asynchronous operations associated with this device.
   void cancel();
 
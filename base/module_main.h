@@ -39,7 +39,11 @@ namespace base {
 template <typename Module>
 int safe_main(int argc, char**argv) {
   Context context;
+  StartupTracer* const tracer = context.startup_tracer.get();
+
+  tracer->Begin("construct");
   Module module(context);
+  tracer->End("construct");
 
   std::string config_file;
   std::string log_file;
@@ -68,13 +72,19 @@ int safe_main(int argc, char**argv) {
   group.push_back(mjlib::base::ClippArchive("remote_debug.")
                   .Accept(context.remote_debug->parameters()).release());
 
+  group.push_back(mjlib::base::ClippArchive("telemetry_stream.")
+                  .Accept(context.telemetry_stream->parameters()).release());
+
   group.push_back(module.program_options());
 
+  tracer->Begin("parse_options");
   mjlib::base::ClippParse(argc, argv, group);
+  tracer->End("parse_options");
 
   InitLogging();
 
   if (!config_file.empty()) {
+    tracer->Begin("parse_config");
     std::ifstream inf(config_file);
     mjlib::base::system_error::throw_if(
         !inf.is_open(), "opening " + config_file);
@@ -82,14 +92,22 @@ int safe_main(int argc, char**argv) {
 
     // Re-parse any cmdline options so they take precedence.
     mjlib::base::ClippParse(argc, argv, group);
+    tracer->End("parse_config");
   }
 
   if (!log_file.empty()) {
+    tracer->Begin("open_log");
     OpenMaybeTimestampedLog(context.telemetry_log.get(),
                             log_file,
                             log_short_name ? kShort : kTimestamped);
+    tracer->End("open_log");
   }
 
+  context.telemetry_registry->Register("startup", tracer->report_signal());
+  tracer->report_signal()->connect([tracer](const auto*) {
+      std::cout << tracer->Format();
+    });
+
   // TODO theamk: move this to logging.cc
   TextLogMessageSignal log_signal_mt;
   context.telemetry_registry->Register("text_log", &log_signal_mt);
@@ -111,6 +129,7 @@ int safe_main(int argc, char**argv) {
       std::make_shared<ErrorHandlerJoiner>(
           [&](mjlib::base::error_code ec) {
             mjlib::base::FailIf(ec);
+            tracer->End("start");
 
             if (cpu_affinity >= 0) {
               std::cout << "Setting CPU affinity for main thread to: "
@@ -145,8 +164,15 @@ int safe_main(int argc, char**argv) {
                 }());
           });
 
-  context.remote_debug->AsyncStart(joiner->Wrap("starting remote_debug"));
-  module.AsyncStart(joiner->Wrap("starting main module"));
+  tracer->Begin("start");
+  context.remote_debug->AsyncStart(
+      tracer->Wrap("start.remote_debug",
+                   joiner->Wrap("starting remote_debug")));
+  context.telemetry_stream->AsyncStart(
+      tracer->Wrap("start.telemetry_stream",
+                   joiner->Wrap("starting telemetry_stream")));
+  module.AsyncStart(
+      tracer->Wrap("start.module", joiner->Wrap("starting main module")));
 
 
   context.context.run();
@@ -0,0 +1,231 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/quaternion_batch.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <iterator>
+
+#include <boost/assert.hpp>
+
+#include "base/simd.h"
+
+namespace mjmech {
+namespace base {
+
+namespace {
+using simd::Double;
+using simd::kLanes;
+
+/// Call @p kernel(inputs, &outputs) for every group of kLanes
+/// elements in [0, size).  The final partial group is staged through
+/// a padded buffer, so kernels never need a scalar tail.
+template <int kInputs, int kOutputs, typename Kernel>
+void ForEach(Eigen::Index size,
+             const std::array<const double*, kInputs>& inputs,
+             const std::array<double*, kOutputs>& outputs,
+             Kernel kernel) {
+  std::array<Double, kInputs> in;
+  std::array<Double, kOutputs> out;
+
+  Eigen::Index i = 0;
+  for (; i + kLanes <= size; i += kLanes) {
+    for (int j = 0; j < kInputs; j++) { in[j] = simd::Load(inputs[j] + i); }
+    kernel(in, &out);
+    for (int j = 0; j < kOutputs; j++) { simd::Store(outputs[j] + i, out[j]); }
+  }
+
+  const Eigen::Index remaining = size - i;
+  if (remaining == 0) { return; }
+
+  // Pad with values which are harmless for every kernel.
+  double buffer[kLanes] = {};
+  for (int j = 0; j < kInputs; j++) {
+    std::fill(std::begin(buffer), std::end(buffer), 1.0);
+    std::copy(inputs[j] + i, inputs[j] + size, buffer);
+    in[j] = simd::Load(buffer);
+  }
+  kernel(in, &out);
+  for (int j = 0; j < kOutputs; j++) {
+    simd::Store(buffer, out[j]);
+    std::copy(buffer, buffer + remaining, outputs[j] + i);
+  }
+}
+
+void RotateKernel(Double qw, Double qx, Double qy, Double qz,
+                  Double vx, Double vy, Double vz,
+                  Double* ox, Double* oy, Double* oz) {
+  // v' = v + w * t + q_xyz x t, where t = 2 * (q_xyz x v)
+  const Double tx = 2.0 * (qy * vz - qz * vy);
+  const Double ty = 2.0 * (qz * vx - qx * vz);
+  const Double tz = 2.0 * (qx * vy - qy * vx);
+
+  *ox = vx + qw * tx + (qy * tz - qz * ty);
+  *oy = vy + qw * ty + (qz * tx - qx * tz);
+  *oz = vz + qw * tz + (qx * ty - qy * tx);
+}
+
+Double Atan2(Double y, Double x) {
+  const Double ax = simd::Abs(x);
+  const Double ay = simd::Abs(y);
+  const Double mx = simd::Max(ax, ay);
+  const Double mn = simd::Min(ax, ay);
+
+  // Reduce to atan(a) with a in [0, 1].  The division is made safe
+  // before the select, so 0/0 never produces a NaN.
+  const simd::Mask nonzero = mx > 0.0;
+  const Double a = simd::Select(
+      nonzero, mn / simd::Select(nonzero, mx, simd::Set(1.0)),
+      simd::Set(0.0));
+  const Double s = a * a;
+
+  // Abramowitz and Stegun 4.4.49, |error| <= 2e-8.
+  Double r =
+      a * (1.0 + s * (-0.3333314528 + s * (0.1999355085 +
+           s * (-0.1420889944 + s * (0.1065626393 +
+           s * (-0.0752896400 + s * (0.0429096138 +
+           s * (-0.0161657367 + 0.0028662257 * s))))))));
+
+  r = simd::Select(ay > ax, M_PI_2 - r, r);
+  r = simd::Select(x < 0.0, M_PI - r, r);
+  r = simd::Select(y < 0.0, -r, r);
+  return r;
+}
+
+Double Asin(Double x) {
+  const Double c = simd::Sqrt(simd::Max((1.0 - x) * (1.0 + x), simd::Set(0.0)));
+  return Atan2(x, c);
+}
+}
+
+void Rotate(const Quaternion& q, const Point3DBatch& in, Point3DBatch* out) {
+  out->resize(in.size());
+
+  const Double qw = simd::Set(q.w());
+  const Double qx = simd::Set(q.x());
+  const Double qy = simd::Set(q.y());
+  const Double qz = simd::Set(q.z());
+
+  ForEach<3, 3>(
+      in.size(),
+      {in.x.data(), in.y.data(), in.z.data()},
+      {out->x.data(), out->y.data(), out->z.data()},
+      [&](const auto& i, auto* o) {
+        RotateKernel(qw, qx, qy, qz, i[0], i[1], i[2],
+                     &(*o)[0], &(*o)[1], &(*o)[2]);
+      });
+}
+
+void Rotate(const QuaternionBatch& q, const Point3DBatch& in,
+            Point3DBatch* out) {
+  BOOST_ASSERT(q.size() == in.size());
+  out->resize(in.size());
+
+  ForEach<7, 3>(
+      in.size(),
+      {q.w.data(), q.x.data(), q.y.data(), q.z.data(),
+            in.x.data(), in.y.data(), in.z.data()},
+      {out->x.data(), out->y.data(), out->z.data()},
+      [&](const auto& i, auto* o) {
+        RotateKernel(i[0], i[1], i[2], i[3], i[4], i[5], i[6],
+                     &(*o)[0], &(*o)[1], &(*o)[2]);
+      });
+}
+
+void Multiply(const QuaternionBatch& lhs, const QuaternionBatch& rhs,
+              QuaternionBatch* out) {
+  BOOST_ASSERT(lhs.size() == rhs.size());
+  out->resize(lhs.size());
+
+  ForEach<8, 4>(
+      lhs.size(),
+      {lhs.w.data(), lhs.x.data(), lhs.y.data(), lhs.z.data(),
+            rhs.w.data(), rhs.x.data(), rhs.y.data(), rhs.z.data()},
+      {out->w.data(), out->x.data(), out->y.data(), out->z.data()},
+      [](const auto& i, auto* o) {
+        // The same as operator*(Quaternion, Quaternion).
+        const auto& a = i[0];
+        const auto& b = i[1];
+        const auto& c = i[2];
+        const auto& d = i[3];
+
+        const auto& e = i[4];
+        const auto& f = i[5];
+        const auto& g = i[6];
+        const auto& h = i[7];
+
+        (*o)[0] = a * e - b * f - c * g - d * h;
+        (*o)[1] = b * e + a * f + c * h - d * g;
+        (*o)[2] = a * g - b * h + c * e + d * f;
+        (*o)[3] = a * h + b * g - c * f + d * e;
+      });
+}
+
+Eigen::ArrayXd FastAtan2(const Eigen::ArrayXd& y, const Eigen::ArrayXd& x) {
+  BOOST_ASSERT(y.size() == x.size());
+  Eigen::ArrayXd result(y.size());
+  ForEach<2, 1>(
+      y.size(), {y.data(), x.data()}, {result.data()},
+      [](const auto& i, auto* o) { (*o)[0] = Atan2(i[0], i[1]); });
+  return result;
+}
+
+Eigen::ArrayXd FastAsin(const Eigen::ArrayXd& x) {
+  Eigen::ArrayXd result(x.size());
+  ForEach<1, 1>(
+      x.size(), {x.data()}, {result.data()},
+      [](const auto& i, auto* o) { (*o)[0] = Asin(i[0]); });
+  return result;
+}
+
+void ToEuler(const QuaternionBatch& q, EulerBatch* out) {
+  out->resize(q.size());
+
+  ForEach<4, 3>(
+      q.size(),
+      {q.w.data(), q.x.data(), q.y.data(), q.z.data()},
+      {out->roll.data(), out->pitch.data(), out->yaw.data()},
+      [](const auto& i, auto* o) {
+        const auto& w = i[0];
+        const auto& x = i[1];
+        const auto& y = i[2];
+        const auto& z = i[3];
+
+        const Double sinp = 2.0 * (w * y - z * x);
+        const Double roll = Atan2(2.0 * (w * x + y * z),
+                                  1.0 - 2.0 * (x * x + y * y));
+        const Double pitch = Asin(
+            simd::Min(simd::Max(sinp, simd::Set(-1.0)), simd::Set(1.0)));
+        const Double yaw = Atan2(2.0 * (w * z + x * y),
+                                 1.0 - 2.0 * (y * y + z * z));
+
+        // At gimbal lock roll and yaw are not separable, so all of it
+        // is attributed to yaw, as Quaternion::euler_rad does.
+        const simd::Mask up = sinp >= (1.0 - 1e-8);
+        const simd::Mask down = sinp <= (-1.0 + 1e-8);
+        const Double locked_yaw = 2.0 * Atan2(x, w);
+
+        (*o)[0] = simd::Select(up | down, simd::Set(0.0), roll);
+        (*o)[1] = simd::Select(
+            up, simd::Set(M_PI_2),
+            simd::Select(down, simd::Set(-M_PI_2), pitch));
+        (*o)[2] = simd::Select(
+            up, -locked_yaw, simd::Select(down, locked_yaw, yaw));
+      });
+}
+
+}
+}
@@ -0,0 +1,139 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <Eigen/Core>
+
+#include "base/euler.h"
+#include "base/point3d.h"
+#include "base/quaternion.h"
+
+namespace mjmech {
+namespace base {
+
+/// Batch versions of the Quaternion operations, for when many
+/// rotations need to be evaluated at once, like when post-processing
+/// logs.
+///
+/// Values are stored as a structure of arrays, so that every lane of
+/// a SIMD register holds a different element.  The kernels use AVX or
+/// SSE2 on x86 and NEON on 64 bit ARM, depending upon what the
+/// compiler targets, and plain scalar code elsewhere.  Any size is
+/// accepted.
+
+struct QuaternionBatch {
+  Eigen::ArrayXd w;
+  Eigen::ArrayXd x;
+  Eigen::ArrayXd y;
+  Eigen::ArrayXd z;
+
+  QuaternionBatch() {}
+  explicit QuaternionBatch(Eigen::Index size) { resize(size); }
+
+  Eigen::Index size() const { return w.size(); }
+
+  void resize(Eigen::Index size) {
+    w.resize(size);
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+  }
+
+  void set(Eigen::Index i, const Quaternion& q) {
+    w(i) = q.w();
+    x(i) = q.x();
+    y(i) = q.y();
+    z(i) = q.z();
+  }
+
+  Quaternion get(Eigen::Index i) const {
+    return Quaternion(w(i), x(i), y(i), z(i));
+  }
+};
+
+struct Point3DBatch {
+  Eigen::ArrayXd x;
+  Eigen::ArrayXd y;
+  Eigen::ArrayXd z;
+
+  Point3DBatch() {}
+  explicit Point3DBatch(Eigen::Index size) { resize(size); }
+
+  Eigen::Index size() const { return x.size(); }
+
+  void resize(Eigen::Index size) {
+    x.resize(size);
+    y.resize(size);
+    z.resize(size);
+  }
+
+  void set(Eigen::Index i, const Point3D& p) {
+    x(i) = p.x();
+    y(i) = p.y();
+    z(i) = p.z();
+  }
+
+  Point3D get(Eigen::Index i) const {
+    return Point3D(x(i), y(i), z(i));
+  }
+};
+
+struct EulerBatch {
+  Eigen::ArrayXd roll;
+  Eigen::ArrayXd pitch;
+  Eigen::ArrayXd yaw;
+
+  EulerBatch() {}
+  explicit EulerBatch(Eigen::Index size) { resize(size); }
+
+  Eigen::Index size() const { return roll.size(); }
+
+  void resize(Eigen::Index size) {
+    roll.resize(size);
+    pitch.resize(size);
+    yaw.resize(size);
+  }
+
+  Euler get(Eigen::Index i) const {
+    return Euler{roll(i), pitch(i), yaw(i)};
+  }
+};
+
+/// Rotate every point by the same quaternion.
+void Rotate(const Quaternion&, const Point3DBatch& in, Point3DBatch* out);
+
+/// Rotate each point by the corresponding quaternion.
+void Rotate(const QuaternionBatch&, const Point3DBatch& in,
+            Point3DBatch* out);
+
+/// Element-wise lhs * rhs.
+void Multiply(const QuaternionBatch& lhs, const QuaternionBatch& rhs,
+              QuaternionBatch* out);
+
+/// The same as Quaternion::euler_rad for each element, evaluated with
+/// the approximations below.  Angles are within 1e-7 rad of the
+/// scalar version.
+void ToEuler(const QuaternionBatch&, EulerBatch* out);
+
+/// Polynomial approximations which only use operations Eigen can
+/// vectorize.  Maximum absolute error over the whole domain:
+///
+///  * FastAtan2: 1e-8 rad
+///  * FastAsin: 5e-8 rad, for inputs in [-1, 1]
+Eigen::ArrayXd FastAtan2(const Eigen::ArrayXd& y, const Eigen::ArrayXd& x);
+Eigen::ArrayXd FastAsin(const Eigen::ArrayXd& x);
+
+}
+}
@@ -14,7 +14,10 @@
 
 #pragma once
 
+#include <algorithm>
+#include <cstdint>
 #include <random>
+#include <vector>
 
 namespace mjmech {
 namespace base {
@@ -26,27 +29,87 @@ namespace base {
 template <typename T>
 class ReservoirSampler {
  public:
-  ReservoirSampler(std::size_t size)
-      : size_(size) {}
+  ReservoirSampler(std::size_t size, uint32_t seed = 0)
+      : size_(size), rng_(seed) {
+    samples_.reserve(size_);
+  }
 
   using Container = std::vector<T>;
-  using iterator = Container::iterator;
-  using const_iterator = Container::const_iterator;
+  using iterator = typename Container::iterator;
+  using const_iterator = typename Container::const_iterator;
 
   void Add(T value) {
     count_++;
 
     if (samples_.size() < size_) {
-      samples.push_back(std::move(value));
+      samples_.push_back(std::move(value));
     } else {
-      const std::size_t M = static_cast<std::size_t>(
-          std::uniform_int<>(0, count_ - 1)(rng_));
+      const std::size_t M =
+          std::uniform_int_distribution<std::size_t>(0, count_ - 1)(rng_);
       if (M < size_) {
-        samples_[M] = value;
+        samples_[M] = std::move(value);
+      }
+    }
+  }
+
+  /// Combine with a sampler which saw a different part of the data,
+  /// for instance on another thread.  Afterwards, this is a sample of
+  /// everything either one saw.
+  ///
+  /// Each slot is filled by picking a side in proportion to how many
+  /// of the original items it has not yet been picked for, which is
+  /// the same as drawing without replacement from the original items.
+  /// The slot then gets a sample from that side which has not yet been
+  /// used.
+  void Merge(const ReservoirSampler& other) {
+    if (other.count_ == 0) { return; }
+    if (count_ == 0) {
+      samples_ = other.samples_;
+      count_ = other.count_;
+      samples_.resize(std::min(samples_.size(), size_));
+      return;
+    }
+
+    Container mine = std::move(samples_);
+    Container theirs = other.samples_;
+    std::shuffle(mine.begin(), mine.end(), rng_);
+    std::shuffle(theirs.begin(), theirs.end(), rng_);
+
+    double my_remaining = count_;
+    double their_remaining = other.count_;
+
+    samples_.clear();
+    samples_.reserve(size_);
+    size_t my_next = 0;
+    size_t their_next = 0;
+    while (samples_.size() < size_ &&
+           (my_next < mine.size() || their_next < theirs.size())) {
+      const bool take_mine =
+          their_next == theirs.size() ||
+          (my_next < mine.size() &&
+           std::uniform_real_distribution<double>(
+               0.0, my_remaining + their_remaining)(rng_) < my_remaining);
+      if (take_mine) {
+        samples_.push_back(std::move(mine[my_next++]));
+        my_remaining--;
+      } else {
+        samples_.push_back(std::move(theirs[their_next++]));
+        their_remaining--;
       }
     }
+
+    count_ += other.count_;
   }
 
+  void Clear() {
+    samples_.clear();
+    count_ = 0;
+  }
+
+  /// The number of items ever added, including via Merge.
+  std::size_t count() const { return count_; }
+  std::size_t size() const { return samples_.size(); }
+
   iterator begin() { return samples_.begin(); }
   iterator end() { return samples_.end(); }
 
@@ -59,7 +122,7 @@ class ReservoirSampler {
 
   std::mt19937 rng_;
   std::size_t count_ = 0;
-}
+};
 
 }
 }
@@ -0,0 +1,85 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstddef>
+#include <utility>
+
+namespace mjmech {
+namespace base {
+
+/// A queue with a fixed capacity, set at compile time, which is
+/// stored inline and so never allocates.
+///
+/// When full, push_back() refuses new items, while
+/// push_back_overwrite() drops the oldest one.  The latter makes this
+/// a history window of the most recent Capacity items.
+template <typename T, size_t Capacity>
+class RingBuffer {
+ public:
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+  /// Return false, and leave the buffer unchanged, if it is full.
+  bool push_back(T value) {
+    if (full()) { return false; }
+    slots_[wrap(begin_ + size_)] = std::move(value);
+    size_++;
+    return true;
+  }
+
+  void push_back_overwrite(T value) {
+    if (full()) { pop_front(); }
+    slots_[wrap(begin_ + size_)] = std::move(value);
+    size_++;
+  }
+
+  void pop_front() {
+    begin_ = wrap(begin_ + 1);
+    size_--;
+  }
+
+  void clear() {
+    begin_ = 0;
+    size_ = 0;
+  }
+
+  T& front() { return slots_[begin_]; }
+  const T& front() const { return slots_[begin_]; }
+
+  T& back() { return slots_[wrap(begin_ + size_ - 1)]; }
+  const T& back() const { return slots_[wrap(begin_ + size_ - 1)]; }
+
+  /// Index 0 is the oldest item.
+  T& operator[](size_t index) { return slots_[wrap(begin_ + index)]; }
+  const T& operator[](size_t index) const {
+    return slots_[wrap(begin_ + index)];
+  }
+
+  size_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+  bool full() const { return size_ == Capacity; }
+  static constexpr size_t capacity() { return Capacity; }
+
+ private:
+  static size_t wrap(size_t index) { return index & (Capacity - 1); }
+
+  T slots_[Capacity] = {};
+  size_t begin_ = 0;
+  size_t size_ = 0;
+};
+
+}
+}
@@ -21,6 +21,7 @@
 #include "mjlib/io/deadline_timer.h"
 
 #include "common.h"
+#include "coroutine.h"
 
 namespace mjmech {
 namespace base {
@@ -80,6 +81,80 @@ class SignalResult : boost::noncopyable {
             context->handler(boost::system::error_code(), *value);
           });
   }
+
+#ifdef MJMECH_COROUTINES
+  template <typename T>
+  struct Result {
+    boost::system::error_code error;
+    T value{};
+  };
+
+  /// The same as Wait, but co_await gives a Result<T>.
+  ///
+  /// Unlike Wait, the state shared by the two handlers lives in the
+  /// coroutine frame rather than a per-wait shared_ptr.  That is safe
+  /// because the coroutine does not resume until both the signal and
+  /// the timer handlers are finished with it.  When the signal wins,
+  /// that means waiting for the canceled timer handler to run.
+  /// Connecting to the signal still allocates its slot and
+  /// connection, and the timer wait may as well.
+  template <typename T>
+  class Awaiter {
+   public:
+    Awaiter(const boost::asio::any_io_executor& executor,
+            boost::signals2::signal<void (const T*)>* signal,
+            double timeout_s)
+        : timer_(executor),
+          signal_(signal),
+          timeout_s_(timeout_s) {}
+
+    Awaiter(const Awaiter&) = delete;
+    Awaiter& operator=(const Awaiter&) = delete;
+
+    bool await_ready() const noexcept { return false; }
+
+    void await_suspend(std::coroutine_handle<> handle) {
+      handle_ = handle;
+
+      connection_ = signal_->connect([this](const T* value) {
+          if (!active_) { return; }
+          active_ = false;
+          connection_.disconnect();
+          result_.value = *value;
+          timer_.cancel();
+        });
+
+      timer_.expires_from_now(ConvertSecondsToDuration(timeout_s_));
+      timer_.async_wait([this](boost::system::error_code) {
+          if (active_) {
+            active_ = false;
+            connection_.disconnect();
+            result_.error = boost::asio::error::operation_aborted;
+          }
+          handle_.resume();
+        });
+    }
+
+    Result<T> await_resume() { return std::move(result_); }
+
+   private:
+    mjlib::io::DeadlineTimer timer_;
+    boost::signals2::signal<void (const T*)>* const signal_;
+    const double timeout_s_;
+
+    std::coroutine_handle<> handle_;
+    bool active_ = true;
+    boost::signals2::connection connection_;
+    Result<T> result_;
+  };
+
+  template <typename T>
+  static Awaiter<T> Await(const boost::asio::any_io_executor& executor,
+                          boost::signals2::signal<void (const T*)>* signal,
+                          double timeout_s) {
+    return Awaiter<T>(executor, signal, timeout_s);
+  }
+#endif
 };
 }
 }
@@ -0,0 +1,259 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__)
+#include <immintrin.h>
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#endif
+
+namespace mjmech {
+namespace base {
+
+/// A minimal vector of doubles, with just the operations our numeric
+/// kernels need.  Each kernel is written once against this and
+/// compiled for whichever instruction set the target has: AVX or SSE2
+/// on x86, and NEON on 64 bit ARM.  32 bit ARM NEON has no double
+/// precision lanes, so it gets the scalar fallback, with kLanes == 1.
+namespace simd {
+
+#if defined(__AVX__)
+
+constexpr int kLanes = 4;
+struct Double { __m256d v; };
+struct Mask { __m256d v; };
+
+inline Double Load(const double* p) { return {_mm256_loadu_pd(p)}; }
+inline void Store(double* p, Double a) { _mm256_storeu_pd(p, a.v); }
+inline Double Set(double a) { return {_mm256_set1_pd(a)}; }
+
+inline Double operator+(Double a, Double b) {
+  return {_mm256_add_pd(a.v, b.v)};
+}
+inline Double operator-(Double a, Double b) {
+  return {_mm256_sub_pd(a.v, b.v)};
+}
+inline Double operator*(Double a, Double b) {
+  return {_mm256_mul_pd(a.v, b.v)};
+}
+inline Double operator/(Double a, Double b) {
+  return {_mm256_div_pd(a.v, b.v)};
+}
+inline Double Min(Double a, Double b) { return {_mm256_min_pd(a.v, b.v)}; }
+inline Double Max(Double a, Double b) { return {_mm256_max_pd(a.v, b.v)}; }
+inline Double Sqrt(Double a) { return {_mm256_sqrt_pd(a.v)}; }
+inline Double Abs(Double a) {
+  return {_mm256_andnot_pd(_mm256_set1_pd(-0.0), a.v)};
+}
+
+inline Mask operator<(Double a, Double b) {
+  return {_mm256_cmp_pd(a.v, b.v, _CMP_LT_OQ)};
+}
+inline Mask operator>(Double a, Double b) {
+  return {_mm256_cmp_pd(a.v, b.v, _CMP_GT_OQ)};
+}
+inline Mask operator<=(Double a, Double b) {
+  return {_mm256_cmp_pd(a.v, b.v, _CMP_LE_OQ)};
+}
+inline Mask operator>=(Double a, Double b) {
+  return {_mm256_cmp_pd(a.v, b.v, _CMP_GE_OQ)};
+}
+inline Mask operator|(Mask a, Mask b) { return {_mm256_or_pd(a.v, b.v)}; }
+
+/// mask ? a : b
+inline Double Select(Mask mask, Double a, Double b) {
+  return {_mm256_blendv_pd(b.v, a.v, mask.v)};
+}
+
+#elif defined(__SSE2__)
+
+constexpr int kLanes = 2;
+struct Double { __m128d v; };
+struct Mask { __m128d v; };
+
+inline Double Load(const double* p) { return {_mm_loadu_pd(p)}; }
+inline void Store(double* p, Double a) { _mm_storeu_pd(p, a.v); }
+inline Double Set(double a) { return {_mm_set1_pd(a)}; }
+
+inline Double operator+(Double a, Double b) { return {_mm_add_pd(a.v, b.v)}; }
+inline Double operator-(Double a, Double b) { return {_mm_sub_pd(a.v, b.v)}; }
+inline Double operator*(Double a, Double b) { return {_mm_mul_pd(a.v, b.v)}; }
+inline Double operator/(Double a, Double b) { return {_mm_div_pd(a.v, b.v)}; }
+inline Double Min(Double a, Double b) { return {_mm_min_pd(a.v, b.v)}; }
+inline Double Max(Double a, Double b) { return {_mm_max_pd(a.v, b.v)}; }
+inline Double Sqrt(Double a) { return {_mm_sqrt_pd(a.v)}; }
+inline Double Abs(Double a) { return {_mm_andnot_pd(_mm_set1_pd(-0.0), a.v)}; }
+
+inline Mask operator<(Double a, Double b) { return {_mm_cmplt_pd(a.v, b.v)}; }
+inline Mask operator>(Double a, Double b) { return {_mm_cmpgt_pd(a.v, b.v)}; }
+inline Mask operator<=(Double a, Double b) { return {_mm_cmple_pd(a.v, b.v)}; }
+inline Mask operator>=(Double a, Double b) { return {_mm_cmpge_pd(a.v, b.v)}; }
+inline Mask operator|(Mask a, Mask b) { return {_mm_or_pd(a.v, b.v)}; }
+
+inline Double Select(Mask mask, Double a, Double b) {
+  return {_mm_or_pd(_mm_and_pd(mask.v, a.v), _mm_andnot_pd(mask.v, b.v))};
+}
+
+#elif defined(__ARM_NEON) && defined(__aarch64__)
+
+constexpr int kLanes = 2;
+struct Double { float64x2_t v; };
+struct Mask { uint64x2_t v; };
+
+inline Double Load(const double* p) { return {vld1q_f64(p)}; }
+inline void Store(double* p, Double a) { vst1q_f64(p, a.v); }
+inline Double Set(double a) { return {vdupq_n_f64(a)}; }
+
+inline Double operator+(Double a, Double b) { return {vaddq_f64(a.v, b.v)}; }
+inline Double operator-(Double a, Double b) { return {vsubq_f64(a.v, b.v)}; }
+inline Double operator*(Double a, Double b) { return {vmulq_f64(a.v, b.v)}; }
+inline Double operator/(Double a, Double b) { return {vdivq_f64(a.v, b.v)}; }
+inline Double Min(Double a, Double b) { return {vminq_f64(a.v, b.v)}; }
+inline Double Max(Double a, Double b) { return {vmaxq_f64(a.v, b.v)}; }
+inline Double Sqrt(Double a) { return {vsqrtq_f64(a.v)}; }
+inline Double Abs(Double a) { return {vabsq_f64(a.v)}; }
+
+inline Mask operator<(Double a, Double b) { return {vcltq_f64(a.v, b.v)}; }
+inline Mask operator>(Double a, Double b) { return {vcgtq_f64(a.v, b.v)}; }
+inline Mask operator<=(Double a, Double b) { return {vcleq_f64(a.v, b.v)}; }
+inline Mask operator>=(Double a, Double b) { return {vcgeq_f64(a.v, b.v)}; }
+inline Mask operator|(Mask a, Mask b) { return {vorrq_u64(a.v, b.v)}; }
+
+inline Double Select(Mask mask, Double a, Double b) {
+  return {vbslq_f64(mask.v, a.v, b.v)};
+}
+
+#else
+
+constexpr int kLanes = 1;
+struct Double { double v; };
+struct Mask { bool v; };
+
+inline Double Load(const double* p) { return {*p}; }
+inline void Store(double* p, Double a) { *p = a.v; }
+inline Double Set(double a) { return {a}; }
+
+inline Double operator+(Double a, Double b) { return {a.v + b.v}; }
+inline Double operator-(Double a, Double b) { return {a.v - b.v}; }
+inline Double operator*(Double a, Double b) { return {a.v * b.v}; }
+inline Double operator/(Double a, Double b) { return {a.v / b.v}; }
+inline Double Min(Double a, Double b) { return {std::min(a.v, b.v)}; }
+inline Double Max(Double a, Double b) { return {std::max(a.v, b.v)}; }
+inline Double Sqrt(Double a) { return {std::sqrt(a.v)}; }
+inline Double Abs(Double a) { return {std::abs(a.v)}; }
+
+inline Mask operator<(Double a, Double b) { return {a.v < b.v}; }
+inline Mask operator>(Double a, Double b) { return {a.v > b.v}; }
+inline Mask operator<=(Double a, Double b) { return {a.v <= b.v}; }
+inline Mask operator>=(Double a, Double b) { return {a.v >= b.v}; }
+inline Mask operator|(Mask a, Mask b) { return {a.v || b.v}; }
+
+inline Double Select(Mask mask, Double a, Double b) {
+  return mask.v ? a : b;
+}
+
+#endif
+
+inline Double operator-(Double a) { return Set(0.0) - a; }
+inline Double operator+(double a, Double b) { return Set(a) + b; }
+inline Double operator-(double a, Double b) { return Set(a) - b; }
+inline Double operator*(double a, Double b) { return Set(a) * b; }
+inline Mask operator<(Double a, double b) { return a < Set(b); }
+inline Mask operator>(Double a, double b) { return a > Set(b); }
+inline Mask operator<=(Double a, double b) { return a <= Set(b); }
+inline Mask operator>=(Double a, double b) { return a >= Set(b); }
+
+/// The single precision counterpart, with just the arithmetic.  Unlike
+/// doubles, 32 bit ARM NEON does have float lanes, so on the Pi this
+/// is 4 wide where Double is scalar.
+#if defined(__AVX__)
+
+constexpr int kFloatLanes = 8;
+struct Float { __m256 v; };
+
+inline Float Load(const float* p) { return {_mm256_loadu_ps(p)}; }
+inline void Store(float* p, Float a) { _mm256_storeu_ps(p, a.v); }
+inline Float Set(float a) { return {_mm256_set1_ps(a)}; }
+
+inline Float operator+(Float a, Float b) { return {_mm256_add_ps(a.v, b.v)}; }
+inline Float operator-(Float a, Float b) { return {_mm256_sub_ps(a.v, b.v)}; }
+inline Float operator*(Float a, Float b) { return {_mm256_mul_ps(a.v, b.v)}; }
+
+#elif defined(__SSE2__)
+
+constexpr int kFloatLanes = 4;
+struct Float { __m128 v; };
+
+inline Float Load(const float* p) { return {_mm_loadu_ps(p)}; }
+inline void Store(float* p, Float a) { _mm_storeu_ps(p, a.v); }
+inline Float Set(float a) { return {_mm_set1_ps(a)}; }
+
+inline Float operator+(Float a, Float b) { return {_mm_add_ps(a.v, b.v)}; }
+inline Float operator-(Float a, Float b) { return {_mm_sub_ps(a.v, b.v)}; }
+inline Float operator*(Float a, Float b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+#elif defined(__ARM_NEON)
+
+constexpr int kFloatLanes = 4;
+struct Float { float32x4_t v; };
+
+inline Float Load(const float* p) { return {vld1q_f32(p)}; }
+inline void Store(float* p, Float a) { vst1q_f32(p, a.v); }
+inline Float Set(float a) { return {vdupq_n_f32(a)}; }
+
+inline Float operator+(Float a, Float b) { return {vaddq_f32(a.v, b.v)}; }
+inline Float operator-(Float a, Float b) { return {vsubq_f32(a.v, b.v)}; }
+inline Float operator*(Float a, Float b) { return {vmulq_f32(a.v, b.v)}; }
+
+#else
+
+constexpr int kFloatLanes = 1;
+struct Float { float v; };
+
+inline Float Load(const float* p) { return {*p}; }
+inline void Store(float* p, Float a) { *p = a.v; }
+inline Float Set(float a) { return {a}; }
+
+inline Float operator+(Float a, Float b) { return {a.v + b.v}; }
+inline Float operator-(Float a, Float b) { return {a.v - b.v}; }
+inline Float operator*(Float a, Float b) { return {a.v * b.v}; }
+
+#endif
+
+/// Select the vector type for a scalar, for kernels which are
+/// templated on precision.
+template <typename Scalar>
+struct Traits;
+
+template <>
+struct Traits<double> {
+  using Vector = Double;
+  static constexpr int kLanes = simd::kLanes;
+};
+
+template <>
+struct Traits<float> {
+  using Vector = Float;
+  static constexpr int kLanes = kFloatLanes;
+};
+
+}
+
+}
+}
@@ -0,0 +1,96 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+namespace mjmech {
+namespace base {
+
+/// Pass every value, in order, from one writer thread to one reader
+/// thread without locks.  Unlike TripleBuffer, nothing is dropped, so
+/// the writer must handle the queue being full.
+///
+/// The capacity is fixed at compile time and the storage is inline,
+/// so this never allocates.
+template <typename T, size_t Capacity>
+class SpscQueue {
+ public:
+  static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0,
+                "Capacity must be a power of two");
+
+  SpscQueue() {}
+
+  SpscQueue(const SpscQueue&) = delete;
+  SpscQueue& operator=(const SpscQueue&) = delete;
+
+  // Writer side.
+
+  /// Return false if the queue is full.
+  bool Push(T value) {
+    const size_t tail = tail_.load(std::memory_order_relaxed);
+    if (tail - head_cache_ == Capacity) {
+      head_cache_ = head_.load(std::memory_order_acquire);
+      if (tail - head_cache_ == Capacity) { return false; }
+    }
+    slots_[tail & kMask] = std::move(value);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Reader side.
+
+  /// Return false if the queue is empty.
+  bool Pop(T* value) {
+    const size_t head = head_.load(std::memory_order_relaxed);
+    if (head == tail_cache_) {
+      tail_cache_ = tail_.load(std::memory_order_acquire);
+      if (head == tail_cache_) { return false; }
+    }
+    *value = std::move(slots_[head & kMask]);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  /// This is exact only when called from a side which has no
+  /// operation in progress, and may be stale as soon as it returns.
+  size_t size() const {
+    return tail_.load(std::memory_order_acquire) -
+        head_.load(std::memory_order_acquire);
+  }
+
+  static constexpr size_t capacity() { return Capacity; }
+
+ private:
+  static constexpr size_t kMask = Capacity - 1;
+  static constexpr size_t kCacheLine = 64;
+
+  // The indices only ever increase, and are masked on use.  Each side
+  // keeps a copy of the other's index, so that it only needs to touch
+  // the other side's cache line when the copy says it is full or
+  // empty.  Everything one side writes is on its own cache line.
+  alignas(kCacheLine) std::atomic<size_t> tail_{0};
+  size_t head_cache_ = 0;
+
+  alignas(kCacheLine) std::atomic<size_t> head_{0};
+  size_t tail_cache_ = 0;
+
+  alignas(kCacheLine) T slots_[Capacity] = {};
+};
+
+}
+}
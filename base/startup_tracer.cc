@@ -0,0 +1,94 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/startup_tracer.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <fmt/format.h>
+
+namespace mjmech {
+namespace base {
+
+StartupTracer::StartupTracer()
+    : start_(std::chrono::steady_clock::now()) {}
+
+double StartupTracer::Elapsed() const {
+  return std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start_).count();
+}
+
+void StartupTracer::Begin(const std::string& name) {
+  Phase phase;
+  phase.name = name;
+  phase.start_s = Elapsed();
+  report_.phases.push_back(phase);
+}
+
+void StartupTracer::End(const std::string& name) {
+  // Search from the back, so that the most recent phase of this name
+  // is the one ended.
+  for (auto it = report_.phases.rbegin(); it != report_.phases.rend(); ++it) {
+    if (it->name == name && it->end_s < 0.0) {
+      it->end_s = Elapsed();
+      return;
+    }
+  }
+}
+
+mjlib::io::ErrorCallback StartupTracer::Wrap(
+    const std::string& name, mjlib::io::ErrorCallback callback) {
+  Begin(name);
+  return [this, name, callback=std::move(callback)](
+      const mjlib::base::error_code& ec) mutable {
+    End(name);
+    callback(ec);
+  };
+}
+
+void StartupTracer::MarkFirstFullStatus() {
+  if (report_.first_full_status_s >= 0.0) { return; }
+  report_.first_full_status_s = Elapsed();
+}
+
+void StartupTracer::MarkReady() {
+  if (report_.ready_s >= 0.0) { return; }
+  report_.ready_s = Elapsed();
+  report_.timestamp = boost::posix_time::microsec_clock::universal_time();
+  report_signal_(&report_);
+}
+
+std::string StartupTracer::Format() const {
+  std::string result = "startup:\n";
+  for (const auto& phase : report_.phases) {
+    if (phase.end_s < 0.0) {
+      result += fmt::format("  {:<40} {:8.3f}s  (running)\n",
+                            phase.name, phase.start_s);
+    } else {
+      result += fmt::format("  {:<40} {:8.3f}s  {:8.3f}s\n",
+                            phase.name, phase.start_s,
+                            phase.end_s - phase.start_s);
+    }
+  }
+  const auto milestone = [&](const char* name, double value) {
+    if (value < 0.0) { return; }
+    result += fmt::format("  {:<40} {:8.3f}s\n", name, value);
+  };
+  milestone("first full status", report_.first_full_status_s);
+  milestone("ready", report_.ready_s);
+  return result;
+}
+
+}
+}
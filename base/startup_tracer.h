@@ -0,0 +1,105 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/signals2/signal.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+
+namespace mjmech {
+namespace base {
+
+/// Records where the time goes between the start of the process and
+/// the robot being ready to control.  Each component records the
+/// phases it goes through, and the two milestones that matter are
+/// marked when they are reached.  At ready, a Report is emitted.
+///
+/// All times are seconds since construction, which is the start of
+/// safe_main.  This must only be used from the main executor.
+class StartupTracer : boost::noncopyable {
+ public:
+  StartupTracer();
+
+  struct Phase {
+    std::string name;
+    double start_s = 0.0;
+    // Negative while the phase is still running.
+    double end_s = -1.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(name));
+      a->Visit(MJ_NVP(start_s));
+      a->Visit(MJ_NVP(end_s));
+    }
+  };
+
+  struct Report {
+    boost::posix_time::ptime timestamp;
+    std::vector<Phase> phases;
+
+    /// The first cycle which heard from every servo.
+    double first_full_status_s = -1.0;
+
+    /// Configuration finished, so control can start.
+    double ready_s = -1.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(timestamp));
+      a->Visit(MJ_NVP(phases));
+      a->Visit(MJ_NVP(first_full_status_s));
+      a->Visit(MJ_NVP(ready_s));
+    }
+  };
+
+  void Begin(const std::string& name);
+  void End(const std::string& name);
+
+  /// Begin @p name now, and return a callback which ends it before
+  /// calling @p callback.
+  mjlib::io::ErrorCallback Wrap(const std::string& name,
+                                mjlib::io::ErrorCallback callback);
+
+  /// Only the first call of each of these counts.
+  void MarkFirstFullStatus();
+  void MarkReady();
+
+  /// Emitted once, from MarkReady.
+  using ReportSignal = boost::signals2::signal<void (const Report*)>;
+  ReportSignal* report_signal() { return &report_signal_; }
+
+  const Report& report() const { return report_; }
+
+  /// A table of the phases in start order, then the milestones.
+  std::string Format() const;
+
+ private:
+  double Elapsed() const;
+
+  const std::chrono::steady_clock::time_point start_;
+  Report report_;
+  ReportSignal report_signal_;
+};
+
+}
+}
@@ -0,0 +1,234 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+#include "mjlib/base/assert.h"
+
+namespace mjmech {
+namespace base {
+
+void Moments::Merge(const Moments& other) {
+  if (other.count_ == 0) { return; }
+  if (count_ == 0) {
+    *this = other;
+    return;
+  }
+
+  // Chan, Golub and LeVeque's pairwise update.
+  const int64_t count = count_ + other.count_;
+  const double delta = other.mean_ - mean_;
+  mean_ += delta * other.count_ / count;
+  m2_ += other.m2_ +
+      delta * delta * static_cast<double>(count_) * other.count_ / count;
+  count_ = count;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+}
+
+double Moments::stddev() const {
+  return std::sqrt(variance());
+}
+
+QuantileSketch::QuantileSketch(int k, uint32_t seed)
+    : k_(k), rng_(seed) {
+  MJ_ASSERT(k_ >= 2);
+  levels_.resize(1);
+  levels_[0].reserve(k_);
+  UpdateMaxRetained();
+}
+
+int QuantileSketch::Capacity(size_t level) const {
+  // Levels below the top shrink geometrically, so that most of the
+  // memory goes to the values which stand for the most.
+  const size_t depth = levels_.size() - 1 - level;
+  return std::max(
+      2, static_cast<int>(std::ceil(k_ * std::pow(2.0 / 3.0, depth))));
+}
+
+void QuantileSketch::UpdateMaxRetained() {
+  max_retained_ = 0;
+  for (size_t i = 0; i < levels_.size(); i++) {
+    max_retained_ += Capacity(i);
+  }
+}
+
+void QuantileSketch::Compress() {
+  for (size_t level = 0; level < levels_.size(); level++) {
+    if (static_cast<int>(levels_[level].size()) < Capacity(level)) {
+      continue;
+    }
+
+    if (level + 1 == levels_.size()) {
+      levels_.emplace_back();
+      UpdateMaxRetained();
+    }
+
+    auto& items = levels_[level];
+    auto& next = levels_[level + 1];
+
+    // An odd item out stays behind.
+    const size_t compact = items.size() & ~static_cast<size_t>(1);
+    const size_t begin = items.size() - compact;
+    std::sort(items.begin(), items.end());
+
+    for (size_t i = begin + (rng_() & 1); i < items.size(); i += 2) {
+      next.push_back(items[i]);
+    }
+    retained_ -= compact / 2;
+    items.resize(begin);
+
+    // One compaction is usually enough to make room.
+    if (retained_ < max_retained_) { break; }
+  }
+}
+
+void QuantileSketch::Merge(const QuantileSketch& other) {
+  MJ_ASSERT(other.k_ == k_);
+  if (other.count_ == 0) { return; }
+
+  if (other.levels_.size() > levels_.size()) {
+    levels_.resize(other.levels_.size());
+    UpdateMaxRetained();
+  }
+  for (size_t i = 0; i < other.levels_.size(); i++) {
+    levels_[i].insert(levels_[i].end(),
+                      other.levels_[i].begin(), other.levels_[i].end());
+  }
+  retained_ += other.retained_;
+  count_ += other.count_;
+  min_ = std::min(min_, other.min_);
+  max_ = std::max(max_, other.max_);
+
+  while (retained_ >= max_retained_) {
+    const int64_t before = retained_;
+    Compress();
+    if (retained_ == before) { break; }
+  }
+}
+
+void QuantileSketch::Clear() {
+  levels_.clear();
+  levels_.resize(1);
+  retained_ = 0;
+  count_ = 0;
+  min_ = std::numeric_limits<double>::infinity();
+  max_ = -std::numeric_limits<double>::infinity();
+  UpdateMaxRetained();
+}
+
+double QuantileSketch::Quantile(double q) const {
+  if (count_ == 0) { return 0.0; }
+  if (q <= 0.0) { return min_; }
+  if (q >= 1.0) { return max_; }
+
+  std::vector<std::pair<double, int64_t>> weighted;
+  weighted.reserve(retained_);
+  int64_t total = 0;
+  for (size_t level = 0; level < levels_.size(); level++) {
+    const int64_t weight = int64_t(1) << level;
+    for (double value : levels_[level]) {
+      weighted.emplace_back(value, weight);
+      total += weight;
+    }
+  }
+  std::sort(weighted.begin(), weighted.end());
+
+  const double target = q * total;
+  int64_t cumulative = 0;
+  for (const auto& pair : weighted) {
+    cumulative += pair.second;
+    if (cumulative >= target) { return pair.first; }
+  }
+  return max_;
+}
+
+WindowedStatistics::WindowedStatistics(const Options& options)
+    : options_(options),
+      bucket_duration_(boost::posix_time::microseconds(
+          static_cast<int64_t>(
+              1e6 * options.window_s / options.buckets))) {
+  MJ_ASSERT(options_.buckets >= 1);
+  // One extra, which is the one being filled.
+  for (int i = 0; i < options_.buckets + 1; i++) {
+    buckets_.emplace_back(options_.k);
+  }
+}
+
+void WindowedStatistics::Advance(boost::posix_time::ptime now) {
+  if (buckets_[current_].start.is_special()) {
+    buckets_[current_].start = now;
+    return;
+  }
+
+  // Step through any buckets which saw nothing, clearing each, but go
+  // no further than once around the ring.
+  for (size_t i = 0; i < buckets_.size(); i++) {
+    const auto end = buckets_[current_].start + bucket_duration_;
+    if (now < end) { return; }
+
+    current_ = (current_ + 1) % buckets_.size();
+    auto& bucket = buckets_[current_];
+    bucket.start = end;
+    bucket.moments.Clear();
+    bucket.sketch.Clear();
+  }
+
+  // Everything is older than the window now.
+  buckets_[current_].start = now;
+}
+
+void WindowedStatistics::Add(boost::posix_time::ptime now, double value) {
+  Advance(now);
+  auto& bucket = buckets_[current_];
+  bucket.moments.Add(value);
+  bucket.sketch.Add(value);
+}
+
+StatisticsSummary WindowedStatistics::Summarize(
+    boost::posix_time::ptime now) const {
+  Moments moments;
+  QuantileSketch sketch(options_.k);
+
+  const auto window = boost::posix_time::microseconds(
+      static_cast<int64_t>(1e6 * options_.window_s));
+  for (const auto& bucket : buckets_) {
+    if (bucket.start.is_special()) { continue; }
+    if (bucket.start + bucket_duration_ + window <= now) { continue; }
+    moments.Merge(bucket.moments);
+    sketch.Merge(bucket.sketch);
+  }
+
+  StatisticsSummary result;
+  result.count = moments.count();
+  if (result.count == 0) { return result; }
+
+  result.mean = moments.mean();
+  result.stddev = moments.stddev();
+  result.min = moments.min();
+  result.max = moments.max();
+  result.p01 = sketch.Quantile(0.01);
+  result.p05 = sketch.Quantile(0.05);
+  result.p50 = sketch.Quantile(0.50);
+  result.p95 = sketch.Quantile(0.95);
+  result.p99 = sketch.Quantile(0.99);
+  return result;
+}
+
+}
+}
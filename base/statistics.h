@@ -0,0 +1,185 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/visitor.h"
+
+namespace mjmech {
+namespace base {
+
+/// The count, mean, variance and range of a stream of values,
+/// accumulated with Welford's method.  Two sets of moments for
+/// different parts of a stream can be merged exactly, for instance
+/// from different threads.
+class Moments {
+ public:
+  void Add(double value) {
+    count_++;
+    const double delta = value - mean_;
+    mean_ += delta / count_;
+    m2_ += delta * (value - mean_);
+    if (value < min_) { min_ = value; }
+    if (value > max_) { max_ = value; }
+  }
+
+  void Merge(const Moments&);
+
+  void Clear() { *this = Moments(); }
+
+  int64_t count() const { return count_; }
+  double mean() const { return mean_; }
+  double variance() const { return count_ > 1 ? m2_ / (count_ - 1) : 0.0; }
+  double stddev() const;
+  double min() const { return min_; }
+  double max() const { return max_; }
+
+ private:
+  int64_t count_ = 0;
+  double mean_ = 0.0;
+  double m2_ = 0.0;
+  double min_ = std::numeric_limits<double>::infinity();
+  double max_ = -std::numeric_limits<double>::infinity();
+};
+
+/// Estimate quantiles of a stream of values in bounded memory, using
+/// the KLL sketch from "Optimal Quantile Approximation in Streams",
+/// Karnin, Lang and Liberty.
+///
+/// Values are kept in a stack of compactors, where each value at
+/// level h stands for 2^h of the originals.  When a level fills, it
+/// is sorted and every other value, starting at a random one of the
+/// first two, is promoted to the next level.  With the default @p k
+/// the rank error is around 1%.  Sketches of different parts of a
+/// stream can be merged.
+class QuantileSketch {
+ public:
+  explicit QuantileSketch(int k = 200, uint32_t seed = 0);
+
+  void Add(double value) {
+    count_++;
+    if (value < min_) { min_ = value; }
+    if (value > max_) { max_ = value; }
+    levels_[0].push_back(value);
+    retained_++;
+    if (retained_ >= max_retained_) { Compress(); }
+  }
+
+  /// @p other must have the same k.
+  void Merge(const QuantileSketch& other);
+
+  void Clear();
+
+  /// Return the estimated value below which a fraction @p q of the
+  /// stream lies.  0 and 1 give the exact minimum and maximum.
+  double Quantile(double q) const;
+
+  int64_t count() const { return count_; }
+
+  /// The number of values currently held.
+  int64_t retained() const { return retained_; }
+
+ private:
+  int Capacity(size_t level) const;
+  void UpdateMaxRetained();
+  void Compress();
+
+  int k_;
+  std::mt19937 rng_;
+
+  std::vector<std::vector<double>> levels_;
+  int64_t retained_ = 0;
+  int64_t max_retained_ = 0;
+
+  int64_t count_ = 0;
+  double min_ = std::numeric_limits<double>::infinity();
+  double max_ = -std::numeric_limits<double>::infinity();
+};
+
+/// A report of the distribution of a stream of values.
+struct StatisticsSummary {
+  int64_t count = 0;
+  double mean = 0.0;
+  double stddev = 0.0;
+  double min = 0.0;
+  double max = 0.0;
+  double p01 = 0.0;
+  double p05 = 0.0;
+  double p50 = 0.0;
+  double p95 = 0.0;
+  double p99 = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(mean));
+    a->Visit(MJ_NVP(stddev));
+    a->Visit(MJ_NVP(min));
+    a->Visit(MJ_NVP(max));
+    a->Visit(MJ_NVP(p01));
+    a->Visit(MJ_NVP(p05));
+    a->Visit(MJ_NVP(p50));
+    a->Visit(MJ_NVP(p95));
+    a->Visit(MJ_NVP(p99));
+  }
+};
+
+/// Moments and quantiles over a rolling window of time.
+///
+/// Neither structure can forget individual values, so the window is
+/// split into buckets, each with its own.  The oldest bucket is
+/// dropped as time passes, and a query merges the rest.  The window
+/// covered is thus between window_s and window_s * (1 + 1 / buckets).
+class WindowedStatistics {
+ public:
+  struct Options {
+    double window_s = 10.0;
+    int buckets = 10;
+    int k = 200;
+
+    Options() {}
+  };
+
+  explicit WindowedStatistics(const Options& = Options());
+
+  void Add(boost::posix_time::ptime now, double value);
+
+  StatisticsSummary Summarize(boost::posix_time::ptime now) const;
+
+ private:
+  struct Bucket {
+    boost::posix_time::ptime start;
+    Moments moments;
+    QuantileSketch sketch;
+
+    Bucket(int k) : sketch(k) {}
+  };
+
+  void Advance(boost::posix_time::ptime now);
+
+  const Options options_;
+  const boost::posix_time::time_duration bucket_duration_;
+  std::vector<Bucket> buckets_;
+  size_t current_ = 0;
+};
+
+}
+}
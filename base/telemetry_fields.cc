@@ -0,0 +1,229 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_fields.h"
+
+#include <cstring>
+
+#include <fmt/format.h>
+
+#include "base/format_hex.h"
+
+namespace mjmech {
+namespace base {
+
+namespace {
+using Element = mjlib::telemetry::BinarySchemaParser::Element;
+using Type = mjlib::telemetry::Format::Type;
+
+class Reader {
+ public:
+  Reader(std::string_view data) : data_(data) {}
+
+  bool ReadBytes(size_t size, std::string_view* result) {
+    if (size > data_.size()) { return false; }
+    *result = data_.substr(0, size);
+    data_.remove_prefix(size);
+    return true;
+  }
+
+  template <typename T>
+  bool Read(T* value) {
+    std::string_view bytes;
+    if (!ReadBytes(sizeof(T), &bytes)) { return false; }
+    std::memcpy(value, bytes.data(), sizeof(T));
+    return true;
+  }
+
+  /// Little endian, and sign extended if @p is_signed.
+  bool ReadInt(int size, bool is_signed, int64_t* value) {
+    std::string_view bytes;
+    if (size < 1 || size > 8 || !ReadBytes(size, &bytes)) { return false; }
+    uint64_t result = 0;
+    for (int i = 0; i < size; i++) {
+      result |= static_cast<uint64_t>(static_cast<uint8_t>(bytes[i])) << (8 * i);
+    }
+    if (is_signed && size < 8 && (result >> (8 * size - 1)) & 1) {
+      result |= ~uint64_t(0) << (8 * size);
+    }
+    *value = static_cast<int64_t>(result);
+    return true;
+  }
+
+  bool ReadVaruint(uint64_t* value) {
+    uint64_t result = 0;
+    for (int shift = 0; shift < 64; shift += 7) {
+      uint8_t byte = 0;
+      if (!Read(&byte)) { return false; }
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      if ((byte & 0x80) == 0) {
+        *value = result;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  bool ReadVarint(int64_t* value) {
+    uint64_t result = 0;
+    int shift = 0;
+    uint8_t byte = 0;
+    do {
+      if (shift >= 64 || !Read(&byte)) { return false; }
+      result |= static_cast<uint64_t>(byte & 0x7f) << shift;
+      shift += 7;
+    } while (byte & 0x80);
+    if (shift < 64 && (byte & 0x40)) { result |= ~uint64_t(0) << shift; }
+    *value = static_cast<int64_t>(result);
+    return true;
+  }
+
+  bool ReadString(std::string_view* value) {
+    uint64_t size = 0;
+    return ReadVaruint(&size) && ReadBytes(size, value);
+  }
+
+ private:
+  std::string_view data_;
+};
+
+std::string Join(const std::string& prefix, const std::string& name) {
+  return prefix.empty() ? name : prefix + "." + name;
+}
+
+bool Decode(const Element* element, const std::string& name, Reader* reader,
+            std::vector<TelemetryField>* fields) {
+  auto emit = [&](std::string value) {
+    fields->push_back({name, std::move(value)});
+    return true;
+  };
+
+  switch (element->type) {
+    case Type::kFinal:
+    case Type::kNull: {
+      return true;
+    }
+    case Type::kBoolean: {
+      uint8_t value = 0;
+      if (!reader->Read(&value)) { return false; }
+      return emit(value ? "true" : "false");
+    }
+    case Type::kFixedInt:
+    case Type::kFixedUInt: {
+      int64_t value = 0;
+      const bool is_signed = element->type == Type::kFixedInt;
+      if (!reader->ReadInt(element->int_size, is_signed, &value)) {
+        return false;
+      }
+      return emit(is_signed ? fmt::format("{}", value) :
+                  fmt::format("{}", static_cast<uint64_t>(value)));
+    }
+    case Type::kVarint:
+    case Type::kTimestamp:
+    case Type::kDuration: {
+      int64_t value = 0;
+      if (element->type == Type::kVarint ?
+          !reader->ReadVarint(&value) :
+          !reader->ReadInt(8, true, &value)) {
+        return false;
+      }
+      return emit(fmt::format("{}", value));
+    }
+    case Type::kVaruint: {
+      uint64_t value = 0;
+      if (!reader->ReadVaruint(&value)) { return false; }
+      return emit(fmt::format("{}", value));
+    }
+    case Type::kFloat32: {
+      float value = 0.0f;
+      if (!reader->Read(&value)) { return false; }
+      return emit(fmt::format("{}", value));
+    }
+    case Type::kFloat64: {
+      double value = 0.0;
+      if (!reader->Read(&value)) { return false; }
+      return emit(fmt::format("{}", value));
+    }
+    case Type::kBytes:
+    case Type::kString: {
+      std::string_view value;
+      if (!reader->ReadString(&value)) { return false; }
+      return emit(element->type == Type::kString ?
+                  std::string(value) : FormatHex(value));
+    }
+    case Type::kObject: {
+      for (const auto& field : element->fields) {
+        if (!Decode(field.element, Join(name, field.name), reader, fields)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case Type::kEnum: {
+      uint64_t value = 0;
+      if (!reader->ReadVaruint(&value)) { return false; }
+      const auto it = element->enum_items.find(value);
+      return emit(it != element->enum_items.end() ?
+                  it->second : fmt::format("{}", value));
+    }
+    case Type::kArray:
+    case Type::kFixedArray: {
+      uint64_t size = element->array_size;
+      if (element->type == Type::kArray && !reader->ReadVaruint(&size)) {
+        return false;
+      }
+      for (uint64_t i = 0; i < size; i++) {
+        if (!Decode(element->children.front(),
+                    Join(name, fmt::format("{}", i)), reader, fields)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case Type::kMap: {
+      uint64_t size = 0;
+      if (!reader->ReadVaruint(&size)) { return false; }
+      for (uint64_t i = 0; i < size; i++) {
+        std::string_view key;
+        if (!reader->ReadString(&key) ||
+            !Decode(element->children.front(),
+                    Join(name, std::string(key)), reader, fields)) {
+          return false;
+        }
+      }
+      return true;
+    }
+    case Type::kUnion: {
+      uint64_t index = 0;
+      if (!reader->ReadVaruint(&index) ||
+          index >= element->children.size()) {
+        return false;
+      }
+      return Decode(element->children[index], name, reader, fields);
+    }
+  }
+  return false;
+}
+}
+
+bool DecodeTelemetryFields(
+    const mjlib::telemetry::BinarySchemaParser::Element* schema,
+    std::string_view data,
+    std::vector<TelemetryField>* fields) {
+  Reader reader(data);
+  return Decode(schema, "", &reader, fields);
+}
+
+}
+}
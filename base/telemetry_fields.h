@@ -0,0 +1,52 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/telemetry/binary_schema_parser.h"
+
+namespace mjmech {
+namespace base {
+
+/// One scalar value from a telemetry record.
+struct TelemetryField {
+  /// The dotted path from the root, with array elements numbered, for
+  /// instance "joints.1.velocity_dps".
+  std::string name;
+  std::string value;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(value));
+  }
+};
+
+/// Decode one instance of a record, described by @p schema, into its
+/// scalar fields in schema order.  Enumerations are given by name,
+/// and bytes in hex.  Return false if @p data does not match the
+/// schema, in which case @p fields holds what was decoded before the
+/// mismatch.
+bool DecodeTelemetryFields(
+    const mjlib::telemetry::BinarySchemaParser::Element* schema,
+    std::string_view data,
+    std::vector<TelemetryField>* fields);
+
+}
+}
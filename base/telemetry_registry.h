@@ -23,6 +23,7 @@
 
 #include "base/telemetry_log_registrar.h"
 #include "base/telemetry_remote_debug_registrar.h"
+#include "base/telemetry_stream_registrar.h"
 
 namespace mjmech {
 namespace base {
@@ -31,8 +32,9 @@ class TelemetryRegistry : boost::noncopyable {
  public:
   TelemetryRegistry(boost::asio::io_context& context,
                     mjlib::telemetry::FileWriter* log,
-                    TelemetryRemoteDebugServer* debug)
-      : log_(context, log), debug_(debug) {}
+                    TelemetryRemoteDebugServer* debug,
+                    TelemetryStreamPublisher* stream = nullptr)
+      : log_(context, log), debug_(debug), stream_(stream) {}
 
   /// Register a serializable object, and return a function object
   /// which when called will disseminate the
@@ -50,6 +52,7 @@ class TelemetryRegistry : boost::noncopyable {
 
     log_.Register(record_name, &ptr->signal);
     debug_.Register(record_name, &ptr->signal);
+    stream_.Register(record_name, &ptr->signal);
 
     records_.insert(
         std::make_pair(
@@ -80,6 +83,7 @@ class TelemetryRegistry : boost::noncopyable {
 
   TelemetryLogRegistrar log_;
   TelemetryRemoteDebugRegistrar debug_;
+  TelemetryStreamRegistrar stream_;
 };
 
 }
@@ -14,11 +14,19 @@
 
 #include "telemetry_remote_debug_server.h"
 
+#include <atomic>
+
 #include <boost/asio/post.hpp>
 
 #include "mjlib/base/json5_read_archive.h"
 #include "mjlib/base/json5_write_archive.h"
 #include "mjlib/base/fail.h"
+#include "mjlib/io/now.h"
+#include "mjlib/io/repeating_timer.h"
+
+#include "base/common.h"
+#include "base/spsc_queue.h"
+#include "base/statistics.h"
 
 namespace mjmech {
 namespace base {
@@ -26,7 +34,31 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
  public:
   Impl(const boost::asio::any_io_executor& executor)
       : executor_(executor),
-        socket_(executor) {}
+        socket_(executor),
+        drain_timer_(executor) {}
+
+  void StartDrain() {
+    drain_timer_.start(
+        ConvertSecondsToDuration(parameters_.drain_period_s),
+        [this](auto&& ec) {
+          mjlib::base::FailIf(ec);
+          DrainWatches();
+        });
+  }
+
+  /// Fold every queued value into its statistics.  This runs here,
+  /// rather than in the watch callback, because the callback is on
+  /// whatever thread emits the record, often the control loop, and
+  /// compacting a sketch sorts and allocates.
+  void DrainWatches() {
+    for (auto& pair : watches_) {
+      auto& watch = *pair.second;
+      Sample sample;
+      while (watch.queue.Pop(&sample)) {
+        watch.statistics.Add(sample.timestamp, sample.value);
+      }
+    }
+  }
 
   void StartRead() {
     socket_.async_receive_from(
@@ -51,11 +83,13 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
   struct Message {
     std::string command;
     std::vector<std::string> names;
+    double window_s = 10.0;
 
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(command));
       a->Visit(MJ_NVP(names));
+      a->Visit(MJ_NVP(window_s));
     }
   };
 
@@ -66,6 +100,12 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
       DoEnumerate(from);
     } else if (message.command == "get") {
       DoGet(message, from);
+    } else if (message.command == "watch") {
+      DoWatch(message);
+    } else if (message.command == "unwatch") {
+      for (const auto& name : message.names) { watches_.erase(name); }
+    } else if (message.command == "stats") {
+      DoStats(message, from);
     } else {
       std::cerr << "unknown remote debug command: '"
                 << message.command << "'\n";
@@ -112,6 +152,94 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
     }
   }
 
+  void DoWatch(const Message& message) {
+    for (const auto& name : message.names) {
+      if (watches_.count(name)) { continue; }
+
+      // The record name is the longest registered prefix, since
+      // record names may themselves contain dots.
+      auto it = handlers_.end();
+      for (auto candidate = handlers_.begin(); candidate != handlers_.end();
+           ++candidate) {
+        const auto& record = candidate->first;
+        if (name.size() > record.size() + 1 &&
+            name.compare(0, record.size(), record) == 0 &&
+            name[record.size()] == '.' &&
+            (it == handlers_.end() || record.size() > it->first.size())) {
+          it = candidate;
+        }
+      }
+      if (it == handlers_.end()) {
+        std::cerr << "watch for unknown record: '" + name + "'\n";
+        continue;
+      }
+
+      WindowedStatistics::Options options;
+      options.window_s = message.window_s;
+      auto watch = std::make_unique<Watch>(options);
+      auto* const watch_ptr = watch.get();
+      watch->connection = it->second->Watch(
+          name.substr(it->first.size() + 1),
+          [this, watch_ptr](double value) {
+            if (!watch_ptr->queue.Push(
+                    {mjlib::io::Now(executor_.context()), value})) {
+              watch_ptr->dropped.fetch_add(1, std::memory_order_relaxed);
+            }
+          });
+      if (!watch->connection.connected()) {
+        std::cerr << "watch for unknown field: '" + name + "'\n";
+        continue;
+      }
+
+      watches_.insert(std::make_pair(name, std::move(watch)));
+    }
+  }
+
+  struct Stats {
+    std::string name;
+    StatisticsSummary summary;
+    // Values lost because the queue filled between drains.
+    int64_t dropped = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(name));
+      a->Visit(MJ_NVP(summary));
+      a->Visit(MJ_NVP(dropped));
+    }
+  };
+
+  struct StatsResponse {
+    std::string type = "stats";
+    std::vector<Stats> stats;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(type));
+      a->Visit(MJ_NVP(stats));
+    }
+  };
+
+  void DoStats(const Message& message, const udp::endpoint& from) {
+    DrainWatches();
+
+    const auto now = mjlib::io::Now(executor_.context());
+    StatsResponse response;
+    for (const auto& name : message.names) {
+      auto it = watches_.find(name);
+      if (it == watches_.end()) {
+        std::cerr << "stats for unwatched name: '" + name + "'\n";
+        continue;
+      }
+      const auto& watch = *it->second;
+      response.stats.push_back(
+          {name, watch.statistics.Summarize(now),
+           watch.dropped.load(std::memory_order_relaxed)});
+    }
+
+    SendData(mjlib::base::Json5WriteArchive::Write(response), from);
+  }
+
   void HandleWrite(std::shared_ptr<std::string>,
                    mjlib::base::error_code ec) {
     mjlib::base::FailIf(ec);
@@ -122,8 +250,28 @@ class TelemetryRemoteDebugServer::Impl : boost::noncopyable {
   udp::socket socket_;
   char receive_buffer_[3000] = {};
   udp::endpoint receive_endpoint_;
+  mjlib::io::RepeatingTimer drain_timer_;
 
   std::map<std::string, std::unique_ptr<Handler> > handlers_;
+
+  struct Sample {
+    boost::posix_time::ptime timestamp;
+    double value = 0.0;
+  };
+
+  struct Watch {
+    Watch(const WindowedStatistics::Options& options)
+        : statistics(options) {}
+
+    // Filled by the record's emitter and drained on our executor.
+    SpscQueue<Sample, 1024> queue;
+    std::atomic<int64_t> dropped{0};
+
+    WindowedStatistics statistics;
+    boost::signals2::scoped_connection connection;
+  };
+
+  std::map<std::string, std::unique_ptr<Watch>> watches_;
 };
 
 TelemetryRemoteDebugServer::TelemetryRemoteDebugServer(
@@ -142,6 +290,7 @@ void TelemetryRemoteDebugServer::AsyncStart(mjlib::io::ErrorCallback handler) {
   udp::endpoint endpoint(udp::v4(), impl_->parameters_.port);
   impl_->socket_.bind(endpoint);
   impl_->StartRead();
+  impl_->StartDrain();
 
   boost::asio::post(
       impl_->executor_,
@@ -21,9 +21,22 @@
 #include "mjlib/base/json5_write_archive.h"
 #include "mjlib/io/async_types.h"
 
+#include "base/field_reader.h"
+
 namespace mjmech {
 namespace base {
 
+/// Answers UDP requests with the most recent value of registered
+/// records.  Requests are JSON objects with a "command" and a list of
+/// "names":
+///
+///  * enumerate: list the registered records
+///  * get: reply with the named records
+///  * watch: start keeping statistics of the named numeric fields,
+///    for instance "hc_status.state.robot.tip_pitch_deg", over a
+///    rolling window of "window_s" seconds
+///  * unwatch: stop keeping them
+///  * stats: reply with a summary of the named watched fields
 class TelemetryRemoteDebugServer : boost::noncopyable {
  public:
   typedef boost::asio::ip::udp udp;
@@ -34,9 +47,14 @@ class TelemetryRemoteDebugServer : boost::noncopyable {
   struct Parameters {
     int port = 13380;
 
+    /// How often values of watched fields are folded into their
+    /// statistics.
+    double drain_period_s = 0.05;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(port));
+      a->Visit(MJ_NVP(drain_period_s));
     }
   };
 
@@ -61,6 +79,12 @@ class TelemetryRemoteDebugServer : boost::noncopyable {
     /// to the given UDP endpoint.  If a request is still outstanding,
     /// this will be a noop.
     virtual void Respond(const udp::endpoint&) = 0;
+
+    /// Call @p callback with the value of the numeric @p field from
+    /// every new instance.  Return an unconnected connection if there
+    /// is no such field.
+    virtual boost::signals2::connection Watch(
+        const std::string& field, std::function<void (double)> callback) = 0;
   };
 
   template <typename T>
@@ -110,7 +134,8 @@ class TelemetryRemoteDebugServer : boost::noncopyable {
                     const std::string& name,
                     boost::signals2::signal<void (const T*)>* signal)
         : parent_(parent),
-          name_(name) {
+          name_(name),
+          signal_(signal) {
       signal->connect(std::bind(&ConcreteHandler::HandleData, this,
                                 std::placeholders::_1));
     }
@@ -123,10 +148,20 @@ class TelemetryRemoteDebugServer : boost::noncopyable {
                             endpoint);
     }
 
+    virtual boost::signals2::connection Watch(
+        const std::string& field, std::function<void (double)> callback) {
+      const auto reader = FieldReader::Find<T>(field);
+      if (!reader.valid()) { return {}; }
+      return signal_->connect([reader, callback](const T* data) {
+          callback(reader.Read(data));
+        });
+    }
+
     void HandleData(const T* data) { data_ = *data; }
 
     TelemetryRemoteDebugServer* const parent_;
     const std::string name_;
+    boost::signals2::signal<void (const T*)>* const signal_;
     T data_;
   };
 
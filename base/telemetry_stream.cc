@@ -0,0 +1,547 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_stream.h"
+
+#include <algorithm>
+#include <iterator>
+
+#include <boost/assert.hpp>
+
+namespace mjmech {
+namespace base {
+
+namespace {
+using Format = TelemetryStreamFormat;
+
+// Never bother starting a fragment with less than this much room.
+constexpr size_t kMinFragment = 32;
+
+template <typename T>
+void Put(std::string* out, T value) {
+  using U = std::make_unsigned_t<T>;
+  const U u = static_cast<U>(value);
+  for (size_t i = 0; i < sizeof(T); i++) {
+    out->push_back(static_cast<char>((u >> (8 * i)) & 0xff));
+  }
+}
+
+template <typename T>
+void PutAt(std::string* out, size_t offset, T value) {
+  using U = std::make_unsigned_t<T>;
+  const U u = static_cast<U>(value);
+  for (size_t i = 0; i < sizeof(T); i++) {
+    (*out)[offset + i] = static_cast<char>((u >> (8 * i)) & 0xff);
+  }
+}
+
+class Reader {
+ public:
+  Reader(std::string_view data) : data_(data) {}
+
+  template <typename T>
+  bool Read(T* value) {
+    if (data_.size() - offset_ < sizeof(T)) { return false; }
+    using U = std::make_unsigned_t<T>;
+    U u = 0;
+    for (size_t i = 0; i < sizeof(T); i++) {
+      u |= static_cast<U>(static_cast<uint8_t>(data_[offset_ + i])) << (8 * i);
+    }
+    offset_ += sizeof(T);
+    *value = static_cast<T>(u);
+    return true;
+  }
+
+  bool ReadBytes(size_t size, std::string_view* value) {
+    if (data_.size() - offset_ < size) { return false; }
+    *value = data_.substr(offset_, size);
+    offset_ += size;
+    return true;
+  }
+
+  size_t remaining() const { return data_.size() - offset_; }
+
+ private:
+  std::string_view data_;
+  size_t offset_ = 0;
+};
+
+void XorInto(std::string* dest, std::string_view source) {
+  if (dest->size() < source.size()) { dest->resize(source.size(), 0); }
+  for (size_t i = 0; i < source.size(); i++) {
+    (*dest)[i] ^= source[i];
+  }
+}
+}
+
+bool TelemetryStreamFormat::ReadStreamId(
+    std::string_view datagram, uint16_t* stream_id) {
+  Reader reader(datagram);
+  uint8_t version = 0;
+  uint8_t flags = 0;
+  return (reader.Read(&version) &&
+          version == kVersion &&
+          reader.Read(&flags) &&
+          reader.Read(stream_id));
+}
+
+TelemetryStreamEncoder::TelemetryStreamEncoder(
+    const Options& options, EmitHandler emit)
+    : options_(options),
+      emit_(std::move(emit)) {
+  BOOST_ASSERT(options_.max_datagram_size >=
+               Format::kHeaderSize + Format::kChunkHeaderSize + kMinFragment);
+  current_.reserve(options_.max_datagram_size);
+  parity_.reserve(options_.max_datagram_size);
+}
+
+void TelemetryStreamEncoder::WriteSchema(uint16_t identifier,
+                                         std::string_view name,
+                                         std::string_view schema) {
+  std::string data;
+  data.reserve(name.size() + 1 + schema.size());
+  data.append(name.data(), name.size());
+  data.push_back(0);
+  data.append(schema.data(), schema.size());
+  WriteMessage(Format::kSchema, identifier, 0, data);
+}
+
+void TelemetryStreamEncoder::WriteData(uint16_t identifier,
+                                       int64_t timestamp_us,
+                                       std::string_view data) {
+  WriteMessage(Format::kData, identifier, timestamp_us, data);
+}
+
+void TelemetryStreamEncoder::Flush() {
+  if (current_.size() > Format::kHeaderSize) {
+    FinishDatagram();
+  }
+
+  // A partially complete FEC group is closed out as well, so that
+  // receivers are not left waiting for parity that may be a long time
+  // in coming.
+  if (group_count_ > 0) {
+    std::string parity;
+    parity.reserve(Format::kHeaderSize + parity_.size());
+    Put<uint8_t>(&parity, Format::kVersion);
+    Put<uint8_t>(&parity, Format::kFlagParity);
+    Put<uint16_t>(&parity, options_.stream_id);
+    Put<uint32_t>(&parity, sequence_++);
+    Put<uint16_t>(&parity, options_.fec_group_size);
+    Put<uint16_t>(&parity, group_count_);
+    Put<uint16_t>(&parity, parity_size_);
+    parity.append(parity_);
+
+    emit_(parity);
+    stats_.parity_datagrams++;
+
+    parity_.clear();
+    parity_size_ = 0;
+    group_count_ = 0;
+  }
+}
+
+void TelemetryStreamEncoder::WriteMessage(Format::ChunkType type,
+                                          uint16_t identifier,
+                                          int64_t timestamp_us,
+                                          std::string_view data) {
+  const uint32_t message_id = message_id_++;
+  stats_.messages++;
+
+  size_t offset = 0;
+  while (true) {
+    if (current_.empty()) { StartDatagram(); }
+
+    const size_t used = current_.size() + Format::kChunkHeaderSize;
+    const size_t room =
+        used >= options_.max_datagram_size ?
+        0 : options_.max_datagram_size - used;
+    const size_t remaining = data.size() - offset;
+
+    if (room == 0 || (room < remaining && room < kMinFragment)) {
+      FinishDatagram();
+      continue;
+    }
+
+    const size_t to_write = std::min(room, remaining);
+    if (to_write != data.size()) { stats_.fragments++; }
+
+    Put<uint8_t>(&current_, type);
+    Put<uint16_t>(&current_, identifier);
+    Put<uint32_t>(&current_, message_id);
+    Put<uint32_t>(&current_, offset);
+    Put<uint32_t>(&current_, data.size());
+    Put<int64_t>(&current_, timestamp_us);
+    Put<uint16_t>(&current_, to_write);
+    current_.append(data.data() + offset, to_write);
+
+    offset += to_write;
+
+    if (current_.size() + Format::kChunkHeaderSize >=
+        options_.max_datagram_size) {
+      FinishDatagram();
+    }
+
+    if (offset >= data.size()) { break; }
+  }
+}
+
+void TelemetryStreamEncoder::StartDatagram() {
+  current_.assign(Format::kHeaderSize, 0);
+}
+
+void TelemetryStreamEncoder::FinishDatagram() {
+  const size_t payload_size = current_.size() - Format::kHeaderSize;
+  const bool fec = options_.fec_group_size > 0;
+
+  PutAt<uint8_t>(&current_, 0, Format::kVersion);
+  PutAt<uint8_t>(&current_, 1, 0);
+  PutAt<uint16_t>(&current_, 2, options_.stream_id);
+  PutAt<uint32_t>(&current_, 4, sequence_++);
+  PutAt<uint16_t>(&current_, 8, fec ? options_.fec_group_size : 0);
+  PutAt<uint16_t>(&current_, 10, fec ? group_count_ : 0);
+  PutAt<uint16_t>(&current_, 12, payload_size);
+
+  emit_(current_);
+  stats_.datagrams++;
+
+  if (fec) {
+    XorInto(&parity_, std::string_view(current_).substr(Format::kHeaderSize));
+    parity_size_ ^= static_cast<uint16_t>(payload_size);
+    group_count_++;
+  }
+
+  current_.clear();
+
+  if (fec && group_count_ >= options_.fec_group_size) {
+    Flush();
+  }
+}
+
+TelemetryStreamDecoder::TelemetryStreamDecoder(
+    SchemaHandler schema_handler, DataHandler data_handler)
+    : TelemetryStreamDecoder(std::move(schema_handler),
+                             std::move(data_handler), Options()) {}
+
+TelemetryStreamDecoder::TelemetryStreamDecoder(
+    SchemaHandler schema_handler, DataHandler data_handler,
+    const Options& options)
+    : schema_handler_(std::move(schema_handler)),
+      data_handler_(std::move(data_handler)),
+      options_(options) {}
+
+const TelemetryStreamDecoder::Record*
+TelemetryStreamDecoder::record(uint16_t identifier) const {
+  const auto it = records_.find(identifier);
+  if (it == records_.end()) { return nullptr; }
+  return &it->second;
+}
+
+void TelemetryStreamDecoder::Process(std::string_view datagram) {
+  Reader reader(datagram);
+
+  uint8_t version = 0;
+  Header header;
+  if (!reader.Read(&version) ||
+      version != Format::kVersion ||
+      !reader.Read(&header.flags) ||
+      !reader.Read(&header.stream_id) ||
+      !reader.Read(&header.sequence) ||
+      !reader.Read(&header.fec_group_size) ||
+      !reader.Read(&header.fec_index) ||
+      !reader.Read(&header.payload_size)) {
+    stats_.malformed++;
+    return;
+  }
+
+  stats_.datagrams++;
+
+  if (have_sequence_) {
+    const int32_t delta =
+        static_cast<int32_t>(header.sequence - next_sequence_);
+    if (delta >= 0) {
+      stats_.lost += delta;
+      next_sequence_ = header.sequence + 1;
+    } else if (static_cast<uint32_t>(-static_cast<int64_t>(delta)) >
+               options_.restart_threshold) {
+      // The sender started over.  Anything still pending belongs to
+      // its previous incarnation, and would otherwise shadow the new
+      // groups and message ids.
+      Reset();
+    }
+  }
+
+  if (!have_sequence_) {
+    have_sequence_ = true;
+    next_sequence_ = header.sequence + 1;
+  }
+
+  const auto payload = datagram.substr(Format::kHeaderSize);
+
+  if (header.fec_group_size == 0) {
+    if (header.flags & Format::kFlagParity) {
+      stats_.malformed++;
+      return;
+    }
+    ProcessPayload(payload);
+    return;
+  }
+
+  ProcessGroup(header, payload);
+}
+
+void TelemetryStreamDecoder::Reset() {
+  stats_.restarts++;
+  stats_.incomplete += partial_.size();
+  groups_.clear();
+  partial_.clear();
+  have_sequence_ = false;
+}
+
+void TelemetryStreamDecoder::ProcessGroup(const Header& header,
+                                          std::string_view payload) {
+  const uint32_t group_start = header.sequence - header.fec_index;
+  auto it = groups_.find(group_start);
+  if (it == groups_.end()) {
+    it = groups_.insert(std::make_pair(group_start, Group())).first;
+    while (groups_.size() > options_.max_groups) {
+      // Compare by serial number age, so that the sequence number
+      // wrapping does not make the newest group look like the oldest.
+      auto oldest = groups_.begin();
+      for (auto search = groups_.begin(); search != groups_.end(); ++search) {
+        if (static_cast<int32_t>(search->first - oldest->first) < 0) {
+          oldest = search;
+        }
+      }
+      groups_.erase(oldest);
+    }
+    it = groups_.find(group_start);
+    if (it == groups_.end()) {
+      // This was so old that it was immediately discarded.
+      return;
+    }
+  }
+
+  Group& group = it->second;
+
+  if (header.flags & Format::kFlagParity) {
+    if (group.have_parity) {
+      stats_.duplicate++;
+      return;
+    }
+    group.have_parity = true;
+    group.size = header.fec_index;
+    group.parity = std::string(payload);
+    group.parity_size = header.payload_size;
+    if (group.payloads.size() < group.size) {
+      group.payloads.resize(group.size);
+      group.present.resize(group.size, false);
+    }
+  } else {
+    if (group.payloads.size() <= header.fec_index) {
+      group.payloads.resize(header.fec_index + 1);
+      group.present.resize(header.fec_index + 1, false);
+    }
+    if (group.present[header.fec_index]) {
+      stats_.duplicate++;
+      return;
+    }
+    group.present[header.fec_index] = true;
+    if (!group.finished) {
+      group.payloads[header.fec_index] = std::string(payload);
+    }
+    ProcessPayload(payload);
+  }
+
+  MaybeRecover(group_start, &group);
+}
+
+void TelemetryStreamDecoder::MaybeRecover(uint32_t, Group* group) {
+  if (!group->have_parity || group->finished) { return; }
+
+  int missing = 0;
+  size_t missing_index = 0;
+  for (size_t i = 0; i < group->size; i++) {
+    if (!group->present[i]) {
+      missing++;
+      missing_index = i;
+    }
+  }
+
+  if (missing > 1) { return; }
+
+  group->finished = true;
+
+  if (missing == 1) {
+    std::string recovered = group->parity;
+    uint16_t size = group->parity_size;
+    for (size_t i = 0; i < group->size; i++) {
+      if (i == missing_index) { continue; }
+      XorInto(&recovered, group->payloads[i]);
+      size ^= static_cast<uint16_t>(group->payloads[i].size());
+    }
+    if (size <= recovered.size()) {
+      recovered.resize(size);
+      group->present[missing_index] = true;
+      stats_.recovered++;
+      ProcessPayload(recovered);
+    } else {
+      stats_.malformed++;
+    }
+  }
+
+  // Nothing more can be done with this group, so release its memory.
+  group->payloads.clear();
+  group->parity.clear();
+}
+
+void TelemetryStreamDecoder::ProcessPayload(std::string_view payload) {
+  Reader reader(payload);
+
+  while (reader.remaining() > 0) {
+    uint8_t type = 0;
+    uint16_t identifier = 0;
+    uint32_t message_id = 0;
+    uint32_t offset = 0;
+    uint32_t total_size = 0;
+    int64_t timestamp_us = 0;
+    uint16_t size = 0;
+    std::string_view data;
+
+    if (!reader.Read(&type) ||
+        !reader.Read(&identifier) ||
+        !reader.Read(&message_id) ||
+        !reader.Read(&offset) ||
+        !reader.Read(&total_size) ||
+        !reader.Read(&timestamp_us) ||
+        !reader.Read(&size) ||
+        !reader.ReadBytes(size, &data)) {
+      stats_.malformed++;
+      return;
+    }
+
+    if (!ProcessChunk(type, identifier, message_id, offset, total_size,
+                      timestamp_us, data)) {
+      stats_.malformed++;
+      return;
+    }
+  }
+}
+
+bool TelemetryStreamDecoder::ProcessChunk(
+    uint8_t type, uint16_t identifier, uint32_t message_id,
+    uint32_t offset, uint32_t total_size,
+    int64_t timestamp_us, std::string_view data) {
+  if (total_size > options_.max_message_size) { return false; }
+  if (static_cast<uint64_t>(offset) + data.size() > total_size) {
+    return false;
+  }
+
+  if (offset == 0 && data.size() == total_size) {
+    Deliver(type, identifier, timestamp_us, data);
+    return true;
+  }
+
+  const auto key = std::make_pair(identifier, message_id);
+  auto it = partial_.find(key);
+  if (it == partial_.end()) {
+    if (partial_.size() >= options_.max_partial) {
+      // Discard the oldest message we have been waiting on.
+      auto oldest = partial_.begin();
+      for (auto search = partial_.begin(); search != partial_.end(); ++search) {
+        if (static_cast<int32_t>(search->first.second -
+                                 oldest->first.second) < 0) {
+          oldest = search;
+        }
+      }
+      partial_.erase(oldest);
+      stats_.incomplete++;
+    }
+    Partial partial;
+    partial.data.resize(total_size);
+    partial.remaining = total_size;
+    it = partial_.insert(std::make_pair(key, std::move(partial))).first;
+  }
+
+  Partial& partial = it->second;
+  if (partial.data.size() != total_size || data.size() > partial.remaining) {
+    partial_.erase(it);
+    return false;
+  }
+
+  // A fragment which overlaps one we already have is a duplicate.
+  // Counting it again would complete the message with a hole in it.
+  const uint32_t end = offset + data.size();
+  auto next = partial.received.lower_bound(offset);
+  if ((next != partial.received.end() && next->first < end) ||
+      (next != partial.received.begin() && std::prev(next)->second > offset)) {
+    stats_.duplicate++;
+    return true;
+  }
+  partial.received.insert(std::make_pair(offset, end));
+
+  std::copy(data.begin(), data.end(), partial.data.begin() + offset);
+  partial.remaining -= data.size();
+
+  if (partial.remaining == 0) {
+    const std::string complete = std::move(partial.data);
+    partial_.erase(it);
+    Deliver(type, identifier, timestamp_us, complete);
+  }
+
+  return true;
+}
+
+void TelemetryStreamDecoder::Deliver(uint8_t type, uint16_t identifier,
+                                     int64_t timestamp_us,
+                                     std::string_view data) {
+  stats_.messages++;
+
+  if (type == Format::kSchema) {
+    const auto nul = data.find('\0');
+    if (nul == std::string_view::npos) {
+      stats_.malformed++;
+      return;
+    }
+    const auto name = data.substr(0, nul);
+    const auto schema = data.substr(nul + 1);
+
+    auto& record = records_[identifier];
+    if (record.name == name && record.schema == schema) {
+      // This is just the periodic re-transmission.
+      return;
+    }
+    record.identifier = identifier;
+    record.name = std::string(name);
+    record.schema = std::string(schema);
+    if (schema_handler_) { schema_handler_(record); }
+    return;
+  }
+
+  if (type != Format::kData) {
+    stats_.malformed++;
+    return;
+  }
+
+  const auto it = records_.find(identifier);
+  if (it == records_.end()) {
+    stats_.unknown_record++;
+    return;
+  }
+
+  if (data_handler_) { data_handler_(it->second, timestamp_us, data); }
+}
+
+}
+}
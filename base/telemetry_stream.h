@@ -0,0 +1,247 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace mjmech {
+namespace base {
+
+/// The datagram format used to stream telemetry records over a lossy
+/// link, like UDP multicast.
+///
+/// Each datagram consists of a fixed header followed by zero or more
+/// chunks.  A chunk carries either the schema for a record, or some
+/// or all of one serialized instance of a record.  Records which do
+/// not fit in a single datagram are fragmented across several.
+///
+/// Optionally, every 'fec_group_size' data datagrams are followed by
+/// a parity datagram that is the XOR of all of them.  This allows a
+/// receiver to recover any single lost datagram from a group without
+/// a retransmission.
+///
+/// The sender keeps no per-receiver state.  Schemas are re-sent
+/// periodically so that a receiver may join at any time.
+///
+/// All integers are little endian.
+///
+///  Datagram header:
+///   u8  version
+///   u8  flags (bit 0: parity datagram)
+///   u16 stream_id
+///   u32 sequence
+///   u16 fec_group_size (0 if no FEC is in use)
+///   u16 fec_index (position within the group, for parity the data count)
+///   u16 payload_size (for parity, XOR of all payload sizes in the group)
+///
+///  Chunk header:
+///   u8  type (0 = schema, 1 = data)
+///   u16 identifier
+///   u32 message_id
+///   u32 offset (of this fragment within the complete message)
+///   u32 total_size (of the complete message)
+///   i64 timestamp_us
+///   u16 size (of this fragment)
+///
+///  Schema chunk contents are the record name, a NUL, then the schema.
+struct TelemetryStreamFormat {
+  static constexpr uint8_t kVersion = 1;
+  static constexpr uint8_t kFlagParity = 0x01;
+
+  static constexpr size_t kHeaderSize = 14;
+  static constexpr size_t kChunkHeaderSize = 25;
+
+  enum ChunkType : uint8_t {
+    kSchema = 0,
+    kData = 1,
+  };
+
+  /// Extract the stream_id from a datagram without decoding it.
+  /// Return false if this is not a valid datagram.
+  static bool ReadStreamId(std::string_view datagram, uint16_t* stream_id);
+};
+
+class TelemetryStreamEncoder {
+ public:
+  struct Options {
+    uint16_t stream_id = 0;
+
+    /// The maximum size of any emitted datagram.  This should be set
+    /// from UdpDataLink::get_max_data_size().
+    size_t max_datagram_size = 1372;
+
+    /// If non-zero, emit a parity datagram after every this many data
+    /// datagrams.
+    int fec_group_size = 0;
+  };
+
+  using EmitHandler = std::function<void (std::string_view)>;
+
+  TelemetryStreamEncoder(const Options&, EmitHandler);
+
+  void WriteSchema(uint16_t identifier,
+                   std::string_view name,
+                   std::string_view schema);
+
+  void WriteData(uint16_t identifier,
+                 int64_t timestamp_us,
+                 std::string_view data);
+
+  /// Emit any partially filled datagram.
+  void Flush();
+
+  struct Stats {
+    uint64_t datagrams = 0;
+    uint64_t parity_datagrams = 0;
+    uint64_t messages = 0;
+    uint64_t fragments = 0;
+  };
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  void WriteMessage(TelemetryStreamFormat::ChunkType,
+                    uint16_t identifier,
+                    int64_t timestamp_us,
+                    std::string_view data);
+  void StartDatagram();
+  void FinishDatagram();
+
+  const Options options_;
+  EmitHandler emit_;
+
+  std::string current_;
+  std::string parity_;
+  uint16_t parity_size_ = 0;
+  int group_count_ = 0;
+
+  uint32_t sequence_ = 0;
+  uint32_t message_id_ = 0;
+
+  Stats stats_;
+};
+
+class TelemetryStreamDecoder {
+ public:
+  struct Options {
+    /// How many FEC groups to keep around waiting for late or
+    /// recovered datagrams.
+    size_t max_groups = 8;
+
+    /// How many partially reassembled records to keep.
+    size_t max_partial = 32;
+
+    /// Chunks claiming a complete message larger than this are
+    /// discarded as malformed, rather than reserving space for it.
+    size_t max_message_size = 1 << 20;
+
+    /// A datagram whose sequence number is at least this far behind
+    /// the newest one seen is taken to mean the sender restarted, and
+    /// all pending state is discarded.
+    uint32_t restart_threshold = 1024;
+  };
+
+  struct Record {
+    uint16_t identifier = 0;
+    std::string name;
+    std::string schema;
+  };
+
+  using SchemaHandler = std::function<void (const Record&)>;
+  using DataHandler = std::function<
+    void (const Record&, int64_t timestamp_us, std::string_view data)>;
+
+  TelemetryStreamDecoder(SchemaHandler, DataHandler);
+  TelemetryStreamDecoder(SchemaHandler, DataHandler, const Options&);
+
+  /// Process one received datagram.  Malformed datagrams are counted
+  /// and discarded.
+  void Process(std::string_view datagram);
+
+  const Record* record(uint16_t identifier) const;
+
+  struct Stats {
+    uint64_t datagrams = 0;
+    uint64_t malformed = 0;
+    uint64_t lost = 0;
+    uint64_t recovered = 0;
+    uint64_t duplicate = 0;
+    uint64_t messages = 0;
+    uint64_t incomplete = 0;
+    uint64_t unknown_record = 0;
+    uint64_t restarts = 0;
+  };
+
+  const Stats& stats() const { return stats_; }
+
+ private:
+  struct Header {
+    uint8_t flags = 0;
+    uint16_t stream_id = 0;
+    uint32_t sequence = 0;
+    uint16_t fec_group_size = 0;
+    uint16_t fec_index = 0;
+    uint16_t payload_size = 0;
+  };
+
+  struct Group {
+    uint16_t size = 0;
+    std::vector<std::string> payloads;
+    std::vector<bool> present;
+    std::string parity;
+    uint16_t parity_size = 0;
+    bool have_parity = false;
+    bool finished = false;
+  };
+
+  struct Partial {
+    std::string data;
+    size_t remaining = 0;
+
+    /// The byte ranges received so far, as start -> end.
+    std::map<uint32_t, uint32_t> received;
+  };
+
+  void Reset();
+  void ProcessGroup(const Header&, std::string_view payload);
+  void MaybeRecover(uint32_t group_start, Group*);
+  void ProcessPayload(std::string_view payload);
+  bool ProcessChunk(uint8_t type, uint16_t identifier, uint32_t message_id,
+                    uint32_t offset, uint32_t total_size,
+                    int64_t timestamp_us, std::string_view data);
+  void Deliver(uint8_t type, uint16_t identifier,
+               int64_t timestamp_us, std::string_view data);
+
+  SchemaHandler schema_handler_;
+  DataHandler data_handler_;
+  const Options options_;
+
+  std::map<uint16_t, Record> records_;
+  std::map<uint32_t, Group> groups_;
+  std::map<std::pair<uint16_t, uint32_t>, Partial> partial_;
+
+  bool have_sequence_ = false;
+  uint32_t next_sequence_ = 0;
+
+  Stats stats_;
+};
+
+}
+}
@@ -0,0 +1,174 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_stream_publisher.h"
+
+#include <set>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/asio/post.hpp>
+
+#include "mjlib/base/fail.h"
+#include "mjlib/io/now.h"
+#include "mjlib/io/repeating_timer.h"
+
+#include "base/common.h"
+#include "base/logging.h"
+#include "base/telemetry_stream.h"
+#include "base/udp_data_link.h"
+
+namespace mjmech {
+namespace base {
+
+class TelemetryStreamPublisher::Impl {
+ public:
+  Impl(const boost::asio::any_io_executor& executor)
+      : executor_(executor),
+        schema_timer_(executor),
+        flush_timer_(executor) {}
+
+  void Start() {
+    if (parameters_.dest.empty()) { return; }
+
+    std::vector<std::string> names;
+    boost::split(names, parameters_.records, boost::is_any_of(","));
+    for (const auto& name : names) {
+      if (!name.empty()) { selected_.insert(name); }
+    }
+
+    for (auto& record : records_) {
+      record.enabled = IsSelected(record.name);
+    }
+
+    UdpDataLink::Parameters link_params;
+    // We only send, so disable the automatic multicast listen.
+    link_params.source = ":";
+    link_params.dest = parameters_.dest;
+    link_params.link_mtu = parameters_.link_mtu;
+    link_params.socket_params = parameters_.socket_params;
+    link_ = std::make_unique<UdpDataLink>(executor_, log_, link_params);
+
+    encoder_ = std::make_unique<TelemetryStreamEncoder>(
+        [&]() {
+          TelemetryStreamEncoder::Options options;
+          options.stream_id = parameters_.stream_id;
+          options.max_datagram_size = link_->get_max_data_size();
+          options.fec_group_size = parameters_.fec_group_size;
+          return options;
+        }(),
+        [this](std::string_view datagram) {
+          link_->Send(std::string(datagram));
+        });
+
+    SendSchemas();
+
+    schema_timer_.start(
+        ConvertSecondsToDuration(parameters_.schema_period_s),
+        [this](auto&& ec) {
+          mjlib::base::FailIf(ec);
+          SendSchemas();
+        });
+    flush_timer_.start(
+        ConvertSecondsToDuration(parameters_.flush_period_s),
+        [this](auto&& ec) {
+          mjlib::base::FailIf(ec);
+          encoder_->Flush();
+        });
+  }
+
+  bool IsSelected(const std::string& name) const {
+    return selected_.empty() || selected_.count(name) != 0;
+  }
+
+  /// Records may be registered after Start, for instance by lazily
+  /// started components.
+  int Add(const std::string& name, const std::string& schema) {
+    const int result = records_.size();
+    const bool enabled = encoder_ && IsSelected(name);
+    records_.push_back({name, schema, enabled});
+    if (enabled) {
+      // Receivers should not have to wait for the next schema period.
+      encoder_->WriteSchema(result, name, schema);
+    }
+    return result;
+  }
+
+  void SendSchemas() {
+    for (size_t i = 0; i < records_.size(); i++) {
+      const auto& record = records_[i];
+      if (!record.enabled) { continue; }
+      encoder_->WriteSchema(i, record.name, record.schema);
+    }
+  }
+
+  struct Record {
+    std::string name;
+    std::string schema;
+    bool enabled = false;
+  };
+
+  boost::asio::any_io_executor executor_;
+  Parameters parameters_;
+  LogRef log_ = GetLogInstance("TelemetryStreamPublisher");
+
+  std::vector<Record> records_;
+
+  // Empty means every record.  This is only valid after Start.
+  std::set<std::string> selected_;
+
+  std::unique_ptr<UdpDataLink> link_;
+  std::unique_ptr<TelemetryStreamEncoder> encoder_;
+
+  mjlib::io::RepeatingTimer schema_timer_;
+  mjlib::io::RepeatingTimer flush_timer_;
+};
+
+TelemetryStreamPublisher::TelemetryStreamPublisher(
+    const boost::asio::any_io_executor& executor)
+    : impl_(std::make_unique<Impl>(executor)) {}
+
+TelemetryStreamPublisher::~TelemetryStreamPublisher() {}
+
+TelemetryStreamPublisher::Parameters* TelemetryStreamPublisher::parameters() {
+  return &impl_->parameters_;
+}
+
+void TelemetryStreamPublisher::AsyncStart(mjlib::io::ErrorCallback handler) {
+  impl_->Start();
+
+  boost::asio::post(
+      impl_->executor_,
+      std::bind(std::move(handler), mjlib::base::error_code()));
+}
+
+int TelemetryStreamPublisher::AllocateIdentifier(
+    const std::string& name, const std::string& schema) {
+  return impl_->Add(name, schema);
+}
+
+bool TelemetryStreamPublisher::IsEnabled(int identifier) const {
+  return impl_->encoder_ && impl_->records_[identifier].enabled;
+}
+
+void TelemetryStreamPublisher::WriteData(
+    int identifier, const std::string& data) {
+  impl_->encoder_->WriteData(
+      identifier,
+      ConvertPtimeToMicroseconds(mjlib::io::Now(impl_->executor_.context())),
+      data);
+}
+
+}
+}
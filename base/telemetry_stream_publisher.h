@@ -0,0 +1,115 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/signals2/signal.hpp>
+
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+#include "mjlib/telemetry/binary_schema_archive.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+#include "base/udp_socket.h"
+
+namespace mjmech {
+namespace base {
+
+/// Streams registered telemetry records over UDP, usually to a
+/// multicast group, using the TelemetryStreamFormat.
+///
+/// No per-receiver state is kept, so the cost on the robot is the
+/// same regardless of how many ground stations are listening.
+class TelemetryStreamPublisher : boost::noncopyable {
+ public:
+  TelemetryStreamPublisher(const boost::asio::any_io_executor&);
+  ~TelemetryStreamPublisher();
+
+  struct Parameters {
+    /// Where to send datagrams (IP:PORT).  If empty, the publisher is
+    /// disabled and records are not even serialized.
+    std::string dest;
+
+    /// A comma separated list of record names to publish.  If empty,
+    /// all records are published.
+    std::string records;
+
+    int stream_id = 0;
+
+    /// If non-zero, emit one XOR parity datagram for every this many
+    /// data datagrams.
+    int fec_group_size = 4;
+
+    /// How often to re-send all schemas, so that receivers can join
+    /// at any time.
+    double schema_period_s = 1.0;
+
+    /// Partially filled datagrams are sent at least this often.
+    double flush_period_s = 0.01;
+
+    int link_mtu = 1400;
+
+    UdpSocket::Parameters socket_params;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(dest));
+      a->Visit(MJ_NVP(records));
+      a->Visit(MJ_NVP(stream_id));
+      a->Visit(MJ_NVP(fec_group_size));
+      a->Visit(MJ_NVP(schema_period_s));
+      a->Visit(MJ_NVP(flush_period_s));
+      a->Visit(MJ_NVP(link_mtu));
+      socket_params.Serialize(a);
+    }
+  };
+
+  Parameters* parameters();
+
+  void AsyncStart(mjlib::io::ErrorCallback handler);
+
+  template <typename T>
+  void Register(const std::string& name,
+                boost::signals2::signal<void (const T*)>* signal) {
+    const int identifier = AllocateIdentifier(
+        name, mjlib::telemetry::BinarySchemaArchive::template schema<T>());
+    signal->connect([this, identifier](const T* data) {
+        // Don't even bother serializing if nobody wants this.
+        if (!IsEnabled(identifier)) { return; }
+
+        buffer_.clear();
+        mjlib::telemetry::BinaryWriteArchive(buffer_).Accept(data);
+        WriteData(identifier, buffer_.str());
+      });
+  }
+
+ private:
+  int AllocateIdentifier(const std::string& name, const std::string& schema);
+  bool IsEnabled(int identifier) const;
+  void WriteData(int identifier, const std::string& data);
+
+  mjlib::base::FastOStringStream buffer_;
+
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,120 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_stream_receiver.h"
+
+#include <map>
+
+#include <fmt/format.h>
+
+#include "base/logging.h"
+#include "base/udp_data_link.h"
+
+namespace mjmech {
+namespace base {
+
+class TelemetryStreamReceiver::Impl {
+ public:
+  Impl(const boost::asio::any_io_executor& executor,
+       const Parameters& parameters)
+      : link_(executor, log_, [&]() {
+          UdpDataLink::Parameters link_params;
+          link_params.source = parameters.source;
+          // We never reply.
+          link_params.dest = ":";
+          link_params.socket_params = parameters.socket_params;
+          return link_params;
+        }()) {
+    link_.data_signal()->connect(
+        std::bind(&Impl::HandleData, this,
+                  std::placeholders::_1, std::placeholders::_2));
+  }
+
+  void HandleData(const std::string& data, const UdpDataLink::PeerInfo& peer) {
+    uint16_t stream_id = 0;
+    if (!TelemetryStreamFormat::ReadStreamId(data, &stream_id)) {
+      malformed_++;
+      return;
+    }
+
+    const auto key = std::make_pair(peer.name, stream_id);
+    auto it = decoders_.find(key);
+    if (it == decoders_.end()) {
+      log_.info(fmt::format("new stream {} from {}", stream_id, peer.name));
+
+      Source source;
+      source.peer = peer.name;
+      source.stream_id = stream_id;
+
+      it = decoders_.emplace(
+          key,
+          std::make_unique<TelemetryStreamDecoder>(
+              [this, source](const Record& record) {
+                schema_signal_(source, record);
+              },
+              [this, source](const Record& record, int64_t timestamp_us,
+                             std::string_view data) {
+                data_signal_(source, record, timestamp_us, data);
+              })).first;
+    }
+
+    it->second->Process(data);
+  }
+
+  LogRef log_ = GetLogInstance("TelemetryStreamReceiver");
+  UdpDataLink link_;
+
+  std::map<std::pair<std::string, uint16_t>,
+           std::unique_ptr<TelemetryStreamDecoder>> decoders_;
+  uint64_t malformed_ = 0;
+
+  SchemaSignal schema_signal_;
+  DataSignal data_signal_;
+};
+
+TelemetryStreamReceiver::TelemetryStreamReceiver(
+    const boost::asio::any_io_executor& executor,
+    const Parameters& parameters)
+    : impl_(std::make_unique<Impl>(executor, parameters)) {}
+
+TelemetryStreamReceiver::~TelemetryStreamReceiver() {}
+
+TelemetryStreamReceiver::SchemaSignal*
+TelemetryStreamReceiver::schema_signal() {
+  return &impl_->schema_signal_;
+}
+
+TelemetryStreamReceiver::DataSignal* TelemetryStreamReceiver::data_signal() {
+  return &impl_->data_signal_;
+}
+
+TelemetryStreamDecoder::Stats TelemetryStreamReceiver::stats() const {
+  TelemetryStreamDecoder::Stats result;
+  result.malformed = impl_->malformed_;
+  for (const auto& pair : impl_->decoders_) {
+    const auto& stats = pair.second->stats();
+    result.datagrams += stats.datagrams;
+    result.malformed += stats.malformed;
+    result.lost += stats.lost;
+    result.recovered += stats.recovered;
+    result.duplicate += stats.duplicate;
+    result.messages += stats.messages;
+    result.incomplete += stats.incomplete;
+    result.unknown_record += stats.unknown_record;
+  }
+  return result;
+}
+
+}
+}
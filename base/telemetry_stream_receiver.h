@@ -0,0 +1,83 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+#include <string_view>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/signals2/signal.hpp>
+
+#include "mjlib/base/visitor.h"
+
+#include "base/telemetry_stream.h"
+#include "base/udp_socket.h"
+
+namespace mjmech {
+namespace base {
+
+/// Listens for datagrams from one or more TelemetryStreamPublishers
+/// and emits the reassembled schemas and records.
+///
+/// Each (sender, stream_id) pair is decoded independently.
+class TelemetryStreamReceiver : boost::noncopyable {
+ public:
+  struct Parameters {
+    /// Where to listen (IP:PORT or :PORT).  A multicast address
+    /// subscribes to that group.
+    std::string source;
+
+    UdpSocket::Parameters socket_params;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(source));
+      socket_params.Serialize(a);
+    }
+  };
+
+  TelemetryStreamReceiver(const boost::asio::any_io_executor&,
+                          const Parameters&);
+  ~TelemetryStreamReceiver();
+
+  struct Source {
+    /// The address of the sender.
+    std::string peer;
+    uint16_t stream_id = 0;
+  };
+
+  using Record = TelemetryStreamDecoder::Record;
+
+  using SchemaSignal = boost::signals2::signal<
+    void (const Source&, const Record&)>;
+  using DataSignal = boost::signals2::signal<
+    void (const Source&, const Record&,
+          int64_t timestamp_us, std::string_view data)>;
+
+  SchemaSignal* schema_signal();
+  DataSignal* data_signal();
+
+  /// Return the statistics of all decoders summed together.
+  TelemetryStreamDecoder::Stats stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,42 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <boost/signals2/signal.hpp>
+
+#include "base/telemetry_stream_publisher.h"
+
+namespace mjmech {
+namespace base {
+
+/// A registrar which streams records over the network to any number
+/// of listening ground stations.  This is a pass-through to the
+/// non-copyable TelemetryStreamPublisher.
+class TelemetryStreamRegistrar {
+ public:
+  TelemetryStreamRegistrar(TelemetryStreamPublisher* publisher)
+      : publisher_(publisher) {}
+
+  template <typename T>
+  void Register(const std::string& name,
+                boost::signals2::signal<void (const T*)>* signal) {
+    if (publisher_ == nullptr) { return; }
+    publisher_->Register(name, signal);
+  }
+
+  TelemetryStreamPublisher* const publisher_;
+};
+}
+}
@@ -0,0 +1,142 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// Compare BiquadFilterBank against filtering each channel separately
+/// with scalar code, recomputing the one pole coefficient every cycle
+/// as the control loop used to, and against the single precision
+/// bank.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "base/biquad_filter.h"
+
+namespace {
+using namespace mjmech;
+
+struct Options {
+  int channels = 6;
+  int samples = 1000000;
+  double rate_hz = 400.0;
+};
+
+template <typename Functor>
+double Measure(const Options& options, Functor f) {
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < options.samples; i++) { f(i); }
+  const auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      options.samples;
+}
+
+int work(int argc, char** argv) {
+  Options options;
+
+  auto group = clipp::group(
+      (clipp::option("channels") & clipp::value("", options.channels)),
+      (clipp::option("samples") & clipp::value("", options.samples)),
+      (clipp::option("rate") & clipp::value("", options.rate_hz)));
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  std::mt19937 rng(0);
+  std::normal_distribution<double> dist;
+
+  const int kInputs = 1024;
+  std::vector<double> inputs(kInputs * options.channels);
+  for (auto& value : inputs) { value = dist(rng); }
+  const std::vector<float> inputsf(inputs.begin(), inputs.end());
+
+  base::FilterConfig config;
+  config.half_life_s = 0.1;
+  config.lowpass_hz = 20.0;
+  const double period_s = 1.0 / options.rate_hz;
+
+  std::vector<double> output(options.channels);
+  double sink = 0.0;
+
+  // The scalar version: a one pole filter with its coefficient
+  // recomputed every cycle, followed by a direct form I biquad.
+  struct State {
+    double y = 0.0;
+    double x1 = 0.0;
+    double x2 = 0.0;
+    double y1 = 0.0;
+    double y2 = 0.0;
+  };
+  std::vector<State> states(options.channels);
+
+  const double scalar_ns = Measure(options, [&](int i) {
+      const double* in = &inputs[(i % kInputs) * options.channels];
+      for (int c = 0; c < options.channels; c++) {
+        auto& s = states[c];
+        const double alpha = std::pow(0.5, period_s / config.half_life_s);
+        s.y = alpha * s.y + (1.0 - alpha) * in[c];
+
+        const auto b = base::Biquad::LowPass(
+            config.lowpass_hz, config.lowpass_q, options.rate_hz);
+        const double y = b.b0 * s.y + b.b1 * s.x1 + b.b2 * s.x2 -
+            b.a1 * s.y1 - b.a2 * s.y2;
+        s.x2 = s.x1;
+        s.x1 = s.y;
+        s.y2 = s.y1;
+        s.y1 = y;
+        output[c] = y;
+      }
+      sink += output[0];
+    });
+
+  base::BiquadFilterBank bank(
+      std::vector<std::vector<base::Biquad>>(
+          options.channels, config.Design(options.rate_hz)));
+
+  const double bank_ns = Measure(options, [&](int i) {
+      bank.Process(&inputs[(i % kInputs) * options.channels], output.data());
+      sink += output[0];
+    });
+
+  base::BiquadFilterBankf bankf(
+      std::vector<std::vector<base::Biquad>>(
+          options.channels, config.Design(options.rate_hz)));
+  std::vector<float> outputf(options.channels);
+
+  const double bankf_ns = Measure(options, [&](int i) {
+      bankf.Process(&inputsf[(i % kInputs) * options.channels],
+                    outputf.data());
+      sink += outputf[0];
+    });
+
+  std::cout << fmt::format(
+      "{} channels: scalar {:7.2f} ns  bank {:7.2f} ns  speedup {:5.2f}x"
+      "  float bank {:7.2f} ns  speedup {:5.2f}x  ({})\n",
+      options.channels, scalar_ns, bank_ns, scalar_ns / bank_ns,
+      bankf_ns, scalar_ns / bankf_ns, sink);
+
+  return 0;
+}
+}
+
+int main(int argc, char** argv) {
+  return work(argc, argv);
+}
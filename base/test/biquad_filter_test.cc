@@ -0,0 +1,238 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/biquad_filter.h"
+
+#include <cmath>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::base;
+
+namespace {
+constexpr double kRate = 400.0;
+
+/// A direct form I implementation to compare against.
+class Reference {
+ public:
+  Reference(const std::vector<Biquad>& sections)
+      : sections_(sections), state_(sections.size()) {}
+
+  double operator()(double x) {
+    for (size_t i = 0; i < sections_.size(); i++) {
+      const auto& b = sections_[i];
+      auto& s = state_[i];
+      const double y =
+          b.b0 * x + b.b1 * s.x1 + b.b2 * s.x2 - b.a1 * s.y1 - b.a2 * s.y2;
+      s.x2 = s.x1;
+      s.x1 = x;
+      s.y2 = s.y1;
+      s.y1 = y;
+      x = y;
+    }
+    return x;
+  }
+
+ private:
+  struct State {
+    double x1 = 0.0;
+    double x2 = 0.0;
+    double y1 = 0.0;
+    double y2 = 0.0;
+  };
+
+  std::vector<Biquad> sections_;
+  std::vector<State> state_;
+};
+
+/// Return the amplitude of the steady state response to a sine.
+double Gain(const std::vector<Biquad>& sections, double hz) {
+  BiquadFilterBank bank({sections});
+  double peak = 0.0;
+  const int kSamples = kRate * 5;
+  for (int i = 0; i < kSamples; i++) {
+    const double x = std::sin(2.0 * M_PI * hz * i / kRate);
+    double y = 0.0;
+    bank.Process(&x, &y);
+    if (i > kSamples / 2) { peak = std::max(peak, std::abs(y)); }
+  }
+  return peak;
+}
+}
+
+BOOST_AUTO_TEST_CASE(BiquadOnePoleMatchesExponential) {
+  const double kHalfLife = 0.1;
+  BiquadFilterBank bank({{Biquad::OnePole(kHalfLife, kRate)}});
+
+  const double alpha = std::pow(0.5, (1.0 / kRate) / kHalfLife);
+  double expected = 0.0;
+  for (int i = 0; i < 100; i++) {
+    const double x = (i % 7) - 3.0;
+    expected = alpha * expected + (1.0 - alpha) * x;
+    double y = 0.0;
+    bank.Process(&x, &y);
+    BOOST_TEST(std::abs(y - expected) < 1e-12);
+  }
+
+  // After one half life, a step is half complete.
+  bank.Reset(0, 0.0);
+  double y = 0.0;
+  for (int i = 0; i < kHalfLife * kRate; i++) {
+    const double x = 1.0;
+    bank.Process(&x, &y);
+  }
+  BOOST_TEST(std::abs(y - 0.5) < 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(BiquadResponse) {
+  const auto lowpass = Biquad::LowPass(10.0, 0.7071, kRate);
+  BOOST_TEST(std::abs(lowpass.dc_gain() - 1.0) < 1e-12);
+  BOOST_TEST(std::abs(Gain({lowpass}, 1.0) - 1.0) < 0.01);
+  BOOST_TEST(std::abs(Gain({lowpass}, 10.0) - M_SQRT1_2) < 0.01);
+  BOOST_TEST(Gain({lowpass}, 100.0) < 0.02);
+
+  const auto notch = Biquad::Notch(50.0, 2.0, kRate);
+  BOOST_TEST(std::abs(notch.dc_gain() - 1.0) < 1e-12);
+  BOOST_TEST(Gain({notch}, 50.0) < 0.01);
+  BOOST_TEST(Gain({notch}, 5.0) > 0.98);
+
+  // The derivative of a ramp is its slope.
+  BiquadFilterBank bank({{Biquad::Derivative(kRate)}});
+  bank.Reset(0, 0.0);
+  for (int i = 1; i < 10; i++) {
+    const double x = 3.0 * i / kRate;
+    double y = 0.0;
+    bank.Process(&x, &y);
+    BOOST_TEST(std::abs(y - 3.0) < 1e-9);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BiquadBankMatchesReference) {
+  FilterConfig tip;
+  tip.half_life_s = 0.1;
+
+  FilterConfig rate;
+  rate.lowpass_hz = 40.0;
+  rate.notch_hz = 80.0;
+
+  FilterConfig accel;
+  accel.lowpass_hz = 10.0;
+  accel.derivative = true;
+
+  const std::vector<std::vector<Biquad>> channels = {
+    tip.Design(kRate),
+    rate.Design(kRate),
+    accel.Design(kRate),
+    {},
+    rate.Design(kRate),
+  };
+  BOOST_TEST(channels[2].size() == 2);
+
+  BiquadFilterBank bank(channels);
+  BOOST_TEST(bank.channels() == 5);
+
+  std::vector<Reference> references;
+  for (const auto& channel : channels) { references.emplace_back(channel); }
+
+  for (int i = 0; i < 1000; i++) {
+    double input[5] = {};
+    double output[5] = {};
+    for (int c = 0; c < 5; c++) {
+      input[c] = std::sin(0.01 * i * (c + 1)) + 0.1 * ((i * 7 + c) % 5);
+    }
+    bank.Process(input, output);
+    for (int c = 0; c < 5; c++) {
+      BOOST_TEST(std::abs(output[c] - references[c](input[c])) < 1e-9);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BiquadBankReset) {
+  FilterConfig config;
+  config.half_life_s = 1.0;
+  config.lowpass_hz = 5.0;
+  config.notch_hz = 30.0;
+
+  FilterConfig derivative = config;
+  derivative.derivative = true;
+
+  BiquadFilterBank bank({config.Design(kRate), derivative.Design(kRate)});
+  bank.Reset(0, 16.5);
+  bank.Reset(1, 4.0);
+
+  const double input[2] = {16.5, 4.0};
+  for (int i = 0; i < 10; i++) {
+    double output[2] = {};
+    bank.Process(input, output);
+    BOOST_TEST(std::abs(output[0] - 16.5) < 1e-9);
+    BOOST_TEST(std::abs(output[1]) < 1e-9);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BiquadBankSinglePrecision) {
+  FilterConfig tip;
+  tip.half_life_s = 0.1;
+
+  FilterConfig rate;
+  rate.lowpass_hz = 40.0;
+  rate.notch_hz = 80.0;
+
+  FilterConfig accel;
+  accel.lowpass_hz = 10.0;
+  accel.derivative = true;
+
+  const std::vector<std::vector<Biquad>> channels = {
+    tip.Design(kRate),
+    tip.Design(kRate),
+    rate.Design(kRate),
+    rate.Design(kRate),
+    accel.Design(kRate),
+  };
+
+  BiquadFilterBank bank(channels);
+  BiquadFilterBankf bankf(channels);
+  BOOST_TEST(bankf.channels() == 5);
+
+  for (int c = 0; c < 5; c++) {
+    bank.Reset(c, 2.0);
+    bankf.Reset(c, 2.0f);
+  }
+
+  // Signals of roughly the size the control loop sees, over a minute.
+  // The error is relative to each channel's range, since the
+  // derivative amplifies rounding by the sample rate.
+  double max_error[5] = {};
+  double max_output[5] = {};
+  for (int i = 0; i < 60 * kRate; i++) {
+    double input[5] = {};
+    float inputf[5] = {};
+    for (int c = 0; c < 5; c++) {
+      input[c] = 2.0 + 30.0 * std::sin(0.003 * i * (c + 1)) +
+          ((i * 7 + c) % 5 - 2.0);
+      inputf[c] = input[c];
+    }
+
+    double output[5] = {};
+    float outputf[5] = {};
+    bank.Process(input, output);
+    bankf.Process(inputf, outputf);
+    for (int c = 0; c < 5; c++) {
+      max_error[c] = std::max(max_error[c], std::abs(output[c] - outputf[c]));
+      max_output[c] = std::max(max_output[c], std::abs(output[c]));
+    }
+  }
+  for (int c = 0; c < 5; c++) {
+    BOOST_TEST(max_error[c] < 1e-4 * max_output[c]);
+  }
+}
@@ -0,0 +1,199 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// Compare a chain of operations written as callbacks, in the style
+/// of HoverbotControl, against the same chain written as a coroutine
+/// loop.  Each operation completes through boost::asio::post, as the
+/// pi3hat and timers do.  Reports the time and heap allocations per
+/// step.
+///
+/// Build with --config=coroutines.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "base/coroutine.h"
+
+namespace {
+std::atomic<int64_t> g_allocations{0};
+}
+
+void* operator new(size_t size) {
+  g_allocations++;
+  if (void* result = std::malloc(size ? size : 1)) { return result; }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+using namespace mjmech;
+
+struct Options {
+  int steps = 1000000;
+};
+
+/// An operation which completes on the next turn of the context.
+class Operation {
+ public:
+  Operation(boost::asio::io_context& context) : context_(context) {}
+
+  void AsyncRun(int* value, mjlib::io::ErrorCallback callback) {
+    (*value)++;
+    boost::asio::post(
+        context_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+ private:
+  boost::asio::io_context& context_;
+};
+
+struct Result {
+  double ns = 0.0;
+  double allocations = 0.0;
+};
+
+template <typename Functor>
+Result Measure(const Options& options, Functor f) {
+  const auto start_allocations = g_allocations.load();
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  const auto end = std::chrono::steady_clock::now();
+
+  Result result;
+  result.ns = std::chrono::duration<double, std::nano>(end - start).count() /
+      options.steps;
+  result.allocations =
+      static_cast<double>(g_allocations - start_allocations) / options.steps;
+  return result;
+}
+
+/// Three operations per step, each started from the completion of
+/// the last, as HandleTimer -> HandleStatus -> HandleCommand do.
+class CallbackChain {
+ public:
+  CallbackChain(boost::asio::io_context& context, int steps)
+      : operation_(context), steps_(steps) {}
+
+  void Start() { StartStatus(); }
+
+ private:
+  void StartStatus() {
+    operation_.AsyncRun(
+        &value_, std::bind(&CallbackChain::HandleStatus, this,
+                           std::placeholders::_1));
+  }
+
+  void HandleStatus(const mjlib::base::error_code& ec) {
+    if (ec) { return; }
+    operation_.AsyncRun(
+        &value_, std::bind(&CallbackChain::HandleControl, this,
+                           std::placeholders::_1));
+  }
+
+  void HandleControl(const mjlib::base::error_code& ec) {
+    if (ec) { return; }
+    operation_.AsyncRun(
+        &value_, std::bind(&CallbackChain::HandleCommand, this,
+                           std::placeholders::_1));
+  }
+
+  void HandleCommand(const mjlib::base::error_code& ec) {
+    if (ec) { return; }
+    if (++step_ < steps_) { StartStatus(); }
+  }
+
+  Operation operation_;
+  const int steps_;
+  int step_ = 0;
+  int value_ = 0;
+};
+
+#ifdef MJMECH_COROUTINES
+base::Task<mjlib::base::error_code> CoroutineLoop(
+    boost::asio::io_context& context, int steps) {
+  Operation operation(context);
+  int value = 0;
+
+  const auto run = [&]() {
+    return base::AwaitError([&](mjlib::io::ErrorCallback callback) {
+        operation.AsyncRun(&value, std::move(callback));
+      });
+  };
+
+  for (int step = 0; step < steps; step++) {
+    if (auto ec = co_await run()) { co_return ec; }
+    if (auto ec = co_await run()) { co_return ec; }
+    if (auto ec = co_await run()) { co_return ec; }
+  }
+  co_return mjlib::base::error_code();
+}
+#endif
+
+int work(int argc, char** argv) {
+  Options options;
+
+  auto group = clipp::group(
+      (clipp::option("steps") & clipp::value("", options.steps)));
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  const auto callback = Measure(options, [&]() {
+      boost::asio::io_context context;
+      CallbackChain chain(context, options.steps);
+      chain.Start();
+      context.run();
+    });
+
+  std::cout << fmt::format(
+      "callback   {:7.1f} ns/step  {:5.2f} allocs/step\n",
+      callback.ns, callback.allocations);
+
+#ifdef MJMECH_COROUTINES
+  const auto coroutine = Measure(options, [&]() {
+      boost::asio::io_context context;
+      base::Spawn(CoroutineLoop(context, options.steps),
+                  [](const mjlib::base::error_code&) {});
+      context.run();
+    });
+
+  std::cout << fmt::format(
+      "coroutine  {:7.1f} ns/step  {:5.2f} allocs/step\n",
+      coroutine.ns, coroutine.allocations);
+#else
+  std::cout << "coroutines are not supported by this toolchain\n";
+#endif
+
+  return 0;
+}
+}
+
+int main(int argc, char** argv) {
+  return work(argc, argv);
+}
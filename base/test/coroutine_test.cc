@@ -0,0 +1,104 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/coroutine.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+#ifdef MJMECH_COROUTINES
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+
+#include "base/signal_result.h"
+
+using namespace mjmech::base;
+
+namespace {
+Task<int> Double(int value) {
+  co_return value * 2;
+}
+
+Task<mjlib::base::error_code> Sum(boost::asio::io_context& context,
+                                  int count, int* result) {
+  for (int i = 0; i < count; i++) {
+    const auto ec = co_await AwaitError(
+        [&](mjlib::io::ErrorCallback callback) {
+          boost::asio::post(context, [callback = std::move(callback)]() {
+              callback({});
+            });
+        });
+    if (ec) { co_return ec; }
+    *result += co_await Double(i);
+  }
+  co_return mjlib::base::error_code();
+}
+}
+
+BOOST_AUTO_TEST_CASE(CoroutineTaskTest) {
+  boost::asio::io_context context;
+  int result = 0;
+  bool done = false;
+
+  Spawn(Sum(context, 10, &result), [&](const mjlib::base::error_code& ec) {
+      BOOST_TEST(!ec);
+      done = true;
+    });
+
+  // Nothing completes until the context runs.
+  BOOST_TEST(!done);
+  context.run();
+  BOOST_TEST(done);
+  BOOST_TEST(result == 90);
+}
+
+BOOST_AUTO_TEST_CASE(CoroutineSignalResultTest) {
+  boost::asio::io_context context;
+  auto executor = context.get_executor();
+  boost::signals2::signal<void (const int*)> signal;
+
+  std::vector<int> values;
+  std::vector<bool> errors;
+
+  const auto waiter = [&]() -> Task<mjlib::base::error_code> {
+    // The first wait is satisfied by the signal, the second times
+    // out.
+    for (int i = 0; i < 2; i++) {
+      const auto result = co_await SignalResult::Await(
+          executor, &signal, 0.2);
+      values.push_back(result.value);
+      errors.push_back(!!result.error);
+    }
+    co_return mjlib::base::error_code();
+  };
+
+  bool done = false;
+  Spawn(waiter(), [&](const mjlib::base::error_code&) { done = true; });
+
+  boost::asio::post(context, [&]() {
+      int value = 5;
+      signal(&value);
+    });
+
+  context.run();
+  BOOST_TEST(done);
+  BOOST_TEST_REQUIRE(values.size() == 2);
+  BOOST_TEST(values[0] == 5);
+  BOOST_TEST(!errors[0]);
+  BOOST_TEST(values[1] == 0);
+  BOOST_TEST(errors[1]);
+  BOOST_TEST(signal.num_slots() == 0);
+}
+
+#endif
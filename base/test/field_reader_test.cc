@@ -0,0 +1,85 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/field_reader.h"
+
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/visitor.h"
+
+using mjmech::base::FieldReader;
+
+namespace {
+struct Inner {
+  double value = 0.0;
+  float single = 0.0f;
+  std::vector<double> list;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(value));
+    a->Visit(MJ_NVP(single));
+    a->Visit(MJ_NVP(list));
+  }
+};
+
+struct Outer {
+  int count = 0;
+  Inner first;
+  Inner second;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(first));
+    a->Visit(MJ_NVP(second));
+  }
+};
+}
+
+BOOST_AUTO_TEST_CASE(FieldReaderTest) {
+  Outer data;
+  data.count = 3;
+  data.first.value = 1.5;
+  data.second.value = -2.5;
+  data.second.single = 4.0f;
+
+  const auto count = FieldReader::Find<Outer>("count");
+  BOOST_TEST_REQUIRE(count.valid());
+  BOOST_TEST(count.Read(&data) == 3.0);
+
+  const auto first = FieldReader::Find<Outer>("first.value");
+  BOOST_TEST_REQUIRE(first.valid());
+  BOOST_TEST(first.Read(&data) == 1.5);
+
+  const auto second = FieldReader::Find<Outer>("second.value");
+  BOOST_TEST_REQUIRE(second.valid());
+  BOOST_TEST(second.Read(&data) == -2.5);
+
+  const auto single = FieldReader::Find<Outer>("second.single");
+  BOOST_TEST_REQUIRE(single.valid());
+  BOOST_TEST(single.Read(&data) == 4.0);
+
+  // A later change is seen.
+  data.second.value = 7.0;
+  BOOST_TEST(second.Read(&data) == 7.0);
+
+  BOOST_TEST(!FieldReader::Find<Outer>("first").valid());
+  BOOST_TEST(!FieldReader::Find<Outer>("first.list").valid());
+  BOOST_TEST(!FieldReader::Find<Outer>("first.missing").valid());
+  BOOST_TEST(!FieldReader::Find<Outer>("count.value").valid());
+  BOOST_TEST(!FieldReader::Find<Outer>("").valid());
+}
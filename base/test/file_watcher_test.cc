@@ -0,0 +1,59 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/file_watcher.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <fstream>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::FileWatcher;
+
+BOOST_AUTO_TEST_CASE(FileWatcherTest) {
+  char directory[] = "/tmp/file_watcher_test.XXXXXX";
+  BOOST_TEST_REQUIRE(::mkdtemp(directory) != nullptr);
+  const std::string watched = std::string(directory) + "/watched.cfg";
+  const std::string other = std::string(directory) + "/other.cfg";
+
+  boost::asio::io_context context;
+  std::vector<std::string> changes;
+  FileWatcher dut(context.get_executor(), {watched},
+                  [&](const std::string& filename) {
+                    changes.push_back(filename);
+                  });
+
+  // A file which is not watched.
+  { std::ofstream(other) << "1"; }
+  context.poll();
+  BOOST_TEST(changes.empty());
+
+  // Written in place.
+  { std::ofstream(watched) << "2"; }
+  context.run_one();
+  BOOST_TEST_REQUIRE(changes.size() == 1);
+  BOOST_TEST(changes[0] == watched);
+
+  // Written elsewhere and renamed over.
+  BOOST_TEST(std::rename(other.c_str(), watched.c_str()) == 0);
+  context.run_one();
+  BOOST_TEST(changes.size() == 2);
+
+  ::unlink(watched.c_str());
+  ::rmdir(directory);
+}
@@ -0,0 +1,124 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/// Compare FitPlane, which solves with an SVD of every point, against
+/// PlaneFitter, both refit from scratch and as a sliding window where
+/// each step adds one point and removes one.
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "base/fit_plane.h"
+
+namespace {
+using namespace mjmech;
+
+struct Options {
+  int iterations = 2000;
+  double outlier_fraction = 0.2;
+};
+
+/// Return the nanoseconds per call of @p f.
+template <typename Functor>
+double Measure(const Options& options, Functor f) {
+  f();  // warm up
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < options.iterations; i++) { f(); }
+  const auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      options.iterations;
+}
+
+// Keep the optimizer from discarding results.
+double g_sink = 0.0;
+
+int work(int argc, char** argv) {
+  Options options;
+
+  auto group = clipp::group(
+      (clipp::option("iterations") & clipp::value("", options.iterations)),
+      (clipp::option("outlier_fraction") &
+       clipp::value("", options.outlier_fraction)));
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> coord(-1.0, 1.0);
+  std::normal_distribution<double> noise(0.0, 0.002);
+  std::uniform_real_distribution<double> unit(0.0, 1.0);
+
+  const auto make_point = [&](bool allow_outlier) {
+    const double x = coord(rng);
+    const double y = coord(rng);
+    double z = 0.1 * x - 0.05 * y + 0.3 + noise(rng);
+    if (allow_outlier && unit(rng) < options.outlier_fraction) {
+      z += 0.5 * coord(rng);
+    }
+    return Eigen::Vector3d(x, y, z);
+  };
+
+  for (int size : {4, 16, 64, 256, 1024}) {
+    std::vector<Eigen::Vector3d> points;
+    for (int i = 0; i < size; i++) { points.push_back(make_point(false)); }
+    std::vector<Eigen::Vector3d> noisy;
+    for (int i = 0; i < size; i++) { noisy.push_back(make_point(true)); }
+
+    const double svd_ns = Measure(options, [&]() {
+        g_sink += base::FitPlane(points).a;
+      });
+
+    const double refit_ns = Measure(options, [&]() {
+        base::PlaneFitter fitter;
+        for (const auto& p : points) { fitter.Add(p); }
+        g_sink += fitter.Fit().a;
+      });
+
+    base::PlaneFitter window;
+    for (const auto& p : points) { window.Add(p); }
+    size_t oldest = 0;
+    const double window_ns = Measure(options, [&]() {
+        window.Remove(points[oldest]);
+        window.Add(points[oldest]);
+        oldest = (oldest + 1) % points.size();
+        g_sink += window.Fit().a;
+      });
+
+    const double ransac_ns = Measure(options, [&]() {
+        g_sink += base::FitPlaneRansac(noisy, {}).a;
+      });
+
+    std::cout << fmt::format(
+        "{:5d} points  svd {:9.0f} ns  refit {:8.0f} ns  "
+        "window {:5.0f} ns  ransac {:9.0f} ns\n",
+        size, svd_ns, refit_ns, window_ns, ransac_ns);
+  }
+
+  return g_sink == 12345.0 ? 1 : 0;
+}
+}
+
+int main(int argc, char** argv) {
+  return work(argc, argv);
+}
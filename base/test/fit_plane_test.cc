@@ -14,6 +14,8 @@
 
 #include "base/fit_plane.h"
 
+#include <cmath>
+
 #include <boost/test/auto_unit_test.hpp>
 
 using mjmech::base::FitPlane;
@@ -47,3 +49,95 @@ BOOST_AUTO_TEST_CASE(BasicFitPlane, * boost::unit_test::tolerance(1e-4)) {
     BOOST_TEST(result.b == 0.5);
   }
 }
+
+BOOST_AUTO_TEST_CASE(PlaneFitterMatchesFitPlane,
+                     * boost::unit_test::tolerance(1e-6)) {
+  std::vector<Eigen::Vector3d> points;
+  for (int i = 0; i < 50; i++) {
+    const double x = std::sin(i * 1.3) * 4.0 + 100.0;
+    const double y = std::cos(i * 0.7) * 3.0 - 50.0;
+    const double noise = 0.01 * std::sin(i * 2.9);
+    points.push_back({x, y, 0.2 * x - 0.3 * y + 1.5 + noise});
+  }
+
+  mjmech::base::PlaneFitter dut(points.front());
+  for (const auto& p : points) { dut.Add(p); }
+  BOOST_TEST(dut.size() == 50);
+
+  const auto expected = FitPlane(points);
+  const auto result = dut.Fit();
+  BOOST_TEST(result.a == expected.a);
+  BOOST_TEST(result.b == expected.b);
+  BOOST_TEST(result.c == expected.c);
+
+  // Slide a window of 10 along the points.
+  dut.Clear();
+  for (size_t i = 0; i < points.size(); i++) {
+    dut.Add(points[i]);
+    if (i >= 10) { dut.Remove(points[i - 10]); }
+  }
+  BOOST_TEST(dut.size() == 10);
+  const auto window_expected = FitPlane(
+      std::vector<Eigen::Vector3d>(points.end() - 10, points.end()));
+  const auto window_result = dut.Fit();
+  BOOST_TEST(window_result.a == window_expected.a);
+  BOOST_TEST(window_result.b == window_expected.b);
+  BOOST_TEST(window_result.c == window_expected.c);
+}
+
+BOOST_AUTO_TEST_CASE(PlaneFitterDegenerate) {
+  mjmech::base::PlaneFitter dut;
+  {
+    const auto result = dut.Fit();
+    BOOST_TEST(result.a == 0.0);
+    BOOST_TEST(result.b == 0.0);
+    BOOST_TEST(result.c == 0.0);
+  }
+
+  // Points on a line do not determine a plane, but the result should
+  // still pass through them.
+  dut.Add({0, 0, 1});
+  dut.Add({1, 0, 2});
+  dut.Add({2, 0, 3});
+  const auto result = dut.Fit();
+  BOOST_TEST(std::isfinite(result.b));
+  BOOST_TEST(std::abs(result.a * 2.0 + result.c - 3.0) < 1e-6);
+
+  // With a zero origin, it picks the same plane as FitPlane.
+  const auto expected = FitPlane({{0, 0, 1}, {1, 0, 2}, {2, 0, 3}});
+  BOOST_TEST(std::abs(result.a - expected.a) < 1e-6);
+  BOOST_TEST(std::abs(result.b - expected.b) < 1e-6);
+  BOOST_TEST(std::abs(result.c - expected.c) < 1e-6);
+
+  // Any other origin picks a different plane which fits just as well.
+  mjmech::base::PlaneFitter shifted({0, 5, 0});
+  shifted.Add({0, 0, 1});
+  shifted.Add({1, 0, 2});
+  shifted.Add({2, 0, 3});
+  const auto other = shifted.Fit();
+  BOOST_TEST(std::abs(other.b - expected.b) > 0.01);
+  for (const double x : {0.0, 1.0, 2.0}) {
+    BOOST_TEST(std::abs(other.a * x + other.c - (x + 1.0)) < 1e-6);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FitPlaneRansacRejectsOutliers,
+                     * boost::unit_test::tolerance(1e-4)) {
+  std::vector<Eigen::Vector3d> points;
+  for (int x = -3; x <= 3; x++) {
+    for (int y = -3; y <= 3; y++) {
+      points.push_back({double(x), double(y), 0.5 * x + 0.25 * y + 2.0});
+    }
+  }
+  // A third as many points again, far off the plane.
+  for (int i = 0; i < 16; i++) {
+    points.push_back({std::sin(i) * 3.0, std::cos(i) * 3.0, 10.0 + i});
+  }
+
+  int inliers = 0;
+  const auto result = mjmech::base::FitPlaneRansac(points, {}, &inliers);
+  BOOST_TEST(inliers == 49);
+  BOOST_TEST(result.a == 0.5);
+  BOOST_TEST(result.b == 0.25);
+  BOOST_TEST(result.c == 2.0);
+}
@@ -0,0 +1,121 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+/// Compare the ways of solving for the leg force ratios, for 2 to 6
+/// legs.  Between calls the legs move a little, as they would from
+/// one control cycle to the next, so that the warm started solvers
+/// see a realistic starting point.
+
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "base/leg_force.h"
+
+namespace {
+using namespace mjmech;
+
+struct Options {
+  int iterations = 2000;
+};
+
+// Keep the optimizer from discarding results.
+double g_sink = 0.0;
+
+std::vector<Eigen::Vector2d> MakeLegs(int count, int step) {
+  std::vector<Eigen::Vector2d> result;
+  for (int i = 0; i < count; i++) {
+    const double angle = 2.0 * M_PI * (i + 0.25) / count;
+    const double wobble = 0.05 * std::sin(0.01 * step + i);
+    result.push_back({
+        (0.2 + wobble) * std::cos(angle) + 0.03,
+        (0.15 - wobble) * std::sin(angle) - 0.02});
+  }
+  return result;
+}
+
+/// Return the nanoseconds per call of @p f, which is passed the legs
+/// for each step.
+template <typename Functor>
+double Measure(const Options& options, int count, Functor f) {
+  std::vector<std::vector<Eigen::Vector2d>> steps;
+  for (int i = 0; i < options.iterations; i++) {
+    steps.push_back(MakeLegs(count, i));
+  }
+
+  f(steps.front());  // warm up
+
+  const auto start = std::chrono::steady_clock::now();
+  for (const auto& legs : steps) { f(legs); }
+  const auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      options.iterations;
+}
+
+int work(int argc, char** argv) {
+  Options options;
+
+  auto group = clipp::group(
+      (clipp::option("iterations") & clipp::value("", options.iterations)));
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  for (int count = 2; count <= 6; count++) {
+    const double numerical_ns = Measure(options, count, [&](const auto& legs) {
+        base::LegForceOptions lm_options;
+        lm_options.numerical_jacobian = true;
+        g_sink += base::OptimizeLegForce(legs, lm_options).front();
+      });
+
+    const double analytic_ns = Measure(options, count, [&](const auto& legs) {
+        g_sink += base::OptimizeLegForce(legs).front();
+      });
+
+    base::LegForceOptions warm_options;
+    const double warm_ns = Measure(options, count, [&](const auto& legs) {
+        warm_options.initial = base::OptimizeLegForce(legs, warm_options);
+        g_sink += warm_options.initial.front();
+      });
+
+    base::LegForceOptimizer optimizer;
+    int solves = 0;
+    const double active_set_ns = Measure(
+        options, count, [&](const auto& legs) {
+          g_sink += optimizer.Optimize(legs).front();
+          solves += optimizer.iterations();
+        });
+
+    std::cout << fmt::format(
+        "{} legs  numerical {:7.0f} ns  analytic {:7.0f} ns  "
+        "warm {:7.0f} ns  active set {:5.0f} ns ({:.2f} solves)\n",
+        count, numerical_ns, analytic_ns, warm_ns, active_set_ns,
+        static_cast<double>(solves) / (options.iterations + 1));
+  }
+
+  return g_sink == 12345.0 ? 1 : 0;
+}
+}
+
+int main(int argc, char** argv) {
+  return work(argc, argv);
+}
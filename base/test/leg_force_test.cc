@@ -64,3 +64,58 @@ BOOST_AUTO_TEST_CASE(LegForceTest, * boost::unit_test::tolerance(1e-3)) {
     BOOST_TEST(result[1] == 0.992665);
   }
 }
+
+BOOST_AUTO_TEST_CASE(LegForceWarmStart, * boost::unit_test::tolerance(1e-3)) {
+  mjmech::base::LegForceOptions options;
+  options.initial = {0.1, 0.9};
+  const auto result = OptimizeLegForce({{-4, 1}, {2, 0}}, options);
+  BOOST_TEST_REQUIRE(result.size() == 2);
+  BOOST_TEST(result[0] == 0.088235);
+  BOOST_TEST(result[1] == 0.911764);
+}
+
+BOOST_AUTO_TEST_CASE(LegForceOptimizerTest,
+                     * boost::unit_test::tolerance(1e-3)) {
+  mjmech::base::LegForceOptimizer dut;
+
+  const std::vector<std::vector<Eigen::Vector2d>> cases = {
+    {{-1., -1.}, {-1., 1.}, {1., -1.}, {1., 1.}},
+    {{-4, 0}, {2, 0}},
+    {{-4, 1}, {2, 1}},
+    {{-4, 1}, {2, 0}},
+    {{-4, 4}, {2, 0}},
+    {{-3, 1}, {-1, -2}, {2, 1.5}, {3, -0.5}, {0.5, 0.2}, {-0.2, 2}},
+  };
+
+  // Solve every case both from scratch and warm started from the
+  // previous one, and compare with the penalty solution.
+  for (const auto& legs : cases) {
+    for (int warm = 0; warm < 2; warm++) {
+      if (!warm) { dut.Reset(); }
+      const auto expected = OptimizeLegForce(legs);
+      const auto result = dut.Optimize(legs);
+      BOOST_TEST_REQUIRE(result.size() == legs.size());
+      for (size_t i = 0; i < legs.size(); i++) {
+        BOOST_TEST(result[i] == expected[i]);
+      }
+    }
+  }
+
+  // The same legs again should need only one solve.
+  dut.Optimize(cases.back());
+  BOOST_TEST(dut.iterations() == 1);
+
+  BOOST_TEST(dut.Optimize({}).empty());
+  BOOST_TEST(dut.Optimize({{1, 1}}).front() == 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(LegForceOptimizerBounds,
+                     * boost::unit_test::tolerance(1e-6)) {
+  // Balancing these exactly would need a negative force on the
+  // second leg, so it should take none at all.
+  mjmech::base::LegForceOptimizer dut;
+  const auto result = dut.Optimize({{1, 0}, {2, 0}});
+  BOOST_TEST_REQUIRE(result.size() == 2);
+  BOOST_TEST(result[0] == 1.0);
+  BOOST_TEST(result[1] == 0.0);
+}
@@ -0,0 +1,139 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// Compare the batch quaternion operations against calling the scalar
+/// Quaternion methods in a loop.
+
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "base/quaternion_batch.h"
+
+namespace {
+using namespace mjmech;
+
+struct Options {
+  int size = 4096;
+  int iterations = 1000;
+};
+
+/// Return the nanoseconds per element for @p f, which processes the
+/// whole batch once.
+template <typename Functor>
+double Measure(const Options& options, Functor f) {
+  f();  // warm up
+
+  const auto start = std::chrono::steady_clock::now();
+  for (int i = 0; i < options.iterations; i++) { f(); }
+  const auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      (static_cast<double>(options.iterations) * options.size);
+}
+
+void Report(const std::string& name, double scalar_ns, double batch_ns) {
+  std::cout << fmt::format(
+      "{:<10} scalar {:7.2f} ns  batch {:7.2f} ns  speedup {:5.2f}x\n",
+      name, scalar_ns, batch_ns, scalar_ns / batch_ns);
+}
+
+int work(int argc, char** argv) {
+  Options options;
+
+  auto group = clipp::group(
+      (clipp::option("size") & clipp::value("", options.size)),
+      (clipp::option("iterations") & clipp::value("", options.iterations)));
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  std::mt19937 rng(0);
+  std::normal_distribution<double> dist;
+
+  std::vector<base::Quaternion> quaternions;
+  std::vector<base::Quaternion> others;
+  std::vector<base::Point3D> points;
+  base::QuaternionBatch quaternion_batch(options.size);
+  base::QuaternionBatch other_batch(options.size);
+  base::Point3DBatch point_batch(options.size);
+
+  for (int i = 0; i < options.size; i++) {
+    quaternions.push_back(
+        base::Quaternion(dist(rng), dist(rng), dist(rng), dist(rng))
+        .normalized());
+    others.push_back(
+        base::Quaternion(dist(rng), dist(rng), dist(rng), dist(rng))
+        .normalized());
+    points.push_back(base::Point3D(dist(rng), dist(rng), dist(rng)));
+
+    quaternion_batch.set(i, quaternions.back());
+    other_batch.set(i, others.back());
+    point_batch.set(i, points.back());
+  }
+
+  std::vector<base::Point3D> point_out(options.size);
+  std::vector<base::Quaternion> quaternion_out(options.size);
+  std::vector<base::Euler> euler_out(options.size);
+  base::Point3DBatch point_batch_out;
+  base::QuaternionBatch quaternion_batch_out;
+  base::EulerBatch euler_batch_out;
+
+  Report(
+      "rotate",
+      Measure(options, [&]() {
+          for (int i = 0; i < options.size; i++) {
+            point_out[i] = quaternions[i].Rotate(points[i]);
+          }
+        }),
+      Measure(options, [&]() {
+          base::Rotate(quaternion_batch, point_batch, &point_batch_out);
+        }));
+
+  Report(
+      "multiply",
+      Measure(options, [&]() {
+          for (int i = 0; i < options.size; i++) {
+            quaternion_out[i] = quaternions[i] * others[i];
+          }
+        }),
+      Measure(options, [&]() {
+          base::Multiply(quaternion_batch, other_batch,
+                         &quaternion_batch_out);
+        }));
+
+  Report(
+      "euler",
+      Measure(options, [&]() {
+          for (int i = 0; i < options.size; i++) {
+            euler_out[i] = quaternions[i].euler_rad();
+          }
+        }),
+      Measure(options, [&]() {
+          base::ToEuler(quaternion_batch, &euler_batch_out);
+        }));
+
+  return 0;
+}
+}
+
+int main(int argc, char** argv) {
+  return work(argc, argv);
+}
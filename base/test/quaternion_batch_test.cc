@@ -0,0 +1,151 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/quaternion_batch.h"
+
+#include <random>
+
+#include <boost/test/auto_unit_test.hpp>
+
+namespace {
+using namespace mjmech;
+using base::Quaternion;
+using base::Point3D;
+
+Quaternion RandomQuaternion(std::mt19937* rng) {
+  std::normal_distribution<double> dist;
+  return Quaternion(dist(*rng), dist(*rng), dist(*rng), dist(*rng))
+      .normalized();
+}
+
+Point3D RandomPoint(std::mt19937* rng) {
+  std::uniform_real_distribution<double> dist(-10.0, 10.0);
+  return Point3D(dist(*rng), dist(*rng), dist(*rng));
+}
+
+base::QuaternionBatch RandomQuaternions(std::mt19937* rng, int size) {
+  base::QuaternionBatch result(size);
+  for (int i = 0; i < size; i++) { result.set(i, RandomQuaternion(rng)); }
+  return result;
+}
+
+base::Point3DBatch RandomPoints(std::mt19937* rng, int size) {
+  base::Point3DBatch result(size);
+  for (int i = 0; i < size; i++) { result.set(i, RandomPoint(rng)); }
+  return result;
+}
+
+// A rotation which a naive rotation through a pure quaternion would
+// have handled the same way.
+Point3D ReferenceRotate(const Quaternion& q, const Point3D& v) {
+  const Quaternion p(0.0, v.x(), v.y(), v.z());
+  const Quaternion r = q * p * q.conjugated();
+  return Point3D(r.x(), r.y(), r.z());
+}
+}
+
+BOOST_AUTO_TEST_CASE(QuaternionRotateMatchesReference) {
+  std::mt19937 rng(1);
+  for (int i = 0; i < 1000; i++) {
+    const auto q = RandomQuaternion(&rng);
+    const auto v = RandomPoint(&rng);
+    BOOST_TEST((q.Rotate(v) - ReferenceRotate(q, v)).norm() < 1e-12);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BatchRotate) {
+  std::mt19937 rng(2);
+  const int kSize = 257;
+  const auto q = RandomQuaternions(&rng, kSize);
+  const auto v = RandomPoints(&rng, kSize);
+
+  base::Point3DBatch out;
+  base::Rotate(q, v, &out);
+  BOOST_TEST(out.size() == kSize);
+  for (int i = 0; i < kSize; i++) {
+    BOOST_TEST((out.get(i) - q.get(i).Rotate(v.get(i))).norm() < 1e-12);
+  }
+
+  const auto single = RandomQuaternion(&rng);
+  base::Rotate(single, v, &out);
+  for (int i = 0; i < kSize; i++) {
+    BOOST_TEST((out.get(i) - single.Rotate(v.get(i))).norm() < 1e-12);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BatchMultiply) {
+  std::mt19937 rng(3);
+  const int kSize = 101;
+  const auto lhs = RandomQuaternions(&rng, kSize);
+  const auto rhs = RandomQuaternions(&rng, kSize);
+
+  base::QuaternionBatch out;
+  base::Multiply(lhs, rhs, &out);
+  for (int i = 0; i < kSize; i++) {
+    const auto expected = lhs.get(i) * rhs.get(i);
+    const auto actual = out.get(i);
+    BOOST_TEST(std::abs(actual.w() - expected.w()) < 1e-15);
+    BOOST_TEST(std::abs(actual.x() - expected.x()) < 1e-15);
+    BOOST_TEST(std::abs(actual.y() - expected.y()) < 1e-15);
+    BOOST_TEST(std::abs(actual.z() - expected.z()) < 1e-15);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FastTrigErrorBounds) {
+  const int kSize = 100001;
+  Eigen::ArrayXd angle = Eigen::ArrayXd::LinSpaced(kSize, -M_PI, M_PI);
+  const Eigen::ArrayXd y = 3.0 * angle.sin();
+  const Eigen::ArrayXd x = 3.0 * angle.cos();
+
+  const Eigen::ArrayXd atan2 = base::FastAtan2(y, x);
+  double max_atan2_error = 0.0;
+  for (int i = 0; i < kSize; i++) {
+    max_atan2_error = std::max(
+        max_atan2_error, std::abs(atan2(i) - std::atan2(y(i), x(i))));
+  }
+  BOOST_TEST(max_atan2_error < 2e-8);
+
+  const Eigen::ArrayXd s = Eigen::ArrayXd::LinSpaced(kSize, -1.0, 1.0);
+  const Eigen::ArrayXd asin = base::FastAsin(s);
+  double max_asin_error = 0.0;
+  for (int i = 0; i < kSize; i++) {
+    max_asin_error = std::max(
+        max_asin_error, std::abs(asin(i) - std::asin(s(i))));
+  }
+  BOOST_TEST(max_asin_error < 5e-8);
+
+  // The degenerate case matches std::atan2 as well.
+  const Eigen::ArrayXd zero = Eigen::ArrayXd::Zero(1);
+  BOOST_TEST(base::FastAtan2(zero, zero)(0) == 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(BatchEuler) {
+  std::mt19937 rng(4);
+  const int kSize = 1000;
+  auto q = RandomQuaternions(&rng, kSize);
+
+  // Include both gimbal lock orientations.
+  q.set(0, Quaternion::FromEuler(0.3, M_PI_2, 0.2));
+  q.set(1, Quaternion::FromEuler(-0.1, -M_PI_2, 0.4));
+
+  base::EulerBatch out;
+  base::ToEuler(q, &out);
+  for (int i = 0; i < kSize; i++) {
+    const auto expected = q.get(i).euler_rad();
+    const auto actual = out.get(i);
+    BOOST_TEST(std::abs(actual.roll - expected.roll) < 1e-7);
+    BOOST_TEST(std::abs(actual.pitch - expected.pitch) < 1e-7);
+    BOOST_TEST(std::abs(actual.yaw - expected.yaw) < 1e-7);
+  }
+}
@@ -0,0 +1,67 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/reservoir_sampler.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::ReservoirSampler;
+
+BOOST_AUTO_TEST_CASE(ReservoirSamplerBasicTest) {
+  ReservoirSampler<int> dut(10);
+  for (int i = 0; i < 5; i++) { dut.Add(i); }
+
+  // Until it is full, everything is kept.
+  BOOST_TEST(dut.size() == 5);
+  int expected = 0;
+  for (int value : dut) { BOOST_TEST(value == expected++); }
+
+  for (int i = 5; i < 10000; i++) { dut.Add(i); }
+  BOOST_TEST(dut.size() == 10);
+  BOOST_TEST(dut.count() == 10000);
+}
+
+BOOST_AUTO_TEST_CASE(ReservoirSamplerMergeTest) {
+  // One side sees 9 times as many items as the other, so after a
+  // merge it should provide about 90% of the samples.
+  int from_small = 0;
+  int total = 0;
+  for (uint32_t seed = 0; seed < 50; seed++) {
+    ReservoirSampler<int> large(100, seed);
+    ReservoirSampler<int> small(100, seed + 1000);
+    for (int i = 0; i < 9000; i++) { large.Add(i); }
+    for (int i = 0; i < 1000; i++) { small.Add(-1 - i); }
+
+    large.Merge(small);
+    BOOST_TEST(large.count() == 10000);
+    BOOST_TEST(large.size() == 100);
+    for (int value : large) {
+      total++;
+      if (value < 0) { from_small++; }
+    }
+  }
+
+  const double fraction = static_cast<double>(from_small) / total;
+  BOOST_TEST(fraction > 0.07);
+  BOOST_TEST(fraction < 0.13);
+
+  // Merging into an empty sampler just copies.
+  ReservoirSampler<int> empty(4);
+  ReservoirSampler<int> other(4);
+  other.Add(1);
+  other.Add(2);
+  empty.Merge(other);
+  BOOST_TEST(empty.size() == 2);
+  BOOST_TEST(empty.count() == 2);
+}
@@ -0,0 +1,148 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// Compare RingBuffer against circular_buffer for a history window,
+/// and SpscQueue against a mutex protected deque for passing values
+/// between threads.
+
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <mutex>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "base/circular_buffer.h"
+#include "base/ring_buffer.h"
+#include "base/spsc_queue.h"
+
+namespace {
+using namespace mjmech;
+
+struct Options {
+  int count = 10000000;
+};
+
+constexpr size_t kWindow = 256;
+
+// Keep the optimizer from discarding results.
+int64_t g_sink = 0;
+
+/// Return the nanoseconds per item for @p f, which handles all of
+/// them.
+template <typename Functor>
+double Measure(const Options& options, Functor f) {
+  const auto start = std::chrono::steady_clock::now();
+  f();
+  const auto end = std::chrono::steady_clock::now();
+
+  return std::chrono::duration<double, std::nano>(end - start).count() /
+      options.count;
+}
+
+/// Pass options.count values from a writer thread to this one.  Both
+/// sides yield when they cannot make progress, so that this finishes
+/// even on a single core.
+template <typename PushFunctor, typename PopFunctor>
+double MeasureHandoff(const Options& options,
+                      PushFunctor push, PopFunctor pop) {
+  return Measure(options, [&]() {
+      std::thread writer([&]() {
+          for (int i = 0; i < options.count; i++) {
+            while (!push(i)) { std::this_thread::yield(); }
+          }
+        });
+      for (int i = 0; i < options.count; i++) {
+        int value = 0;
+        while (!pop(&value)) { std::this_thread::yield(); }
+        g_sink += value;
+      }
+      writer.join();
+    });
+}
+
+int work(int argc, char** argv) {
+  Options options;
+
+  auto group = clipp::group(
+      (clipp::option("count") & clipp::value("", options.count)));
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  const double circular_ns = Measure(options, [&]() {
+      base::circular_buffer<int> buffer;
+      size_t size = 0;
+      for (int i = 0; i < options.count; i++) {
+        if (size == kWindow) {
+          buffer.pop_front();
+          size--;
+        }
+        buffer.push_back(int(i));
+        size++;
+        g_sink += buffer.front();
+      }
+    });
+
+  const double ring_ns = Measure(options, [&]() {
+      base::RingBuffer<int, kWindow> buffer;
+      for (int i = 0; i < options.count; i++) {
+        buffer.push_back_overwrite(i);
+        g_sink += buffer.front();
+      }
+    });
+
+  std::cout << fmt::format(
+      "history    circular_buffer {:6.2f} ns  RingBuffer {:6.2f} ns\n",
+      circular_ns, ring_ns);
+
+  std::mutex mutex;
+  std::deque<int> deque;
+  const double mutex_ns = MeasureHandoff(
+      options,
+      [&](int value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (deque.size() >= kWindow) { return false; }
+        deque.push_back(value);
+        return true;
+      },
+      [&](int* value) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (deque.empty()) { return false; }
+        *value = deque.front();
+        deque.pop_front();
+        return true;
+      });
+
+  base::SpscQueue<int, kWindow> queue;
+  const double spsc_ns = MeasureHandoff(
+      options,
+      [&](int value) { return queue.Push(value); },
+      [&](int* value) { return queue.Pop(value); });
+
+  std::cout << fmt::format(
+      "handoff    mutex deque     {:6.2f} ns  SpscQueue  {:6.2f} ns\n",
+      mutex_ns, spsc_ns);
+
+  return g_sink == 12345 ? 1 : 0;
+}
+}
+
+int main(int argc, char** argv) {
+  return work(argc, argv);
+}
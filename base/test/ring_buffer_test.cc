@@ -0,0 +1,93 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/ring_buffer.h"
+
+#include <memory>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "base/circular_buffer.h"
+
+using mjmech::base::RingBuffer;
+
+BOOST_AUTO_TEST_CASE(RingBufferBasicTest) {
+  RingBuffer<int, 4> dut;
+  BOOST_TEST(dut.empty());
+  BOOST_TEST(dut.capacity() == 4);
+
+  for (int i = 1; i <= 4; i++) {
+    BOOST_TEST(dut.push_back(i));
+    BOOST_TEST(dut.back() == i);
+  }
+  BOOST_TEST(dut.full());
+  BOOST_TEST(!dut.push_back(5));
+  BOOST_TEST(dut.front() == 1);
+  BOOST_TEST(dut.back() == 4);
+
+  dut.pop_front();
+  dut.pop_front();
+  BOOST_TEST(dut.size() == 2);
+  BOOST_TEST(dut.front() == 3);
+
+  // Now wrap around the end of the storage.
+  BOOST_TEST(dut.push_back(5));
+  BOOST_TEST(dut.push_back(6));
+  BOOST_TEST(!dut.push_back(7));
+  for (size_t i = 0; i < dut.size(); i++) {
+    BOOST_TEST(dut[i] == static_cast<int>(i + 3));
+  }
+  BOOST_TEST(dut.back() == 6);
+
+  dut.clear();
+  BOOST_TEST(dut.empty());
+}
+
+BOOST_AUTO_TEST_CASE(RingBufferOverwriteTest) {
+  RingBuffer<int, 8> dut;
+  for (int i = 0; i < 20; i++) { dut.push_back_overwrite(i); }
+
+  // Only the most recent 8 remain, oldest first.
+  BOOST_TEST(dut.size() == 8);
+  for (size_t i = 0; i < dut.size(); i++) {
+    BOOST_TEST(dut[i] == static_cast<int>(i + 12));
+  }
+  BOOST_TEST(dut.front() == 12);
+  BOOST_TEST(dut.back() == 19);
+}
+
+BOOST_AUTO_TEST_CASE(RingBufferMoveOnlyTest) {
+  RingBuffer<std::unique_ptr<int>, 2> dut;
+  dut.push_back_overwrite(std::make_unique<int>(1));
+  dut.push_back_overwrite(std::make_unique<int>(2));
+  dut.push_back_overwrite(std::make_unique<int>(3));
+  BOOST_TEST(*dut.front() == 2);
+  BOOST_TEST(*dut.back() == 3);
+}
+
+BOOST_AUTO_TEST_CASE(CircularBufferBackTest) {
+  mjmech::base::circular_buffer<int> dut;
+
+  // Push enough to make it grow a few times, and check that back()
+  // is always the most recent item.
+  for (int i = 0; i < 10; i++) {
+    dut.push_back(int(i));
+    BOOST_TEST(dut.back() == i);
+    BOOST_TEST(dut.front() == 0);
+  }
+
+  for (int i = 0; i < 9; i++) { dut.pop_front(); }
+  BOOST_TEST(dut.front() == 9);
+  BOOST_TEST(dut.back() == 9);
+}
@@ -0,0 +1,71 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/spsc_queue.h"
+
+#include <thread>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::SpscQueue;
+
+BOOST_AUTO_TEST_CASE(SpscQueueBasicTest) {
+  SpscQueue<int, 4> dut;
+
+  int value = 0;
+  BOOST_TEST(!dut.Pop(&value));
+
+  for (int i = 1; i <= 4; i++) { BOOST_TEST(dut.Push(i)); }
+  BOOST_TEST(!dut.Push(5));
+  BOOST_TEST(dut.size() == 4);
+
+  BOOST_TEST(dut.Pop(&value));
+  BOOST_TEST(value == 1);
+  BOOST_TEST(dut.Push(5));
+
+  for (int i = 2; i <= 5; i++) {
+    BOOST_TEST(dut.Pop(&value));
+    BOOST_TEST(value == i);
+  }
+  BOOST_TEST(!dut.Pop(&value));
+  BOOST_TEST(dut.size() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(SpscQueueThreadTest) {
+  struct Value {
+    int a = 0;
+    int b = 0;
+  };
+
+  SpscQueue<Value, 64> dut;
+  constexpr int kCount = 200000;
+
+  std::thread writer([&]() {
+    for (int i = 1; i <= kCount; i++) {
+      while (!dut.Push(Value{i, -i})) {}
+    }
+  });
+
+  // Every value arrives, in order, and none are torn.
+  int last = 0;
+  while (last < kCount) {
+    Value value;
+    if (!dut.Pop(&value)) { continue; }
+    BOOST_REQUIRE_EQUAL(value.a, -value.b);
+    BOOST_REQUIRE_EQUAL(value.a, last + 1);
+    last = value.a;
+  }
+
+  writer.join();
+}
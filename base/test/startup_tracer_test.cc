@@ -0,0 +1,74 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/startup_tracer.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::StartupTracer;
+
+BOOST_AUTO_TEST_CASE(StartupTracerPhaseTest) {
+  StartupTracer dut;
+
+  dut.Begin("a");
+  dut.Begin("b");
+  dut.End("a");
+
+  const auto& phases = dut.report().phases;
+  BOOST_TEST_REQUIRE(phases.size() == 2);
+  BOOST_TEST(phases[0].name == "a");
+  BOOST_TEST(phases[0].end_s >= phases[0].start_s);
+  BOOST_TEST(phases[1].name == "b");
+  BOOST_TEST(phases[1].end_s < 0.0);
+
+  // Ending something which never began is ignored.
+  dut.End("c");
+  BOOST_TEST(phases.size() == 2);
+
+  bool called = false;
+  auto callback = dut.Wrap("c", [&](const mjlib::base::error_code&) {
+      // The phase has ended before the callback is invoked.
+      BOOST_TEST(dut.report().phases.back().end_s >= 0.0);
+      called = true;
+    });
+  BOOST_TEST(phases.back().name == "c");
+  BOOST_TEST(phases.back().end_s < 0.0);
+  callback({});
+  BOOST_TEST(called);
+}
+
+BOOST_AUTO_TEST_CASE(StartupTracerMilestoneTest) {
+  StartupTracer dut;
+
+  int reports = 0;
+  dut.report_signal()->connect([&](const auto* report) {
+      reports++;
+      BOOST_TEST(report->first_full_status_s >= 0.0);
+      BOOST_TEST(report->ready_s >= report->first_full_status_s);
+    });
+
+  dut.MarkFirstFullStatus();
+  const double first = dut.report().first_full_status_s;
+  BOOST_TEST(first >= 0.0);
+  BOOST_TEST(reports == 0);
+
+  dut.MarkReady();
+  dut.MarkFirstFullStatus();
+  dut.MarkReady();
+  BOOST_TEST(reports == 1);
+  BOOST_TEST(dut.report().first_full_status_s == first);
+
+  const auto text = dut.Format();
+  BOOST_TEST(text.find("ready") != std::string::npos);
+}
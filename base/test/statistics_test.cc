@@ -0,0 +1,155 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/statistics.h"
+
+#include <algorithm>
+#include <cmath>
+#include <random>
+#include <vector>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::base;
+
+BOOST_AUTO_TEST_CASE(MomentsTest, * boost::unit_test::tolerance(1e-9)) {
+  const std::vector<double> values = {4, 7, 13, 16, -2, 0.5, 100};
+
+  Moments all;
+  Moments first;
+  Moments second;
+  for (size_t i = 0; i < values.size(); i++) {
+    all.Add(values[i]);
+    (i < 3 ? first : second).Add(values[i]);
+  }
+
+  double mean = 0.0;
+  for (double v : values) { mean += v; }
+  mean /= values.size();
+  double variance = 0.0;
+  for (double v : values) { variance += (v - mean) * (v - mean); }
+  variance /= values.size() - 1;
+
+  BOOST_TEST(all.count() == 7);
+  BOOST_TEST(all.mean() == mean);
+  BOOST_TEST(all.variance() == variance);
+  BOOST_TEST(all.min() == -2.0);
+  BOOST_TEST(all.max() == 100.0);
+
+  first.Merge(second);
+  BOOST_TEST(first.count() == 7);
+  BOOST_TEST(first.mean() == mean);
+  BOOST_TEST(first.variance() == variance);
+  BOOST_TEST(first.min() == -2.0);
+  BOOST_TEST(first.max() == 100.0);
+
+  Moments empty;
+  empty.Merge(all);
+  BOOST_TEST(empty.mean() == mean);
+}
+
+namespace {
+double ExactQuantile(std::vector<double> values, double q) {
+  std::sort(values.begin(), values.end());
+  return values[std::min(values.size() - 1,
+                         static_cast<size_t>(q * values.size()))];
+}
+}
+
+BOOST_AUTO_TEST_CASE(QuantileSketchTest) {
+  std::mt19937 rng(0);
+  std::normal_distribution<double> dist(5.0, 2.0);
+
+  QuantileSketch all;
+  QuantileSketch first(200, 1);
+  QuantileSketch second(200, 2);
+  std::vector<double> values;
+  for (int i = 0; i < 100000; i++) {
+    const double value = dist(rng);
+    values.push_back(value);
+    all.Add(value);
+    (i % 3 ? first : second).Add(value);
+  }
+  first.Merge(second);
+
+  BOOST_TEST(all.count() == 100000);
+  BOOST_TEST(first.count() == 100000);
+  // Memory stays bounded.
+  BOOST_TEST(all.retained() < 2000);
+  BOOST_TEST(first.retained() < 2000);
+
+  BOOST_TEST(all.Quantile(0.0) == *std::min_element(values.begin(),
+                                                    values.end()));
+  BOOST_TEST(all.Quantile(1.0) == *std::max_element(values.begin(),
+                                                    values.end()));
+
+  // The rank error should be a couple percent at most.  For this
+  // distribution, that is well under 0.2 near the middle and a bit
+  // more in the tails.
+  for (double q : {0.01, 0.05, 0.25, 0.5, 0.75, 0.95, 0.99}) {
+    const double expected = ExactQuantile(values, q);
+    const double tolerance = (q < 0.05 || q > 0.95) ? 0.4 : 0.2;
+    BOOST_TEST(std::abs(all.Quantile(q) - expected) < tolerance);
+    BOOST_TEST(std::abs(first.Quantile(q) - expected) < tolerance);
+  }
+
+  all.Clear();
+  BOOST_TEST(all.count() == 0);
+  BOOST_TEST(all.Quantile(0.5) == 0.0);
+}
+
+BOOST_AUTO_TEST_CASE(WindowedStatisticsTest,
+                     * boost::unit_test::tolerance(1e-9)) {
+  WindowedStatistics::Options options;
+  options.window_s = 1.0;
+  options.buckets = 10;
+  WindowedStatistics dut(options);
+
+  const auto start = boost::posix_time::ptime(
+      boost::gregorian::date(2020, 1, 1));
+  const auto at = [&](double s) {
+    return start + boost::posix_time::microseconds(
+        static_cast<int64_t>(s * 1e6));
+  };
+
+  BOOST_TEST(dut.Summarize(start).count == 0);
+
+  // One second of 1s, then one second of 3s.
+  for (int i = 0; i < 100; i++) { dut.Add(at(i * 0.01), 1.0); }
+  for (int i = 100; i < 200; i++) { dut.Add(at(i * 0.01), 3.0); }
+
+  {
+    // Only the 3s, and at most one bucket of the 1s, are in the
+    // window.
+    const auto summary = dut.Summarize(at(2.0));
+    BOOST_TEST(summary.count >= 100);
+    BOOST_TEST(summary.count <= 110);
+    BOOST_TEST(summary.max == 3.0);
+    BOOST_TEST(summary.p50 == 3.0);
+  }
+
+  {
+    // Long after, everything is gone.
+    const auto summary = dut.Summarize(at(10.0));
+    BOOST_TEST(summary.count == 0);
+  }
+
+  // A gap longer than the window clears everything.
+  dut.Add(at(20.0), 5.0);
+  {
+    const auto summary = dut.Summarize(at(20.0));
+    BOOST_TEST(summary.count == 1);
+    BOOST_TEST(summary.mean == 5.0);
+  }
+}
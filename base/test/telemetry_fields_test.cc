@@ -0,0 +1,93 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_fields.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/fast_stream.h"
+#include "mjlib/telemetry/binary_schema_archive.h"
+#include "mjlib/telemetry/binary_write_archive.h"
+
+using namespace mjmech::base;
+
+namespace {
+struct Inner {
+  double value = 0.0;
+  bool flag = false;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(value));
+    a->Visit(MJ_NVP(flag));
+  }
+};
+
+struct Outer {
+  int32_t count = 0;
+  std::string label;
+  Inner inner;
+  std::vector<Inner> items;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(label));
+    a->Visit(MJ_NVP(inner));
+    a->Visit(MJ_NVP(items));
+  }
+};
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryFieldsBasic) {
+  Outer outer;
+  outer.count = -3;
+  outer.label = "hi";
+  outer.inner.value = 1.5;
+  outer.inner.flag = true;
+  outer.items.resize(2);
+  outer.items[1].value = 2.25;
+
+  mjlib::base::FastOStringStream stream;
+  mjlib::telemetry::BinaryWriteArchive(stream).Accept(&outer);
+  const std::string data = stream.str();
+
+  const mjlib::telemetry::BinarySchemaParser parser(
+      mjlib::telemetry::BinarySchemaArchive::schema<Outer>(), "outer");
+
+  std::vector<TelemetryField> fields;
+  BOOST_TEST(DecodeTelemetryFields(parser.root(), data, &fields));
+
+  const std::vector<std::pair<std::string, std::string>> expected = {
+    {"count", "-3"},
+    {"label", "hi"},
+    {"inner.value", "1.5"},
+    {"inner.flag", "true"},
+    {"items.0.value", "0"},
+    {"items.0.flag", "false"},
+    {"items.1.value", "2.25"},
+    {"items.1.flag", "false"},
+  };
+  BOOST_TEST_REQUIRE(fields.size() == expected.size());
+  for (size_t i = 0; i < expected.size(); i++) {
+    BOOST_TEST(fields[i].name == expected[i].first);
+    BOOST_TEST(fields[i].value == expected[i].second);
+  }
+
+  // A truncated record is reported, with what came before it.
+  fields.clear();
+  BOOST_TEST(!DecodeTelemetryFields(
+                 parser.root(), std::string_view(data).substr(0, 5), &fields));
+  BOOST_TEST(fields.size() < expected.size());
+}
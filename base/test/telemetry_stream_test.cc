@@ -0,0 +1,293 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/telemetry_stream.h"
+
+#include <algorithm>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::base;
+
+namespace {
+struct Fixture {
+  using Encoder = TelemetryStreamEncoder;
+  using Decoder = TelemetryStreamDecoder;
+
+  Fixture(int fec_group_size = 0, size_t max_datagram_size = 200,
+          const TelemetryStreamDecoder::Options& decoder_options = {})
+      : encoder([&]() {
+          Encoder::Options options;
+          options.stream_id = 3;
+          options.max_datagram_size = max_datagram_size;
+          options.fec_group_size = fec_group_size;
+          return options;
+        }(),
+        [this](std::string_view datagram) {
+          datagrams.push_back(std::string(datagram));
+        }),
+        decoder(
+            [this](const Decoder::Record& record) {
+              schemas.push_back(record.name + ":" + record.schema);
+            },
+            [this](const Decoder::Record& record, int64_t timestamp_us,
+                   std::string_view data) {
+              received.push_back(
+                  {record.name, timestamp_us, std::string(data)});
+            },
+            decoder_options) {}
+
+  void DeliverAll(std::vector<size_t> drop = {}) {
+    for (size_t i = 0; i < datagrams.size(); i++) {
+      if (std::find(drop.begin(), drop.end(), i) != drop.end()) { continue; }
+      decoder.Process(datagrams[i]);
+    }
+    datagrams.clear();
+  }
+
+  struct Item {
+    std::string name;
+    int64_t timestamp_us = 0;
+    std::string data;
+  };
+
+  std::vector<std::string> datagrams;
+  std::vector<std::string> schemas;
+  std::vector<Item> received;
+
+  Encoder encoder;
+  Decoder decoder;
+};
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamBasic) {
+  Fixture dut;
+
+  dut.encoder.WriteSchema(1, "imu", "schema1");
+  dut.encoder.WriteData(1, 1000, "abc");
+  dut.encoder.WriteData(1, 2000, "def");
+  dut.encoder.Flush();
+
+  BOOST_TEST(dut.datagrams.size() == 1);
+  for (const auto& datagram : dut.datagrams) {
+    BOOST_TEST(datagram.size() <= 200);
+  }
+
+  dut.DeliverAll();
+
+  BOOST_TEST_REQUIRE(dut.schemas.size() == 1);
+  BOOST_TEST(dut.schemas[0] == "imu:schema1");
+  BOOST_TEST_REQUIRE(dut.received.size() == 2);
+  BOOST_TEST(dut.received[0].name == "imu");
+  BOOST_TEST(dut.received[0].timestamp_us == 1000);
+  BOOST_TEST(dut.received[0].data == "abc");
+  BOOST_TEST(dut.received[1].data == "def");
+
+  // A repeated schema does not trigger a second callback.
+  dut.encoder.WriteSchema(1, "imu", "schema1");
+  dut.encoder.Flush();
+  dut.DeliverAll();
+  BOOST_TEST(dut.schemas.size() == 1);
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamUnknownRecord) {
+  Fixture dut;
+
+  dut.encoder.WriteData(4, 1000, "abc");
+  dut.encoder.Flush();
+  dut.DeliverAll();
+
+  BOOST_TEST(dut.received.size() == 0);
+  BOOST_TEST(dut.decoder.stats().unknown_record == 1);
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamFragment) {
+  Fixture dut;
+
+  std::string big;
+  for (int i = 0; i < 1000; i++) { big.push_back(static_cast<char>(i * 7)); }
+
+  dut.encoder.WriteSchema(2, "big", "s");
+  dut.encoder.WriteData(2, 5, big);
+  dut.encoder.WriteData(2, 6, "small");
+  dut.encoder.Flush();
+
+  BOOST_TEST(dut.datagrams.size() > 5);
+  for (const auto& datagram : dut.datagrams) {
+    BOOST_TEST(datagram.size() <= 200);
+  }
+
+  dut.DeliverAll();
+
+  BOOST_TEST_REQUIRE(dut.received.size() == 2);
+  BOOST_TEST(dut.received[0].data == big);
+  BOOST_TEST(dut.received[0].timestamp_us == 5);
+  BOOST_TEST(dut.received[1].data == "small");
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamLossWithoutFec) {
+  Fixture dut;
+
+  std::string big(600, 'x');
+  dut.encoder.WriteSchema(2, "big", "s");
+  dut.encoder.Flush();
+  dut.DeliverAll();
+
+  dut.encoder.WriteData(2, 5, big);
+  dut.encoder.Flush();
+  BOOST_TEST_REQUIRE(dut.datagrams.size() > 2);
+  dut.DeliverAll({1});
+
+  BOOST_TEST(dut.received.size() == 0);
+  BOOST_TEST(dut.decoder.stats().lost == 1);
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamFecRecover) {
+  Fixture dut(4);
+
+  std::string big;
+  for (int i = 0; i < 700; i++) { big.push_back(static_cast<char>(i * 3)); }
+
+  dut.encoder.WriteSchema(2, "big", "s");
+  dut.encoder.WriteData(2, 5, big);
+  dut.encoder.WriteData(2, 6, "tail");
+  dut.encoder.Flush();
+
+  BOOST_TEST(dut.encoder.stats().parity_datagrams >= 1);
+
+  // Drop one datagram from the first group.
+  dut.DeliverAll({2});
+
+  BOOST_TEST(dut.decoder.stats().recovered == 1);
+  BOOST_TEST_REQUIRE(dut.received.size() == 2);
+  BOOST_TEST(dut.received[0].data == big);
+  BOOST_TEST(dut.received[1].data == "tail");
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamFecTooManyLost) {
+  Fixture dut(4);
+
+  std::string big(700, 'y');
+  dut.encoder.WriteSchema(2, "big", "s");
+  dut.encoder.Flush();
+  dut.DeliverAll();
+
+  dut.encoder.WriteData(2, 5, big);
+  dut.encoder.Flush();
+
+  dut.DeliverAll({0, 1});
+
+  BOOST_TEST(dut.decoder.stats().recovered == 0);
+  BOOST_TEST(dut.received.size() == 0);
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamMalformed) {
+  Fixture dut;
+
+  dut.decoder.Process("");
+  dut.decoder.Process("garbage that is long enough");
+  BOOST_TEST(dut.decoder.stats().malformed == 2);
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamMessageTooLarge) {
+  TelemetryStreamDecoder::Options options;
+  options.max_message_size = 500;
+  Fixture dut(0, 200, options);
+
+  dut.encoder.WriteSchema(2, "big", "s");
+  dut.encoder.Flush();
+  dut.DeliverAll();
+
+  // Every fragment of this claims a 1000 byte message, so none of
+  // them are accepted.
+  dut.encoder.WriteData(2, 5, std::string(1000, 'z'));
+  dut.encoder.Flush();
+  const auto fragments = dut.datagrams.size();
+  BOOST_TEST(fragments > 5);
+  dut.DeliverAll();
+
+  BOOST_TEST(dut.received.size() == 0);
+  BOOST_TEST(dut.decoder.stats().malformed == fragments);
+
+  // Smaller messages still get through.
+  dut.encoder.WriteData(2, 6, std::string(400, 'w'));
+  dut.encoder.Flush();
+  dut.DeliverAll();
+  BOOST_TEST_REQUIRE(dut.received.size() == 1);
+  BOOST_TEST(dut.received[0].data == std::string(400, 'w'));
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamDuplicateFragment) {
+  Fixture dut;
+
+  dut.encoder.WriteSchema(2, "big", "s");
+  dut.encoder.Flush();
+  dut.DeliverAll();
+
+  std::string big;
+  for (int i = 0; i < 400; i++) { big.push_back(static_cast<char>(i * 5)); }
+  dut.encoder.WriteData(2, 5, big);
+  dut.encoder.Flush();
+  BOOST_TEST_REQUIRE(dut.datagrams.size() == 3);
+
+  // The first fragment arrives twice, which must not stand in for the
+  // last one.
+  dut.decoder.Process(dut.datagrams[0]);
+  dut.decoder.Process(dut.datagrams[0]);
+  dut.decoder.Process(dut.datagrams[1]);
+  BOOST_TEST(dut.received.size() == 0);
+  BOOST_TEST(dut.decoder.stats().duplicate == 1);
+
+  dut.decoder.Process(dut.datagrams[2]);
+  BOOST_TEST_REQUIRE(dut.received.size() == 1);
+  BOOST_TEST(dut.received[0].data == big);
+}
+
+BOOST_AUTO_TEST_CASE(TelemetryStreamSenderRestart) {
+  TelemetryStreamDecoder::Options options;
+  options.restart_threshold = 16;
+  Fixture dut(4, 200, options);
+
+  const std::string big(3000, 'r');
+  dut.encoder.WriteSchema(2, "big", "s");
+  for (int i = 0; i < 5; i++) { dut.encoder.WriteData(2, i, big); }
+  dut.encoder.Flush();
+  BOOST_TEST_REQUIRE(dut.datagrams.size() > 80);
+  dut.DeliverAll();
+  BOOST_TEST(dut.received.size() == 5);
+
+  // A rebooted sender starts again from sequence and message id 0.
+  TelemetryStreamEncoder::Options encoder_options;
+  encoder_options.stream_id = 3;
+  encoder_options.max_datagram_size = 200;
+  encoder_options.fec_group_size = 4;
+  TelemetryStreamEncoder restarted(
+      encoder_options, [&](std::string_view datagram) {
+        dut.datagrams.push_back(std::string(datagram));
+      });
+
+  std::string data;
+  for (int i = 0; i < 700; i++) { data.push_back(static_cast<char>(i * 3)); }
+  restarted.WriteSchema(2, "big", "s");
+  restarted.WriteData(2, 10, data);
+  restarted.Flush();
+  dut.DeliverAll({2});
+
+  BOOST_TEST(dut.decoder.stats().restarts == 1);
+  BOOST_TEST(dut.decoder.stats().recovered == 1);
+  BOOST_TEST(dut.decoder.stats().lost == 1);
+  BOOST_TEST_REQUIRE(dut.received.size() == 6);
+  BOOST_TEST(dut.received[5].timestamp_us == 10);
+  BOOST_TEST(dut.received[5].data == data);
+}
@@ -0,0 +1,76 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "base/triple_buffer.h"
+
+#include <thread>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using mjmech::base::TripleBuffer;
+
+BOOST_AUTO_TEST_CASE(TripleBufferBasicTest) {
+  TripleBuffer<int> dut;
+
+  BOOST_TEST(!dut.Update());
+  BOOST_TEST(dut.front() == 0);
+
+  dut.Write(1);
+  BOOST_TEST(dut.Update());
+  BOOST_TEST(dut.front() == 1);
+  BOOST_TEST(!dut.Update());
+  BOOST_TEST(dut.front() == 1);
+
+  // Only the newest value is seen.
+  dut.Write(2);
+  dut.Write(3);
+  dut.back() = 4;
+  dut.Publish();
+  BOOST_TEST(dut.Update());
+  BOOST_TEST(dut.front() == 4);
+  BOOST_TEST(!dut.Update());
+}
+
+BOOST_AUTO_TEST_CASE(TripleBufferThreadTest) {
+  struct Value {
+    int a = 0;
+    int b = 0;
+  };
+
+  TripleBuffer<Value> dut;
+  constexpr int kCount = 200000;
+
+  std::thread writer([&]() {
+    for (int i = 1; i <= kCount; i++) {
+      dut.back().a = i;
+      dut.back().b = -i;
+      dut.Publish();
+    }
+  });
+
+  int last = 0;
+  int updates = 0;
+  while (last < kCount) {
+    if (!dut.Update()) { continue; }
+    updates++;
+    const auto& value = dut.front();
+    // Values are never torn, and never go backwards.
+    BOOST_REQUIRE_EQUAL(value.a, -value.b);
+    BOOST_REQUIRE_GT(value.a, last);
+    last = value.a;
+  }
+
+  writer.join();
+  BOOST_TEST(updates > 0);
+}
@@ -0,0 +1,81 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+namespace mjmech {
+namespace base {
+
+/// Pass the most recent value from one writer thread to one reader
+/// thread without locks.
+///
+/// The writer fills in back() and calls Publish().  The reader calls
+/// Update(), then looks at front().  Neither side ever waits on the
+/// other, and values which the reader does not get to in time are
+/// overwritten.
+template <typename T>
+class TripleBuffer {
+ public:
+  TripleBuffer() {}
+
+  TripleBuffer(const TripleBuffer&) = delete;
+  TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+  // Writer side.
+
+  T& back() { return slots_[back_]; }
+
+  void Publish() {
+    back_ = middle_.exchange(back_ | kFresh, std::memory_order_acq_rel) &
+        kIndexMask;
+  }
+
+  void Write(T value) {
+    back() = std::move(value);
+    Publish();
+  }
+
+  // Reader side.
+
+  /// Make the most recently published value available in front().
+  /// Return false if nothing new has been published since the last
+  /// call.
+  bool Update() {
+    if ((middle_.load(std::memory_order_acquire) & kFresh) == 0) {
+      return false;
+    }
+    front_ = middle_.exchange(front_, std::memory_order_acq_rel) &
+        kIndexMask;
+    return true;
+  }
+
+  const T& front() const { return slots_[front_]; }
+  T& front() { return slots_[front_]; }
+
+ private:
+  static constexpr uint8_t kIndexMask = 0x03;
+  static constexpr uint8_t kFresh = 0x04;
+
+  T slots_[3] = {};
+
+  uint8_t back_ = 0;
+  std::atomic<uint8_t> middle_{1};
+  uint8_t front_ = 2;
+};
+
+}
+}
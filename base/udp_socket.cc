@@ -136,6 +136,17 @@ void UdpSocket::PrepareSocket() {
     log_.debug("Setting do-not-route option");
     socket_.set_option(boost::asio::socket_base::do_not_route(true));
   }
+
+  if (parameters_.reuse_port) {
+    log_.debug("Setting reuse-port option");
+    int fd = socket_.native_handle();
+    int val = 1;
+    int result = ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT,
+                              &val, sizeof(val));
+    if (result < 0) {
+      throw mjlib::base::system_error(errno, boost::system::generic_category());
+    }
+  }
 }
 
 
@@ -116,6 +116,11 @@ class UdpSocket {
     // Warn and drop packets if more than that many are in flight.
     int max_tx_pending = 16;
 
+    // Set SO_REUSEPORT, so that several sockets may bind to the same
+    // port.  For unicast the kernel then load balances flows across
+    // them by source address, for multicast each gets a copy.
+    bool reuse_port = false;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(default_port));
@@ -125,6 +130,7 @@ class UdpSocket {
       a->Visit(MJ_NVP(dont_fragment));
       a->Visit(MJ_NVP(dont_route));
       a->Visit(MJ_NVP(max_tx_pending));
+      a->Visit(MJ_NVP(reuse_port));
     };
   };
 
@@ -0,0 +1,74 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/balance_gains.h"
+
+#include <cmath>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/limit.h"
+#include "mjlib/base/system_error.h"
+
+namespace mjmech {
+namespace mech {
+
+BalanceGainTable::BalanceGainTable(const std::vector<BalanceGain>& gains)
+    : gains_(gains) {
+  mjlib::base::system_error::throw_if(
+      gains_.empty(), "balance gain table is empty");
+
+  min_pitch_deg_ = gains_.front().pitch_deg;
+  if (gains_.size() == 1) { return; }
+
+  const double step = gains_[1].pitch_deg - gains_[0].pitch_deg;
+  for (size_t i = 1; i < gains_.size(); i++) {
+    const double this_step = gains_[i].pitch_deg - gains_[i - 1].pitch_deg;
+    mjlib::base::system_error::throw_if(
+        !(step > 0.0) || std::abs(this_step - step) > 1e-6 * step,
+        fmt::format("balance gains must be evenly spaced, entry {} is at {}",
+                    i, gains_[i].pitch_deg));
+  }
+  inverse_step_ = 1.0 / step;
+}
+
+BalanceGainTable::Output BalanceGainTable::Evaluate(const State& x) const {
+  // Find the pair of entries to interpolate between.
+  const int last = static_cast<int>(gains_.size()) - 1;
+  const double position = mjlib::base::Limit(
+      (x.pitch_deg - min_pitch_deg_) * inverse_step_,
+      0.0, static_cast<double>(last));
+  const int index = std::min(static_cast<int>(position), std::max(0, last - 1));
+  const double fraction = position - index;
+
+  const auto& a = gains_[index];
+  const auto& b = gains_[std::min(index + 1, last)];
+  const auto lerp = [&](double BalanceGain::* k) {
+    return a.*k + fraction * (b.*k - a.*k);
+  };
+
+  Output result;
+  result.common_Nm = -(
+      lerp(&BalanceGain::k_pitch) * x.pitch_deg +
+      lerp(&BalanceGain::k_pitch_rate) * x.pitch_rate_dps +
+      lerp(&BalanceGain::k_velocity) * x.velocity_error_mps +
+      lerp(&BalanceGain::k_position) * x.position_error_m);
+  result.differential_Nm = -(
+      lerp(&BalanceGain::k_yaw) * x.yaw_error_deg +
+      lerp(&BalanceGain::k_yaw_rate) * x.yaw_rate_error_dps);
+  return result;
+}
+
+}
+}
@@ -0,0 +1,103 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <vector>
+
+#include "mjlib/base/visitor.h"
+
+namespace mjmech {
+namespace mech {
+
+/// State feedback gains for the balance mode at pitch_deg.  These are
+/// generated offline by utils/balance_gains.py.
+///
+/// The only equilibrium is upright and at rest, where no torque is
+/// needed, and every state below is measured from it.  Other pitches
+/// are not equilibria, so rather than being linearized about, each
+/// entry is designed for the dynamics written exactly as
+/// A(pitch_deg) x about upright.  That is why the gains apply to the
+/// absolute pitch with no trim torque.
+///
+/// The common mode joint torque is:
+///
+///  -(k_pitch * pitch_deg + k_pitch_rate * pitch_rate_dps +
+///    k_velocity * velocity_error_mps + k_position * position_error_m)
+///
+/// and the differential torque is:
+///
+///  -(k_yaw * yaw_error_deg + k_yaw_rate * yaw_rate_error_dps)
+struct BalanceGain {
+  double pitch_deg = 0.0;
+
+  double k_pitch = 0.0;
+  double k_pitch_rate = 0.0;
+  double k_velocity = 0.0;
+  double k_position = 0.0;
+
+  double k_yaw = 0.0;
+  double k_yaw_rate = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(pitch_deg));
+    a->Visit(MJ_NVP(k_pitch));
+    a->Visit(MJ_NVP(k_pitch_rate));
+    a->Visit(MJ_NVP(k_velocity));
+    a->Visit(MJ_NVP(k_position));
+    a->Visit(MJ_NVP(k_yaw));
+    a->Visit(MJ_NVP(k_yaw_rate));
+  }
+};
+
+/// Schedules BalanceGain by pitch.
+///
+/// The table must be sorted by pitch_deg with even spacing, so that
+/// finding an entry is arithmetic rather than a search, and each
+/// evaluation is a fixed, small number of operations.  Gains are
+/// interpolated between entries and held beyond either end.
+class BalanceGainTable {
+ public:
+  BalanceGainTable() {}
+
+  /// Throws if @p gains is empty or unevenly spaced.
+  explicit BalanceGainTable(const std::vector<BalanceGain>& gains);
+
+  bool empty() const { return gains_.empty(); }
+
+  struct State {
+    double pitch_deg = 0.0;
+    double pitch_rate_dps = 0.0;
+    double velocity_error_mps = 0.0;
+    double position_error_m = 0.0;
+    double yaw_error_deg = 0.0;
+    double yaw_rate_error_dps = 0.0;
+  };
+
+  struct Output {
+    double common_Nm = 0.0;
+    double differential_Nm = 0.0;
+  };
+
+  Output Evaluate(const State&) const;
+
+ private:
+  std::vector<BalanceGain> gains_;
+  double min_pitch_deg_ = 0.0;
+  double inverse_step_ = 0.0;
+};
+
+}
+}
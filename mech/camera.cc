@@ -0,0 +1,65 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/camera.h"
+
+#include <boost/asio/post.hpp>
+
+#include "mjlib/base/clipp_archive.h"
+
+namespace mjmech {
+namespace mech {
+
+class Camera::Impl {
+ public:
+  Impl(base::Context& context)
+      : executor_(context.executor) {}
+
+  void AsyncStart(mjlib::io::ErrorCallback callback) {
+    if (parameters_.enabled) {
+      driver_ = std::make_unique<CameraDriver>(parameters_.driver);
+
+      // Give everyone else a chance to add readers first.
+      boost::asio::post(executor_, [this]() { driver_->Start(); });
+    }
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+  boost::asio::any_io_executor executor_;
+  Parameters parameters_;
+  std::unique_ptr<CameraDriver> driver_;
+};
+
+Camera::Camera(base::Context& context)
+    : impl_(std::make_unique<Impl>(context)) {}
+
+Camera::~Camera() {}
+
+void Camera::AsyncStart(mjlib::io::ErrorCallback callback) {
+  impl_->AsyncStart(std::move(callback));
+}
+
+CameraDriver* Camera::driver() {
+  return impl_->driver_.get();
+}
+
+clipp::group Camera::program_options() {
+  return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
+}
+
+}
+}
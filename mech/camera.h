@@ -0,0 +1,74 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <clipp/clipp.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+
+#include "base/context.h"
+
+#include "mech/camera_driver.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Owns the single CameraDriver which every image consumer shares.
+///
+/// The driver is created during AsyncStart, and capture begins once
+/// control returns to the executor.  Components which are started
+/// after this one in the same batch can therefore add their readers
+/// from their own AsyncStart and still see every frame.
+class Camera : boost::noncopyable {
+ public:
+  /// Consumers take one of these, which returns nullptr when the
+  /// camera is disabled.
+  using Getter = std::function<CameraDriver*()>;
+
+  Camera(base::Context&);
+  ~Camera();
+
+  void AsyncStart(mjlib::io::ErrorCallback);
+
+  /// Valid after AsyncStart, nullptr if disabled.
+  CameraDriver* driver();
+
+  struct Parameters {
+    bool enabled = false;
+
+    CameraDriver::Options driver;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(enabled));
+      driver.Serialize(a);
+    }
+  };
+
+  clipp::group program_options();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -14,13 +14,27 @@
 
 #include "mech/camera_driver.h"
 
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
 #include <thread>
+#include <vector>
 
 #include <boost/date_time/posix_time/posix_time.hpp>
 
 #include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/videoio/videoio.hpp>
-#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include "mjlib/base/assert.h"
+#include "mjlib/base/fail.h"
+
+#include "base/common.h"
+#include "base/cpu_affinity.h"
+
+#include "mech/camera_playback.h"
 
 #ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
 #include <raspicam_cv.h>
@@ -29,70 +43,320 @@
 namespace mjmech {
 namespace mech {
 
-#ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
 class CameraDriver::Impl {
  public:
   Impl(const Options& options)
-      : thread_(std::bind(&Impl::Run, this, options)) {
+      : options_(options),
+        pool_(options.pool_size +
+              (IsRecording(options) ?
+               CameraRecorder::max_frames(options.record) : 0),
+              options.width, options.height, CV_8UC3) {
+    // The recorder starts its threads as soon as it exists.
+    if (IsRecording(options_)) {
+      recorder_ = std::make_unique<CameraRecorder>(options_.record);
+    }
+  }
+
+  static bool IsRecording(const Options& options) {
+    return options.record_every >= 1 && !options.record.path.empty();
   }
 
   ~Impl() {
     done_.store(true);
-    thread_.join();
+    if (thread_.joinable()) { thread_.join(); }
+
+    CloseQueues();
+  }
+
+  void Start() {
+    MJ_ASSERT(!thread_.joinable());
+    if (!options_.source.empty()) {
+      thread_ = std::thread(std::bind(&Impl::RunPlayback, this));
+      return;
+    }
+#ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
+    thread_ = std::thread(std::bind(&Impl::Run, this));
+#endif
+  }
+
+  std::shared_ptr<CameraLatestFrame> AddLatestFrameReader() {
+    auto result = std::make_shared<CameraLatestFrame>();
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    latest_.push_back(result);
+    return result;
+  }
+
+  std::shared_ptr<CameraFrameQueue> AddFrameQueue(size_t capacity) {
+    auto result = std::make_shared<CameraFrameQueue>(capacity);
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    queues_.push_back(result);
+    return result;
   }
 
-  void Run(Options options) {
+  Stats stats() const {
+    Stats result;
+    result.frames = frames_.load();
+    result.pool_exhausted = pool_exhausted_.load();
+    result.playback_rejected = playback_rejected_.load();
+    return result;
+  }
+
+#ifdef COM_GITHUB_MJBOTS_RASPBERRYPI
+  void Run() {
+    mjlib::base::FailIf(base::SetThreadAffinity());
     raspicam::RaspiCam_Cv camera;
-    camera.set(cv::CAP_PROP_FRAME_WIDTH, options.width);
-    camera.set(cv::CAP_PROP_FRAME_HEIGHT, options.height);
-    camera.set(cv::CAP_PROP_MODE, options.mode);
-    camera.set(cv::CAP_PROP_FPS, options.fps);
-    camera.setRotation(options.rotation);
+    camera.set(cv::CAP_PROP_FRAME_WIDTH, options_.width);
+    camera.set(cv::CAP_PROP_FRAME_HEIGHT, options_.height);
+    camera.set(cv::CAP_PROP_MODE, options_.mode);
+    camera.set(cv::CAP_PROP_FPS, options_.fps);
+    camera.setRotation(options_.rotation);
     camera.set(cv::CAP_PROP_FORMAT, CV_8UC3);
     camera.open();
 
-    cv::Mat image;
-    uint16_t count = 0;
+    const auto latency = base::ConvertSecondsToDuration(
+        options_.capture_latency_s >= 0.0 ?
+        options_.capture_latency_s : 1.0 / options_.fps);
+
     while (!done_.load()) {
       camera.grab();
-      camera.retrieve(image);
-      if (options.record_every >= 1) {
-        if (count == 0) {
-          cv::imwrite(MakePath(options), image);
-          count = options.record_every - 1;
-        } else {
-          count--;
-        }
-      }
-      image_signal_(image);
+      // Stamp the frame before anything else, so that only the
+      // latency of grab() itself, and not our own work, is included.
+      const auto exposure =
+          boost::posix_time::microsec_clock::universal_time() - latency;
+
+      auto frame = pool_.Acquire();
+      if (!frame) {
+        pool_exhausted_++;
+        continue;
+      }
+
+      // The pool buffers are already the right size, so this does
+      // not allocate.
+      camera.retrieve(frame->image);
+      frame->timestamp = exposure;
+      frame->rotation_deg = options_.rotation;
+      Emit(std::move(frame));
+    }
+  }
+#endif
+
+  void RunPlayback() {
+    mjlib::base::FailIf(base::SetThreadAffinity());
+    CameraPlayback playback(options_.source);
+
+    const auto start = boost::posix_time::microsec_clock::universal_time();
+    const auto start_steady = std::chrono::steady_clock::now();
+    const double period_s = 1.0 / options_.fps;
+    const bool realtime = options_.playback_speed > 0.0;
+
+    cv::Mat decoded;
+    cv::Mat rotated;
+    cv::Mat converted;
+    uint64_t index = 0;
+    bool rewound = false;
+
+    while (!done_.load()) {
+      if (!playback.Read(&decoded)) {
+        // Stop if rewinding got us nothing, rather than spinning.
+        if (!options_.playback_loop || rewound) { break; }
+        playback.Rewind();
+        rewound = true;
+        continue;
+      }
+      rewound = false;
+
+      if (realtime) {
+        std::this_thread::sleep_until(
+            start_steady + std::chrono::microseconds(static_cast<int64_t>(
+                index * period_s / options_.playback_speed * 1e6)));
+      }
+
+      auto frame = pool_.Acquire();
+      while (!frame && !realtime && !done_.load()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        frame = pool_.Acquire();
+      }
+      if (!frame) {
+        pool_exhausted_++;
+        index++;
+        continue;
+      }
+
+      // Recordings from the camera are already rotated, so only apply
+      // whatever remains to reach the configured rotation.
+      Rotate(decoded,
+             ((options_.rotation - playback.rotation_deg()) % 360 + 360) % 360,
+             &rotated);
+      if (!ConvertToBgr(rotated, &converted)) {
+        playback_rejected_++;
+        index++;
+        continue;
+      }
+      Fit(converted, &frame->image);
+
+      // Timestamps advance at the camera rate regardless of the
+      // playback speed, so results do not depend on how fast the
+      // host is.
+      frame->timestamp = start + base::ConvertSecondsToDuration(
+          index * period_s);
+      frame->rotation_deg = options_.rotation;
+      index++;
+
+      Emit(std::move(frame));
+    }
+
+    // Let every frame readers know nothing more is coming.
+    CloseQueues();
+  }
+
+  /// Rotate clockwise by @p rotation_deg, which must be a multiple of
+  /// 90 to have any effect.
+  static void Rotate(const cv::Mat& input, int rotation_deg,
+                     cv::Mat* output) {
+    switch (rotation_deg) {
+      case 90: {
+        cv::rotate(input, *output, cv::ROTATE_90_CLOCKWISE);
+        return;
+      }
+      case 180: {
+        cv::rotate(input, *output, cv::ROTATE_180);
+        return;
+      }
+      case 270: {
+        cv::rotate(input, *output, cv::ROTATE_90_COUNTERCLOCKWISE);
+        return;
+      }
+    }
+    *output = input;
+  }
+
+  /// Convert to 8 bit BGR.  Return false if there is no sensible way
+  /// to.
+  static bool ConvertToBgr(const cv::Mat& input, cv::Mat* output) {
+    cv::Mat scaled;
+    switch (input.depth()) {
+      case CV_8U: {
+        scaled = input;
+        break;
+      }
+      case CV_16U: {
+        input.convertTo(scaled, CV_8U, 1.0 / 256.0);
+        break;
+      }
+      default: {
+        return false;
+      }
     }
+
+    switch (scaled.channels()) {
+      case 1: {
+        cv::cvtColor(scaled, *output, cv::COLOR_GRAY2BGR);
+        return true;
+      }
+      case 3: {
+        *output = scaled;
+        return true;
+      }
+      case 4: {
+        cv::cvtColor(scaled, *output, cv::COLOR_BGRA2BGR);
+        return true;
+      }
+    }
+    return false;
+  }
+
+  /// Scale @p input to fit within @p output, keeping its aspect
+  /// ratio, and fill the remainder with black.
+  static void Fit(const cv::Mat& input, cv::Mat* output) {
+    if (input.size() == output->size()) {
+      input.copyTo(*output);
+      return;
+    }
+
+    const double scale = std::min(
+        static_cast<double>(output->cols) / input.cols,
+        static_cast<double>(output->rows) / input.rows);
+    const cv::Size size(
+        std::max(1, static_cast<int>(std::round(input.cols * scale))),
+        std::max(1, static_cast<int>(std::round(input.rows * scale))));
+
+    *output = cv::Scalar::all(0);
+    cv::Mat region = (*output)(cv::Rect(
+        (output->cols - size.width) / 2, (output->rows - size.height) / 2,
+        size.width, size.height));
+    // The region is already the right size and type, so this writes
+    // in place.
+    cv::resize(input, region, size, 0, 0, cv::INTER_AREA);
+  }
+
+  void CloseQueues() {
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    for (auto& queue : queues_) { queue->Close(); }
   }
 
-  std::string MakePath(const Options& options) const {
-    const auto now = boost::posix_time::microsec_clock::universal_time();
-    return options.record_path + to_iso_string(now) + ".png";
+  void Emit(std::shared_ptr<CameraFrame> frame) {
+    frame->frame_number = frames_++;
+
+    CameraFramePtr shared = std::move(frame);
+
+    if (recorder_) {
+      if (record_count_ == 0) {
+        // The recorder holds a reference, and encodes on its own
+        // threads.
+        recorder_->Write(shared);
+        record_count_ = options_.record_every - 1;
+      } else {
+        record_count_--;
+      }
+    }
+
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    for (auto& latest : latest_) { latest->Write(shared); }
+    for (auto& queue : queues_) { queue->Push(shared); }
   }
 
+  const Options options_;
+  CameraFramePool pool_;
+  std::unique_ptr<CameraRecorder> recorder_;
+  int record_count_ = 0;
+
+  std::mutex readers_mutex_;
+  std::vector<std::shared_ptr<CameraLatestFrame>> latest_;
+  std::vector<std::shared_ptr<CameraFrameQueue>> queues_;
+
+  std::atomic<uint64_t> frames_{0};
+  std::atomic<uint64_t> pool_exhausted_{0};
+  std::atomic<uint64_t> playback_rejected_{0};
+
   std::thread thread_;
   std::atomic<bool> done_{false};
-  ImageSignal image_signal_;
-};
-#else
-class CameraDriver::Impl {
- public:
-  Impl(const Options&) {}
-
-  ImageSignal image_signal_;
 };
-#endif
 
 CameraDriver::CameraDriver(const Options& options)
     : impl_(std::make_unique<Impl>(options)) {}
 
 CameraDriver::~CameraDriver() {}
 
-CameraDriver::ImageSignal* CameraDriver::image_signal() {
-  return &impl_->image_signal_;
+void CameraDriver::Start() {
+  impl_->Start();
+}
+
+std::shared_ptr<CameraLatestFrame> CameraDriver::AddLatestFrameReader() {
+  return impl_->AddLatestFrameReader();
+}
+
+std::shared_ptr<CameraFrameQueue> CameraDriver::AddFrameQueue(
+    size_t capacity) {
+  return impl_->AddFrameQueue(capacity);
+}
+
+CameraDriver::Stats CameraDriver::stats() const {
+  return impl_->stats();
+}
+
+CameraRecorder::Stats CameraDriver::record_stats() const {
+  if (!impl_->recorder_) { return {}; }
+  return impl_->recorder_->stats();
 }
 
 }
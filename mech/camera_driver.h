@@ -14,17 +14,31 @@
 
 #pragma once
 
-#include <boost/signals2/signal.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
 
 #include <opencv2/core/core.hpp>
 
 #include "mjlib/base/visitor.h"
 #include "mjlib/io/async_types.h"
 
+#include "mech/camera_frame.h"
+#include "mech/camera_recorder.h"
+
 namespace mjmech {
 namespace mech {
 
 /// Read frames from a camera.
+///
+/// Each frame is captured into a buffer from a fixed pool and handed
+/// to readers by reference, so no reader can stall capture.  If every
+/// buffer is still held by readers, frames are dropped until one is
+/// released.
+///
+/// Frames come from the Raspberry Pi camera, or, when a source is
+/// configured, from a video file or directory of images played back
+/// at the configured rate.
 class CameraDriver {
  public:
   struct Options {
@@ -34,8 +48,34 @@ class CameraDriver {
     int fps = 60;
     int rotation = 270;
 
-    std::string record_path = "/tmp/mjbots-camera";
+    /// The time from the middle of the exposure until grab() returns.
+    /// raspicam does not expose the sensor timestamp, so frames are
+    /// stamped when grab() returns, less this.  If < 0, one frame
+    /// period at fps is assumed.
+    double capture_latency_s = -1.0;
+
+    /// If non-empty, play back this video file or directory of images
+    /// instead of using the camera.  Frames are rotated, except by
+    /// whatever CameraRecorder recorded was already applied, converted
+    /// to 8 bit BGR, then scaled to fit width x height with their
+    /// aspect ratio kept.
+    std::string source;
+
+    /// Relative to fps.  If <= 0, play back as fast as possible,
+    /// waiting for a free buffer rather than dropping frames.
+    double playback_speed = 1.0;
+    bool playback_loop = false;
+
+    /// The number of preallocated frame buffers.  This must exceed
+    /// the number of frames readers hold at once, including up to 3
+    /// for each latest frame reader.  Buffers for the recorder are
+    /// added to this.
+    int pool_size = 8;
+
+    /// If >= 1, and record.path is set, every Nth frame is handed to
+    /// a CameraRecorder.
     int record_every = -1;
+    CameraRecorder::Options record;
 
     template <typename Archive>
     void Serialize(Archive* a) {
@@ -44,17 +84,44 @@ class CameraDriver {
       a->Visit(MJ_NVP(mode));
       a->Visit(MJ_NVP(fps));
       a->Visit(MJ_NVP(rotation));
-      a->Visit(MJ_NVP(record_path));
+      a->Visit(MJ_NVP(capture_latency_s));
+      a->Visit(MJ_NVP(source));
+      a->Visit(MJ_NVP(playback_speed));
+      a->Visit(MJ_NVP(playback_loop));
+      a->Visit(MJ_NVP(pool_size));
       a->Visit(MJ_NVP(record_every));
+      a->Visit(MJ_NVP(record));
     }
   };
 
   CameraDriver(const Options& options);
   ~CameraDriver();
 
-  using ImageSignal = boost::signals2::signal<void (const cv::Mat&)>;
-  // This will be emitted from a background thread.
-  ImageSignal* image_signal();
+  /// Begin capturing in a background thread.  Readers added before
+  /// this will see every frame.
+  void Start();
+
+  /// Return a buffer which always has the most recent frame.  It
+  /// must only be read from one thread.
+  std::shared_ptr<CameraLatestFrame> AddLatestFrameReader();
+
+  /// Return a queue which receives every frame, up to @p capacity
+  /// outstanding.  It is closed when the driver is destroyed, or
+  /// when playback reaches the end of its source.
+  std::shared_ptr<CameraFrameQueue> AddFrameQueue(size_t capacity);
+
+  struct Stats {
+    uint64_t frames = 0;
+    /// Frames which were skipped because no buffer was free.
+    uint64_t pool_exhausted = 0;
+    /// Played back frames with a depth or channel count which can not
+    /// be converted to BGR.
+    uint64_t playback_rejected = 0;
+  };
+
+  Stats stats() const;
+
+  CameraRecorder::Stats record_stats() const;
 
  private:
   class Impl;
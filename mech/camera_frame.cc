@@ -0,0 +1,84 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/camera_frame.h"
+
+#include <vector>
+
+namespace mjmech {
+namespace mech {
+
+class CameraFramePool::Impl : public std::enable_shared_from_this<Impl> {
+ public:
+  Impl(int size, int width, int height, int type) {
+    frames_.reserve(size);
+    free_.reserve(size);
+    for (int i = 0; i < size; i++) {
+      frames_.push_back(std::make_unique<CameraFrame>());
+      frames_.back()->image = cv::Mat(height, width, type);
+      free_.push_back(frames_.back().get());
+    }
+  }
+
+  std::shared_ptr<CameraFrame> Acquire() {
+    CameraFrame* frame = nullptr;
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (free_.empty()) { return {}; }
+      frame = free_.back();
+      free_.pop_back();
+    }
+
+    // The deleter keeps the pool alive for as long as any frame is
+    // out.
+    return std::shared_ptr<CameraFrame>(
+        frame, [self=shared_from_this()](CameraFrame* released) {
+          std::lock_guard<std::mutex> lock(self->mutex_);
+          self->free_.push_back(released);
+        });
+  }
+
+  int size() const { return frames_.size(); }
+
+  int available() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return free_.size();
+  }
+
+ private:
+  std::vector<std::unique_ptr<CameraFrame>> frames_;
+
+  mutable std::mutex mutex_;
+  std::vector<CameraFrame*> free_;
+};
+
+CameraFramePool::CameraFramePool(int size, int width, int height, int type)
+    : impl_(std::make_shared<Impl>(size, width, height, type)) {}
+
+CameraFramePool::~CameraFramePool() {}
+
+std::shared_ptr<CameraFrame> CameraFramePool::Acquire() {
+  return impl_->Acquire();
+}
+
+int CameraFramePool::size() const {
+  return impl_->size();
+}
+
+int CameraFramePool::available() const {
+  return impl_->available();
+}
+
+}
+}
@@ -0,0 +1,141 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include "base/triple_buffer.h"
+
+namespace mjmech {
+namespace mech {
+
+/// A single captured image.
+///
+/// Frames come from a CameraFramePool, and return to it when the
+/// last CameraFramePtr referring to them goes away.  Consumers must
+/// hold on to the CameraFramePtr, not a copy of the cv::Mat header,
+/// as the pixels are reused for a later frame.
+struct CameraFrame {
+  cv::Mat image;
+  boost::posix_time::ptime timestamp;
+  uint64_t frame_number = 0;
+  /// The clockwise rotation, in degrees, already applied to what the
+  /// sensor saw.
+  int rotation_deg = 0;
+};
+
+using CameraFramePtr = std::shared_ptr<const CameraFrame>;
+
+/// A fixed set of preallocated frames.
+class CameraFramePool : boost::noncopyable {
+ public:
+  CameraFramePool(int size, int width, int height, int type);
+  ~CameraFramePool();
+
+  /// Return a frame which no one else refers to, or nullptr if every
+  /// frame is still in use.  Frames may safely outlive the pool.
+  std::shared_ptr<CameraFrame> Acquire();
+
+  int size() const;
+  int available() const;
+
+ private:
+  class Impl;
+  std::shared_ptr<Impl> impl_;
+};
+
+/// Hand the most recent frame to a single reader thread, for
+/// consumers which do not care about frames they miss.
+using CameraLatestFrame = base::TripleBuffer<CameraFramePtr>;
+
+/// Hand every frame to a reader, up to a fixed number outstanding.
+/// Push never blocks, when the queue is full the frame is dropped
+/// and counted.
+///
+/// @p T must be default constructible and convertible to bool, like
+/// a shared_ptr.
+template <typename T>
+class FrameQueue : boost::noncopyable {
+ public:
+  FrameQueue(size_t capacity) : capacity_(capacity) {}
+
+  bool Push(T frame) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (closed_) { return false; }
+      if (queue_.size() >= capacity_) {
+        dropped_++;
+        return false;
+      }
+      queue_.push_back(std::move(frame));
+    }
+    cv_.notify_one();
+    return true;
+  }
+
+  /// Wait up to @p timeout for a frame.  Return nullptr on timeout or
+  /// once the queue is closed and empty.
+  template <typename Duration>
+  T Pop(Duration timeout) {
+    std::unique_lock<std::mutex> lock(mutex_);
+    cv_.wait_for(lock, timeout, [&]() { return closed_ || !queue_.empty(); });
+    if (queue_.empty()) { return {}; }
+    auto result = std::move(queue_.front());
+    queue_.pop_front();
+    return result;
+  }
+
+  /// Wake up any reader, and reject any further frames.
+  void Close() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      closed_ = true;
+    }
+    cv_.notify_all();
+  }
+
+  bool closed() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return closed_;
+  }
+
+  uint64_t dropped() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return dropped_;
+  }
+
+ private:
+  const size_t capacity_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  std::deque<T> queue_;
+  bool closed_ = false;
+  uint64_t dropped_ = 0;
+};
+
+using CameraFrameQueue = FrameQueue<CameraFramePtr>;
+
+}
+}
@@ -0,0 +1,598 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/camera_imu_alignment.h"
+
+#include <semaphore.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "mjlib/base/clipp_archive.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/system_error.h"
+
+#include "base/common.h"
+#include "base/cpu_affinity.h"
+#include "base/handler_util.h"
+#include "base/logging.h"
+#include "base/spsc_queue.h"
+#include "base/telemetry_registry.h"
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+struct Status {
+  boost::posix_time::ptime timestamp;
+
+  /// imu_timestamp = camera timestamp + offset_s
+  double offset_s = 0.0;
+
+  /// The most recent estimate, whether or not it was accepted.
+  double raw_offset_s = 0.0;
+  double correlation = 0.0;
+  double optical_rate_std_dps = 0.0;
+  int64_t updates = 0;
+
+  int64_t frames = 0;
+  int64_t frames_valid = 0;
+
+  /// IMU samples lost because the vision thread fell behind.
+  int64_t imu_dropped = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(offset_s));
+    a->Visit(MJ_NVP(raw_offset_s));
+    a->Visit(MJ_NVP(correlation));
+    a->Visit(MJ_NVP(optical_rate_std_dps));
+    a->Visit(MJ_NVP(updates));
+    a->Visit(MJ_NVP(frames));
+    a->Visit(MJ_NVP(frames_valid));
+    a->Visit(MJ_NVP(imu_dropped));
+  }
+};
+
+struct FrameAttitude {
+  boost::posix_time::ptime timestamp;
+  uint64_t frame_number = 0;
+  boost::posix_time::ptime imu_timestamp;
+  bool valid = false;
+  AttitudeData attitude;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(frame_number));
+    a->Visit(MJ_NVP(imu_timestamp));
+    a->Visit(MJ_NVP(valid));
+    a->Visit(MJ_NVP(attitude));
+  }
+};
+
+double ToSeconds(boost::posix_time::ptime time) {
+  return base::ConvertPtimeToMicroseconds(time) * 1e-6;
+}
+
+}
+
+bool InterpolateRate(const std::vector<RateSample>& samples,
+                     double time_s, double* rate_dps) {
+  if (samples.empty() ||
+      time_s < samples.front().time_s ||
+      time_s > samples.back().time_s) {
+    return false;
+  }
+  auto it = std::lower_bound(
+      samples.begin(), samples.end(), time_s,
+      [](const auto& sample, double t) { return sample.time_s < t; });
+  if (it == samples.begin()) {
+    *rate_dps = it->rate_dps;
+    return true;
+  }
+  const auto& b = *it;
+  const auto& a = *(it - 1);
+  const double f = (time_s - a.time_s) / (b.time_s - a.time_s);
+  *rate_dps = a.rate_dps + f * (b.rate_dps - a.rate_dps);
+  return true;
+}
+
+OffsetEstimate FindOffset(const std::vector<RateSample>& optical,
+                          const std::vector<RateSample>& imu,
+                          double max_offset_s, double step_s) {
+  OffsetEstimate result;
+
+  std::vector<double> a;
+  std::vector<double> b;
+  a.reserve(optical.size());
+  b.reserve(optical.size());
+
+  for (double offset = -max_offset_s; offset <= max_offset_s;
+       offset += step_s) {
+    a.clear();
+    b.clear();
+    for (const auto& sample : optical) {
+      double imu_rate = 0.0;
+      if (!InterpolateRate(imu, sample.time_s + offset, &imu_rate)) {
+        continue;
+      }
+      a.push_back(sample.rate_dps);
+      b.push_back(imu_rate);
+    }
+
+    // Require most of the window to overlap, so that the edges of
+    // the search range are not favored by short, noisy overlaps.
+    if (a.size() < 10 || a.size() * 5 < optical.size() * 4) { continue; }
+
+    double mean_a = 0.0;
+    double mean_b = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+      mean_a += a[i];
+      mean_b += b[i];
+    }
+    mean_a /= a.size();
+    mean_b /= b.size();
+
+    double cov = 0.0;
+    double var_a = 0.0;
+    double var_b = 0.0;
+    for (size_t i = 0; i < a.size(); i++) {
+      const double da = a[i] - mean_a;
+      const double db = b[i] - mean_b;
+      cov += da * db;
+      var_a += da * da;
+      var_b += db * db;
+    }
+    if (var_a <= 0.0 || var_b <= 0.0) { continue; }
+
+    const double correlation = cov / std::sqrt(var_a * var_b);
+    if (correlation > result.correlation) {
+      result.correlation = correlation;
+      result.offset_s = offset;
+    }
+  }
+
+  return result;
+}
+
+bool InterpolateAttitude(const std::deque<AttitudeData>& history,
+                         boost::posix_time::ptime timestamp,
+                         AttitudeData* result) {
+  if (history.empty() ||
+      timestamp < history.front().timestamp ||
+      timestamp > history.back().timestamp) {
+    return false;
+  }
+
+  auto it = std::lower_bound(
+      history.begin(), history.end(), timestamp,
+      [](const auto& sample, const auto& t) {
+        return sample.timestamp < t;
+      });
+  if (it == history.begin()) {
+    *result = *it;
+    return true;
+  }
+
+  const auto& b = *it;
+  const auto& a = *(it - 1);
+  const double f =
+      base::ConvertDurationToSeconds(timestamp - a.timestamp) /
+      base::ConvertDurationToSeconds(b.timestamp - a.timestamp);
+
+  *result = f < 0.5 ? a : b;
+  result->timestamp = timestamp;
+  result->attitude = base::Quaternion(
+      a.attitude.eigen().slerp(f, b.attitude.eigen()));
+  result->rate_dps = a.rate_dps + f * (b.rate_dps - a.rate_dps);
+  result->accel_mps2 = a.accel_mps2 + f * (b.accel_mps2 - a.accel_mps2);
+  result->euler_deg = (180.0 / M_PI) * result->attitude.euler_rad();
+  return true;
+}
+
+CameraImuOffsetEstimator::CameraImuOffsetEstimator(
+    const Parameters& parameters)
+    : parameters_(parameters),
+      offset_s_(parameters.initial_offset_s) {}
+
+void CameraImuOffsetEstimator::AddImu(const AttitudeData& data) {
+  imu_history_.push_back(data);
+
+  // Each estimate searches the whole optical window at offsets up to
+  // max_offset_s, and needs most of it to overlap the IMU.
+  const double keep_s = std::max(
+      parameters_.history_s, parameters_.window_s + parameters_.max_offset_s);
+  const auto oldest =
+      data.timestamp - base::ConvertSecondsToDuration(keep_s);
+  while (imu_history_.front().timestamp < oldest) {
+    imu_history_.pop_front();
+  }
+}
+
+void CameraImuOffsetEstimator::AddOptical(const RateSample& sample) {
+  optical_.push_back(sample);
+
+  while (optical_.front().time_s < sample.time_s - parameters_.window_s) {
+    optical_.pop_front();
+  }
+}
+
+std::optional<CameraImuOffsetEstimator::Update>
+CameraImuOffsetEstimator::Estimate() {
+  if (optical_.size() < 10) { return {}; }
+
+  std::vector<RateSample> imu;
+  imu.reserve(imu_history_.size());
+  for (const auto& sample : imu_history_) {
+    imu.push_back({ToSeconds(sample.timestamp), sample.rate_dps.norm()});
+  }
+
+  const std::vector<RateSample> optical(optical_.begin(), optical_.end());
+
+  double mean = 0.0;
+  for (const auto& sample : optical) { mean += sample.rate_dps; }
+  mean /= optical.size();
+  double var = 0.0;
+  for (const auto& sample : optical) {
+    var += std::pow(sample.rate_dps - mean, 2);
+  }
+
+  Update result;
+  result.optical_rate_std_dps = std::sqrt(var / optical.size());
+
+  // Without enough rotation, any correlation is just noise.
+  if (result.optical_rate_std_dps < parameters_.min_rate_dps) {
+    return result;
+  }
+
+  result.estimate = FindOffset(
+      optical, imu, parameters_.max_offset_s, parameters_.offset_step_s);
+  if (result.estimate.correlation >= parameters_.min_correlation) {
+    if (updates_ == 0) {
+      offset_s_ = result.estimate.offset_s;
+    } else {
+      offset_s_ +=
+          parameters_.filter_alpha * (result.estimate.offset_s - offset_s_);
+    }
+    updates_++;
+  }
+
+  return result;
+}
+
+class CameraImuAlignment::Impl {
+ public:
+  Impl(base::Context& context,
+       Camera::Getter camera_getter,
+       ImuSignal* imu_signal)
+      : executor_(context.executor),
+        camera_getter_(std::move(camera_getter)),
+        imu_signal_(imu_signal) {
+    if (::sem_init(&imu_event_, 0, 0) < 0) {
+      throw mjlib::base::system_error::syserrno("initializing imu event");
+    }
+
+    context.telemetry_registry->Register(
+        "camera_imu_alignment", &status_signal_);
+    context.telemetry_registry->Register(
+        "camera_attitude", &frame_attitude_signal_);
+  }
+
+  ~Impl() {
+    imu_connection_.disconnect();
+    done_ = true;
+    ::sem_post(&imu_event_);
+    if (thread_.joinable()) { thread_.join(); }
+    ::sem_destroy(&imu_event_);
+  }
+
+  void AsyncStart(mjlib::io::ErrorCallback callback) {
+    estimator_.emplace(parameters_);
+    status_.offset_s = estimator_->offset_s();
+
+    auto* camera = camera_getter_();
+    if (camera) {
+      // Every frame is needed to measure rotation, so allow a little
+      // slack before dropping any.
+      queue_ = camera->AddFrameQueue(4);
+      thread_ = std::thread(std::bind(&Impl::Run, this));
+
+      // Without a camera, there is no reason to cost the control
+      // thread anything.
+      imu_connection_ = imu_signal_->connect(
+          std::bind(&Impl::HandleImu, this, std::placeholders::_1));
+    }
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+  std::shared_ptr<LatestAlignedFrame> AddLatestFrameReader() {
+    auto result = std::make_shared<LatestAlignedFrame>();
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    readers_.push_back(result);
+    return result;
+  }
+
+  std::shared_ptr<AlignedFrameQueue> AddFrameQueue(size_t capacity) {
+    auto result = std::make_shared<AlignedFrameQueue>(capacity);
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    queues_.push_back(result);
+    return result;
+  }
+
+  /// This is called from the control thread, so must not block or
+  /// allocate.
+  void HandleImu(const AttitudeData* data) {
+    if (!imu_queue_.Push(*data)) {
+      imu_dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    // sem_post takes no lock, and only enters the kernel when the
+    // vision thread is actually waiting.
+    if (imu_waiting_.exchange(false)) { ::sem_post(&imu_event_); }
+  }
+
+  /// Move everything the control thread has sent into the history.
+  void DrainImu() {
+    AttitudeData data;
+    while (imu_queue_.Pop(&data)) {
+      estimator_->AddImu(data);
+    }
+  }
+
+  void Run() {
+    mjlib::base::FailIf(base::SetThreadAffinity());
+    Loop();
+
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    for (auto& queue : queues_) { queue->Close(); }
+  }
+
+  void Loop() {
+    while (true) {
+      if (done_) { return; }
+
+      DrainImu();
+
+      auto frame = queue_->Pop(std::chrono::milliseconds(100));
+      if (!frame) {
+        if (queue_->closed()) { return; }
+        continue;
+      }
+
+      MeasureOpticalRate(*frame);
+      Tag(std::move(frame));
+
+      if (last_update_.is_not_a_date_time() ||
+          base::ConvertDurationToSeconds(
+              last_frame_time_ - last_update_) >=
+          parameters_.update_period_s) {
+        last_update_ = last_frame_time_;
+        UpdateOffset();
+      }
+    }
+  }
+
+  void MeasureOpticalRate(const CameraFrame& frame) {
+    const int width = parameters_.analysis_width;
+    const int height = frame.image.rows * width / frame.image.cols;
+
+    cv::cvtColor(frame.image, gray_, cv::COLOR_BGR2GRAY);
+    cv::resize(gray_, small_, cv::Size(width, height), 0, 0, cv::INTER_AREA);
+    small_.convertTo(current_, CV_32F);
+
+    if (window_.size() != current_.size()) {
+      cv::createHanningWindow(window_, current_.size(), CV_32F);
+      previous_ = cv::Mat();
+    }
+
+    if (!previous_.empty()) {
+      const double dt =
+          base::ConvertDurationToSeconds(frame.timestamp - last_frame_time_);
+      // Skip over gaps, where the frames may have too little in
+      // common to compare.
+      if (dt > 0.0 && dt < 0.2) {
+        const cv::Point2d shift =
+            cv::phaseCorrelate(previous_, current_, window_);
+        const double rad_per_pixel =
+            parameters_.hfov_deg * M_PI / 180.0 / width;
+        RateSample sample;
+        sample.time_s = ToSeconds(last_frame_time_) + 0.5 * dt;
+        sample.rate_dps = std::hypot(shift.x, shift.y) * rad_per_pixel / dt *
+            180.0 / M_PI;
+        estimator_->AddOptical(sample);
+      }
+    }
+
+    std::swap(previous_, current_);
+    last_frame_time_ = frame.timestamp;
+  }
+
+  void Tag(CameraFramePtr frame) {
+    auto aligned = std::make_shared<AlignedFrame>();
+    aligned->frame = frame;
+    aligned->imu_timestamp = frame->timestamp +
+        base::ConvertSecondsToDuration(estimator_->offset_s());
+
+    // The IMU sample after this frame may not have arrived yet, so
+    // wait for the control thread to signal that more have.
+    WaitForImu(aligned->imu_timestamp);
+
+    aligned->valid = InterpolateAttitude(
+        estimator_->imu_history(), aligned->imu_timestamp, &aligned->attitude);
+
+    frames_++;
+    if (aligned->valid) { frames_valid_++; }
+
+    FrameAttitude log;
+    log.timestamp = frame->timestamp;
+    log.frame_number = frame->frame_number;
+    log.imu_timestamp = aligned->imu_timestamp;
+    log.valid = aligned->valid;
+    log.attitude = aligned->attitude;
+    boost::asio::post(
+        executor_,
+        lifetime_.Wrap([this, log]() { frame_attitude_signal_(&log); }));
+
+    AlignedFramePtr shared = std::move(aligned);
+    std::lock_guard<std::mutex> lock(readers_mutex_);
+    for (auto& reader : readers_) { reader->Write(shared); }
+    for (auto& queue : queues_) { queue->Push(shared); }
+  }
+
+  /// Drain IMU samples until one at or after @p timestamp arrives,
+  /// or imu_wait_s passes.
+  void WaitForImu(boost::posix_time::ptime timestamp) {
+    struct timespec deadline = {};
+    ::clock_gettime(CLOCK_REALTIME, &deadline);
+    const int64_t wait_ns =
+        static_cast<int64_t>(parameters_.imu_wait_s * 1e9);
+    deadline.tv_sec += (deadline.tv_nsec + wait_ns) / 1000000000;
+    deadline.tv_nsec = (deadline.tv_nsec + wait_ns) % 1000000000;
+
+    while (true) {
+      // Announce that we are waiting before looking, so a sample
+      // pushed after the check below is guaranteed to post.
+      imu_waiting_.store(true);
+      DrainImu();
+      const auto& history = estimator_->imu_history();
+      if (done_ ||
+          (!history.empty() && history.back().timestamp >= timestamp)) {
+        break;
+      }
+      if (::sem_timedwait(&imu_event_, &deadline) < 0 &&
+          errno == ETIMEDOUT) {
+        break;
+      }
+    }
+    // A post may have raced with the check above.  That leaves at most
+    // one count behind, which only costs an extra pass through the
+    // loop next time.
+    imu_waiting_.store(false);
+  }
+
+  void UpdateOffset() {
+    const auto update = estimator_->Estimate();
+    if (update) { PostStatus(*update); }
+  }
+
+  void PostStatus(const CameraImuOffsetEstimator::Update& update) {
+    Status status;
+    status.offset_s = estimator_->offset_s();
+    status.raw_offset_s = update.estimate.offset_s;
+    status.correlation = update.estimate.correlation;
+    status.optical_rate_std_dps = update.optical_rate_std_dps;
+    status.updates = estimator_->updates();
+    status.frames = frames_;
+    status.frames_valid = frames_valid_;
+    status.imu_dropped = imu_dropped_.load(std::memory_order_relaxed);
+
+    boost::asio::post(
+        executor_,
+        lifetime_.Wrap([this, status]() {
+            status_ = status;
+            status_.timestamp = mjlib::io::Now(executor_.context());
+            status_signal_(&status_);
+          }));
+  }
+
+  boost::asio::any_io_executor executor_;
+  Camera::Getter camera_getter_;
+  ImuSignal* const imu_signal_;
+  boost::signals2::connection imu_connection_;
+  Parameters parameters_;
+
+  base::LogRef log_ = base::GetLogInstance("CameraImuAlignment");
+
+  std::shared_ptr<CameraFrameQueue> queue_;
+  std::thread thread_;
+
+  std::mutex readers_mutex_;
+  std::vector<std::shared_ptr<LatestAlignedFrame>> readers_;
+  std::vector<std::shared_ptr<AlignedFrameQueue>> queues_;
+
+  std::atomic<bool> done_{false};
+
+  // Written by the control thread, read by thread_.  At 400Hz this
+  // covers a stall of more than half a second.
+  base::SpscQueue<AttitudeData, 256> imu_queue_;
+  std::atomic<int64_t> imu_dropped_{0};
+
+  // Set by thread_ while it waits for samples, and cleared by the
+  // control thread when it posts imu_event_.
+  std::atomic<bool> imu_waiting_{false};
+  sem_t imu_event_;
+
+  // Only accessed from thread_, once AsyncStart has created it.
+  std::optional<CameraImuOffsetEstimator> estimator_;
+  cv::Mat gray_;
+  cv::Mat small_;
+  cv::Mat current_;
+  cv::Mat previous_;
+  cv::Mat window_;
+  boost::posix_time::ptime last_frame_time_;
+  boost::posix_time::ptime last_update_;
+  int64_t frames_ = 0;
+  int64_t frames_valid_ = 0;
+
+  base::HandlerLifetime lifetime_;
+
+  // Only accessed from executor_.
+  Status status_;
+  boost::signals2::signal<void (const Status*)> status_signal_;
+  boost::signals2::signal<void (const FrameAttitude*)> frame_attitude_signal_;
+};
+
+CameraImuAlignment::CameraImuAlignment(base::Context& context,
+                                       Camera::Getter camera_getter,
+                                       ImuSignal* imu_signal)
+    : impl_(std::make_unique<Impl>(
+                context, std::move(camera_getter), imu_signal)) {}
+
+CameraImuAlignment::~CameraImuAlignment() {}
+
+void CameraImuAlignment::AsyncStart(mjlib::io::ErrorCallback callback) {
+  impl_->AsyncStart(std::move(callback));
+}
+
+std::shared_ptr<CameraImuAlignment::LatestAlignedFrame>
+CameraImuAlignment::AddLatestFrameReader() {
+  return impl_->AddLatestFrameReader();
+}
+
+std::shared_ptr<CameraImuAlignment::AlignedFrameQueue>
+CameraImuAlignment::AddFrameQueue(size_t capacity) {
+  return impl_->AddFrameQueue(capacity);
+}
+
+clipp::group CameraImuAlignment::program_options() {
+  return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
+}
+
+}
+}
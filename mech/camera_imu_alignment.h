@@ -0,0 +1,222 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <deque>
+#include <memory>
+#include <optional>
+#include <vector>
+
+#include <clipp/clipp.h>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/signals2/signal.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+
+#include "base/context.h"
+#include "base/triple_buffer.h"
+
+#include "mech/attitude_data.h"
+#include "mech/camera.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Tag every camera frame with the attitude at the moment it was
+/// captured.
+///
+/// Camera and IMU timestamps come from different threads with
+/// different latencies, so the offset between them is estimated
+/// online.  The image rotation rate is measured by phase correlation
+/// between consecutive downscaled frames, and its magnitude is
+/// correlated against the magnitude of the IMU rate_dps over a range
+/// of candidate offsets.  Using magnitudes means no camera to IMU
+/// rotation is required.  The estimate is only updated when the
+/// window had enough rotation to be meaningful.
+///
+/// The attitude for each frame is interpolated from a short history
+/// of IMU samples, and every tag is logged as "camera_attitude".  The
+/// history is kept on the vision thread, and samples reach it through
+/// a lock free queue, so the control thread never waits on it.
+class CameraImuAlignment : boost::noncopyable {
+ public:
+  using ImuSignal = boost::signals2::signal<void (const AttitudeData*)>;
+
+  /// @param camera_getter will be called at AsyncStart time
+  CameraImuAlignment(base::Context&,
+                     Camera::Getter camera_getter,
+                     ImuSignal* imu_signal);
+  ~CameraImuAlignment();
+
+  void AsyncStart(mjlib::io::ErrorCallback);
+
+  struct AlignedFrame {
+    CameraFramePtr frame;
+
+    /// The frame timestamp, converted to the IMU clock.
+    boost::posix_time::ptime imu_timestamp;
+
+    /// False if the IMU history did not cover imu_timestamp.
+    bool valid = false;
+    AttitudeData attitude;
+  };
+
+  using AlignedFramePtr = std::shared_ptr<const AlignedFrame>;
+  using LatestAlignedFrame = base::TripleBuffer<AlignedFramePtr>;
+
+  /// Return a buffer which always has the most recent tagged frame.
+  /// It must only be read from one thread.
+  std::shared_ptr<LatestAlignedFrame> AddLatestFrameReader();
+
+  using AlignedFrameQueue = FrameQueue<AlignedFramePtr>;
+
+  /// Return a queue which receives every tagged frame, up to
+  /// @p capacity outstanding.  It is closed when the camera stops.
+  std::shared_ptr<AlignedFrameQueue> AddFrameQueue(size_t capacity);
+
+  struct Parameters {
+    /// How much IMU data to keep for interpolation.  At least
+    /// window_s + max_offset_s is always kept, so that each estimate
+    /// can see the IMU for the whole window.
+    double history_s = 2.0;
+
+    /// How much data each offset estimate uses, and how often one is
+    /// made.
+    double window_s = 5.0;
+    double update_period_s = 1.0;
+
+    /// Candidate offsets are searched over +- this range.
+    double max_offset_s = 0.1;
+    double offset_step_s = 0.002;
+    double initial_offset_s = 0.0;
+
+    /// Frames are reduced to this width before measuring rotation.
+    int analysis_width = 160;
+    double hfov_deg = 62.2;
+
+    /// Estimates are only accepted when the optical rate varies by at
+    /// least this much, and correlates at least this well.
+    double min_rate_dps = 15.0;
+    double min_correlation = 0.6;
+
+    /// Accepted estimates are low pass filtered with this weight.
+    double filter_alpha = 0.2;
+
+    /// How long to wait for IMU data to arrive for a new frame.
+    double imu_wait_s = 0.05;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(history_s));
+      a->Visit(MJ_NVP(window_s));
+      a->Visit(MJ_NVP(update_period_s));
+      a->Visit(MJ_NVP(max_offset_s));
+      a->Visit(MJ_NVP(offset_step_s));
+      a->Visit(MJ_NVP(initial_offset_s));
+      a->Visit(MJ_NVP(analysis_width));
+      a->Visit(MJ_NVP(hfov_deg));
+      a->Visit(MJ_NVP(min_rate_dps));
+      a->Visit(MJ_NVP(min_correlation));
+      a->Visit(MJ_NVP(filter_alpha));
+      a->Visit(MJ_NVP(imu_wait_s));
+    }
+  };
+
+  clipp::group program_options();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// A rate magnitude at a point in time, in seconds since an arbitrary
+/// epoch.
+struct RateSample {
+  double time_s = 0.0;
+  double rate_dps = 0.0;
+};
+
+/// @p samples must be sorted by time.  Return false if @p time_s is
+/// outside of their range.
+bool InterpolateRate(const std::vector<RateSample>& samples,
+                     double time_s, double* rate_dps);
+
+struct OffsetEstimate {
+  double offset_s = 0.0;
+  /// -1 if no offset had enough overlap to be compared.
+  double correlation = -1.0;
+};
+
+/// Find the offset which best aligns @p optical with @p imu, such that
+/// optical[i] corresponds to imu at optical[i].time_s + offset.
+/// Offsets within +- @p max_offset_s are tried every @p step_s.
+OffsetEstimate FindOffset(const std::vector<RateSample>& optical,
+                          const std::vector<RateSample>& imu,
+                          double max_offset_s, double step_s);
+
+/// @p history must be sorted by timestamp.  The attitude is slerped
+/// and the rates linearly interpolated between the samples either
+/// side of @p timestamp.  Return false if it is outside of their
+/// range.
+bool InterpolateAttitude(const std::deque<AttitudeData>& history,
+                         boost::posix_time::ptime timestamp,
+                         AttitudeData* result);
+
+/// The online offset estimate, kept apart from the camera and the
+/// vision thread so that it can be driven directly.
+class CameraImuOffsetEstimator {
+ public:
+  using Parameters = CameraImuAlignment::Parameters;
+
+  explicit CameraImuOffsetEstimator(const Parameters&);
+
+  /// Samples must be added in time order.
+  void AddImu(const AttitudeData&);
+  void AddOptical(const RateSample&);
+
+  struct Update {
+    double optical_rate_std_dps = 0.0;
+
+    /// Left at its default if there was too little rotation to try.
+    OffsetEstimate estimate;
+  };
+
+  /// Make one estimate from the current window, and fold it into
+  /// offset_s() if it is good enough.  Return nothing if the window
+  /// does not yet have enough samples.
+  std::optional<Update> Estimate();
+
+  /// imu timestamp = camera timestamp + offset_s()
+  double offset_s() const { return offset_s_; }
+  int64_t updates() const { return updates_; }
+
+  const std::deque<AttitudeData>& imu_history() const {
+    return imu_history_;
+  }
+
+ private:
+  const Parameters parameters_;
+
+  std::deque<AttitudeData> imu_history_;
+  std::deque<RateSample> optical_;
+  double offset_s_ = 0.0;
+  int64_t updates_ = 0;
+};
+
+}
+}
@@ -0,0 +1,179 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/camera_playback.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <regex>
+#include <vector>
+
+#include <boost/algorithm/string/predicate.hpp>
+#include <boost/filesystem.hpp>
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/videoio/videoio.hpp>
+
+#include "mjlib/base/fail.h"
+
+#include "mech/camera_recorder.h"
+
+namespace fs = boost::filesystem;
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+/// Larger than any sensor we record from, but small enough that a
+/// corrupt header can not ask for an absurd allocation.
+constexpr uint32_t kMaxRawDimension = 8192;
+
+bool IsImageFile(const fs::path& path) {
+  const std::string extension = path.extension().native();
+  for (const char* known : {
+          ".raw", ".png", ".jpg", ".jpeg", ".bmp", ".ppm", ".pgm", ".tif",
+          ".tiff"}) {
+    if (boost::iequals(extension, known)) { return true; }
+  }
+  return false;
+}
+
+/// CameraRecorder names encoded files <timestamp>-r<rotation>.<ext>.
+int FilenameRotation(const std::string& filename) {
+  static const std::regex kRotation(R"(-r(0|90|180|270)\.[^./]+$)");
+  std::smatch match;
+  if (!std::regex_search(filename, match, kRotation)) { return 0; }
+  return std::stoi(match[1]);
+}
+
+bool ReadRaw(const std::string& filename, cv::Mat* image, int* rotation_deg) {
+  std::ifstream in(filename, std::ios::binary);
+  if (!in.is_open()) { return false; }
+
+  CameraRecorder::RawHeader header;
+  const CameraRecorder::RawHeader expected;
+  in.read(reinterpret_cast<char*>(&header), sizeof(header));
+  if (!in.good() ||
+      std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0) {
+    return false;
+  }
+
+  // CameraRecorder only writes 8 bit color or grayscale frames, with
+  // a rotation the camera supports.
+  if (header.rows == 0 || header.rows > kMaxRawDimension ||
+      header.cols == 0 || header.cols > kMaxRawDimension ||
+      (header.type != CV_8UC1 && header.type != CV_8UC3) ||
+      header.rotation_deg % 90 != 0 || header.rotation_deg >= 360) {
+    return false;
+  }
+
+  *rotation_deg = static_cast<int>(header.rotation_deg);
+  image->create(header.rows, header.cols, header.type);
+  in.read(reinterpret_cast<char*>(image->data),
+          image->total() * image->elemSize());
+  return in.good();
+}
+}
+
+class CameraPlayback::Impl {
+ public:
+  Impl(const std::string& path) {
+    if (fs::is_directory(path)) {
+      for (const auto& entry : fs::directory_iterator(path)) {
+        if (!fs::is_regular_file(entry.path()) ||
+            !IsImageFile(entry.path())) {
+          continue;
+        }
+        files_.push_back(entry.path().native());
+      }
+      std::sort(files_.begin(), files_.end());
+      if (files_.empty()) {
+        mjlib::base::Fail("no images found in: " + path);
+      }
+    } else {
+      if (!video_.open(path)) {
+        mjlib::base::Fail("could not open video: " + path);
+      }
+      path_ = path;
+    }
+  }
+
+  bool Read(cv::Mat* image) {
+    rotation_deg_ = 0;
+    if (!path_.empty()) {
+      return video_.read(*image) && !image->empty();
+    }
+
+    while (next_file_ < files_.size()) {
+      const auto& filename = files_[next_file_++];
+      if (boost::iends_with(filename, ".raw")) {
+        if (ReadRaw(filename, image, &rotation_deg_)) { return true; }
+      } else {
+        try {
+          *image = cv::imread(filename, cv::IMREAD_UNCHANGED);
+        } catch (const cv::Exception&) {
+          image->release();
+        }
+        if (!image->empty()) {
+          rotation_deg_ = FilenameRotation(filename);
+          return true;
+        }
+      }
+      // Skip anything which fails to decode.
+    }
+    return false;
+  }
+
+  int rotation_deg() const { return rotation_deg_; }
+
+  void Rewind() {
+    if (!path_.empty()) {
+      // Not every backend can seek, so just start over.
+      video_.open(path_);
+    }
+    next_file_ = 0;
+  }
+
+ private:
+  // Set only for video files.
+  std::string path_;
+  cv::VideoCapture video_;
+
+  std::vector<std::string> files_;
+  size_t next_file_ = 0;
+
+  int rotation_deg_ = 0;
+};
+
+CameraPlayback::CameraPlayback(const std::string& path)
+    : impl_(std::make_unique<Impl>(path)) {}
+
+CameraPlayback::~CameraPlayback() {}
+
+bool CameraPlayback::Read(cv::Mat* image) {
+  return impl_->Read(image);
+}
+
+void CameraPlayback::Rewind() {
+  impl_->Rewind();
+}
+
+int CameraPlayback::rotation_deg() const {
+  return impl_->rotation_deg();
+}
+
+}
+}
@@ -0,0 +1,55 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <string>
+
+#include <boost/noncopyable.hpp>
+
+#include <opencv2/core/core.hpp>
+
+namespace mjmech {
+namespace mech {
+
+/// Read a sequence of images from a video file, or from a directory
+/// of image files.
+///
+/// Directory entries are read in lexicographic order.  Anything
+/// OpenCV can decode is accepted, as are the .raw files written by
+/// CameraRecorder.  Other files are ignored.  Images are returned
+/// with whatever depth and channels they were stored with.
+class CameraPlayback : boost::noncopyable {
+ public:
+  CameraPlayback(const std::string& path);
+  ~CameraPlayback();
+
+  /// Return false at the end of the sequence.
+  bool Read(cv::Mat*);
+
+  /// The clockwise rotation already applied to the last image read,
+  /// as recorded by CameraRecorder, or 0 for any other source.
+  int rotation_deg() const;
+
+  /// Start again from the first image.
+  void Rewind();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,208 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/camera_recorder.h"
+
+#include <condition_variable>
+#include <deque>
+#include <fstream>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+
+#include "mjlib/base/fail.h"
+
+#include "base/cpu_affinity.h"
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+enum class Codec {
+  kRaw,
+  kJpeg,
+  kPng,
+};
+
+Codec ParseCodec(const std::string& codec) {
+  if (codec == "raw") { return Codec::kRaw; }
+  if (codec == "jpeg" || codec == "jpg") { return Codec::kJpeg; }
+  if (codec == "png") { return Codec::kPng; }
+  mjlib::base::Fail("unknown camera record codec: " + codec);
+}
+
+const char* Extension(Codec codec) {
+  switch (codec) {
+    case Codec::kRaw: { return ".raw"; }
+    case Codec::kJpeg: { return ".jpg"; }
+    case Codec::kPng: { return ".png"; }
+  }
+  mjlib::base::AssertNotReached();
+}
+}
+
+class CameraRecorder::Impl {
+ public:
+  Impl(const Options& options)
+      : options_(options),
+        codec_(ParseCodec(options.codec)) {
+    switch (codec_) {
+      case Codec::kRaw: {
+        break;
+      }
+      case Codec::kJpeg: {
+        params_ = {cv::IMWRITE_JPEG_QUALITY, options_.jpeg_quality};
+        break;
+      }
+      case Codec::kPng: {
+        params_ = {cv::IMWRITE_PNG_COMPRESSION, options_.png_compression};
+        break;
+      }
+    }
+
+    for (int i = 0; i < std::max(1, options_.threads); i++) {
+      threads_.emplace_back(std::bind(&Impl::Run, this));
+    }
+  }
+
+  ~Impl() {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      done_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) { thread.join(); }
+  }
+
+  bool Write(CameraFramePtr frame) {
+    {
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (static_cast<int>(queue_.size()) >= options_.queue_size) {
+        stats_.dropped++;
+        return false;
+      }
+      queue_.push_back(std::move(frame));
+      stats_.queued++;
+    }
+    cv_.notify_one();
+    return true;
+  }
+
+  Stats stats() const {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return stats_;
+  }
+
+ private:
+  void Run() {
+    mjlib::base::FailIf(base::SetThreadAffinity());
+    std::vector<uchar> buffer;
+
+    while (true) {
+      CameraFramePtr frame;
+      {
+        std::unique_lock<std::mutex> lock(mutex_);
+        cv_.wait(lock, [&]() { return done_ || !queue_.empty(); });
+        // Anything already queued is still written on shutdown.
+        if (queue_.empty()) { return; }
+        frame = std::move(queue_.front());
+        queue_.pop_front();
+      }
+
+      const auto bytes = WriteFrame(*frame, &buffer);
+      // Return the buffer to the pool before waiting for another.
+      frame.reset();
+
+      std::lock_guard<std::mutex> lock(mutex_);
+      if (bytes < 0) {
+        stats_.errors++;
+      } else {
+        stats_.written++;
+        stats_.bytes += bytes;
+      }
+    }
+  }
+
+  /// Return the number of bytes written, or -1 on error.
+  int64_t WriteFrame(const CameraFrame& frame, std::vector<uchar>* buffer) {
+    const std::string path =
+        options_.path + to_iso_string(frame.timestamp) +
+        "-r" + std::to_string(frame.rotation_deg) + Extension(codec_);
+    std::ofstream out(path, std::ios::binary);
+    if (!out.is_open()) { return -1; }
+
+    int64_t size = 0;
+    if (codec_ == Codec::kRaw) {
+      RawHeader header;
+      header.rows = frame.image.rows;
+      header.cols = frame.image.cols;
+      header.type = frame.image.type();
+      header.rotation_deg = frame.rotation_deg;
+      out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+      const auto row_size = frame.image.cols * frame.image.elemSize();
+      for (int row = 0; row < frame.image.rows; row++) {
+        out.write(reinterpret_cast<const char*>(frame.image.ptr(row)),
+                  row_size);
+      }
+      size = sizeof(header) + row_size * frame.image.rows;
+    } else {
+      if (!cv::imencode(Extension(codec_), frame.image, *buffer, params_)) {
+        return -1;
+      }
+      out.write(reinterpret_cast<const char*>(buffer->data()),
+                buffer->size());
+      size = buffer->size();
+    }
+
+    if (!out.good()) { return -1; }
+    return size;
+  }
+
+  const Options options_;
+  const Codec codec_;
+  std::vector<int> params_;
+
+  mutable std::mutex mutex_;
+  std::condition_variable cv_;
+  bool done_ = false;
+  std::deque<CameraFramePtr> queue_;
+  Stats stats_;
+
+  std::vector<std::thread> threads_;
+};
+
+CameraRecorder::CameraRecorder(const Options& options)
+    : impl_(std::make_unique<Impl>(options)) {}
+
+CameraRecorder::~CameraRecorder() {}
+
+bool CameraRecorder::Write(CameraFramePtr frame) {
+  return impl_->Write(std::move(frame));
+}
+
+int CameraRecorder::max_frames(const Options& options) {
+  return options.queue_size + std::max(1, options.threads);
+}
+
+CameraRecorder::Stats CameraRecorder::stats() const {
+  return impl_->stats();
+}
+
+}
+}
@@ -0,0 +1,124 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include "mjlib/base/visitor.h"
+
+#include "mech/camera_frame.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Write camera frames to disk from a pool of background threads.
+///
+/// Frames are held by reference in a bounded queue and encoded by the
+/// workers, so that the capture thread neither copies pixels nor
+/// waits on the codec or the disk.  When the queue is full, the frame
+/// is dropped and counted.
+///
+/// Each queued frame, and each one being encoded, keeps its buffer out
+/// of the CameraFramePool, so the pool must have max_frames() more
+/// buffers than it otherwise would.
+class CameraRecorder : boost::noncopyable {
+ public:
+  struct Options {
+    /// Each file is named <path><timestamp>-r<rotation>.<extension>.
+    std::string path = "/tmp/mjbots-camera";
+
+    /// One of "raw", "jpeg", or "png".
+    ///
+    /// raw files are a RawHeader followed by the pixel data, and cost
+    /// little more than a copy.
+    std::string codec = "jpeg";
+
+    /// 0-100
+    int jpeg_quality = 90;
+    /// 0-9
+    int png_compression = 1;
+
+    int queue_size = 8;
+    int threads = 2;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(path));
+      a->Visit(MJ_NVP(codec));
+      a->Visit(MJ_NVP(jpeg_quality));
+      a->Visit(MJ_NVP(png_compression));
+      a->Visit(MJ_NVP(queue_size));
+      a->Visit(MJ_NVP(threads));
+    }
+  };
+
+  /// The layout of the start of a raw file.  All fields are in host
+  /// byte order.
+  ///
+  /// Encoded files record the rotation in their name instead, as
+  /// <path><timestamp>-r<rotation_deg>.<extension>.
+  struct RawHeader {
+    char magic[4] = {'M', 'J', 'R', 'W'};
+    uint32_t rows = 0;
+    uint32_t cols = 0;
+    /// The OpenCV type, like CV_8UC3.
+    uint32_t type = 0;
+    /// CameraFrame::rotation_deg
+    uint32_t rotation_deg = 0;
+  };
+
+  CameraRecorder(const Options&);
+  ~CameraRecorder();
+
+  /// Queue @p frame for writing.  This never blocks on the workers.
+  /// Return false if the frame was dropped.
+  bool Write(CameraFramePtr frame);
+
+  /// The most frames this can hold at once.
+  static int max_frames(const Options&);
+
+  struct Stats {
+    int64_t queued = 0;
+    int64_t written = 0;
+    int64_t dropped = 0;
+    int64_t errors = 0;
+    int64_t bytes = 0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(queued));
+      a->Visit(MJ_NVP(written));
+      a->Visit(MJ_NVP(dropped));
+      a->Visit(MJ_NVP(errors));
+      a->Visit(MJ_NVP(bytes));
+    }
+  };
+
+  Stats stats() const;
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
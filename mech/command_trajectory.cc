@@ -0,0 +1,107 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/command_trajectory.h"
+
+#include <boost/assert.hpp>
+
+#include "mjlib/base/time_conversions.h"
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+using HC = HoverbotCommand;
+
+double Lerp(double a, double b, double fraction) {
+  return a + fraction * (b - a);
+}
+
+HC::Waypoint Interpolate(const HC::Waypoint& a, const HC::Waypoint& b,
+                         double time_s) {
+  const double fraction = (time_s - a.time_s) / (b.time_s - a.time_s);
+
+  HC::Waypoint result;
+  result.time_s = time_s;
+  result.pitch.pitch_deg =
+      Lerp(a.pitch.pitch_deg, b.pitch.pitch_deg, fraction);
+  result.pitch.pitch_rate_dps =
+      Lerp(a.pitch.pitch_rate_dps, b.pitch.pitch_rate_dps, fraction);
+  result.pitch.yaw_rate_dps =
+      Lerp(a.pitch.yaw_rate_dps, b.pitch.yaw_rate_dps, fraction);
+  result.drive.velocity_mps =
+      Lerp(a.drive.velocity_mps, b.drive.velocity_mps, fraction);
+  result.drive.accel_mps2 =
+      Lerp(a.drive.accel_mps2, b.drive.accel_mps2, fraction);
+  result.drive.yaw_rate_dps =
+      Lerp(a.drive.yaw_rate_dps, b.drive.yaw_rate_dps, fraction);
+  return result;
+}
+}
+
+CommandTrajectory::CommandTrajectory(size_t max_waypoints)
+    : max_waypoints_(max_waypoints) {
+  waypoints_.reserve(max_waypoints_);
+}
+
+bool CommandTrajectory::Set(const std::vector<Waypoint>& waypoints,
+                            boost::posix_time::ptime start) {
+  if (waypoints.size() > max_waypoints_) { return false; }
+  for (size_t i = 1; i < waypoints.size(); i++) {
+    if (!(waypoints[i].time_s > waypoints[i - 1].time_s)) { return false; }
+  }
+
+  Clear();
+
+  // This fits in the reserved storage, so does not allocate.
+  waypoints_.assign(waypoints.begin(), waypoints.end());
+  start_ = start;
+  return true;
+}
+
+void CommandTrajectory::Clear() {
+  waypoints_.clear();
+  index_ = 0;
+}
+
+double CommandTrajectory::duration_s() const {
+  return waypoints_.empty() ? 0.0 : waypoints_.back().time_s;
+}
+
+CommandTrajectory::Waypoint CommandTrajectory::Sample(
+    boost::posix_time::ptime now) {
+  BOOST_ASSERT(!waypoints_.empty());
+
+  const double time_s = mjlib::base::ConvertDurationToSeconds(now - start_);
+
+  if (time_s <= waypoints_.front().time_s) {
+    index_ = 0;
+    return waypoints_.front();
+  }
+
+  // The clock stepped backwards, so search again from the start.
+  if (time_s < waypoints_[index_].time_s) { index_ = 0; }
+
+  while (index_ + 1 < waypoints_.size() &&
+         waypoints_[index_ + 1].time_s <= time_s) {
+    index_++;
+  }
+
+  if (index_ + 1 == waypoints_.size()) { return waypoints_.back(); }
+
+  return Interpolate(waypoints_[index_], waypoints_[index_ + 1], time_s);
+}
+
+}
+}
@@ -0,0 +1,74 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <vector>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mech/hoverbot_command.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Holds the waypoints of a HoverbotCommand and interpolates the
+/// pitch and drive setpoints from them on the robot clock.
+///
+/// Storage for the maximum number of waypoints is allocated up front,
+/// so neither loading a new trajectory nor sampling one allocates.
+class CommandTrajectory {
+ public:
+  using Waypoint = HoverbotCommand::Waypoint;
+
+  explicit CommandTrajectory(size_t max_waypoints);
+
+  /// Replace the current trajectory with @p waypoints, with time_s
+  /// measured from @p start.  Return false, and leave the current
+  /// trajectory in place, if there are too many waypoints or their
+  /// times do not strictly increase.
+  bool Set(const std::vector<Waypoint>& waypoints,
+           boost::posix_time::ptime start);
+
+  void Clear();
+
+  bool empty() const { return waypoints_.empty(); }
+
+  /// The time from start until the last waypoint.
+  double duration_s() const;
+
+  /// The waypoint at or before the most recent Sample.
+  int index() const { return static_cast<int>(index_); }
+
+  /// Return the setpoint at @p now.  Before the first waypoint and
+  /// after the last, that waypoint is held.  Between two, every value
+  /// is interpolated linearly.
+  ///
+  /// Successive calls are expected to have non-decreasing times, which
+  /// makes each one constant time.  If time goes backwards, the search
+  /// starts over from the first waypoint.  Must not be called when
+  /// empty().
+  Waypoint Sample(boost::posix_time::ptime now);
+
+ private:
+  const size_t max_waypoints_;
+  std::vector<Waypoint> waypoints_;
+  boost::posix_time::ptime start_;
+
+  // The waypoint at or before the most recent sample.
+  size_t index_ = 0;
+};
+
+}
+}
@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include <chrono>
+
 #include <boost/asio/any_io_executor.hpp>
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 
@@ -33,6 +35,7 @@ class ControlTiming {
     timestamps_.cycle_start = Now();
     timestamps_.delta_s = mjlib::base::ConvertDurationToSeconds(
         timestamps_.cycle_start - timestamps_.last_cycle_start);
+    timestamps_.start = Clock::now();
   }
 
   struct Status {
@@ -57,38 +60,45 @@ class ControlTiming {
   Status status() const {
     Status result;
 
-    result.query_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.query_done - timestamps_.cycle_start);
-    result.status_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.status_done - timestamps_.query_done);
-    result.control_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.control_done - timestamps_.status_done);
-    result.command_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.command_done - timestamps_.control_done);
-    result.cycle_s = mjlib::base::ConvertDurationToSeconds(
-        timestamps_.command_done - timestamps_.cycle_start);
-    result.delta_s = timestamps_.delta_s;
+    const auto& t = timestamps_;
+    result.query_s = Seconds(t.start, t.query_done);
+    result.status_s = Seconds(t.query_done, t.status_done);
+    result.control_s = Seconds(t.status_done, t.control_done);
+    result.command_s = Seconds(t.control_done, t.command_done);
+    result.cycle_s = Seconds(t.start, t.command_done);
+    result.delta_s = t.delta_s;
 
     return result;
   }
 
   boost::posix_time::ptime cycle_start() const { return timestamps_.cycle_start; }
 
-  void finish_query() { timestamps_.query_done = Now(); }
-  void finish_status() { timestamps_.status_done = Now(); }
-  void finish_control() { timestamps_.control_done = Now(); }
-  void finish_command() { timestamps_.command_done = Now(); }
+  void finish_query() { timestamps_.query_done = Clock::now(); }
+  void finish_status() { timestamps_.status_done = Clock::now(); }
+  void finish_control() { timestamps_.control_done = Clock::now(); }
+  void finish_command() { timestamps_.command_done = Clock::now(); }
 
  private:
+  // The stages only take microseconds, so they are timed with this
+  // rather than the executor's clock, which has microsecond
+  // resolution.
+  using Clock = std::chrono::steady_clock;
+
+  static double Seconds(Clock::time_point start, Clock::time_point end) {
+    return std::chrono::duration<double>(end - start).count();
+  }
+
   struct Timestamps {
     boost::posix_time::ptime last_cycle_start;
     double delta_s = 0.0;
 
     boost::posix_time::ptime cycle_start;
-    boost::posix_time::ptime query_done;
-    boost::posix_time::ptime status_done;
-    boost::posix_time::ptime control_done;
-    boost::posix_time::ptime command_done;
+
+    Clock::time_point start;
+    Clock::time_point query_done;
+    Clock::time_point status_done;
+    Clock::time_point control_done;
+    Clock::time_point command_done;
   };
 
   boost::posix_time::ptime Now() const {
@@ -0,0 +1,633 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/fleet_aggregator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <shared_mutex>
+#include <sstream>
+#include <thread>
+#include <tuple>
+
+#include <fmt/format.h>
+
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/filesystem.hpp>
+
+#include "mjlib/base/clipp_archive.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/json5_write_archive.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/io/now.h"
+#include "mjlib/io/repeating_timer.h"
+#include "mjlib/telemetry/binary_schema_parser.h"
+#include "mjlib/telemetry/file_writer.h"
+
+#include "base/common.h"
+#include "base/format_hex.h"
+#include "base/logging.h"
+#include "base/telemetry_fields.h"
+#include "base/telemetry_stream.h"
+#include "base/timestamped_log.h"
+
+#include "mech/web_server.h"
+
+namespace pl = std::placeholders;
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+constexpr int kCaptureBatchSize = 65536;
+
+template <typename T>
+void WriteLittle(std::ostream& ostr, T value) {
+  char buf[sizeof(T)] = {};
+  for (size_t i = 0; i < sizeof(T); i++) {
+    buf[i] = static_cast<char>((static_cast<uint64_t>(value) >> (8 * i)) & 0xff);
+  }
+  ostr.write(buf, sizeof(buf));
+}
+
+template <typename T>
+bool ReadLittle(std::istream& istr, T* value) {
+  char buf[sizeof(T)] = {};
+  if (!istr.read(buf, sizeof(buf))) { return false; }
+  uint64_t result = 0;
+  for (size_t i = 0; i < sizeof(T); i++) {
+    result |= static_cast<uint64_t>(static_cast<uint8_t>(buf[i])) << (8 * i);
+  }
+  *value = static_cast<T>(result);
+  return true;
+}
+
+struct RecordSummary {
+  std::string name;
+  uint64_t count = 0;
+  int64_t timestamp_us = 0;
+  std::vector<base::TelemetryField> fields;
+  // Only set, as hex, if the record could not be decoded.
+  std::string data;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(count));
+    a->Visit(MJ_NVP(timestamp_us));
+    a->Visit(MJ_NVP(fields));
+    a->Visit(MJ_NVP(data));
+  }
+};
+
+struct RobotSummary {
+  std::string name;
+  int stream_id = 0;
+  std::string log;
+  uint64_t datagrams = 0;
+  uint64_t lost = 0;
+  uint64_t recovered = 0;
+  uint64_t incomplete = 0;
+  std::vector<RecordSummary> records;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(name));
+    a->Visit(MJ_NVP(stream_id));
+    a->Visit(MJ_NVP(log));
+    a->Visit(MJ_NVP(datagrams));
+    a->Visit(MJ_NVP(lost));
+    a->Visit(MJ_NVP(recovered));
+    a->Visit(MJ_NVP(incomplete));
+    a->Visit(MJ_NVP(records));
+  }
+};
+
+struct Snapshot {
+  std::vector<RobotSummary> robots;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(robots));
+  }
+};
+}
+
+void FleetCapture::Write(std::ostream& ostr, const Entry& entry) {
+  WriteLittle(ostr, entry.timestamp_us);
+  WriteLittle(ostr, entry.address);
+  WriteLittle(ostr, entry.port);
+  WriteLittle(ostr, static_cast<uint16_t>(entry.data.size()));
+  ostr.write(entry.data.data(), entry.data.size());
+}
+
+bool FleetCapture::Read(std::istream& istr, Entry* entry) {
+  uint16_t size = 0;
+  if (!ReadLittle(istr, &entry->timestamp_us) ||
+      !ReadLittle(istr, &entry->address) ||
+      !ReadLittle(istr, &entry->port) ||
+      !ReadLittle(istr, &size)) {
+    return false;
+  }
+  entry->data.resize(size);
+  return !!istr.read(&entry->data[0], size);
+}
+
+class FleetAggregator::Impl {
+ public:
+  Impl(base::Context& context)
+      : executor_(context.executor),
+        stats_timer_(executor_) {}
+
+  ~Impl() {
+    for (auto& worker : workers_) {
+      worker->context.stop();
+    }
+    for (auto& worker : workers_) {
+      worker->thread.join();
+    }
+    for (auto& worker : workers_) {
+      FlushCapture(worker.get());
+    }
+  }
+
+  void AsyncStart(mjlib::io::ErrorCallback callback) {
+    if (!parameters_.capture.empty()) {
+      capture_.open(parameters_.capture, std::ios::binary);
+      mjlib::base::system_error::throw_if(
+          !capture_.is_open(), "opening " + parameters_.capture);
+    }
+
+    int threads = parameters_.threads;
+    if (threads <= 0) {
+      threads = std::max<int>(1, std::thread::hardware_concurrency());
+    }
+
+    const auto source = base::UdpSocket::ParseAddress(parameters_.source);
+    if (source.address &&
+        base::UdpSocket::IsMulticastBroadcast(*source.address) &&
+        threads > 1) {
+      log_.warn("multicast source, using only one receive thread");
+      threads = 1;
+    }
+
+    auto socket_params = parameters_.socket_params;
+    socket_params.reuse_port = threads > 1;
+
+    for (int i = 0; i < threads; i++) {
+      auto worker = std::make_unique<Worker>();
+      worker->socket = std::make_unique<base::UdpSocket>(
+          worker->context.get_executor(), log_, source, true, socket_params);
+      worker->socket->data_signal()->connect(
+          std::bind(&Impl::HandleDatagram, this, worker.get(),
+                    pl::_1, pl::_2));
+      worker->socket->StartRead();
+      workers_.push_back(std::move(worker));
+    }
+
+    log_.info(fmt::format("listening on {} with {} threads",
+                          parameters_.source, threads));
+
+    for (auto& worker : workers_) {
+      worker->thread = std::thread([w=worker.get()]() {
+          w->context.run();
+        });
+    }
+
+    stats_timer_.start(
+        base::ConvertSecondsToDuration(parameters_.stats_period_s),
+        std::bind(&Impl::HandleStatsTimer, this, pl::_1));
+
+    if (parameters_.port < 0) {
+      boost::asio::post(
+          executor_,
+          std::bind(std::move(callback), mjlib::base::error_code()));
+      return;
+    }
+
+    WebServer::Options options;
+    options.port = parameters_.port;
+    const auto assets = FindAssetPath();
+    if (!assets.empty()) {
+      options.document_roots.push_back({std::string("/"), assets});
+    }
+    options.websocket_handlers.push_back(
+        {"/fleet", std::bind(&Impl::HandleWebsocket, this, pl::_1)});
+    web_server_ = std::make_unique<WebServer>(executor_, options);
+    web_server_->AsyncStart(std::move(callback));
+  }
+
+  struct Schema {
+    Schema(const std::string& data_in, const std::string& name)
+        : data(data_in),
+          parser(data, name) {}
+
+    // The parser may refer into this.
+    const std::string data;
+    const mjlib::telemetry::BinarySchemaParser parser;
+  };
+
+  struct Robot {
+    std::mutex mutex;
+
+    std::string name;
+    uint16_t stream_id = 0;
+
+    std::unique_ptr<base::TelemetryStreamDecoder> decoder;
+
+    std::string log_filename;
+    std::unique_ptr<mjlib::telemetry::FileWriter> log;
+    // Records whose schema changed are left out of the log from then
+    // on, and have no identifier.
+    std::map<std::string,
+             std::optional<mjlib::telemetry::FileWriter::Identifier>> log_ids;
+
+    struct Latest {
+      uint64_t count = 0;
+      int64_t timestamp_us = 0;
+      std::string data;
+    };
+    std::map<std::string, Latest> latest;
+
+    // Used to decode the latest values for the dashboard.  These are
+    // replaced, never modified, so a copy may be used unlocked.
+    std::map<std::string, std::shared_ptr<const Schema>> schemas;
+  };
+
+  struct Worker;
+
+  // This is invoked from any of the worker threads.
+  void HandleDatagram(Worker* worker,
+                      const std::string& data,
+                      const base::UdpSocket::endpoint& from) {
+    datagrams_.fetch_add(1, std::memory_order_relaxed);
+
+    // Robots, and the capture format, are keyed on an IPv4 address.
+    if (!from.address().is_v4()) {
+      malformed_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    if (capture_.is_open()) {
+      FleetCapture::Entry entry;
+      entry.timestamp_us = base::ConvertPtimeToMicroseconds(
+          boost::posix_time::microsec_clock::universal_time());
+      entry.address = from.address().to_v4().to_ulong();
+      entry.port = from.port();
+      entry.data = data;
+
+      FleetCapture::Write(worker->capture, entry);
+      if (worker->capture.tellp() >= kCaptureBatchSize) {
+        FlushCapture(worker);
+      }
+    }
+
+    uint16_t stream_id = 0;
+    if (!base::TelemetryStreamFormat::ReadStreamId(data, &stream_id)) {
+      malformed_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    Robot* const robot = GetRobot(from.address().to_v4().to_ulong(),
+                                  from.port(), stream_id);
+
+    // A given robot will nearly always arrive on the same worker, so
+    // this is almost never contended.
+    std::lock_guard<std::mutex> guard(robot->mutex);
+    robot->decoder->Process(data);
+  }
+
+  Robot* GetRobot(uint32_t address, uint16_t port, uint16_t stream_id) {
+    // Robots behind the same NAT, or on the same host, share an
+    // address and likely the default stream_id, but not a port.
+    const auto key = std::make_tuple(address, port, stream_id);
+
+    {
+      std::shared_lock<std::shared_mutex> guard(robots_mutex_);
+      auto it = robots_.find(key);
+      if (it != robots_.end()) { return it->second.get(); }
+    }
+
+    auto robot = std::make_unique<Robot>();
+    Robot* const r = robot.get();
+    const auto address_str = boost::asio::ip::address_v4(address).to_string();
+    r->name = fmt::format("{}:{}", address_str, port);
+    r->stream_id = stream_id;
+    r->decoder = std::make_unique<base::TelemetryStreamDecoder>(
+        std::bind(&Impl::HandleSchema, this, r, pl::_1),
+        std::bind(&Impl::HandleData, this, r, pl::_1, pl::_2, pl::_3));
+
+    // The log is opened with only this robot locked, so that lookups
+    // of every other robot do not wait on the file system.  Holding it
+    // until then means nothing is decoded before it can be logged.
+    std::unique_lock<std::mutex> robot_guard(r->mutex);
+    {
+      std::unique_lock<std::shared_mutex> guard(robots_mutex_);
+      // Another worker may have added it while we were unlocked.
+      auto it = robots_.find(key);
+      if (it != robots_.end()) { return it->second.get(); }
+
+      robots_.insert(std::make_pair(key, std::move(robot)));
+    }
+
+    if (!parameters_.log_prefix.empty()) {
+      r->log_filename = fmt::format(
+          "{}{}-{}-{}.log", parameters_.log_prefix,
+          address_str, port, stream_id);
+      // This is a worker thread, where an exception would terminate
+      // the process, so the robot is kept without a log instead.
+      try {
+        r->log = std::make_unique<mjlib::telemetry::FileWriter>([]() {
+            mjlib::telemetry::FileWriter::Options options;
+            options.blocking = false;
+            return options;
+          }());
+        base::OpenMaybeTimestampedLog(
+            r->log.get(), r->log_filename,
+            parameters_.log_short_name ? base::kShort : base::kTimestamped);
+      } catch (std::exception& e) {
+        log_errors_.fetch_add(1, std::memory_order_relaxed);
+        log_.error(fmt::format("{}: could not open log '{}': {}",
+                               r->name, r->log_filename, e.what()));
+        r->log.reset();
+        r->log_filename.clear();
+      }
+    }
+
+    log_.info(fmt::format("new robot {} stream {}", r->name, stream_id));
+
+    return r;
+  }
+
+  /// Called from @p worker's thread, or once it has stopped.
+  void FlushCapture(Worker* worker) {
+    if (worker->capture.tellp() <= 0) { return; }
+    {
+      std::lock_guard<std::mutex> guard(capture_mutex_);
+      capture_ << worker->capture.str();
+    }
+    worker->capture.str({});
+    worker->capture.clear();
+  }
+
+  // The following are invoked with the robot's mutex held.
+  void HandleSchema(Robot* robot,
+                    const base::TelemetryStreamDecoder::Record& record) {
+    try {
+      robot->schemas[record.name] =
+          std::make_shared<const Schema>(record.schema, record.name);
+    } catch (std::exception& e) {
+      log_.warn(fmt::format("{}: could not parse schema for '{}': {}",
+                            robot->name, record.name, e.what()));
+      robot->schemas.erase(record.name);
+    }
+
+    if (!robot->log) { return; }
+    auto it = robot->log_ids.find(record.name);
+    if (it != robot->log_ids.end()) {
+      // The log can only hold a single schema per record.
+      log_.warn(fmt::format("{}: schema for '{}' changed, not logging",
+                            robot->name, record.name));
+      it->second = {};
+      return;
+    }
+
+    const auto identifier = robot->log->AllocateIdentifier(record.name);
+    robot->log->WriteSchema(identifier, record.schema);
+    robot->log_ids.insert(std::make_pair(record.name, identifier));
+  }
+
+  void HandleData(Robot* robot,
+                  const base::TelemetryStreamDecoder::Record& record,
+                  int64_t timestamp_us,
+                  std::string_view data) {
+    auto& latest = robot->latest[record.name];
+    latest.count++;
+    latest.timestamp_us = timestamp_us;
+    latest.data.assign(data.data(), data.size());
+
+    if (!robot->log) { return; }
+    auto it = robot->log_ids.find(record.name);
+    if (it == robot->log_ids.end() || !it->second) { return; }
+    robot->log->WriteData(
+        base::ConvertMicrosecondsToPtime(timestamp_us), *it->second, data);
+  }
+
+  Snapshot MakeSnapshot() {
+    // Robots are never removed, so the pointers remain valid once the
+    // map is unlocked.
+    std::vector<Robot*> robots;
+    {
+      std::shared_lock<std::shared_mutex> guard(robots_mutex_);
+      for (const auto& pair : robots_) { robots.push_back(pair.second.get()); }
+    }
+
+    Snapshot result;
+    for (Robot* const robot : robots) {
+      RobotSummary summary;
+      summary.name = robot->name;
+      summary.stream_id = robot->stream_id;
+      summary.log = robot->log_filename;
+
+      // Only copy while holding the lock, so that ingest for this
+      // robot is blocked as briefly as possible.
+      std::map<std::string, Robot::Latest> latest;
+      std::map<std::string, std::shared_ptr<const Schema>> schemas;
+      {
+        std::lock_guard<std::mutex> robot_guard(robot->mutex);
+        const auto& stats = robot->decoder->stats();
+        summary.datagrams = stats.datagrams;
+        summary.lost = stats.lost;
+        summary.recovered = stats.recovered;
+        summary.incomplete = stats.incomplete;
+        latest = robot->latest;
+        schemas = robot->schemas;
+      }
+
+      for (const auto& latest_pair : latest) {
+        RecordSummary record;
+        record.name = latest_pair.first;
+        record.count = latest_pair.second.count;
+        record.timestamp_us = latest_pair.second.timestamp_us;
+
+        const auto schema = schemas.find(record.name);
+        if (schema == schemas.end() ||
+            !base::DecodeTelemetryFields(
+                schema->second->parser.root(), latest_pair.second.data,
+                &record.fields)) {
+          record.fields.clear();
+          record.data = base::FormatHex(latest_pair.second.data);
+        }
+        summary.records.push_back(std::move(record));
+      }
+
+      result.robots.push_back(std::move(summary));
+    }
+
+    return result;
+  }
+
+  void HandleStatsTimer(const mjlib::base::error_code& ec) {
+    mjlib::base::FailIf(ec);
+
+    const auto datagrams = datagrams_.load();
+    const auto malformed = malformed_.load();
+    const auto log_errors = log_errors_.load();
+    size_t robots = 0;
+    {
+      std::shared_lock<std::shared_mutex> guard(robots_mutex_);
+      robots = robots_.size();
+    }
+
+    log_.info(fmt::format(
+                  "robots: {}  datagrams/s: {:.0f}  malformed: {}  "
+                  "log errors: {}",
+                  robots,
+                  (datagrams - last_datagrams_) / parameters_.stats_period_s,
+                  malformed, log_errors));
+    last_datagrams_ = datagrams;
+  }
+
+  void HandleWebsocket(WebServer::WebsocketStream stream) {
+    auto session = std::make_shared<WebsocketSession>(this, std::move(stream));
+    session->Start();
+  }
+
+  /// Each message received is answered with a JSON snapshot of every
+  /// robot.
+  class WebsocketSession
+      : public std::enable_shared_from_this<WebsocketSession> {
+   public:
+    WebsocketSession(Impl* parent, WebServer::WebsocketStream stream)
+        : parent_(parent),
+          stream_(std::move(stream)) {}
+
+    void Start() { StartRead(); }
+
+    void StartRead() {
+      stream_.async_read(
+          buffer_,
+          std::bind(&WebsocketSession::HandleRead, shared_from_this(), pl::_1));
+    }
+
+    void HandleRead(mjlib::base::error_code ec) {
+      if (ec) {
+        log_.warn(fmt::format("Closing websocket: {}", ec.message()));
+        return;
+      }
+      buffer_.clear();
+
+      using JsonWrite = mjlib::base::Json5WriteArchive;
+      message_ = JsonWrite::Write(
+          parent_->MakeSnapshot(), JsonWrite::Options().set_standard(true));
+
+      stream_.async_write(
+          boost::asio::buffer(message_),
+          std::bind(&WebsocketSession::HandleWrite, shared_from_this(),
+                    pl::_1));
+    }
+
+    void HandleWrite(mjlib::base::error_code ec) {
+      if (ec) {
+        log_.warn(fmt::format("Closing websocket: {}", ec.message()));
+        return;
+      }
+      StartRead();
+    }
+
+    Impl* const parent_;
+    WebServer::WebsocketStream stream_;
+    base::LogRef log_ = base::GetLogInstance("FleetAggregator");
+
+    boost::beast::flat_buffer buffer_;
+    std::string message_;
+  };
+
+  std::string FindAssetPath() {
+    namespace fs = boost::filesystem;
+
+    fs::path start = fs::canonical("/proc/self/exe").remove_filename();
+
+    for (const char* to_try : {
+            "fleet_assets",
+            "fleet_aggregator.runfiles/com_github_mjbots_mech/mech/fleet_assets",
+            }) {
+      fs::path this_path = start / to_try;
+      if (fs::exists(this_path)) {
+        return this_path.native();
+      }
+    }
+
+    log_.warn("Could not locate fleet dashboard assets");
+    return "";
+  }
+
+  boost::asio::any_io_executor executor_;
+  base::LogRef log_ = base::GetLogInstance("FleetAggregator");
+
+  Parameters parameters_;
+
+  struct Worker {
+    boost::asio::io_context context;
+    boost::asio::executor_work_guard<
+      boost::asio::io_context::executor_type> work_guard{
+      context.get_executor()};
+    std::unique_ptr<base::UdpSocket> socket;
+    std::thread thread;
+
+    // Capture entries are collected here, and written to capture_ a
+    // batch at a time, so that the workers rarely contend for it.
+    std::ostringstream capture;
+  };
+
+  std::vector<std::unique_ptr<Worker>> workers_;
+
+  std::shared_mutex robots_mutex_;
+  // Keyed by address, port and stream_id.
+  std::map<std::tuple<uint32_t, uint16_t, uint16_t>,
+           std::unique_ptr<Robot>> robots_;
+
+  std::mutex capture_mutex_;
+  std::ofstream capture_;
+
+  std::atomic<uint64_t> datagrams_{0};
+  std::atomic<uint64_t> malformed_{0};
+  std::atomic<uint64_t> log_errors_{0};
+  uint64_t last_datagrams_ = 0;
+
+  mjlib::io::RepeatingTimer stats_timer_;
+  std::unique_ptr<WebServer> web_server_;
+};
+
+FleetAggregator::FleetAggregator(base::Context& context)
+    : impl_(std::make_unique<Impl>(context)) {}
+
+FleetAggregator::~FleetAggregator() {}
+
+void FleetAggregator::AsyncStart(mjlib::io::ErrorCallback callback) {
+  impl_->AsyncStart(std::move(callback));
+}
+
+clipp::group FleetAggregator::program_options() {
+  return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
+}
+
+}
+}
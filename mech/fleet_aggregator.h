@@ -0,0 +1,124 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <cstdint>
+#include <istream>
+#include <memory>
+#include <ostream>
+#include <string>
+
+#include <clipp/clipp.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/io/async_types.h"
+
+#include "base/context.h"
+#include "base/udp_socket.h"
+
+namespace mjmech {
+namespace mech {
+
+/// A host side service which receives TelemetryStreamPublisher
+/// streams from any number of robots at once.
+///
+/// Datagrams are received by a pool of worker threads, each with its
+/// own SO_REUSEPORT socket, so the kernel spreads robots across
+/// cores.  Each robot, identified by its address, port and stream_id, is
+/// decoded into its own log file, and the latest value of every
+/// record, decoded into fields with the schema the robot sent, is
+/// available to a web dashboard over a websocket.
+class FleetAggregator : boost::noncopyable {
+ public:
+  FleetAggregator(base::Context&);
+  ~FleetAggregator();
+
+  void AsyncStart(mjlib::io::ErrorCallback);
+
+  struct Parameters {
+    /// Where to listen for robots.  If this is a multicast group,
+    /// only one worker is used, since every SO_REUSEPORT socket would
+    /// receive its own copy of each datagram.
+    std::string source = ":13400";
+
+    /// The number of receive threads, or 0 for one per core.
+    int threads = 0;
+
+    /// If non-empty, each robot is logged to a file named
+    /// <log_prefix><address>-<port>-<stream_id>.log.  A log which
+    /// can not be opened is counted and reported, and the robot is
+    /// received without one.
+    std::string log_prefix;
+    bool log_short_name = false;
+
+    /// If non-empty, every received datagram is appended to this
+    /// file in the FleetCapture format, for later replay.
+    std::string capture;
+
+    /// The port to serve the dashboard on, or negative to disable.
+    int port = 4779;
+
+    double stats_period_s = 5.0;
+
+    base::UdpSocket::Parameters socket_params;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(source));
+      a->Visit(MJ_NVP(threads));
+      a->Visit(MJ_NVP(log_prefix));
+      a->Visit(MJ_NVP(log_short_name));
+      a->Visit(MJ_NVP(capture));
+      a->Visit(MJ_NVP(port));
+      a->Visit(MJ_NVP(stats_period_s));
+      socket_params.Serialize(a);
+    }
+  };
+
+  clipp::group program_options();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+/// A file of raw datagrams, as received by a FleetAggregator.
+///
+/// Each entry is:
+///   i64 timestamp_us
+///   u32 IPv4 address of the sender
+///   u16 port of the sender
+///   u16 size
+///   [size bytes of datagram]
+///
+/// All integers are little endian.  Entries from one sender are in
+/// the order received, but those from different senders may not be.
+struct FleetCapture {
+  struct Entry {
+    int64_t timestamp_us = 0;
+    uint32_t address = 0;
+    uint16_t port = 0;
+    std::string data;
+  };
+
+  static void Write(std::ostream&, const Entry&);
+
+  /// Return false at the end of the stream.
+  static bool Read(std::istream&, Entry*);
+};
+
+}
+}
@@ -0,0 +1,222 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/gamepad_teleop.h"
+
+#include <linux/input.h>
+
+#include <cmath>
+
+#include <fmt/format.h>
+
+#include <boost/asio/post.hpp>
+#include <boost/signals2/signal.hpp>
+
+#include "mjlib/base/clipp_archive.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/io/now.h"
+#include "mjlib/io/repeating_timer.h"
+
+#include "base/common.h"
+#include "base/linux_input.h"
+#include "base/logging.h"
+#include "base/telemetry_registry.h"
+
+namespace pl = std::placeholders;
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+struct Status {
+  boost::posix_time::ptime timestamp;
+
+  bool connected = false;
+  HoverbotCommand::Mode mode = HoverbotCommand::kStopped;
+  bool engaged = false;
+
+  int64_t events = 0;
+  int64_t batches = 0;
+  int64_t commands = 0;
+
+  double drive = 0.0;
+  double yaw = 0.0;
+  double pitch = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(connected));
+    a->Visit(MJ_NVP(mode));
+    a->Visit(MJ_NVP(engaged));
+    a->Visit(MJ_NVP(events));
+    a->Visit(MJ_NVP(batches));
+    a->Visit(MJ_NVP(commands));
+    a->Visit(MJ_NVP(drive));
+    a->Visit(MJ_NVP(yaw));
+    a->Visit(MJ_NVP(pitch));
+  }
+};
+}
+
+class GamepadTeleop::Impl {
+ public:
+  Impl(base::Context& context, CommandHandler command_handler)
+      : executor_(context.executor),
+        command_handler_(std::move(command_handler)),
+        input_(executor_),
+        timer_(executor_) {
+    context.telemetry_registry->Register("gamepad_teleop", &status_signal_);
+  }
+
+  void AsyncStart(mjlib::io::ErrorCallback callback) {
+    if (!parameters_.device.empty()) {
+      input_.Open(parameters_.device);
+      log_.warn(fmt::format("Opened gamepad {}", input_.name()));
+      status_.connected = true;
+
+      StartRead();
+      timer_.start(
+          base::ConvertSecondsToDuration(parameters_.period_s),
+          std::bind(&Impl::HandleTimer, this, pl::_1));
+    }
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+  void StartRead() {
+    input_.AsyncReadSome(
+        &events_, std::bind(&Impl::HandleRead, this, pl::_1));
+  }
+
+  void HandleRead(const mjlib::base::error_code& ec) {
+    if (ec) {
+      // Most likely the gamepad was unplugged or lost its link.  Bring
+      // the robot to a halt and give up control.
+      log_.warn(fmt::format("Gamepad read failed: {}", ec.message()));
+      status_.connected = false;
+      Disengage();
+      timer_.cancel();
+      return;
+    }
+
+    status_.batches++;
+    status_.events += events_.size();
+
+    // Axis values are latched inside LinuxInput, so only buttons need
+    // handling here.  Everything else is coalesced until the next
+    // timer tick.
+    for (const auto& event : events_) {
+      if (event.ev_type != EV_KEY || event.value != 1) { continue; }
+
+      if (event.code == parameters_.stop_button) {
+        Disengage();
+      } else if (event.code == parameters_.drive_button) {
+        Engage(HoverbotCommand::kDrive);
+      } else if (event.code == parameters_.pitch_button) {
+        Engage(HoverbotCommand::kPitch);
+      }
+    }
+
+    StartRead();
+  }
+
+  void Engage(HoverbotCommand::Mode mode) {
+    status_.engaged = true;
+    status_.mode = mode;
+  }
+
+  void Disengage() {
+    if (!status_.engaged) { return; }
+
+    // Leave the robot balancing in place, rather than dropping it.
+    HoverbotCommand command = MakeCommand();
+    command.drive = {};
+    command.pitch = {};
+    command_handler_(command);
+
+    status_.engaged = false;
+  }
+
+  double Axis(int code, bool invert) const {
+    const double value = input_.abs_info(code).scaled();
+    if (std::abs(value) < parameters_.deadband) { return 0.0; }
+    return (invert ? -1.0 : 1.0) * value;
+  }
+
+  HoverbotCommand MakeCommand() {
+    status_.drive = Axis(parameters_.drive_axis, parameters_.invert_drive);
+    status_.yaw = Axis(parameters_.yaw_axis, parameters_.invert_yaw);
+    status_.pitch = Axis(parameters_.pitch_axis, parameters_.invert_pitch);
+
+    HoverbotCommand command;
+    command.priority = parameters_.priority;
+    command.mode = status_.mode;
+
+    if (status_.mode == HoverbotCommand::kDrive) {
+      command.drive.velocity_mps = status_.drive * parameters_.max_speed_mps;
+      command.drive.yaw_rate_dps = status_.yaw * parameters_.max_yaw_rate_dps;
+    } else if (status_.mode == HoverbotCommand::kPitch) {
+      command.pitch.pitch_deg = status_.pitch * parameters_.max_pitch_deg;
+      command.pitch.yaw_rate_dps = status_.yaw * parameters_.max_yaw_rate_dps;
+    }
+
+    return command;
+  }
+
+  void HandleTimer(const mjlib::base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    mjlib::base::FailIf(ec);
+
+    if (status_.engaged) {
+      command_handler_(MakeCommand());
+      status_.commands++;
+    }
+
+    status_.timestamp = mjlib::io::Now(executor_.context());
+    status_signal_(&status_);
+  }
+
+  boost::asio::any_io_executor executor_;
+  CommandHandler command_handler_;
+  Parameters parameters_;
+
+  base::LogRef log_ = base::GetLogInstance("GamepadTeleop");
+
+  base::LinuxInput input_;
+  std::vector<base::LinuxInput::Event> events_;
+  mjlib::io::RepeatingTimer timer_;
+
+  Status status_;
+  boost::signals2::signal<void (const Status*)> status_signal_;
+};
+
+GamepadTeleop::GamepadTeleop(base::Context& context,
+                             CommandHandler command_handler)
+    : impl_(std::make_unique<Impl>(context, std::move(command_handler))) {}
+
+GamepadTeleop::~GamepadTeleop() {}
+
+void GamepadTeleop::AsyncStart(mjlib::io::ErrorCallback callback) {
+  impl_->AsyncStart(std::move(callback));
+}
+
+clipp::group GamepadTeleop::program_options() {
+  return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
+}
+
+}
+}
@@ -0,0 +1,110 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <functional>
+#include <memory>
+
+#include <clipp/clipp.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+
+#include "base/context.h"
+
+#include "mech/hoverbot_command.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Drive the robot directly from an evdev gamepad attached to it,
+/// bypassing the network entirely.
+///
+/// Input events are read in batches, and the most recent axis values
+/// are turned into at most one HoverbotCommand per period.  Pressing
+/// the drive or pitch button engages the corresponding mode.  The
+/// stop button, or losing the device, disengages.  While disengaged,
+/// no commands are sent, so other sources like the web UI take over
+/// once the last command goes stale.
+class GamepadTeleop : boost::noncopyable {
+ public:
+  using CommandHandler = std::function<void (const HoverbotCommand&)>;
+
+  GamepadTeleop(base::Context&, CommandHandler);
+  ~GamepadTeleop();
+
+  void AsyncStart(mjlib::io::ErrorCallback);
+
+  struct Parameters {
+    /// The evdev device, like /dev/input/event0.  If empty, teleop is
+    /// disabled.
+    std::string device;
+
+    int priority = 10;
+    double period_s = 0.01;
+
+    double max_speed_mps = 1.0;
+    double max_yaw_rate_dps = 90.0;
+    double max_pitch_deg = 10.0;
+
+    /// Scaled axis values with a magnitude below this are treated as
+    /// zero.
+    double deadband = 0.05;
+
+    /// Axes and buttons are the ABS_* and BTN_* codes from
+    /// linux/input.h.  The defaults match common dual stick pads.
+    int drive_axis = 0x01;  // ABS_Y
+    int yaw_axis = 0x03;  // ABS_RX
+    int pitch_axis = 0x01;  // ABS_Y
+    bool invert_drive = true;
+    bool invert_yaw = true;
+    bool invert_pitch = false;
+
+    int drive_button = 0x130;  // BTN_SOUTH
+    int pitch_button = 0x133;  // BTN_NORTH
+    int stop_button = 0x131;  // BTN_EAST
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(device));
+      a->Visit(MJ_NVP(priority));
+      a->Visit(MJ_NVP(period_s));
+      a->Visit(MJ_NVP(max_speed_mps));
+      a->Visit(MJ_NVP(max_yaw_rate_dps));
+      a->Visit(MJ_NVP(max_pitch_deg));
+      a->Visit(MJ_NVP(deadband));
+      a->Visit(MJ_NVP(drive_axis));
+      a->Visit(MJ_NVP(yaw_axis));
+      a->Visit(MJ_NVP(pitch_axis));
+      a->Visit(MJ_NVP(invert_drive));
+      a->Visit(MJ_NVP(invert_yaw));
+      a->Visit(MJ_NVP(invert_pitch));
+      a->Visit(MJ_NVP(drive_button));
+      a->Visit(MJ_NVP(pitch_button));
+      a->Visit(MJ_NVP(stop_button));
+    }
+  };
+
+  clipp::group program_options();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
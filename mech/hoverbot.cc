@@ -14,9 +14,15 @@
 
 #include "mech/hoverbot.h"
 
+#include <set>
+
+#include <boost/algorithm/string.hpp>
 #include <boost/asio/post.hpp>
 
+#include "mjlib/base/fail.h"
+
 #include "base/logging.h"
+#include "base/startup_tracer.h"
 #include "base/telemetry_registry.h"
 #include "mech/pi3hat_wrapper.h"
 
@@ -30,7 +36,8 @@ class Hoverbot::Impl {
   Impl(base::Context& context)
       : executor_(context.executor),
         factory_(context.factory.get()),
-        telemetry_registry_(context.telemetry_registry.get()) {
+        telemetry_registry_(context.telemetry_registry.get()),
+        startup_tracer_(context.startup_tracer.get()) {
     m_.pi3hat = std::make_unique<
       mjlib::io::Selector<Pi3hatInterface>>(executor_, "type");
     m_.pi3hat->Register<Pi3hatWrapper>("pi3hat");
@@ -39,6 +46,23 @@ class Hoverbot::Impl {
     m_.hoverbot_control = std::make_unique<HoverbotControl>(
         context,
         [&]() { return m_.pi3hat->selected(); } );
+    m_.camera = std::make_unique<Camera>(context);
+    m_.video_streamer = std::make_unique<VideoStreamer>(
+        context,
+        [&]() { return m_.camera->driver(); });
+    m_.camera_imu_alignment = std::make_unique<CameraImuAlignment>(
+        context,
+        [&]() { return m_.camera->driver(); },
+        m_.hoverbot_control->imu_signal());
+    m_.visual_odometry = std::make_unique<VisualOdometry>(
+        context,
+        [&]() { return m_.camera->driver(); },
+        m_.camera_imu_alignment.get());
+    m_.visual_odometry->estimate_signal()->connect(
+        [q=m_.hoverbot_control.get()](const auto* estimate) {
+          if (!estimate->valid) { return; }
+          q->VisualVelocity(estimate->timestamp, estimate->velocity_mps);
+        });
     m_.web_control = std::make_unique<HoverbotWebControl>(
         context.executor,
         [q=m_.hoverbot_control.get()](const auto& cmd) {
@@ -47,17 +71,36 @@ class Hoverbot::Impl {
         [q=m_.hoverbot_control.get()]() {
           return q->status();
         },
-        []() {
+        [v=m_.video_streamer.get()]() {
           HoverbotWebControl::Options options;
           options.asset_path = "web_control_assets";
+          options.websocket_handlers.push_back(
+              {"/video",
+               [v](WebServer::WebsocketStream stream) {
+                 v->HandleWebsocket(std::move(stream));
+               }});
           return options;
         }());
+    m_.gamepad_teleop = std::make_unique<GamepadTeleop>(
+        context,
+        [q=m_.hoverbot_control.get()](const auto& cmd) {
+          q->Command(cmd);
+        });
     m_.system_info = std::make_unique<SystemInfo>(context);
   }
 
   void AsyncStart(mjlib::io::ErrorCallback callback) {
+    std::set<std::string> lazy;
+    boost::split(lazy, p_.lazy_start, boost::is_any_of(" "),
+                 boost::token_compress_on);
+    lazy.erase("");
+
+    base::StartArchive::Options options;
+    options.tracer = startup_tracer_;
+    options.skip = lazy;
+
     base::StartArchive::Start(
-        &m_, [this, callback=std::move(callback)](
+        &m_, [this, lazy, callback=std::move(callback)](
             const mjlib::base::error_code& ec) mutable {
                // pi3hat should be initialized by now
                Pi3hatWrapper* const pi3hat =
@@ -67,12 +110,28 @@ class Hoverbot::Impl {
                  telemetry_registry_->Register("power", pi3hat->power_signal());
                }
                std::move(callback)(ec);
-             });
+
+               if (!ec && !lazy.empty()) { StartLazy(lazy); }
+             },
+        options);
+  }
+
+  void StartLazy(const std::set<std::string>& lazy) {
+    base::StartArchive::Options options;
+    options.tracer = startup_tracer_;
+    options.only = lazy;
+
+    base::StartArchive::Start(
+        &m_, [](const mjlib::base::error_code& ec) {
+          mjlib::base::FailIf(ec);
+        },
+        options);
   }
 
   boost::asio::any_io_executor executor_;
   mjlib::io::StreamFactory* const factory_;
   base::TelemetryRegistry* telemetry_registry_;
+  base::StartupTracer* const startup_tracer_;
 
   base::LogRef log_ = base::GetLogInstance("Hoverbot");
 
@@ -25,9 +25,14 @@
 #include "base/component_archives.h"
 #include "base/context.h"
 
+#include "mech/camera.h"
+#include "mech/camera_imu_alignment.h"
+#include "mech/gamepad_teleop.h"
 #include "mech/pi3hat_interface.h"
 #include "mech/hoverbot_control.h"
 #include "mech/system_info.h"
+#include "mech/visual_odometry.h"
+#include "mech/video_streamer.h"
 #include "mech/web_control.h"
 
 namespace mjmech {
@@ -47,14 +52,24 @@ class Hoverbot : boost::noncopyable {
     std::unique_ptr<
       mjlib::io::Selector<Pi3hatInterface>> pi3hat;
     std::unique_ptr<HoverbotControl> hoverbot_control;
+    std::unique_ptr<Camera> camera;
+    std::unique_ptr<VideoStreamer> video_streamer;
+    std::unique_ptr<CameraImuAlignment> camera_imu_alignment;
+    std::unique_ptr<VisualOdometry> visual_odometry;
     std::unique_ptr<HoverbotWebControl> web_control;
+    std::unique_ptr<GamepadTeleop> gamepad_teleop;
     std::unique_ptr<SystemInfo> system_info;
 
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(pi3hat));
       a->Visit(MJ_NVP(hoverbot_control));
+      a->Visit(MJ_NVP(camera));
+      a->Visit(MJ_NVP(video_streamer));
+      a->Visit(MJ_NVP(camera_imu_alignment));
+      a->Visit(MJ_NVP(visual_odometry));
       a->Visit(MJ_NVP(web_control));
+      a->Visit(MJ_NVP(gamepad_teleop));
       a->Visit(MJ_NVP(system_info));
     }
   };
@@ -62,8 +77,13 @@ class Hoverbot : boost::noncopyable {
   Members* m();
 
   struct Parameters {
+    /// Space separated members which are not needed to control the
+    /// robot.  These are started only after everything else has.
+    std::string lazy_start;
+
     template <typename Archive>
     void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(lazy_start));
     }
   };
 
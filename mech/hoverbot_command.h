@@ -73,6 +73,10 @@ struct HoverbotCommand {
     // Drive at a fixed velocity and yaw rate.
     kDrive = 7,
 
+    // Drive at a fixed velocity and yaw rate, using the state feedback
+    // gains in the balance configuration instead of the PIDs.
+    kBalance = 8,
+
     kNumModes,
   };
 
@@ -108,6 +112,8 @@ struct HoverbotCommand {
   // Only valid for kJoint mode.
   std::vector<Joint> joints;
 
+  /// In kPitch mode, pitch_deg is approached along a jerk limited
+  /// trajectory, whose rate is used in place of pitch_rate_dps.
   struct Pitch {
     double pitch_deg = 0.0;
     double pitch_rate_dps = 0.0;
@@ -123,6 +129,9 @@ struct HoverbotCommand {
 
   Pitch pitch;
 
+  /// Used in both kDrive and kBalance.  velocity_mps is approached
+  /// along a jerk limited trajectory, whose acceleration is used in
+  /// place of accel_mps2.
   struct Drive {
     double velocity_mps = 0.0;
     double accel_mps2 = 0.0;
@@ -139,6 +148,32 @@ struct HoverbotCommand {
 
   Drive drive;
 
+  /// One setpoint of a trajectory, time_s seconds after the command
+  /// is received.
+  struct Waypoint {
+    double time_s = 0.0;
+    Pitch pitch;
+    Drive drive;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(time_s));
+      a->Visit(MJ_NVP(pitch));
+      a->Visit(MJ_NVP(drive));
+    }
+  };
+
+  /// If non-empty, the pitch and drive setpoints are interpolated from
+  /// these on the robot clock every cycle, in place of pitch and
+  /// drive.  The last waypoint is held once it has passed, and the
+  /// command does not go stale until the timeout after that.  Times
+  /// must be strictly increasing.
+  ///
+  /// The interpolated velocity_mps is still approached along the
+  /// jerk limited trajectory, so drive.accel_mps2 in each waypoint is
+  /// ignored just as it is in drive.
+  std::vector<Waypoint> trajectory;
+
   template <typename Archive>
   void Serialize(Archive* a) {
     a->Visit(MJ_NVP(priority));
@@ -147,6 +182,7 @@ struct HoverbotCommand {
     a->Visit(MJ_NVP(joints));
     a->Visit(MJ_NVP(pitch));
     a->Visit(MJ_NVP(drive));
+    a->Visit(MJ_NVP(trajectory));
   }
 };
 
@@ -171,6 +207,7 @@ struct IsEnum<mjmech::mech::HoverbotCommand::Mode> {
         { M::kStandUp, "stand_up" },
         { M::kPitch, "pitch" },
         { M::kDrive, "drive" },
+        { M::kBalance, "balance" },
       }};
   }
 };
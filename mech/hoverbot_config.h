@@ -19,9 +19,13 @@
 #include "mjlib/base/pid.h"
 #include "mjlib/base/visitor.h"
 
+#include "base/biquad_filter.h"
 #include "base/point3d.h"
 #include "base/sophus.h"
 
+#include "mech/balance_gains.h"
+#include "mech/trajectory.h"
+
 namespace mjmech {
 namespace mech {
 
@@ -49,11 +53,19 @@ struct HoverbotConfig {
   std::vector<Joint> joints;
 
   struct StandUp {
-    double pitch_rate_dps = 180.0;
+    /// Limits the pitch target, in degrees, as it moves from laying
+    /// down to upright.
+    JerkLimits trajectory;
+
+    StandUp() {
+      trajectory.max_velocity_l_s = 180.0;
+      trajectory.max_acceleration_l_s2 = 720.0;
+      trajectory.max_jerk_l_s3 = 7200.0;
+    }
 
     template <typename Archive>
     void Serialize(Archive* a) {
-      a->Visit(MJ_NVP(pitch_rate_dps));
+      a->Visit(MJ_NVP(trajectory));
     }
   };
 
@@ -64,11 +76,21 @@ struct HoverbotConfig {
     mjlib::base::PID::Config pitch_pid;
     mjlib::base::PID::Config yaw_pid;
 
+    /// Limits how the commanded pitch, in degrees, is approached.
+    JerkLimits trajectory;
+
+    Pitch() {
+      trajectory.max_velocity_l_s = 90.0;
+      trajectory.max_acceleration_l_s2 = 720.0;
+      trajectory.max_jerk_l_s3 = 7200.0;
+    }
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(pitch_offset_deg));
       a->Visit(MJ_NVP(pitch_pid));
       a->Visit(MJ_NVP(yaw_pid));
+      a->Visit(MJ_NVP(trajectory));
     }
   };
 
@@ -78,18 +100,128 @@ struct HoverbotConfig {
     double pitch_limit_deg = 20.0;
     mjlib::base::PID::Config drive_pid;
 
+    /// Limits how the commanded velocity, in m/s, is approached.
+    JerkLimits trajectory;
+
+    Drive() {
+      trajectory.max_velocity_l_s = 2.0;
+      trajectory.max_acceleration_l_s2 = 1.0;
+      trajectory.max_jerk_l_s3 = 5.0;
+    }
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(pitch_limit_deg));
       a->Visit(MJ_NVP(drive_pid));
+      a->Visit(MJ_NVP(trajectory));
     }
   };
 
   Drive drive;
 
+  struct Balance {
+    /// Usually loaded from configs/hoverbot_balance.cfg.
+    std::vector<BalanceGain> gains;
+
+    /// The integrated velocity error is limited to this.
+    double max_position_error_m = 0.5;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(gains));
+      a->Visit(MJ_NVP(max_position_error_m));
+    }
+  };
+
+  Balance balance;
+
+  struct Velocity {
+    /// When true, velocity measured by the camera is used to correct
+    /// the wheel odometry, which overestimates when the wheels slip.
+    bool use_visual = false;
+
+    /// How much of the difference each visual measurement corrects.
+    double visual_alpha = 0.3;
+    double max_visual_correction_mps = 1.0;
+
+    /// Without a measurement for this long, the correction decays
+    /// away with this half life.
+    double visual_timeout_s = 0.3;
+    double visual_decay_s = 0.5;
+
+    /// How much wheel velocity history is kept to compare against
+    /// delayed visual measurements.  At most 512 status cycles are
+    /// kept, whatever this is set to.
+    double wheel_history_s = 0.5;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(use_visual));
+      a->Visit(MJ_NVP(visual_alpha));
+      a->Visit(MJ_NVP(max_visual_correction_mps));
+      a->Visit(MJ_NVP(visual_timeout_s));
+      a->Visit(MJ_NVP(visual_decay_s));
+      a->Visit(MJ_NVP(wheel_history_s));
+    }
+  };
+
+  Velocity velocity;
+
   double max_tip_deg = 65;
-  double tip_filter_s = 0.1;
-  double voltage_filter_s = 1.0;
+
+  /// Conditioning applied to measured signals every cycle.
+  struct Filters {
+    base::FilterConfig tip;
+    base::FilterConfig voltage;
+
+    /// This is applied to robot.velocity_mps to get accel_mps2, so it
+    /// should include the derivative.
+    base::FilterConfig accel;
+
+    /// These are used for the pitch and yaw rate feedback.
+    base::FilterConfig pitch_rate;
+    base::FilterConfig yaw_rate;
+
+    Filters() {
+      tip.half_life_s = 0.1;
+      voltage.half_life_s = 1.0;
+      accel.lowpass_hz = 10.0;
+      accel.derivative = true;
+    }
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(tip));
+      a->Visit(MJ_NVP(voltage));
+      a->Visit(MJ_NVP(accel));
+      a->Visit(MJ_NVP(pitch_rate));
+      a->Visit(MJ_NVP(yaw_rate));
+    }
+  };
+
+  Filters filters;
+
+  /// The outer loops run once every N cycles of period_s.  Servo
+  /// status is only queried on status cycles, the IMU is read every
+  /// cycle.
+  struct Rates {
+    int status_divider = 1;
+    int drive_divider = 1;
+    int yaw_divider = 1;
+
+    /// The tip over and battery checks.
+    int monitor_divider = 1;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(status_divider));
+      a->Visit(MJ_NVP(drive_divider));
+      a->Visit(MJ_NVP(yaw_divider));
+      a->Visit(MJ_NVP(monitor_divider));
+    }
+  };
+
+  Rates rates;
 
   template <typename Archive>
   void Serialize(Archive* a) {
@@ -100,9 +232,11 @@ struct HoverbotConfig {
     a->Visit(MJ_NVP(stand_up));
     a->Visit(MJ_NVP(pitch));
     a->Visit(MJ_NVP(drive));
+    a->Visit(MJ_NVP(balance));
+    a->Visit(MJ_NVP(velocity));
     a->Visit(MJ_NVP(max_tip_deg));
-    a->Visit(MJ_NVP(tip_filter_s));
-    a->Visit(MJ_NVP(voltage_filter_s));
+    a->Visit(MJ_NVP(filters));
+    a->Visit(MJ_NVP(rates));
   }
 };
 
@@ -14,30 +14,46 @@
 
 #include "mech/hoverbot_control.h"
 
+#include <array>
+#include <bitset>
+#include <cmath>
 #include <fstream>
+#include <string_view>
+#include <thread>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/asio/executor_work_guard.hpp>
+#include <boost/asio/io_context.hpp>
 #include <boost/asio/post.hpp>
 
 #include <fmt/format.h>
 
 #include "mjlib/base/clipp_archive.h"
 #include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/json5_write_archive.h"
+#include "mjlib/base/system_error.h"
 
 #include "mjlib/io/now.h"
 #include "mjlib/io/repeating_timer.h"
 
+#include "base/biquad_filter.h"
 #include "base/common.h"
+#include "base/file_watcher.h"
+#include "base/handler_util.h"
 #include "base/fit_plane.h"
 #include "base/interpolate.h"
 #include "base/logging.h"
+#include "base/ring_buffer.h"
 #include "base/sophus.h"
+#include "base/startup_tracer.h"
 #include "base/telemetry_registry.h"
 #include "base/timestamped_log.h"
 
 #include "mech/attitude_data.h"
+#include "mech/command_trajectory.h"
 #include "mech/moteus.h"
 #include "mech/hoverbot_config.h"
+#include "mech/hoverbot_filters.h"
 #include "mech/hoverbot_context.h"
 
 namespace pl = std::placeholders;
@@ -46,7 +62,35 @@ namespace mjmech {
 namespace mech {
 
 namespace {
-constexpr int kNumServos = 2;
+// Enough for a few seconds of setpoints at the control rate.
+constexpr size_t kMaxWaypoints = 1000;
+
+// moteus servo ids are 7 bits.
+constexpr int kNumServoIds = 128;
+using ServoIds = std::bitset<kNumServoIds>;
+
+bool IsValidServoId(int id) { return id >= 0 && id < kNumServoIds; }
+
+/// The precision of the per-cycle filtering.  The state, telemetry
+/// and configuration stay in double.  Build with --config=float32 to
+/// use single precision.
+#ifdef MJMECH_CONTROL_FLOAT32
+using ControlScalar = float;
+#else
+using ControlScalar = double;
+#endif
+
+using FilterBanks = HoverbotFilters<ControlScalar>;
+using FilterBank = FilterBanks::Bank;
+
+enum Loop {
+  kInnerLoop,
+  kStatusLoop,
+  kDriveLoop,
+  kYawLoop,
+  kMonitorLoop,
+  kNumLoops,
+};
 
 using HC = HoverbotCommand;
 using HM = HC::Mode;
@@ -125,21 +169,157 @@ struct ReportedServoConfig {
 
 using Config = HoverbotConfig;
 
+/// The command is logged with its trajectory left out, since that can
+/// be up to kMaxWaypoints long.  Only a summary of it is kept.
 struct CommandLog {
   boost::posix_time::ptime timestamp;
 
   const HC* command = &ignored_command;
 
+  int trajectory_waypoints = 0;
+  double trajectory_duration_s = 0.0;
+
   template <typename Archive>
   void Serialize(Archive* a) {
     a->Visit(MJ_NVP(timestamp));
     const_cast<HC*>(command)->Serialize(a);
+    a->Visit(MJ_NVP(trajectory_waypoints));
+    a->Visit(MJ_NVP(trajectory_duration_s));
   }
 
   static HC ignored_command;
 };
 
 HC CommandLog::ignored_command;
+
+/// Emitted for each attempt to reload the configuration.
+struct ConfigReloadLog {
+  boost::posix_time::ptime timestamp;
+
+  /// The change which started this reload.
+  std::string filename;
+
+  bool applied = false;
+  std::string error;
+  bool filters_changed = false;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(filename));
+    a->Visit(MJ_NVP(applied));
+    a->Visit(MJ_NVP(error));
+    a->Visit(MJ_NVP(filters_changed));
+  }
+};
+
+/// Throws if @p pid, named @p name, has a gain or limit which is
+/// negative or not finite.
+void CheckPid(std::string_view name, const mjlib::base::PID::Config& pid) {
+  const auto check = [&](std::string_view field, double value) {
+    mjlib::base::system_error::throw_if(
+        !(std::isfinite(value) && value >= 0.0),
+        fmt::format("{}.{} must be finite and not negative", name, field));
+  };
+  check("kp", pid.kp);
+  check("ki", pid.ki);
+  check("kd", pid.kd);
+  check("ilimit", pid.ilimit);
+  check("max_desired_rate", pid.max_desired_rate);
+  // A negative rate limit disables it.
+  mjlib::base::system_error::throw_if(
+      !std::isfinite(pid.iratelimit),
+      fmt::format("{}.iratelimit must be finite", name));
+  mjlib::base::system_error::throw_if(
+      std::abs(pid.sign) != 1.0,
+      fmt::format("{}.sign must be 1 or -1", name));
+}
+
+/// Later files override earlier ones.
+Config ReadConfig(const std::string& filenames) {
+  Config result;
+  std::vector<std::string> configs;
+  boost::split(configs, filenames, boost::is_any_of(" "));
+  for (const auto& config : configs) {
+    std::ifstream inf(config);
+    mjlib::base::system_error::throw_if(
+        !inf.is_open(),
+        fmt::format("could not open config file '{}'", config));
+
+    mjlib::base::Json5ReadArchive(inf).Accept(&result);
+  }
+
+  CheckPid("pitch.pitch_pid", result.pitch.pitch_pid);
+  CheckPid("pitch.yaw_pid", result.pitch.yaw_pid);
+  CheckPid("drive.drive_pid", result.drive.drive_pid);
+
+  const auto& rates = result.rates;
+  const auto check_divider = [](std::string_view field, int divider) {
+    mjlib::base::system_error::throw_if(
+        divider < 1, fmt::format("rates.{} must be at least 1", field));
+  };
+  check_divider("status_divider", rates.status_divider);
+  check_divider("drive_divider", rates.drive_divider);
+  check_divider("yaw_divider", rates.yaw_divider);
+  check_divider("monitor_divider", rates.monitor_divider);
+  // The drive loop uses the velocity from each servo query, so it may
+  // only run on cycles which query the servos.
+  mjlib::base::system_error::throw_if(
+      rates.drive_divider % rates.status_divider != 0,
+      fmt::format("rates.drive_divider {} must be a multiple of "
+                  "rates.status_divider {}",
+                  rates.drive_divider, rates.status_divider));
+  return result;
+}
+
+/// Everything derived from a changed configuration.  It is prepared
+/// off the control thread, so that applying it at a cycle boundary is
+/// only a few moves.
+struct ReloadedConfig {
+  Config config;
+  /// Whether these replace the running filters is only decided when
+  /// this is applied, against whatever config was live by then.
+  FilterBanks filters;
+  std::string filters_json;
+  BalanceGainTable balance_gains;
+};
+
+/// Throws if @p next can not replace @p current while running.
+ReloadedConfig PrepareReload(const std::string& filenames,
+                             const Config& current) {
+  ReloadedConfig result;
+  result.config = ReadConfig(filenames);
+  const auto& next = result.config;
+
+  const auto same_joints = [&]() {
+    if (next.joints.size() != current.joints.size()) { return false; }
+    for (size_t i = 0; i < next.joints.size(); i++) {
+      if (next.joints[i].id != current.joints[i].id ||
+          next.joints[i].sign != current.joints[i].sign) {
+        return false;
+      }
+    }
+    return true;
+  };
+  mjlib::base::system_error::throw_if(
+      !same_joints(), "joints can not be changed while running");
+
+  using JsonWrite = mjlib::base::Json5WriteArchive;
+  mjlib::base::system_error::throw_if(
+      next.period_s != current.period_s ||
+      JsonWrite::Write(next.rates) != JsonWrite::Write(current.rates),
+      "period_s and rates can not be changed while running");
+  mjlib::base::system_error::throw_if(
+      next.balance.gains.empty() && !current.balance.gains.empty(),
+      "balance gains can not be removed while running");
+
+  result.filters = DesignHoverbotFilters<ControlScalar>(next);
+  result.filters_json = JsonWrite::Write(next.filters);
+  if (!next.balance.gains.empty()) {
+    result.balance_gains = BalanceGainTable(next.balance.gains);
+  }
+  return result;
+}
 }
 
 class HoverbotControl::Impl {
@@ -148,6 +328,7 @@ class HoverbotControl::Impl {
        Pi3hatGetter pi3hat_getter)
       : executor_(context.executor),
         telemetry_log_(context.telemetry_log.get()),
+        startup_tracer_(context.startup_tracer.get()),
         timer_(executor_),
         pi3hat_getter_(pi3hat_getter) {
     context.telemetry_registry->Register("hc_status", &status_signal_);
@@ -155,6 +336,18 @@ class HoverbotControl::Impl {
     context.telemetry_registry->Register("hc_control", &control_signal_);
     context.telemetry_registry->Register("imu", &imu_signal_);
     context.telemetry_registry->Register("servo_config", &servo_config_signal_);
+    context.telemetry_registry->Register(
+        "hc_config_reload", &config_reload_signal_);
+
+    current_command_.trajectory.reserve(kMaxWaypoints);
+  }
+
+  ~Impl() {
+    // Let the worker finish anything already posted, rather than
+    // abandoning it part way.  What it posts back is dropped once
+    // lifetime_ is gone.
+    reload_work_guard_.reset();
+    if (reload_thread_.joinable()) { reload_thread_.join(); }
   }
 
   void AsyncStart(mjlib::io::ErrorCallback callback) {
@@ -163,16 +356,9 @@ class HoverbotControl::Impl {
     BOOST_ASSERT(!!pi3hat_);
 
     // Load our configuration.
-    std::vector<std::string> configs;
-    boost::split(configs, parameters_.config, boost::is_any_of(" "));
-    for (const auto& config : configs) {
-      std::ifstream inf(config);
-      mjlib::base::system_error::throw_if(
-          !inf.is_open(),
-          fmt::format("could not open config file '{}'", parameters_.config));
-
-      mjlib::base::Json5ReadArchive(inf).Accept(&config_);
-    }
+    startup_tracer_->Begin("hoverbot_control.config_load");
+    config_ = ReadConfig(parameters_.config);
+    startup_tracer_->End("hoverbot_control.config_load");
 
     context_.emplace(config_, &current_command_, &status_.state);
 
@@ -180,9 +366,42 @@ class HoverbotControl::Impl {
 
     period_s_ = config_.period_s;
     rate_hz_ = static_cast<int>(1.0 / config_.period_s);
+
+    scheduler_.set_divider(kStatusLoop, config_.rates.status_divider);
+    scheduler_.set_divider(kDriveLoop, config_.rates.drive_divider);
+    scheduler_.set_divider(kYawLoop, config_.rates.yaw_divider);
+    scheduler_.set_divider(kMonitorLoop, config_.rates.monitor_divider);
+
+    // The drive loop keeps the status loop's phase, and ReadConfig
+    // ensures its divider is a multiple of the status divider, so it
+    // always runs on a cycle with fresh servo velocities.  The yaw loop
+    // only uses the IMU, and the monitor can tolerate a cycle of delay,
+    // so those are moved off of it.
+    scheduler_.set_phase(kYawLoop, 1);
+    scheduler_.set_phase(kMonitorLoop, 2);
+
+    {
+      auto filters = DesignHoverbotFilters<ControlScalar>(config_);
+      filters_ = std::move(filters.imu);
+      accel_filter_ = std::move(filters.accel);
+      voltage_filter_ = std::move(filters.voltage);
+      filters_json_ = mjlib::base::Json5WriteArchive::Write(config_.filters);
+    }
+
+    if (!config_.balance.gains.empty()) {
+      balance_gains_ = BalanceGainTable(config_.balance.gains);
+    }
+
+    if (parameters_.reload_config) {
+      StartWorker();
+      StartConfigWatch();
+    }
     timer_.start(mjlib::base::ConvertSecondsToDuration(period_s_),
                  std::bind(&Impl::HandleTimer, this, pl::_1));
 
+    // This ends in HandleStatus, once all the servos are configured.
+    startup_tracer_->Begin("hoverbot_control.configuring");
+
     boost::asio::post(
         executor_,
         std::bind(std::move(callback), mjlib::base::error_code()));
@@ -194,18 +413,35 @@ class HoverbotControl::Impl {
     const bool stale =
         !current_command_timestamp_.is_not_a_date_time() &&
         (mjlib::base::ConvertDurationToSeconds(
-            now - current_command_timestamp_) > parameters_.command_timeout_s);
+            now - current_command_timestamp_) >
+         parameters_.command_timeout_s + command_trajectory_.duration_s());
     if (!higher_priority && !stale) {
       return;
     }
 
-    CommandLog command_log;
-    command_log.timestamp = now;
-    command_log.command = &command;
+    if (command.trajectory.empty()) {
+      command_trajectory_.Clear();
+    } else if (!command_trajectory_.Set(command.trajectory, now)) {
+      WarnRateLimited(fmt::format(
+          "Ignoring command with invalid trajectory: {} waypoints, max {}",
+          command.trajectory.size(), kMaxWaypoints));
+      return;
+    }
 
+    // Copy the whole command, so that nothing added to it later is
+    // missed.  The waypoints are already in command_trajectory_, so
+    // drop them again.  current_command_.trajectory had kMaxWaypoints
+    // reserved, so this never allocates.
     current_command_ = command;
+    current_command_.trajectory.clear();
     current_command_timestamp_ = now;
 
+    CommandLog command_log;
+    command_log.timestamp = now;
+    command_log.command = &current_command_;
+    command_log.trajectory_waypoints = command.trajectory.size();
+    command_log.trajectory_duration_s = command_trajectory_.duration_s();
+
     // Update our logging status.
     if (command.log != HoverbotCommand::Log::kUnset) {
       if (command.log == HoverbotCommand::Log::kEnable &&
@@ -254,6 +490,109 @@ class HoverbotControl::Impl {
     }
   }
 
+  void StartWorker() {
+    reload_thread_ = std::thread([this]() { reload_context_.run(); });
+  }
+
+  void StartConfigWatch() {
+    std::vector<std::string> configs;
+    boost::split(configs, parameters_.config, boost::is_any_of(" "));
+    config_watcher_ = std::make_unique<base::FileWatcher>(
+        executor_, configs,
+        std::bind(&Impl::RequestReload, this, pl::_1));
+  }
+
+  void RequestReload(const std::string& filename) {
+    // An editor may write several files at once.  Those which arrive
+    // while a reload is being prepared get one more after it.
+    if (reload_outstanding_) {
+      reload_again_ = filename;
+      return;
+    }
+    reload_outstanding_ = true;
+
+    boost::asio::post(
+        reload_context_,
+        [this, filename, filenames=parameters_.config, current=config_]() {
+          auto reloaded = std::make_shared<ReloadedConfig>();
+          std::string error;
+          try {
+            *reloaded = PrepareReload(filenames, current);
+          } catch (std::exception& e) {
+            error = e.what();
+          }
+          boost::asio::post(
+              executor_,
+              lifetime_.Wrap([this, filename, reloaded, error]() {
+                  HandleReload(filename, reloaded, error);
+                }));
+        });
+  }
+
+  void HandleReload(const std::string& filename,
+                    std::shared_ptr<ReloadedConfig> reloaded,
+                    const std::string& error) {
+    reload_outstanding_ = false;
+
+    if (!error.empty()) {
+      log_.warn(fmt::format("not reloading '{}': {}", filename, error));
+      ConfigReloadLog reload_log;
+      reload_log.timestamp = Now();
+      reload_log.filename = filename;
+      reload_log.error = error;
+      config_reload_signal_(&reload_log);
+    } else {
+      // This replaces any older change which has not been applied
+      // yet, as each one contains every file.
+      pending_config_ = std::move(reloaded);
+      pending_config_filename_ = filename;
+    }
+
+    if (!reload_again_.empty()) {
+      const auto next = reload_again_;
+      reload_again_.clear();
+      RequestReload(next);
+    }
+  }
+
+  /// Only called between cycles.
+  void ApplyPendingConfig() {
+    auto& pending = *pending_config_;
+
+    // The PIDs and the context refer to members of config_, so they
+    // pick up the new values, while keeping their state.
+    config_ = std::move(pending.config);
+
+    // Another change may have been applied since this one was
+    // prepared, so compare against the filters running now.
+    const bool filters_changed = pending.filters_json != filters_json_;
+    if (filters_changed) {
+      filters_ = std::move(pending.filters.imu);
+      accel_filter_ = std::move(pending.filters.accel);
+      voltage_filter_ = std::move(pending.filters.voltage);
+      filters_json_ = std::move(pending.filters_json);
+
+      // The new filters start from a steady state at their next input.
+      filters_initialized_ = false;
+      accel_initialized_ = false;
+      voltage_initialized_ = false;
+    }
+    if (!config_.balance.gains.empty()) {
+      balance_gains_ = std::move(pending.balance_gains);
+    }
+
+    ConfigReloadLog reload_log;
+    reload_log.timestamp = Now();
+    reload_log.filename = pending_config_filename_;
+    reload_log.applied = true;
+    reload_log.filters_changed = filters_changed;
+    config_reload_signal_(&reload_log);
+
+    log_.warn(fmt::format("reloaded config after change to '{}'",
+                          pending_config_filename_));
+    pending_config_.reset();
+  }
+
   void HandleTimer(const mjlib::base::error_code& ec) {
     if (ec == boost::asio::error::operation_aborted) { return; }
     mjlib::base::FailIf(ec);
@@ -261,7 +600,10 @@ class HoverbotControl::Impl {
     if (!pi3hat_) { return; }
     if (outstanding_) { return; }
 
+    if (pending_config_) { ApplyPendingConfig(); }
+
     timing_ = ControlTiming(executor_, timing_.cycle_start());
+    scheduler_.Cycle();
 
     if (timing_.status().delta_s > 1.5 * period_s_) {
       // We likely skipped a cycle.  Warn.
@@ -278,9 +620,14 @@ class HoverbotControl::Impl {
 
     auto* request = [&]() {
       if (status_.mode == HM::kConfiguring) {
+        queried_servos_ = true;
         return &config_status_request_;
       }
-      return &status_request_;
+      // Until we have a full set of joints, ask every cycle.
+      queried_servos_ =
+          status_.state.joints.size() != config_.joints.size() ||
+          scheduler_.due(kStatusLoop);
+      return queried_servos_ ? &status_request_ : &empty_request_;
     }();
     pi3hat_->Cycle(&imu_data_, request, &status_reply_,
                    std::bind(&Impl::HandleStatus, this, pl::_1));
@@ -293,44 +640,71 @@ class HoverbotControl::Impl {
 
     imu_signal_(&imu_data_);
 
-    {
-      const double alpha =
-          std::pow(0.5, config_.period_s / config_.tip_filter_s);
-      auto& pitch = status_.state.robot.tip_pitch_deg;
-      pitch = alpha * pitch + (1.0 - alpha) * imu_data_.euler_deg.pitch;
+    if (queried_servos_ && !CheckServoReplies()) {
+      outstanding_ = false;
+      return;
+    }
+
+    // Fill in the status structure.
+    if (!UpdateStatus()) {
+      // Guess we didn't have enough to actually do anything.
+      outstanding_ = false;
+      return;
+    }
+
+    if (!ready_) { TraceStartup(); }
+
+    timing_.finish_status();
+
+    scheduler_.Run(kMonitorLoop, [&]() { RunMonitor(); });
 
-      auto& roll = status_.state.robot.tip_roll_deg;
-      roll = alpha * roll + (1.0 - alpha) * imu_data_.euler_deg.roll;
+    // Now run our control loop and generate our command.
+    std::swap(control_log_, old_control_log_);
+    *control_log_ = {};
+    scheduler_.Run(kInnerLoop, [&]() { RunControl(); });
+
+    timing_.finish_control();
+
+    if (!client_command_.empty()) {
+      client_command_reply_.clear();
+      pi3hat_->AsyncTransmit(
+          &client_command_, &client_command_reply_,
+          std::bind(&Impl::HandleCommand, this, pl::_1));
+    } else {
+      HandleCommand({});
     }
+  }
 
+  int num_servos() const { return static_cast<int>(config_.joints.size()); }
+
+  /// Return false if this cycle should be skipped.
+  bool CheckServoReplies() {
     // If we don't have all servos, then skip this cycle.
-    const uint16_t servo_bitmask = [&]() {
-      uint16_t result = 0;
-      for (const auto& item : status_reply_) {
-        result |= (1 << item.id);
-      }
-      return result;
-    }();
+    ServoIds replied;
+    for (const auto& item : status_reply_) {
+      if (IsValidServoId(item.id)) { replied.set(item.id); }
+    }
+    const auto found = [&](int id) {
+      return IsValidServoId(id) && replied.test(id);
+    };
     const int found_servos = [&]() {
       int result = 0;
-      for (int i = 1; i <= kNumServos; i++) {
-        if (servo_bitmask & (1 << i)) {
-          result++;
-        }
+      for (const auto& joint : config_.joints) {
+        if (found(joint.id)) { result++; }
       }
       return result;
     }();
-    status_.missing_replies = kNumServos - found_servos;
+    status_.missing_replies = num_servos() - found_servos;
 
-    if (found_servos != kNumServos) {
-      if (status_.state.joints.size() != kNumServos) {
+    if (found_servos != num_servos()) {
+      if (status_.state.joints.size() != config_.joints.size()) {
         // We have to get at least one full set before we can start
         // updating.
         std::string missing;
-        for (int i = 1; i <= kNumServos; i++) {
-          if ((servo_bitmask & (1 << i)) == 0) {
+        for (const auto& joint : config_.joints) {
+          if (!found(joint.id)) {
             if (!missing.empty()) { missing += ","; }
-            missing += fmt::format("{}", i);
+            missing += fmt::format("{}", joint.id);
           }
         }
         const std::string message =
@@ -339,42 +713,33 @@ class HoverbotControl::Impl {
         log_.warn(message);
         status_.fault = message;
 
-        outstanding_ = false;
-        return;
+        return false;
       }
     }
 
-    // Fill in the status structure.
-    if (!UpdateStatus()) {
-      // Guess we didn't have enough to actually do anything.
-      outstanding_ = false;
-      return;
-    }
+    return true;
+  }
 
-    timing_.finish_status();
+  void RunMonitor() {
+    const auto& robot = status_.state.robot;
 
-    if ((std::abs(status_.state.robot.tip_roll_deg) > config_.max_tip_deg ||
-         std::abs(status_.state.robot.tip_pitch_deg) > config_.max_tip_deg) &&
-        status_.state.robot.in_control_time_s > 5.0) {
+    if ((std::abs(robot.tip_roll_deg) > config_.max_tip_deg ||
+         std::abs(robot.tip_pitch_deg) > config_.max_tip_deg) &&
+        robot.in_control_time_s > 5.0) {
       if (status_.mode != HM::kFault) {
         Fault("Tipping over");
       }
     }
 
-    // Now run our control loop and generate our command.
-    std::swap(control_log_, old_control_log_);
-    *control_log_ = {};
-    RunControl();
-
-    timing_.finish_control();
-
-    if (!client_command_.empty()) {
-      client_command_reply_.clear();
-      pi3hat_->AsyncTransmit(
-          &client_command_, &client_command_reply_,
-          std::bind(&Impl::HandleCommand, this, pl::_1));
-    } else {
-      HandleCommand({});
+    const double min_voltage =
+        Min(status_.state.joints.begin(), status_.state.joints.end(),
+            [](const auto& joint) { return joint.voltage; });
+    const double out_voltage =
+        FilterOne(&voltage_filter_, &voltage_initialized_, min_voltage);
+    status_.state.robot.voltage = out_voltage;
+    if (out_voltage < config_.min_voltage) {
+      Fault(fmt::format(
+                "Battery low: {} < {}", out_voltage, config_.min_voltage));
     }
   }
 
@@ -385,6 +750,10 @@ class HoverbotControl::Impl {
     timing_.finish_command();
     status_.timestamp = Now();
     status_.timing = timing_.status();
+    status_.loops.inner = scheduler_.status(kInnerLoop);
+    status_.loops.drive = scheduler_.status(kDriveLoop);
+    status_.loops.yaw = scheduler_.status(kYawLoop);
+    status_.loops.monitor = scheduler_.status(kMonitorLoop);
 
     status_signal_(&status_);
   }
@@ -396,6 +765,112 @@ class HoverbotControl::Impl {
     return {};
   }
 
+  double LoopPeriod(Loop loop) const {
+    return period_s_ * scheduler_.divider(loop);
+  }
+
+  int LoopRate(Loop loop) const {
+    return static_cast<int>(1.0 / LoopPeriod(loop));
+  }
+
+  /// Filter @p input with a single channel bank.
+  static double FilterOne(FilterBank* bank, bool* initialized,
+                          double input) {
+    const ControlScalar x = input;
+    if (!*initialized) {
+      bank->Reset(0, x);
+      *initialized = true;
+    }
+    ControlScalar output = 0;
+    bank->Process(&x, &output);
+    return output;
+  }
+
+  void UpdateFilters() {
+    auto& robot = status_.state.robot;
+
+    std::array<ControlScalar, kNumImuFilters> input = {};
+    input[kTipPitchFilter] = imu_data_.euler_deg.pitch;
+    input[kTipRollFilter] = imu_data_.euler_deg.roll;
+    input[kPitchRateFilter] = imu_data_.rate_dps.y();
+    input[kYawRateFilter] = imu_data_.rate_dps.z();
+
+    // Start from the first measurement, rather than ramping up from
+    // zero.
+    if (!filters_initialized_) {
+      for (int i = 0; i < kNumImuFilters; i++) { filters_.Reset(i, input[i]); }
+      filters_initialized_ = true;
+    }
+
+    std::array<ControlScalar, kNumImuFilters> output = {};
+    filters_.Process(input.data(), output.data());
+
+    robot.tip_pitch_deg = output[kTipPitchFilter];
+    robot.tip_roll_deg = output[kTipRollFilter];
+    robot.pitch_rate_dps = output[kPitchRateFilter];
+    robot.yaw_rate_dps = output[kYawRateFilter];
+  }
+
+  void UpdateVisualCorrection() {
+    const auto& c = config_.velocity;
+    auto& robot = status_.state.robot;
+    if (!c.use_visual) {
+      robot.visual_correction_mps = 0.0;
+      return;
+    }
+
+    const auto now = imu_data_.timestamp;
+    wheel_history_.push_back_overwrite({now, robot.wheel_velocity_mps});
+    const auto oldest =
+        now - mjlib::base::ConvertSecondsToDuration(c.wheel_history_s);
+    while (wheel_history_.size() > 1 &&
+           wheel_history_.front().timestamp < oldest) {
+      wheel_history_.pop_front();
+    }
+
+    // Without recent measurements, fall back to the wheels alone.
+    if (visual_timestamp_.is_not_a_date_time() ||
+        mjlib::base::ConvertDurationToSeconds(now - visual_timestamp_) >
+        c.visual_timeout_s) {
+      robot.visual_correction_mps *=
+          std::pow(0.5, LoopPeriod(kStatusLoop) / c.visual_decay_s);
+    }
+  }
+
+  void VisualVelocity(boost::posix_time::ptime timestamp,
+                      double velocity_mps) {
+    const auto& c = config_.velocity;
+    auto& robot = status_.state.robot;
+    robot.visual_velocity_mps = velocity_mps;
+
+    if (!c.use_visual || wheel_history_.empty() ||
+        timestamp < wheel_history_.front().timestamp) {
+      return;
+    }
+
+    // The measurement is delayed by the vision pipeline, so compare
+    // it against what the wheels said at the same time.  This is the
+    // first sample at or after timestamp, or the last one.
+    size_t lo = 0;
+    size_t hi = wheel_history_.size() - 1;
+    while (lo < hi) {
+      const size_t mid = (lo + hi) / 2;
+      if (wheel_history_[mid].timestamp < timestamp) {
+        lo = mid + 1;
+      } else {
+        hi = mid;
+      }
+    }
+
+    const double error = velocity_mps - wheel_history_[lo].velocity_mps;
+    robot.visual_correction_mps = mjlib::base::Limit<double>(
+        robot.visual_correction_mps +
+        c.visual_alpha * (error - robot.visual_correction_mps),
+        -c.max_visual_correction_mps,
+        c.max_visual_correction_mps);
+    visual_timestamp_ = timestamp;
+  }
+
   bool UpdateStatus() {
     if (status_.mode == HM::kConfiguring) {
       // Try to update our config structure.
@@ -505,40 +980,27 @@ class HoverbotControl::Impl {
     }
 
     // We should only be here if we have something for all our joints.
-    if (status_.state.joints.size() != kNumServos) {
+    if (status_.state.joints.size() != config_.joints.size()) {
       return false;
     }
 
-    status_.state.robot.velocity_mps =
-        -config_.wheel_diameter_m * M_PI *
-        Average(status_.state.joints.begin(),
-                status_.state.joints.end(),
-                [](const auto& joint) {
-                  return joint.velocity_dps / 360.0;
-                });
-
-    // TODO: This should use a simple filter of some kind, perhaps
-    // combined with the current pitch estimate?
-    status_.state.robot.accel_mps2 = 0.0;
-
-    {
-      const double min_voltage =
-          Min(status_.state.joints.begin(), status_.state.joints.end(),
-              [](const auto& joint) { return joint.voltage; });
-      auto& out_voltage = status_.state.robot.voltage;
-
-      if (out_voltage == 0.0) {
-        out_voltage = min_voltage;
-      } else {
-        const double alpha =
-            std::pow(0.5, config_.period_s / config_.voltage_filter_s);
-        out_voltage = alpha * out_voltage + (1.0 - alpha) * min_voltage;
-      }
-
-      if (out_voltage < config_.min_voltage) {
-        Fault(fmt::format(
-                  "Battery low: {} < {}", out_voltage, config_.min_voltage));
-      }
+    UpdateFilters();
+
+    // Between servo queries, the joints hold their last values.
+    if (queried_servos_) {
+      auto& robot = status_.state.robot;
+      robot.wheel_velocity_mps =
+          -config_.wheel_diameter_m * M_PI *
+          Average(status_.state.joints.begin(),
+                  status_.state.joints.end(),
+                  [](const auto& joint) {
+                    return joint.velocity_dps / 360.0;
+                  });
+      UpdateVisualCorrection();
+      robot.velocity_mps =
+          robot.wheel_velocity_mps + robot.visual_correction_mps;
+      robot.accel_mps2 =
+          FilterOne(&accel_filter_, &accel_initialized_, robot.velocity_mps);
     }
 
     return true;
@@ -599,6 +1061,15 @@ class HoverbotControl::Impl {
   }
 
   void RunControl() {
+    if (!command_trajectory_.empty()) {
+      const auto setpoint = command_trajectory_.Sample(Now());
+      current_command_.pitch = setpoint.pitch;
+      current_command_.drive = setpoint.drive;
+      status_.trajectory_index = command_trajectory_.index();
+    } else {
+      status_.trajectory_index = -1;
+    }
+
     if (current_command_.mode != status_.mode) {
       MaybeChangeMode();
     }
@@ -636,12 +1107,27 @@ class HoverbotControl::Impl {
         DoControl_Drive();
         break;
       }
+      case HM::kBalance: {
+        DoControl_Balance();
+        break;
+      }
       case HM::kNumModes: {
         mjlib::base::AssertNotReached();
       }
     }
   }
 
+  void TraceStartup() {
+    if (status_.state.joints.size() == config_.joints.size()) {
+      startup_tracer_->MarkFirstFullStatus();
+    }
+    if (status_.mode != HM::kConfiguring) {
+      startup_tracer_->End("hoverbot_control.configuring");
+      startup_tracer_->MarkReady();
+      ready_ = true;
+    }
+  }
+
   void MaybeChangeMode() {
     const auto old_mode = status_.mode;
     if (status_.mode == HM::kConfiguring) {
@@ -673,20 +1159,26 @@ class HoverbotControl::Impl {
         break;
       }
       case HM::kStandUp: {
-        status_.state.stand_up.pitch_target_deg = imu_data_.euler_deg.pitch;
+        StartStandUp();
         break;
       }
       case HM::kPitch:
-      case HM::kDrive: {
+      case HM::kDrive:
+      case HM::kBalance: {
         if (status_.mode == HM::kFault) { return; }
+        if (current_command_.mode == HM::kBalance && balance_gains_.empty()) {
+          status_.fault = "no balance gains configured";
+          return;
+        }
 
         if (status_.mode == HM::kStopped ||
             status_.mode == HM::kZeroVelocity) {
           status_.mode = HM::kStandUp;
-          status_.state.stand_up.pitch_target_deg = imu_data_.euler_deg.pitch;
+          StartStandUp();
         } else if (status_.mode == HM::kPitch ||
                    status_.mode == HM::kDrive ||
-                   status_.state.stand_up.pitch_target_deg == 0.0) {
+                   status_.mode == HM::kBalance ||
+                   status_.state.stand_up.trajectory.pose_l == 0.0) {
           // We can't enter these if we are faulted.
           status_.mode = current_command_.mode;
         }
@@ -714,17 +1206,42 @@ class HoverbotControl::Impl {
         }
         case HM::kPitch:
         case HM::kDrive:
+        case HM::kBalance:
         case HM::kNumModes: {
           break;
         }
       }
+
+      // Start the reference trajectories from wherever the previous
+      // mode left off, so that they are continuous.
+      if (status_.mode == HM::kPitch) {
+        status_.state.pitch.trajectory = {};
+        status_.state.pitch.trajectory.pose_l =
+            old_control_log_->pitch.pitch_deg;
+      } else if (status_.mode == HM::kDrive ||
+                 status_.mode == HM::kBalance) {
+        status_.state.drive.trajectory = {};
+        status_.state.drive.trajectory.velocity_l_s =
+            status_.state.robot.velocity_mps;
+        status_.state.balance = {};
+      }
+
       status_.mode_start = Now();
+
+      // Let every outer loop produce a fresh output for the new mode
+      // on this cycle, rather than acting on a held one.
+      scheduler_.Trigger();
     }
   }
 
+  void StartStandUp() {
+    status_.state.stand_up.trajectory = {};
+    status_.state.stand_up.trajectory.pose_l = imu_data_.euler_deg.pitch;
+  }
+
   bool IsConfiguringDone() {
     // We must have heard from all servos.
-    if (reported_servo_config_.servos.size() != kNumServos) {
+    if (reported_servo_config_.servos.size() != config_.joints.size()) {
       status_.fault = "missing servos";
       return false;
     }
@@ -813,28 +1330,35 @@ class HoverbotControl::Impl {
         pitch_pid_.Apply(
             imu_data_.euler_deg.pitch,
             -pitch.pitch_deg + config_.pitch.pitch_offset_deg,
-            imu_data_.rate_dps.y(), -pitch.pitch_rate_dps,
+            status_.state.robot.pitch_rate_dps, -pitch.pitch_rate_dps,
             rate_hz_);
 
     control_log_->pitch_torque_Nm = pitch_torque_Nm;
 
-    double yaw_torque_Nm = 0.0;
     if (yaw_mode == kEnableYaw) {
-      status_.state.pitch.yaw_target =
-          base::WrapNeg180To180(
-              status_.state.pitch.yaw_target +
-              pitch.yaw_rate_dps * period_s_);
-      yaw_torque_Nm =
-          yaw_pid_.Apply(
-              base::WrapNeg180To180(
-                  imu_data_.euler_deg.yaw - status_.state.pitch.yaw_target),
-              0.0,
-              imu_data_.rate_dps.z(), pitch.yaw_rate_dps,
-              rate_hz_);
+      scheduler_.Run(kYawLoop, [&]() {
+        status_.state.pitch.yaw_target =
+            base::WrapNeg180To180(
+                status_.state.pitch.yaw_target +
+                pitch.yaw_rate_dps * LoopPeriod(kYawLoop));
+        yaw_torque_Nm_ =
+            yaw_pid_.Apply(
+                base::WrapNeg180To180(
+                    imu_data_.euler_deg.yaw - status_.state.pitch.yaw_target),
+                0.0,
+                status_.state.robot.yaw_rate_dps, pitch.yaw_rate_dps,
+                LoopRate(kYawLoop));
+      });
+    } else {
+      yaw_torque_Nm_ = 0.0;
     }
 
-    control_log_->yaw_torque_Nm = yaw_torque_Nm;
+    control_log_->yaw_torque_Nm = yaw_torque_Nm_;
+
+    EmitWheelTorques(pitch_torque_Nm, yaw_torque_Nm_);
+  }
 
+  void EmitWheelTorques(double pitch_torque_Nm, double yaw_torque_Nm) {
     std::vector<HC::Joint> joints;
     for (int id : {1, 2}) {
       HC::Joint joint;
@@ -851,32 +1375,32 @@ class HoverbotControl::Impl {
   }
 
   void DoControl_StandUp() {
-    // This isn't a control optimal approach at all, but making a
-    // linear trajectory to follow does make it smoother.
-
-    const auto old_target = status_.state.stand_up.pitch_target_deg;
-    const auto sign = old_target < 0 ? -1.0 : 1.0;
-    status_.state.stand_up.pitch_target_deg += -sign * config_.stand_up.pitch_rate_dps * period_s_;
-
-    if (old_target * status_.state.stand_up.pitch_target_deg <= 0.0) {
-      status_.state.stand_up.pitch_target_deg = 0.0;
-    }
+    auto& trajectory = status_.state.stand_up.trajectory;
+    trajectory = CalculateJerkLimitedTrajectory(
+        trajectory, 0.0, config_.stand_up.trajectory, period_s_);
 
     HC::Pitch pitch;
-    pitch.pitch_deg = -status_.state.stand_up.pitch_target_deg;
-    pitch.pitch_rate_dps = sign * config_.stand_up.pitch_rate_dps;
+    pitch.pitch_deg = -trajectory.pose_l;
+    pitch.pitch_rate_dps = -trajectory.velocity_l_s;
     pitch.yaw_rate_dps = 0.0;
 
     ControlPitch(pitch, kDisableYaw);
   }
 
   void DoControl_Pitch() {
-    ControlPitch(current_command_.pitch, kEnableYaw);
-  }
+    auto& trajectory = status_.state.pitch.trajectory;
+    trajectory = CalculateJerkLimitedTrajectory(
+        trajectory, current_command_.pitch.pitch_deg,
+        config_.pitch.trajectory, period_s_);
 
-  void ControlDrive(const HC::Drive& drive) {
-    control_log_->drive = drive;
+    HC::Pitch pitch = current_command_.pitch;
+    pitch.pitch_deg = trajectory.pose_l;
+    pitch.pitch_rate_dps = trajectory.velocity_l_s;
+
+    ControlPitch(pitch, kEnableYaw);
+  }
 
+  HC::Pitch ControlDrive(const HC::Drive& drive) {
     HC::Pitch pitch;
 
     // TODO: We should have a feedforward where the desired
@@ -886,17 +1410,72 @@ class HoverbotControl::Impl {
             drive_pid_.Apply(
                 status_.state.robot.velocity_mps, drive.velocity_mps,
                 status_.state.robot.accel_mps2, drive.accel_mps2,
-                rate_hz_),
+                LoopRate(kDriveLoop)),
             -config_.drive.pitch_limit_deg,
             config_.drive.pitch_limit_deg);
     pitch.pitch_rate_dps = 0.0;  // TODO
     pitch.yaw_rate_dps = drive.yaw_rate_dps;
 
-    ControlPitch(pitch, kEnableYaw);
+    return pitch;
+  }
+
+  /// Advance the drive reference by one drive loop period.
+  void UpdateDriveReference() {
+    auto& trajectory = status_.state.drive.trajectory;
+    trajectory = CalculateJerkLimitedVelocity(
+        trajectory, current_command_.drive.velocity_mps,
+        config_.drive.trajectory, LoopPeriod(kDriveLoop));
+
+    drive_reference_ = current_command_.drive;
+    drive_reference_.velocity_mps = trajectory.velocity_l_s;
+    drive_reference_.accel_mps2 = trajectory.acceleration_l_s2;
   }
 
   void DoControl_Drive() {
-    ControlDrive(current_command_.drive);
+    scheduler_.Run(kDriveLoop, [&]() {
+      UpdateDriveReference();
+      drive_pitch_ = ControlDrive(drive_reference_);
+    });
+    control_log_->drive = drive_reference_;
+
+    ControlPitch(drive_pitch_, kEnableYaw);
+  }
+
+  void DoControl_Balance() {
+    status_.state.robot.in_control_time_s += period_s_;
+
+    scheduler_.Run(kDriveLoop, [&]() { UpdateDriveReference(); });
+    const auto& drive = drive_reference_;
+    control_log_->drive = drive;
+
+    const auto& robot = status_.state.robot;
+    auto& balance = status_.state.balance;
+    auto& yaw_target = status_.state.pitch.yaw_target;
+
+    BalanceGainTable::State x;
+    x.pitch_deg = imu_data_.euler_deg.pitch - config_.pitch.pitch_offset_deg;
+    x.pitch_rate_dps = robot.pitch_rate_dps;
+    x.velocity_error_mps = robot.velocity_mps - drive.velocity_mps;
+
+    balance.position_error_m = mjlib::base::Limit(
+        balance.position_error_m + x.velocity_error_mps * period_s_,
+        -config_.balance.max_position_error_m,
+        config_.balance.max_position_error_m);
+    x.position_error_m = balance.position_error_m;
+
+    scheduler_.Run(kYawLoop, [&]() {
+      yaw_target = base::WrapNeg180To180(
+          yaw_target + drive.yaw_rate_dps * LoopPeriod(kYawLoop));
+    });
+    x.yaw_error_deg =
+        base::WrapNeg180To180(imu_data_.euler_deg.yaw - yaw_target);
+    x.yaw_rate_error_dps = robot.yaw_rate_dps - drive.yaw_rate_dps;
+
+    const auto u = balance_gains_.Evaluate(x);
+    control_log_->pitch_torque_Nm = u.common_Nm;
+    control_log_->yaw_torque_Nm = u.differential_Nm;
+
+    EmitWheelTorques(u.common_Nm, u.differential_Nm);
   }
 
   void ControlJoints(std::vector<HC::Joint> joints) {
@@ -1060,6 +1639,8 @@ class HoverbotControl::Impl {
 
   boost::asio::any_io_executor executor_;
   mjlib::telemetry::FileWriter* const telemetry_log_;
+  base::StartupTracer* const startup_tracer_;
+  bool ready_ = false;
   Parameters parameters_;
 
   base::LogRef log_ = base::GetLogInstance("HoverbotControl");
@@ -1069,9 +1650,24 @@ class HoverbotControl::Impl {
 
   HoverbotControl::Status status_;
   HC current_command_;
+  CommandTrajectory command_trajectory_{kMaxWaypoints};
   boost::posix_time::ptime current_command_timestamp_;
   ReportedServoConfig reported_servo_config_;
 
+  std::unique_ptr<base::FileWatcher> config_watcher_;
+  // Config reloads are prepared here rather than on executor_.
+  boost::asio::io_context reload_context_;
+  boost::asio::executor_work_guard<
+    boost::asio::io_context::executor_type> reload_work_guard_{
+    reload_context_.get_executor()};
+  std::thread reload_thread_;
+  bool reload_outstanding_ = false;
+  std::string reload_again_;
+  std::shared_ptr<ReloadedConfig> pending_config_;
+  std::string pending_config_filename_;
+  // Wraps the handlers the worker posts back to executor_.
+  base::HandlerLifetime lifetime_;
+
   std::array<ControlLog, 2> control_logs_;
   ControlLog* control_log_ = &control_logs_[0];
   ControlLog* old_control_log_ = &control_logs_[1];
@@ -1088,28 +1684,60 @@ class HoverbotControl::Impl {
   using Request = Client::Request;
   Request status_request_;
   Request config_status_request_;
+  Request empty_request_;
   Client::Reply status_reply_;
+  bool queried_servos_ = false;
 
   Request client_command_;
   Client::Reply client_command_reply_;
 
   bool outstanding_ = false;
   ControlTiming timing_{executor_, {}};
+  LoopScheduler scheduler_{executor_, kNumLoops};
 
   int outstanding_status_requests_ = 0;
   AttitudeData imu_data_;
 
   boost::signals2::signal<void (const Status*)> status_signal_;
   boost::signals2::signal<void (const CommandLog*)> command_signal_;
-  boost::signals2::signal<void (const ControlLog*)> control_signal_;
+  ControlSignal control_signal_;
   boost::signals2::signal<void (const AttitudeData*)> imu_signal_;
   boost::signals2::signal<
     void (const ReportedServoConfig*)> servo_config_signal_;
+  boost::signals2::signal<
+    void (const ConfigReloadLog*)> config_reload_signal_;
 
   std::vector<moteus::Value> values_cache_;
 
   boost::posix_time::ptime last_warn_timestamp_;
 
+  struct WheelSample {
+    boost::posix_time::ptime timestamp;
+    double velocity_mps = 0.0;
+  };
+  // This is filled on the control thread, so is fixed size.  At
+  // 400Hz it holds more than a second, longer than wheel_history_s
+  // needs to be.
+  base::RingBuffer<WheelSample, 512> wheel_history_;
+
+  FilterBank filters_;
+  // The filters section which filters_, accel_filter_ and
+  // voltage_filter_ were designed from.
+  std::string filters_json_;
+  bool filters_initialized_ = false;
+  FilterBank accel_filter_;
+  bool accel_initialized_ = false;
+  FilterBank voltage_filter_;
+  bool voltage_initialized_ = false;
+
+  BalanceGainTable balance_gains_;
+
+  // The most recent outputs of the outer loops, held between runs.
+  HC::Drive drive_reference_;
+  HC::Pitch drive_pitch_;
+  double yaw_torque_Nm_ = 0.0;
+  boost::posix_time::ptime visual_timestamp_;
+
 
   mjlib::base::PID pitch_pid_{
     &config_.pitch.pitch_pid, &status_.state.pitch.pitch_pid};
@@ -1138,6 +1766,27 @@ const HoverbotControl::Status& HoverbotControl::status() const {
   return impl_->status_;
 }
 
+HoverbotControl::StatusSignal* HoverbotControl::status_signal() {
+  return &impl_->status_signal_;
+}
+
+HoverbotControl::Parameters* HoverbotControl::parameters() {
+  return &impl_->parameters_;
+}
+
+HoverbotControl::ImuSignal* HoverbotControl::imu_signal() {
+  return &impl_->imu_signal_;
+}
+
+HoverbotControl::ControlSignal* HoverbotControl::control_signal() {
+  return &impl_->control_signal_;
+}
+
+void HoverbotControl::VisualVelocity(boost::posix_time::ptime timestamp,
+                                     double velocity_mps) {
+  impl_->VisualVelocity(timestamp, velocity_mps);
+}
+
 clipp::group HoverbotControl::program_options() {
   return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
 }
@@ -20,15 +20,18 @@
 
 #include <boost/date_time/posix_time/posix_time_types.hpp>
 #include <boost/noncopyable.hpp>
+#include <boost/signals2/signal.hpp>
 
 #include "mjlib/base/visitor.h"
 
 #include "base/context.h"
 
+#include "mech/attitude_data.h"
 #include "mech/control_timing.h"
 #include "mech/pi3hat_interface.h"
 #include "mech/hoverbot_command.h"
 #include "mech/hoverbot_state.h"
+#include "mech/loop_scheduler.h"
 
 namespace mjmech {
 namespace mech {
@@ -53,6 +56,10 @@ class HoverbotControl : boost::noncopyable {
 
     double command_timeout_s = 1.0;
 
+    /// Watch the config files, and apply any changes while running.
+    /// The joints, period and rates can not be changed this way.
+    bool reload_config = false;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(max_torque_Nm));
@@ -61,6 +68,7 @@ class HoverbotControl : boost::noncopyable {
       a->Visit(MJ_NVP(enable_imu));
       a->Visit(MJ_NVP(servo_debug));
       a->Visit(MJ_NVP(command_timeout_s));
+      a->Visit(MJ_NVP(reload_config));
     }
   };
 
@@ -74,9 +82,29 @@ class HoverbotControl : boost::noncopyable {
     HoverbotState state;
 
     int missing_replies = 0;
+    /// The waypoint of the commanded trajectory at or before now, or
+    /// -1 if there is none.
+    int trajectory_index = -1;
     ControlTiming::Status timing;
     bool performed_rezero = false;
 
+    struct Loops {
+      LoopScheduler::Status inner;
+      LoopScheduler::Status drive;
+      LoopScheduler::Status yaw;
+      LoopScheduler::Status monitor;
+
+      template <typename Archive>
+      void Serialize(Archive* a) {
+        a->Visit(MJ_NVP(inner));
+        a->Visit(MJ_NVP(drive));
+        a->Visit(MJ_NVP(yaw));
+        a->Visit(MJ_NVP(monitor));
+      }
+    };
+
+    Loops loops;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(timestamp));
@@ -85,8 +113,10 @@ class HoverbotControl : boost::noncopyable {
       a->Visit(MJ_NVP(fault));
       a->Visit(MJ_NVP(state));
       a->Visit(MJ_NVP(missing_replies));
+      a->Visit(MJ_NVP(trajectory_index));
       a->Visit(MJ_NVP(timing));
       a->Visit(MJ_NVP(performed_rezero));
+      a->Visit(MJ_NVP(loops));
     }
   };
 
@@ -117,6 +147,26 @@ class HoverbotControl : boost::noncopyable {
   void Command(const HoverbotCommand&);
   const Status& status() const;
 
+  /// Emitted on the executor at the end of every control cycle.
+  using StatusSignal = boost::signals2::signal<void (const Status*)>;
+  StatusSignal* status_signal();
+
+  /// Emitted on the executor for every IMU sample.
+  using ImuSignal = boost::signals2::signal<void (const AttitudeData*)>;
+  ImuSignal* imu_signal();
+
+  /// Emitted on the executor each time a command is sent to the
+  /// servos, just before it is.
+  using ControlSignal = boost::signals2::signal<void (const ControlLog*)>;
+  ControlSignal* control_signal();
+
+  /// Provide an independent measurement of the forward velocity at
+  /// @p timestamp, which must be in the IMU clock.  It is used to
+  /// correct the wheel odometry if enabled in the configuration.
+  void VisualVelocity(boost::posix_time::ptime timestamp,
+                      double velocity_mps);
+
+  Parameters* parameters();
   clipp::group program_options();
 
  private:
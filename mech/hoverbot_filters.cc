@@ -0,0 +1,85 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/hoverbot_filters.h"
+
+#include <cmath>
+#include <string_view>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include "mjlib/base/system_error.h"
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+/// Throws if @p filter, named @p name, can not be designed to run at
+/// @p rate_hz.
+void CheckFilter(std::string_view name, const base::FilterConfig& filter,
+                 double rate_hz) {
+  const auto check = [&](bool bad, std::string_view message) {
+    mjlib::base::system_error::throw_if(
+        bad, fmt::format("filters.{}: {}", name, message));
+  };
+
+  const double nyquist_hz = 0.5 * rate_hz;
+  check(!(std::isfinite(filter.half_life_s) && filter.half_life_s >= 0.0),
+        "half_life_s must be finite and not negative");
+  check(!(filter.lowpass_hz >= 0.0 && filter.lowpass_hz < nyquist_hz),
+        fmt::format("lowpass_hz must be from 0 to below {} Hz", nyquist_hz));
+  check(filter.lowpass_hz > 0.0 &&
+        !(filter.lowpass_q > 0.0 && std::isfinite(filter.lowpass_q)),
+        "lowpass_q must be positive");
+  check(!(filter.notch_hz >= 0.0 && filter.notch_hz < nyquist_hz),
+        fmt::format("notch_hz must be from 0 to below {} Hz", nyquist_hz));
+  check(filter.notch_hz > 0.0 &&
+        !(filter.notch_q > 0.0 && std::isfinite(filter.notch_q)),
+        "notch_q must be positive");
+}
+}
+
+template <typename Scalar>
+HoverbotFilters<Scalar> DesignHoverbotFilters(const HoverbotConfig& config) {
+  using Bank = typename HoverbotFilters<Scalar>::Bank;
+
+  const double rate_hz = 1.0 / config.period_s;
+  const double accel_rate_hz = rate_hz / config.rates.status_divider;
+  const double voltage_rate_hz = rate_hz / config.rates.monitor_divider;
+  const auto& f = config.filters;
+  CheckFilter("tip", f.tip, rate_hz);
+  CheckFilter("pitch_rate", f.pitch_rate, rate_hz);
+  CheckFilter("yaw_rate", f.yaw_rate, rate_hz);
+  CheckFilter("accel", f.accel, accel_rate_hz);
+  CheckFilter("voltage", f.voltage, voltage_rate_hz);
+
+  std::vector<std::vector<base::Biquad>> channels(kNumImuFilters);
+  channels[kTipPitchFilter] = f.tip.Design(rate_hz);
+  channels[kTipRollFilter] = f.tip.Design(rate_hz);
+  channels[kPitchRateFilter] = f.pitch_rate.Design(rate_hz);
+  channels[kYawRateFilter] = f.yaw_rate.Design(rate_hz);
+
+  HoverbotFilters<Scalar> result;
+  result.imu = Bank(channels);
+  result.accel = Bank({f.accel.Design(accel_rate_hz)});
+  result.voltage = Bank({f.voltage.Design(voltage_rate_hz)});
+  return result;
+}
+
+template HoverbotFilters<double> DesignHoverbotFilters(const HoverbotConfig&);
+template HoverbotFilters<float> DesignHoverbotFilters(const HoverbotConfig&);
+
+}
+}
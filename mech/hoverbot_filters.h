@@ -0,0 +1,55 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include "base/biquad_filter.h"
+
+#include "mech/hoverbot_config.h"
+
+namespace mjmech {
+namespace mech {
+
+/// The channels of HoverbotFilters::imu, in order.
+enum HoverbotImuFilter {
+  kTipPitchFilter,
+  kTipRollFilter,
+  kPitchRateFilter,
+  kYawRateFilter,
+  kNumImuFilters,
+};
+
+/// The filters HoverbotControl runs, in one precision.
+template <typename Scalar>
+struct HoverbotFilters {
+  using Bank = base::BasicBiquadFilterBank<Scalar>;
+
+  /// Run every control cycle, with one channel per HoverbotImuFilter.
+  Bank imu;
+  /// Run on the velocity at the status rate.
+  Bank accel;
+  /// Run on the minimum servo voltage at the monitor rate.
+  Bank voltage;
+};
+
+/// Design every filter from @p config.filters, at the rates in
+/// @p config.  This is shared with the offline precision replay, so
+/// that it checks exactly what runs on the robot.  Throws if any
+/// filter has a negative setting, or a corner at or above the Nyquist
+/// rate it runs at.
+template <typename Scalar>
+HoverbotFilters<Scalar> DesignHoverbotFilters(const HoverbotConfig& config);
+
+}
+}
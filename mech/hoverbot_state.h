@@ -24,6 +24,7 @@
 #include "base/quaternion.h"
 
 #include "mech/hoverbot_command.h"
+#include "mech/trajectory.h"
 
 namespace mjmech {
 namespace mech {
@@ -71,11 +72,13 @@ struct HoverbotState {
   std::vector<Joint> joints;
 
   struct StandUp {
-    double pitch_target_deg = 0.0;
+    /// The pose is the pitch target in degrees, which reaches 0 when
+    /// upright.
+    TrajectoryAxis trajectory;
 
     template <typename Archive>
     void Serialize(Archive* a) {
-      a->Visit(MJ_NVP(pitch_target_deg));
+      a->Visit(MJ_NVP(trajectory));
     }
   };
 
@@ -86,11 +89,15 @@ struct HoverbotState {
     mjlib::base::PID::State yaw_pid;
     double yaw_target = 0.0;
 
+    /// The pose is the pitch in degrees.
+    TrajectoryAxis trajectory;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(pitch_pid));
       a->Visit(MJ_NVP(yaw_pid));
       a->Visit(MJ_NVP(yaw_target));
+      a->Visit(MJ_NVP(trajectory));
     }
   };
 
@@ -99,31 +106,59 @@ struct HoverbotState {
   struct Drive {
     mjlib::base::PID::State drive_pid;
 
+    /// The velocity is the reference given to drive_pid in m/s.
+    TrajectoryAxis trajectory;
+
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(drive_pid));
+      a->Visit(MJ_NVP(trajectory));
     }
   };
 
   Drive drive;
 
+  struct Balance {
+    double position_error_m = 0.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(position_error_m));
+    }
+  };
+
+  Balance balance;
+
   // And finally, the robot level.
   struct Robot {
+    /// The best estimate, which the drive controller uses.
     double velocity_mps = 0.0;
     double accel_mps2 = 0.0;
+
+    double wheel_velocity_mps = 0.0;
+    double visual_velocity_mps = 0.0;
+    double visual_correction_mps = 0.0;
+
     double voltage = 0.0;
     double in_control_time_s = 0.0;
     double tip_pitch_deg = 0.0;
     double tip_roll_deg = 0.0;
+    double pitch_rate_dps = 0.0;
+    double yaw_rate_dps = 0.0;
 
     template <typename Archive>
     void Serialize(Archive* a) {
       a->Visit(MJ_NVP(velocity_mps));
       a->Visit(MJ_NVP(accel_mps2));
+      a->Visit(MJ_NVP(wheel_velocity_mps));
+      a->Visit(MJ_NVP(visual_velocity_mps));
+      a->Visit(MJ_NVP(visual_correction_mps));
       a->Visit(MJ_NVP(voltage));
       a->Visit(MJ_NVP(in_control_time_s));
       a->Visit(MJ_NVP(tip_pitch_deg));
       a->Visit(MJ_NVP(tip_roll_deg));
+      a->Visit(MJ_NVP(pitch_rate_dps));
+      a->Visit(MJ_NVP(yaw_rate_dps));
     }
   };
 
@@ -135,6 +170,7 @@ struct HoverbotState {
     a->Visit(MJ_NVP(stand_up));
     a->Visit(MJ_NVP(pitch));
     a->Visit(MJ_NVP(drive));
+    a->Visit(MJ_NVP(balance));
     a->Visit(MJ_NVP(robot));
   }
 };
@@ -0,0 +1,141 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include <boost/asio/any_io_executor.hpp>
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+
+#include "mjlib/base/time_conversions.h"
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/now.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Runs a set of loops, each once every N cycles of a common base
+/// rate, and keeps timing for each one.
+///
+/// Every loop starts with the same phase, so loops with the same
+/// divider are due on the same cycle.  That is required when one
+/// consumes the output of another.  Independent loops can be given
+/// different phases with set_phase, so that the slow work is spread
+/// across cycles.
+///
+/// The per-loop timing is narrower than ControlTiming, whose query,
+/// status and command stages belong to the whole cycle rather than to
+/// any one loop.
+class LoopScheduler {
+ public:
+  LoopScheduler(const boost::asio::any_io_executor& executor, int loops)
+      : executor_(executor),
+        loops_(loops) {}
+
+  struct Status {
+    int64_t runs = 0;
+
+    /// The time between the start of the two most recent runs.
+    double delta_s = 0.0;
+
+    /// How long the most recent run took.
+    double run_s = 0.0;
+
+    /// The longest any run has taken.
+    double max_run_s = 0.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(runs));
+      a->Visit(MJ_NVP(delta_s));
+      a->Visit(MJ_NVP(run_s));
+      a->Visit(MJ_NVP(max_run_s));
+    }
+  };
+
+  void set_divider(int loop, int divider) {
+    loops_.at(loop).divider = std::max(1, divider);
+  }
+
+  /// Delay @p loop by this many cycles relative to a loop with phase
+  /// 0 and the same divider.  Call this after set_divider.
+  void set_phase(int loop, int phase) {
+    auto& l = loops_.at(loop);
+    l.phase = (l.divider - (phase % l.divider)) % l.divider;
+  }
+
+  int divider(int loop) const { return loops_.at(loop).divider; }
+
+  /// Advance to the next base cycle.
+  void Cycle() {
+    count_++;
+    triggered_ = false;
+  }
+
+  /// Make every loop due for the remainder of this cycle, for instance
+  /// after a mode change.
+  void Trigger() { triggered_ = true; }
+
+  bool due(int loop) const {
+    const auto& l = loops_.at(loop);
+    return triggered_ || ((count_ + l.phase) % l.divider) == 0;
+  }
+
+  /// Call @p functor if @p loop is due this cycle.  Return true if it
+  /// was called.
+  template <typename Functor>
+  bool Run(int loop, Functor functor) {
+    if (!due(loop)) { return false; }
+    auto& l = loops_.at(loop);
+
+    const auto start = Now();
+    functor();
+    const auto end = Now();
+
+    if (!l.last_start.is_not_a_date_time()) {
+      l.status.delta_s =
+          mjlib::base::ConvertDurationToSeconds(start - l.last_start);
+    }
+    l.status.run_s = mjlib::base::ConvertDurationToSeconds(end - start);
+    l.status.max_run_s = std::max(l.status.max_run_s, l.status.run_s);
+    l.status.runs++;
+    l.last_start = start;
+    return true;
+  }
+
+  const Status& status(int loop) const { return loops_.at(loop).status; }
+
+ private:
+  boost::posix_time::ptime Now() const {
+    return mjlib::io::Now(executor_.context());
+  }
+
+  struct Loop {
+    int divider = 1;
+    int phase = 0;
+    boost::posix_time::ptime last_start;
+    Status status;
+  };
+
+  boost::asio::any_io_executor executor_;
+  std::vector<Loop> loops_;
+  int64_t count_ = 0;
+  bool triggered_ = false;
+};
+
+}
+}
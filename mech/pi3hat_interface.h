@@ -16,6 +16,8 @@
 
 #include "mjlib/multiplex/asio_client.h"
 
+#include "base/coroutine.h"
+
 #include "mech/imu_client.h"
 
 namespace mjmech {
@@ -32,6 +34,25 @@ class Pi3hatInterface : public ImuClient,
       AttitudeData*,
       const Request*, Reply*,
       mjlib::io::ErrorCallback callback) = 0;
+
+#ifdef MJMECH_COROUTINES
+  /// The same as Cycle and AsyncTransmit, but co_await gives the
+  /// error.
+  auto AwaitCycle(AttitudeData* attitude,
+                  const Request* request, Reply* reply) {
+    return base::AwaitError(
+        [this, attitude, request, reply](mjlib::io::ErrorCallback callback) {
+          Cycle(attitude, request, reply, std::move(callback));
+        });
+  }
+
+  auto AwaitTransmit(const Request* request, Reply* reply) {
+    return base::AwaitError(
+        [this, request, reply](mjlib::io::ErrorCallback callback) {
+          AsyncTransmit(request, reply, std::move(callback));
+        });
+  }
+#endif
 };
 
 }
@@ -14,6 +14,7 @@
 
 #include "mech/pi3hat_wrapper.h"
 
+#include <chrono>
 #include <functional>
 #include <thread>
 
@@ -327,6 +328,7 @@ class Pi3hatWrapper::Impl {
     input.rx_extra_wait_ns = 0;
 
     pi3data_.result = pi3hat_->Cycle(input);
+    pi3data_.cycle_time = std::chrono::steady_clock::now();
 
     // Now come back to the main thread.
     boost::asio::post(
@@ -351,6 +353,7 @@ class Pi3hatWrapper::Impl {
     input.timeout_ns = options_.query_timeout_s * 1e9;
 
     pi3data_.result = pi3hat_->Cycle(input);
+    pi3data_.cycle_time = std::chrono::steady_clock::now();
 
     // Now come back to the main thread.
     boost::asio::post(
@@ -595,7 +598,13 @@ class Pi3hatWrapper::Impl {
     auto make_quat = [](const auto& q) {
       return base::Quaternion(q.w, q.x, q.y, q.z);
     };
-    attitude->timestamp = now;
+    // Back date the sample by however long it took to get from the
+    // child thread to here, so that it can be aligned with data from
+    // other threads, like camera frames.
+    const auto handoff_us =
+        std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - pi3data_.cycle_time).count();
+    attitude->timestamp = now - boost::posix_time::microseconds(handoff_us);
     attitude->attitude = make_quat(pi3data_.attitude.attitude);
     attitude->rate_dps = make_point(pi3data_.attitude.rate_dps);
     attitude->euler_deg = (180.0 / M_PI) * attitude->attitude.euler_rad();
@@ -681,6 +690,9 @@ class Pi3hatWrapper::Impl {
     mjbots::pi3hat::Attitude attitude;
 
     mjbots::pi3hat::Pi3Hat::Output result;
+
+    /// When the result was read.
+    std::chrono::steady_clock::time_point cycle_time;
   };
   Pi3Data pi3data_;
 
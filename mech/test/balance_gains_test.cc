@@ -0,0 +1,138 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/balance_gains.h"
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "mjlib/base/system_error.h"
+
+using namespace mjmech::mech;
+
+namespace {
+BalanceGain Gain(double pitch_deg,
+                 double k_pitch, double k_pitch_rate,
+                 double k_velocity, double k_position,
+                 double k_yaw, double k_yaw_rate) {
+  BalanceGain result;
+  result.pitch_deg = pitch_deg;
+  result.k_pitch = k_pitch;
+  result.k_pitch_rate = k_pitch_rate;
+  result.k_velocity = k_velocity;
+  result.k_position = k_position;
+  result.k_yaw = k_yaw;
+  result.k_yaw_rate = k_yaw_rate;
+  return result;
+}
+
+BalanceGainTable MakeTable() {
+  return BalanceGainTable({
+      Gain(-10.0, 1.0, 0.1, 2.0, 0.5, 0.2, 0.02),
+      Gain(0.0, 2.0, 0.2, 3.0, 1.0, 0.4, 0.04),
+      Gain(10.0, 4.0, 0.3, 5.0, 2.0, 0.6, 0.06),
+    });
+}
+}
+
+BOOST_AUTO_TEST_CASE(BalanceGainInterpolateTest) {
+  const auto table = MakeTable();
+  BOOST_TEST(!table.empty());
+
+  {
+    BalanceGainTable::State state;
+    state.pitch_rate_dps = 10.0;
+    state.velocity_error_mps = 0.5;
+    state.position_error_m = 0.2;
+    state.yaw_error_deg = 5.0;
+    state.yaw_rate_error_dps = 30.0;
+    const auto output = table.Evaluate(state);
+    BOOST_CHECK_SMALL(output.common_Nm - -3.7, 1e-9);
+    BOOST_CHECK_SMALL(output.differential_Nm - -3.2, 1e-9);
+  }
+
+  {
+    BalanceGainTable::State state;
+    state.pitch_deg = 10.0;
+    const auto output = table.Evaluate(state);
+    BOOST_CHECK_SMALL(output.common_Nm - -40.0, 1e-9);
+    BOOST_CHECK_SMALL(output.differential_Nm, 1e-9);
+  }
+
+  {
+    // Halfway between the upper two entries.
+    BalanceGainTable::State state;
+    state.pitch_deg = 5.0;
+    state.pitch_rate_dps = -4.0;
+    state.velocity_error_mps = 1.0;
+    state.position_error_m = -0.4;
+    state.yaw_error_deg = 2.0;
+    state.yaw_rate_error_dps = -10.0;
+    const auto output = table.Evaluate(state);
+    BOOST_CHECK_SMALL(output.common_Nm - -17.4, 1e-9);
+    BOOST_CHECK_SMALL(output.differential_Nm - -0.5, 1e-9);
+  }
+
+  {
+    // Three quarters of the way from -10 to 0.
+    BalanceGainTable::State state;
+    state.pitch_deg = -2.5;
+    state.yaw_rate_error_dps = 20.0;
+    const auto output = table.Evaluate(state);
+    BOOST_CHECK_SMALL(output.common_Nm - 4.375, 1e-9);
+    BOOST_CHECK_SMALL(output.differential_Nm - -0.7, 1e-9);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(BalanceGainClampTest) {
+  const auto table = MakeTable();
+
+  // The gains are held beyond either end, but still apply to the
+  // actual pitch.
+  BalanceGainTable::State state;
+  state.pitch_deg = -30.0;
+  BOOST_CHECK_SMALL(table.Evaluate(state).common_Nm - 30.0, 1e-9);
+
+  state.pitch_deg = 25.0;
+  state.pitch_rate_dps = 2.0;
+  BOOST_CHECK_SMALL(table.Evaluate(state).common_Nm - -100.6, 1e-9);
+
+  const BalanceGainTable single({Gain(3.0, 2.0, 0.5, 0.0, 0.0, 0.0, 0.0)});
+  state.pitch_deg = -20.0;
+  state.pitch_rate_dps = 1.0;
+  BOOST_CHECK_SMALL(single.Evaluate(state).common_Nm - 39.5, 1e-9);
+  state.pitch_deg = 20.0;
+  state.pitch_rate_dps = 0.0;
+  BOOST_CHECK_SMALL(single.Evaluate(state).common_Nm - -40.0, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(BalanceGainMissingTest) {
+  // A default table is how a configuration without gains shows up.
+  BalanceGainTable missing;
+  BOOST_TEST(missing.empty());
+
+  BOOST_CHECK_THROW(BalanceGainTable(std::vector<BalanceGain>()),
+                    mjlib::base::system_error);
+
+  BalanceGain a;
+  a.pitch_deg = 0.0;
+  BalanceGain b;
+  b.pitch_deg = 1.0;
+  BalanceGain c;
+  c.pitch_deg = 3.0;
+
+  // Unevenly spaced.
+  BOOST_CHECK_THROW(BalanceGainTable({a, b, c}), mjlib::base::system_error);
+  // Out of order.
+  BOOST_CHECK_THROW(BalanceGainTable({b, a}), mjlib::base::system_error);
+}
@@ -0,0 +1,184 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/camera_imu_alignment.h"
+
+#include <cmath>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include "base/common.h"
+
+using namespace mjmech;
+using namespace mjmech::mech;
+
+namespace {
+/// Something with enough variation that only one offset lines it up.
+double RateAt(double time_s) {
+  return 50.0 +
+      40.0 * std::sin(2 * M_PI * 1.3 * time_s) +
+      20.0 * std::sin(2 * M_PI * 3.1 * time_s);
+}
+}
+
+BOOST_AUTO_TEST_CASE(InterpolateRateTest) {
+  const std::vector<RateSample> samples = {
+    {0.0, 0.0},
+    {1.0, 10.0},
+    {2.0, 30.0},
+  };
+
+  double rate_dps = 0.0;
+  BOOST_TEST(InterpolateRate(samples, 0.0, &rate_dps));
+  BOOST_TEST(rate_dps == 0.0);
+  BOOST_TEST(InterpolateRate(samples, 0.5, &rate_dps));
+  BOOST_TEST(std::abs(rate_dps - 5.0) < 1e-9);
+  BOOST_TEST(InterpolateRate(samples, 1.0, &rate_dps));
+  BOOST_TEST(rate_dps == 10.0);
+  BOOST_TEST(InterpolateRate(samples, 1.75, &rate_dps));
+  BOOST_TEST(std::abs(rate_dps - 25.0) < 1e-9);
+  BOOST_TEST(InterpolateRate(samples, 2.0, &rate_dps));
+  BOOST_TEST(rate_dps == 30.0);
+
+  rate_dps = -1.0;
+  BOOST_TEST(!InterpolateRate(samples, -0.01, &rate_dps));
+  BOOST_TEST(!InterpolateRate(samples, 2.01, &rate_dps));
+  BOOST_TEST(!InterpolateRate({}, 0.0, &rate_dps));
+  BOOST_TEST(rate_dps == -1.0);
+}
+
+BOOST_AUTO_TEST_CASE(FindOffsetTest) {
+  std::vector<RateSample> imu;
+  for (double t = 0.0; t < 6.0; t += 0.0025) {
+    imu.push_back({t, RateAt(t)});
+  }
+
+  for (const double offset_s : {0.034, -0.052, 0.0}) {
+    std::vector<RateSample> optical;
+    for (double t = 1.0; t < 5.0; t += 1.0 / 30.0) {
+      optical.push_back({t, RateAt(t + offset_s)});
+    }
+
+    const auto result = FindOffset(optical, imu, 0.1, 0.002);
+    BOOST_TEST_CONTEXT("offset_s " << offset_s) {
+      BOOST_TEST(std::abs(result.offset_s - offset_s) <= 0.002);
+      BOOST_TEST(result.correlation > 0.99);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(FindOffsetNoOverlapTest) {
+  std::vector<RateSample> imu;
+  for (double t = 10.0; t < 11.0; t += 0.0025) {
+    imu.push_back({t, RateAt(t)});
+  }
+  std::vector<RateSample> optical;
+  for (double t = 0.0; t < 1.0; t += 1.0 / 30.0) {
+    optical.push_back({t, RateAt(t)});
+  }
+
+  const auto result = FindOffset(optical, imu, 0.1, 0.002);
+  BOOST_TEST(result.correlation == -1.0);
+}
+
+BOOST_AUTO_TEST_CASE(CameraImuOffsetEstimatorTest) {
+  // Run the estimator as the vision thread does, with the default
+  // parameters, for long enough that the optical window fills.
+  const CameraImuAlignment::Parameters parameters;
+  CameraImuOffsetEstimator dut(parameters);
+
+  const auto start = boost::posix_time::ptime(
+      boost::gregorian::date(2020, 1, 1));
+  const double offset_s = 0.030;
+
+  int updates = 0;
+  int imu_count = 0;
+  int frame_count = 0;
+  for (double t = 0.0; t < 12.0; t += 1.0 / 30.0) {
+    // The IMU runs at 400Hz, and is always ahead of the camera.
+    for (; imu_count / 400.0 <= t + 0.05; imu_count++) {
+      const double imu_s = imu_count / 400.0;
+      AttitudeData imu;
+      imu.timestamp = start + boost::posix_time::microseconds(
+          static_cast<int64_t>(imu_s * 1e6));
+      imu.rate_dps = base::Point3D(0, 0, RateAt(imu_s));
+      dut.AddImu(imu);
+    }
+
+    const double time_s =
+        base::ConvertPtimeToMicroseconds(start) * 1e-6 + t;
+    dut.AddOptical({time_s, RateAt(t + offset_s)});
+    frame_count++;
+
+    if (frame_count % 30 != 0) { continue; }
+
+    const auto update = dut.Estimate();
+    BOOST_TEST_REQUIRE(!!update);
+    BOOST_TEST_CONTEXT("t " << t) {
+      BOOST_TEST(update->optical_rate_std_dps > parameters.min_rate_dps);
+      BOOST_TEST(update->estimate.correlation > 0.99);
+      BOOST_TEST(std::abs(update->estimate.offset_s - offset_s) <= 0.002);
+    }
+    updates++;
+  }
+
+  BOOST_TEST(updates == 12);
+  BOOST_TEST(dut.updates() == 12);
+  BOOST_TEST(std::abs(dut.offset_s() - offset_s) <= 0.002);
+
+  // Only as much IMU history is kept as the window needs.
+  const auto& history = dut.imu_history();
+  BOOST_TEST(base::ConvertDurationToSeconds(
+                 history.back().timestamp - history.front().timestamp) <=
+             parameters.window_s + parameters.max_offset_s);
+}
+
+BOOST_AUTO_TEST_CASE(InterpolateAttitudeTest) {
+  const auto start = boost::posix_time::ptime(
+      boost::gregorian::date(2020, 1, 1));
+
+  std::deque<AttitudeData> history(2);
+  history[0].timestamp = start;
+  history[0].rate_dps = base::Point3D(0, 0, 10);
+  history[1].timestamp = start + boost::posix_time::milliseconds(100);
+  history[1].attitude = base::Quaternion::FromAxisAngle(M_PI / 2, 0, 0, 1);
+  history[1].rate_dps = base::Point3D(0, 0, 30);
+  history[1].accel_mps2 = base::Point3D(0, 0, 4);
+
+  AttitudeData result;
+  const auto quarter = start + boost::posix_time::milliseconds(25);
+  BOOST_TEST(InterpolateAttitude(history, quarter, &result));
+  BOOST_TEST(result.timestamp == quarter);
+  BOOST_TEST(std::abs(result.euler_deg.yaw - 22.5) < 1e-6);
+  BOOST_TEST(std::abs(result.euler_deg.roll) < 1e-6);
+  BOOST_TEST(std::abs(result.euler_deg.pitch) < 1e-6);
+  BOOST_TEST(std::abs(result.rate_dps.z() - 15.0) < 1e-9);
+  BOOST_TEST(std::abs(result.accel_mps2.z() - 1.0) < 1e-9);
+
+  BOOST_TEST(InterpolateAttitude(history, start, &result));
+  BOOST_TEST(result.timestamp == start);
+  BOOST_TEST(std::abs(result.euler_deg.yaw) < 1e-6);
+
+  BOOST_TEST(InterpolateAttitude(history, history[1].timestamp, &result));
+  BOOST_TEST(std::abs(result.euler_deg.yaw - 90.0) < 1e-6);
+
+  BOOST_TEST(!InterpolateAttitude(
+                 history, start - boost::posix_time::milliseconds(1),
+                 &result));
+  BOOST_TEST(!InterpolateAttitude(
+                 history,
+                 history[1].timestamp + boost::posix_time::milliseconds(1),
+                 &result));
+  BOOST_TEST(!InterpolateAttitude({}, start, &result));
+}
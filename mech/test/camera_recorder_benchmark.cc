@@ -0,0 +1,169 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// Measure how many frames per second a CameraRecorder can sustain.
+///
+/// Synthetic frames are offered at a fixed rate, or as fast as
+/// possible with --fps 0, and the number written and dropped is
+/// reported.  A configuration is sustainable at a given rate when
+/// nothing is dropped.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+
+#include <opencv2/core/core.hpp>
+
+#include "mjlib/base/clipp.h"
+
+#include "mech/camera_recorder.h"
+
+namespace {
+using namespace mjmech;
+
+struct Options {
+  int width = 1280;
+  int height = 720;
+  double fps = 60.0;
+  double duration_s = 10.0;
+
+  mech::CameraRecorder::Options recorder;
+};
+
+cv::Mat MakeFrame(const Options& options, int index) {
+  // A smooth gradient with some noise compresses roughly like a real
+  // scene, unlike either a constant or pure noise.
+  cv::Mat result(options.height, options.width, CV_8UC3);
+  for (int r = 0; r < result.rows; r++) {
+    auto* row = result.ptr<cv::Vec3b>(r);
+    for (int c = 0; c < result.cols; c++) {
+      row[c] = cv::Vec3b((r + index) & 0xff, (c + index) & 0xff,
+                         (r + c) & 0xff);
+    }
+  }
+  cv::Mat noise(result.size(), result.type());
+  cv::randu(noise, 0, 16);
+  result += noise;
+  return result;
+}
+
+int work(int argc, char** argv) {
+  Options options;
+  options.recorder.path = "/tmp/camera_recorder_benchmark-";
+
+  auto group = clipp::group(
+      (clipp::option("width") & clipp::value("", options.width)),
+      (clipp::option("height") & clipp::value("", options.height)),
+      (clipp::option("fps") & clipp::value("", options.fps)) %
+      "offered frame rate, or 0 for as fast as possible",
+      (clipp::option("duration_s") & clipp::value("", options.duration_s)),
+      (clipp::option("path") & clipp::value("", options.recorder.path)),
+      (clipp::option("codec") & clipp::value("", options.recorder.codec)) %
+      "raw, jpeg, or png",
+      (clipp::option("jpeg_quality") &
+       clipp::value("", options.recorder.jpeg_quality)),
+      (clipp::option("png_compression") &
+       clipp::value("", options.recorder.png_compression)),
+      (clipp::option("queue_size") &
+       clipp::value("", options.recorder.queue_size)),
+      (clipp::option("threads") & clipp::value("", options.recorder.threads))
+  );
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  // Pre-generate a handful of frames so that generating them does
+  // not count against the recorder.
+  std::vector<cv::Mat> frames;
+  for (int i = 0; i < 8; i++) {
+    frames.push_back(MakeFrame(options, i * 17));
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  double offered_s = 0.0;
+  const auto frame_timestamp = [](int64_t i) {
+    // Each file needs a distinct name.
+    return boost::posix_time::ptime(boost::gregorian::date(2020, 1, 1)) +
+        boost::posix_time::microseconds(i);
+  };
+
+  int64_t offered = 0;
+  {
+    mech::CameraRecorder recorder(options.recorder);
+
+    while (true) {
+      const auto now = std::chrono::steady_clock::now();
+      offered_s = std::chrono::duration<double>(now - start).count();
+      if (offered_s >= options.duration_s) { break; }
+
+      // This shares the pixels, as the camera driver does.
+      auto frame = std::make_shared<mech::CameraFrame>();
+      frame->image = frames[offered % frames.size()];
+      frame->timestamp = frame_timestamp(offered);
+      recorder.Write(frame);
+      offered++;
+
+      if (options.fps > 0.0) {
+        std::this_thread::sleep_until(
+            start + std::chrono::microseconds(
+                static_cast<int64_t>(offered * 1e6 / options.fps)));
+      }
+    }
+
+    // Wait for everything queued to reach the disk.
+    auto stats = recorder.stats();
+    while (stats.written + stats.errors < stats.queued) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(10));
+      stats = recorder.stats();
+    }
+
+    const double elapsed_s = std::chrono::duration<double>(
+        std::chrono::steady_clock::now() - start).count();
+
+    std::cout << fmt::format(
+        "codec={} threads={} queue_size={}\n"
+        "offered {} frames in {:.1f}s ({:.1f}/s)\n"
+        "wrote {} frames in {:.1f}s ({:.1f}/s, {:.1f} MB/s)\n"
+        "dropped {} ({:.1f}%) errors {}\n",
+        options.recorder.codec, options.recorder.threads,
+        options.recorder.queue_size,
+        offered, offered_s, offered / offered_s,
+        stats.written, elapsed_s, stats.written / elapsed_s,
+        stats.bytes / elapsed_s / 1e6,
+        stats.dropped, 100.0 * stats.dropped / std::max<int64_t>(1, offered),
+        stats.errors);
+  }
+
+  return 0;
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  try {
+    return work(argc, argv);
+  } catch (std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+}
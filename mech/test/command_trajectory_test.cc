@@ -0,0 +1,170 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/command_trajectory.h"
+
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+namespace pt = boost::posix_time;
+
+namespace {
+using Waypoint = CommandTrajectory::Waypoint;
+
+const pt::ptime kStart =
+    pt::time_from_string("2020-01-01 00:00:00.000");
+
+pt::ptime At(double time_s) {
+  return kStart + pt::microseconds(static_cast<int64_t>(time_s * 1e6));
+}
+
+Waypoint MakeWaypoint(double time_s, double pitch_deg) {
+  Waypoint result;
+  result.time_s = time_s;
+  result.pitch.pitch_deg = pitch_deg;
+  return result;
+}
+
+/// Lean forward while speeding up and turning one way, then lean back
+/// while slowing down and turning the other.
+std::vector<Waypoint> MakeWaypoints() {
+  std::vector<Waypoint> result(3);
+
+  result[0].time_s = 0.5;
+  result[0].pitch.pitch_deg = 1.0;
+  result[0].drive.velocity_mps = 0.2;
+  result[0].drive.yaw_rate_dps = 10.0;
+
+  result[1].time_s = 1.0;
+  result[1].pitch.pitch_deg = 3.0;
+  result[1].pitch.pitch_rate_dps = 4.0;
+  result[1].drive.velocity_mps = 0.6;
+  result[1].drive.accel_mps2 = 0.8;
+  result[1].drive.yaw_rate_dps = -10.0;
+
+  result[2].time_s = 2.0;
+  result[2].pitch.pitch_deg = -1.0;
+  result[2].pitch.yaw_rate_dps = 20.0;
+  result[2].drive.accel_mps2 = -0.6;
+
+  return result;
+}
+}
+
+BOOST_AUTO_TEST_CASE(CommandTrajectoryInterpolateTest) {
+  CommandTrajectory dut(10);
+  BOOST_TEST(dut.empty());
+  BOOST_TEST(dut.Set(MakeWaypoints(), kStart));
+  BOOST_TEST(!dut.empty());
+  BOOST_TEST(dut.duration_s() == 2.0);
+
+  // The first waypoint is held until it is reached.
+  {
+    const auto sample = dut.Sample(At(0.0));
+    BOOST_TEST(dut.index() == 0);
+    BOOST_CHECK_SMALL(sample.pitch.pitch_deg - 1.0, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.velocity_mps - 0.2, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.yaw_rate_dps - 10.0, 1e-9);
+  }
+  BOOST_CHECK_SMALL(dut.Sample(At(0.5)).pitch.pitch_deg - 1.0, 1e-9);
+
+  {
+    const auto sample = dut.Sample(At(0.75));
+    BOOST_TEST(dut.index() == 0);
+    BOOST_CHECK_SMALL(sample.pitch.pitch_deg - 2.0, 1e-9);
+    BOOST_CHECK_SMALL(sample.pitch.pitch_rate_dps - 2.0, 1e-9);
+    BOOST_CHECK_SMALL(sample.pitch.yaw_rate_dps, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.velocity_mps - 0.4, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.accel_mps2 - 0.4, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.yaw_rate_dps, 1e-9);
+  }
+
+  {
+    const auto sample = dut.Sample(At(1.0));
+    BOOST_TEST(dut.index() == 1);
+    BOOST_CHECK_SMALL(sample.pitch.pitch_deg - 3.0, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.yaw_rate_dps - -10.0, 1e-9);
+  }
+
+  {
+    const auto sample = dut.Sample(At(1.25));
+    BOOST_TEST(dut.index() == 1);
+    BOOST_CHECK_SMALL(sample.pitch.pitch_deg - 2.0, 1e-9);
+    BOOST_CHECK_SMALL(sample.pitch.pitch_rate_dps - 3.0, 1e-9);
+    BOOST_CHECK_SMALL(sample.pitch.yaw_rate_dps - 5.0, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.velocity_mps - 0.45, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.accel_mps2 - 0.45, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.yaw_rate_dps - -7.5, 1e-9);
+  }
+
+  // Then the last one is held.
+  {
+    const auto sample = dut.Sample(At(2.0));
+    BOOST_TEST(dut.index() == 2);
+    BOOST_CHECK_SMALL(sample.pitch.pitch_deg - -1.0, 1e-9);
+    BOOST_CHECK_SMALL(sample.pitch.yaw_rate_dps - 20.0, 1e-9);
+    BOOST_CHECK_SMALL(sample.drive.accel_mps2 - -0.6, 1e-9);
+  }
+  BOOST_CHECK_SMALL(dut.Sample(At(10.0)).pitch.pitch_deg - -1.0, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(CommandTrajectoryTimeBackwardsTest) {
+  CommandTrajectory dut(10);
+  BOOST_TEST(dut.Set(MakeWaypoints(), kStart));
+
+  BOOST_CHECK_SMALL(dut.Sample(At(1.5)).pitch.pitch_deg - 1.0, 1e-9);
+  BOOST_TEST(dut.index() == 1);
+
+  // A clock step back lands in an earlier segment.
+  BOOST_CHECK_SMALL(dut.Sample(At(0.75)).pitch.pitch_deg - 2.0, 1e-9);
+  BOOST_TEST(dut.index() == 0);
+
+  BOOST_CHECK_SMALL(dut.Sample(At(1.5)).drive.velocity_mps - 0.3, 1e-9);
+  BOOST_TEST(dut.index() == 1);
+
+  // A new trajectory starts over from its own start time.
+  BOOST_TEST(dut.Set(MakeWaypoints(), At(5.0)));
+  BOOST_TEST(dut.index() == 0);
+  BOOST_CHECK_SMALL(dut.Sample(At(5.75)).pitch.pitch_deg - 2.0, 1e-9);
+}
+
+BOOST_AUTO_TEST_CASE(CommandTrajectoryEmptyTest) {
+  CommandTrajectory dut(2);
+
+  // Too many waypoints, or times which do not increase, leave the
+  // current trajectory alone.
+  BOOST_TEST(!dut.Set(MakeWaypoints(), kStart));
+  BOOST_TEST(dut.empty());
+  BOOST_TEST(dut.duration_s() == 0.0);
+
+  BOOST_TEST(dut.Set({MakeWaypoint(0.0, 1.0), MakeWaypoint(1.0, 2.0)},
+                     kStart));
+  BOOST_TEST(!dut.Set({MakeWaypoint(1.0, 1.0), MakeWaypoint(1.0, 2.0)},
+                      kStart));
+  BOOST_TEST(!dut.empty());
+  BOOST_TEST(dut.duration_s() == 1.0);
+  BOOST_CHECK_SMALL(dut.Sample(At(0.5)).pitch.pitch_deg - 1.5, 1e-9);
+
+  // The command only goes stale this long after the timeout, so an
+  // empty trajectory must not extend it.
+  BOOST_TEST(dut.Set({}, kStart));
+  BOOST_TEST(dut.empty());
+  BOOST_TEST(dut.duration_s() == 0.0);
+
+  BOOST_TEST(dut.Set({MakeWaypoint(0.0, 1.0)}, kStart));
+  dut.Clear();
+  BOOST_TEST(dut.empty());
+  BOOST_TEST(dut.duration_s() == 0.0);
+}
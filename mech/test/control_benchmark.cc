@@ -0,0 +1,452 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// Measure the cost of each stage of the HoverbotControl cycle, in
+/// each control mode, including stand up, with 2, 6 and 12 joints.
+///
+/// The pi3hat is replaced with one that answers every query
+/// immediately with synthetic IMU and servo data, so everything
+/// measured is our own code.  Each stage is timed directly with
+/// steady_clock, from the pi3hat calls and from slots connected at
+/// either end of each signal, so that the telemetry emits are
+/// separated from the work around them.  For each mode this reports
+/// the average ns per cycle of:
+///
+///  * cycle: from the start of the query to the end of the status
+///    emit
+///  * query: from the start of the query until its reply is handled
+///  * imu_emit: the "imu" telemetry
+///  * status: parsing the servo replies and filtering, from
+///    ControlTiming
+///  * control: the monitor and the control law, up to EmitControl,
+///    from ControlTiming
+///  * control_emit: the "hc_control" telemetry in EmitControl
+///  * command: the rest of EmitControl, building the servo command
+///  * status_emit: the "hc_status" telemetry
+///  * allocs: heap allocations per cycle
+///
+/// Pass --log to include the cost of writing the log.
+///
+/// This is not built on Google Benchmark.  That is not a dependency
+/// of this workspace, and each cycle here is a chain of handlers on
+/// the io_context which walks the controller through its modes,
+/// which does not fit its model of timing a loop body.
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <new>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/base/clipp.h"
+#include "mjlib/base/fail.h"
+
+#include "base/context.h"
+
+#include "mech/hoverbot_control.h"
+#include "mech/moteus.h"
+
+namespace {
+std::atomic<int64_t> g_allocations{0};
+}
+
+void* operator new(size_t size) {
+  g_allocations++;
+  if (void* result = std::malloc(size ? size : 1)) { return result; }
+  throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, size_t) noexcept { std::free(ptr); }
+
+namespace {
+using namespace mjmech;
+using HC = mech::HoverbotCommand;
+using HM = HC::Mode;
+
+struct Options {
+  int cycles = 20000;
+  int warmup_cycles = 5000;
+
+  // This is much faster than the robot, so that the benchmark
+  // finishes quickly.  Every mode still sees the same sequence of
+  // states, just over more cycles.
+  double period_s = 0.0001;
+
+  std::string config = "configs/hoverbot.cfg configs/hoverbot_balance.cfg";
+  std::string log;
+};
+
+/// Answers every request immediately.
+class NullPi3hat : public mech::Pi3hatInterface {
+ public:
+  NullPi3hat(const boost::asio::any_io_executor& executor)
+      : executor_(executor) {}
+
+  void set_configuring(bool value) { configuring_ = value; }
+
+  /// While set, the IMU reports the robot lying down, so that
+  /// standing up takes a while.
+  void set_lying_down(bool value) { lying_down_ = value; }
+
+  using Clock = std::chrono::steady_clock;
+
+  Clock::time_point cycle_start() const { return cycle_start_; }
+
+  /// When the servo command was sent this cycle, if it was.
+  Clock::time_point transmit() const { return transmit_; }
+
+  void ReadImu(mech::AttitudeData* attitude,
+               mjlib::io::ErrorCallback callback) override {
+    FillImu(attitude);
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+  void AsyncTransmit(const Request*, Reply*,
+                     mjlib::io::ErrorCallback callback) override {
+    transmit_ = Clock::now();
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+  mjlib::io::SharedStream MakeTunnel(
+      uint8_t, uint32_t, const TunnelOptions&) override {
+    return {};
+  }
+
+  void Cycle(mech::AttitudeData* attitude,
+             const Request* request, Reply* reply,
+             mjlib::io::ErrorCallback callback) override {
+    cycle_start_ = Clock::now();
+    transmit_ = {};
+
+    FillImu(attitude);
+    for (const auto& item : *request) { FillServo(item.id, reply); }
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+ private:
+  void FillImu(mech::AttitudeData* attitude) {
+    // A gentle wobble, well inside the tip over limits.
+    count_++;
+    const double phase = count_ * 0.001;
+    attitude->timestamp = mjlib::io::Now(executor_.context());
+    attitude->euler_deg.pitch =
+        (lying_down_ ? 80.0 : 0.0) + 2.0 * std::sin(phase);
+    attitude->euler_deg.roll = 0.5 * std::cos(phase);
+    attitude->euler_deg.yaw = 10.0 * std::sin(0.1 * phase);
+    attitude->rate_dps = base::Point3D(0.5, 2.0 * std::cos(phase), 0.1);
+  }
+
+  void FillServo(int id, Reply* reply) {
+    using namespace mech::moteus;
+    const auto add = [&](uint32_t reg, Value value) {
+      reply->push_back({});
+      auto& item = reply->back();
+      item.id = id;
+      item.reg = reg;
+      item.value = value;
+    };
+
+    add(kMode, WriteInt(10, kInt8));
+    add(kPosition, WritePosition(0.01 * count_, kFloat));
+    add(kVelocity, WriteVelocity(36.0, kFloat));
+    add(kTorque, WriteTorque(0.1, kFloat));
+    add(kVoltage, WriteVoltage(24.0, kFloat));
+    add(kTemperature, WriteTemperature(30.0, kFloat));
+    add(kFault, WriteInt(0, kInt8));
+
+    if (configuring_) {
+      add(kRezeroState, WriteInt(1, kInt8));
+      add(kRegisterMapVersion, WriteInt(kCurrentRegisterMapVersion, kInt32));
+      add(kSerialNumber1, WriteInt(id, kInt32));
+      add(kSerialNumber2, WriteInt(0, kInt32));
+      add(kSerialNumber3, WriteInt(0, kInt32));
+    }
+  }
+
+  boost::asio::any_io_executor executor_;
+  bool configuring_ = true;
+  bool lying_down_ = false;
+  int64_t count_ = 0;
+  Clock::time_point cycle_start_;
+  Clock::time_point transmit_;
+};
+
+struct Phase {
+  const char* name;
+  /// The mode to command.
+  HM command;
+  /// The mode to measure in.
+  HM mode;
+  /// If true, the mode only lasts as long as the controller stays in
+  /// it on the way to the commanded one, so it is measured from the
+  /// first cycle without warming up, for at most --cycles.
+  bool transient = false;
+  bool lying_down = false;
+};
+
+const Phase kPhases[] = {
+  { "stopped", HM::kStopped, HM::kStopped },
+  { "joint", HM::kJoint, HM::kJoint },
+  { "zero_velocity", HM::kZeroVelocity, HM::kZeroVelocity, false, true },
+  // Pitch is only entered through stand up from here.
+  { "stand_up", HM::kPitch, HM::kStandUp, true, true },
+  { "pitch", HM::kPitch, HM::kPitch },
+  { "drive", HM::kDrive, HM::kDrive },
+  { "balance", HM::kBalance, HM::kBalance },
+  { "stopped", HM::kStopped, HM::kStopped },
+};
+
+/// The times of each point in one cycle, in the order they happen.
+struct Stamps {
+  using Clock = std::chrono::steady_clock;
+
+  Clock::time_point imu_begin;
+  Clock::time_point imu_end;
+  Clock::time_point control_begin;
+  Clock::time_point control_end;
+  Clock::time_point status_begin;
+  Clock::time_point status_end;
+};
+
+/// Return the ns from @p start to @p end, or 0 if either did not
+/// happen this cycle.
+double Elapsed(Stamps::Clock::time_point start,
+               Stamps::Clock::time_point end) {
+  if (start == Stamps::Clock::time_point() ||
+      end == Stamps::Clock::time_point()) {
+    return 0.0;
+  }
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+struct Result {
+  double cycle_ns = 0.0;
+  double query_ns = 0.0;
+  double imu_emit_ns = 0.0;
+  double status_ns = 0.0;
+  double control_ns = 0.0;
+  double control_emit_ns = 0.0;
+  double command_ns = 0.0;
+  double status_emit_ns = 0.0;
+  int64_t allocations = 0;
+  int cycles = 0;
+};
+
+std::string WriteJointConfig(const Options& options, int joints) {
+  const std::string filename =
+      fmt::format("/tmp/control_benchmark_{}.cfg", joints);
+  std::ofstream out(filename);
+  out << "{\n";
+  out << fmt::format("  \"period_s\" : {},\n", options.period_s);
+  out << "  \"joints\" : [\n";
+  for (int i = 1; i <= joints; i++) {
+    out << fmt::format("    {{ \"id\" : {}, \"sign\" : {} }},\n",
+                       i, (i % 2) ? 1 : -1);
+  }
+  out << "  ],\n";
+  out << "}\n";
+  return filename;
+}
+
+HC MakeCommand(HM mode, int joints) {
+  HC result;
+  result.mode = mode;
+  if (mode == HM::kJoint) {
+    for (int i = 1; i <= joints; i++) {
+      HC::Joint joint;
+      joint.id = i;
+      joint.power = true;
+      result.joints.push_back(joint);
+    }
+  }
+  result.pitch.pitch_deg = 1.0;
+  result.drive.velocity_mps = 0.5;
+  result.drive.yaw_rate_dps = 10.0;
+  return result;
+}
+
+void Run(const Options& options, int joints) {
+  base::Context context;
+  NullPi3hat pi3hat(context.executor);
+  mech::HoverbotControl control(context, [&]() { return &pi3hat; });
+
+  control.parameters()->config =
+      options.config + " " + WriteJointConfig(options, joints);
+  if (!options.log.empty()) {
+    context.telemetry_log->Open(options.log);
+  }
+
+  size_t phase = 0;
+  int cycles = 0;
+  bool measuring = false;
+  int64_t start_allocations = 0;
+  Result result;
+  std::vector<Result> results;
+
+  Stamps stamps;
+
+  const auto start_phase = [&]() {
+    const auto& p = kPhases[phase];
+    pi3hat.set_lying_down(p.lying_down);
+    control.Command(MakeCommand(p.command, joints));
+    cycles = 0;
+    measuring = false;
+    result = {};
+  };
+
+  const auto next_phase = [&]() {
+    result.allocations = g_allocations - start_allocations;
+    results.push_back(result);
+
+    phase++;
+    // The final phase only stops the robot.
+    if (phase + 1 >= std::size(kPhases)) {
+      context.context.stop();
+      return;
+    }
+    start_phase();
+  };
+
+  const auto now = []() { return Stamps::Clock::now(); };
+
+  // Slots at the front of each signal run before its telemetry, and
+  // those at the back after.
+  namespace bs = boost::signals2;
+  control.imu_signal()->connect(
+      [&](const auto*) { stamps = {}; stamps.imu_begin = now(); },
+      bs::at_front);
+  control.imu_signal()->connect(
+      [&](const auto*) { stamps.imu_end = now(); });
+  control.control_signal()->connect(
+      [&](const auto*) { stamps.control_begin = now(); }, bs::at_front);
+  control.control_signal()->connect(
+      [&](const auto*) { stamps.control_end = now(); });
+  control.status_signal()->connect(
+      [&](const auto*) { stamps.status_begin = now(); }, bs::at_front);
+
+  control.status_signal()->connect([&](const auto* status) {
+      stamps.status_end = now();
+
+      if (status->mode == HM::kConfiguring) { return; }
+      pi3hat.set_configuring(false);
+
+      if (status->mode == HM::kFault) {
+        std::cout << fmt::format("fault in {}: {}\n",
+                                 kPhases[phase].name, status->fault);
+        context.context.stop();
+        return;
+      }
+
+      const auto& p = kPhases[phase];
+
+      cycles++;
+      if (!measuring) {
+        if (status->mode == p.mode &&
+            (p.transient || cycles >= options.warmup_cycles)) {
+          measuring = true;
+          start_allocations = g_allocations;
+        } else {
+          return;
+        }
+      }
+
+      if (p.transient && status->mode != p.mode) {
+        next_phase();
+        return;
+      }
+
+      const auto& s = stamps;
+      result.cycle_ns += Elapsed(pi3hat.cycle_start(), s.status_end);
+      result.query_ns += Elapsed(pi3hat.cycle_start(), s.imu_begin);
+      result.imu_emit_ns += Elapsed(s.imu_begin, s.imu_end);
+      result.status_ns += status->timing.status_s * 1e9;
+      result.control_ns += status->timing.control_s * 1e9 -
+          Elapsed(s.control_begin, pi3hat.transmit());
+      result.control_emit_ns += Elapsed(s.control_begin, s.control_end);
+      result.command_ns += Elapsed(s.control_end, pi3hat.transmit());
+      result.status_emit_ns += Elapsed(s.status_begin, s.status_end);
+      result.cycles++;
+
+      if (result.cycles < options.cycles) { return; }
+
+      next_phase();
+    });
+
+  control.AsyncStart([&](const mjlib::base::error_code& ec) {
+      mjlib::base::FailIf(ec);
+      start_phase();
+    });
+
+  context.context.run();
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const auto& r = results[i];
+    const double n = std::max(1, r.cycles);
+    std::cout << fmt::format(
+        "{:2d} joints  {:<14} cycles {:6d}  cycle {:8.0f}  query {:6.0f}  "
+        "imu_emit {:6.0f}  status {:6.0f}  control {:6.0f}  "
+        "control_emit {:6.0f}  command {:6.0f}  status_emit {:6.0f}  "
+        "allocs {:6.2f}\n",
+        joints, kPhases[i].name, r.cycles,
+        r.cycle_ns / n, r.query_ns / n, r.imu_emit_ns / n,
+        r.status_ns / n, r.control_ns / n, r.control_emit_ns / n,
+        r.command_ns / n, r.status_emit_ns / n,
+        r.allocations / n);
+  }
+}
+
+int work(int argc, char** argv) {
+  Options options;
+
+  auto group = clipp::group(
+      (clipp::option("cycles") & clipp::value("", options.cycles)),
+      (clipp::option("warmup_cycles") &
+       clipp::value("", options.warmup_cycles)),
+      (clipp::option("period_s") & clipp::value("", options.period_s)),
+      (clipp::option("config") & clipp::value("", options.config)),
+      (clipp::option("log") & clipp::value("", options.log)) %
+      "also write the telemetry log here");
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  for (int joints : {2, 6, 12}) {
+    Run(options, joints);
+  }
+
+  return 0;
+}
+}
+
+int main(int argc, char** argv) {
+  return work(argc, argv);
+}
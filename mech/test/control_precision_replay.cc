@@ -0,0 +1,231 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// Replay the IMU and velocity from a hoverbot log through the
+/// control filters in both double and single precision, and report
+/// how far apart they get and how long each takes.
+///
+/// This is the check to run before flying a --config=float32 build
+/// with a new filter configuration.  It exits non-zero if any channel
+/// differs by more than the tolerance, relative to that channel's
+/// range over the log.
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <boost/algorithm/string.hpp>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/base/clipp.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/telemetry/file_reader.h"
+#include "mjlib/telemetry/mapped_binary_reader.h"
+
+#include "mech/attitude_data.h"
+#include "mech/hoverbot_config.h"
+#include "mech/hoverbot_control.h"
+#include "mech/hoverbot_filters.h"
+
+namespace {
+using namespace mjmech;
+
+struct Options {
+  std::string log;
+  std::string config = "configs/hoverbot.cfg";
+  double tolerance = 1e-4;
+};
+
+/// The first ones are in HoverbotImuFilter order.
+enum Channel {
+  kTipPitch,
+  kTipRoll,
+  kPitchRate,
+  kYawRate,
+  kAccel,
+  kNumChannels,
+};
+
+const char* const kChannelNames[kNumChannels] = {
+  "tip_pitch", "tip_roll", "pitch_rate", "yaw_rate", "accel",
+};
+
+/// The IMU and velocity inputs of the filters, in log order.
+struct Inputs {
+  std::vector<mech::AttitudeData> imu;
+  /// Only from cycles with a servo query, where the accel filter runs.
+  std::vector<double> velocity_mps;
+};
+
+/// The output of every channel for each input, in double regardless
+/// of the precision they were computed in.
+struct Outputs {
+  std::vector<std::array<double, mech::kNumImuFilters>> imu;
+  std::vector<double> accel;
+};
+
+/// Run all of @p inputs through the HoverbotControl filters in one
+/// precision, and return how long that took in ns.  Each filter call
+/// takes only tens of ns, so the whole pass is timed at once rather
+/// than each call.
+template <typename Scalar>
+double Run(const mech::HoverbotConfig& config, const Inputs& inputs,
+           Outputs* outputs) {
+  auto filters = mech::DesignHoverbotFilters<Scalar>(config);
+
+  outputs->imu.resize(inputs.imu.size());
+  outputs->accel.resize(inputs.velocity_mps.size());
+
+  const auto start = std::chrono::steady_clock::now();
+
+  for (size_t i = 0; i < inputs.imu.size(); i++) {
+    const auto& imu = inputs.imu[i];
+    std::array<Scalar, mech::kNumImuFilters> input = {};
+    input[mech::kTipPitchFilter] = imu.euler_deg.pitch;
+    input[mech::kTipRollFilter] = imu.euler_deg.roll;
+    input[mech::kPitchRateFilter] = imu.rate_dps.y();
+    input[mech::kYawRateFilter] = imu.rate_dps.z();
+    if (i == 0) {
+      for (int c = 0; c < mech::kNumImuFilters; c++) {
+        filters.imu.Reset(c, input[c]);
+      }
+    }
+    std::array<Scalar, mech::kNumImuFilters> output = {};
+    filters.imu.Process(input.data(), output.data());
+    std::copy(output.begin(), output.end(), outputs->imu[i].begin());
+  }
+
+  for (size_t i = 0; i < inputs.velocity_mps.size(); i++) {
+    const Scalar input = inputs.velocity_mps[i];
+    if (i == 0) { filters.accel.Reset(0, input); }
+    Scalar output = 0;
+    filters.accel.Process(&input, &output);
+    outputs->accel[i] = output;
+  }
+
+  const auto end = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(end - start).count();
+}
+
+struct Stats {
+  double max_error = 0.0;
+  double max_output = 0.0;
+  int64_t samples = 0;
+
+  void Add(double output, double outputf) {
+    max_error = std::max(max_error, std::abs(output - outputf));
+    max_output = std::max(max_output, std::abs(output));
+    samples++;
+  }
+};
+
+int work(int argc, char** argv) {
+  Options options;
+
+  auto group = clipp::group(
+      clipp::value("log", options.log),
+      (clipp::option("config") & clipp::value("", options.config)),
+      (clipp::option("tolerance") & clipp::value("", options.tolerance)));
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  mech::HoverbotConfig config;
+  {
+    std::vector<std::string> configs;
+    boost::split(configs, options.config, boost::is_any_of(" "));
+    for (const auto& filename : configs) {
+      std::ifstream inf(filename);
+      mjlib::base::system_error::throw_if(
+          !inf.is_open(),
+          fmt::format("could not open config file '{}'", filename));
+      mjlib::base::Json5ReadArchive(inf).Accept(&config);
+    }
+  }
+
+  mjlib::telemetry::FileReader reader(options.log);
+  const auto* imu_record = reader.record("imu");
+  const auto* status_record = reader.record("hc_status");
+  mjlib::base::system_error::throw_if(
+      !imu_record || !status_record,
+      "log has no 'imu' or 'hc_status' record");
+
+  mjlib::telemetry::MappedBinaryReader<mech::AttitudeData> imu_reader(
+      imu_record->schema.get());
+  mjlib::telemetry::MappedBinaryReader<mech::HoverbotControl::Status>
+      status_reader(status_record->schema.get());
+
+  Inputs inputs;
+  int64_t status_count = 0;
+
+  mjlib::telemetry::FileReader::ItemsOptions items_options;
+  items_options.records = {"imu", "hc_status"};
+  for (const auto& item : reader.items(items_options)) {
+    if (item.record == imu_record) {
+      inputs.imu.push_back(imu_reader.Read(item.data));
+    } else {
+      if ((status_count++ % config.rates.status_divider) != 0) { continue; }
+      inputs.velocity_mps.push_back(
+          status_reader.Read(item.data).state.robot.velocity_mps);
+    }
+  }
+
+  Outputs output;
+  Outputs outputf;
+  const double double_ns = Run<double>(config, inputs, &output);
+  const double float_ns = Run<float>(config, inputs, &outputf);
+
+  std::array<Stats, kNumChannels> stats;
+  for (size_t i = 0; i < output.imu.size(); i++) {
+    for (int c = 0; c < mech::kNumImuFilters; c++) {
+      stats[kTipPitch + c].Add(output.imu[i][c], outputf.imu[i][c]);
+    }
+  }
+  for (size_t i = 0; i < output.accel.size(); i++) {
+    stats[kAccel].Add(output.accel[i], outputf.accel[i]);
+  }
+
+  bool pass = true;
+  for (int c = 0; c < kNumChannels; c++) {
+    const auto& s = stats[c];
+    const double relative =
+        s.max_output > 0.0 ? s.max_error / s.max_output : 0.0;
+    const bool ok = relative <= options.tolerance;
+    pass = pass && ok;
+    std::cout << fmt::format(
+        "{:<12} samples {:8d}  max error {:10.3g}  range {:10.3g}  "
+        "relative {:10.3g}  {}\n",
+        kChannelNames[c], s.samples, s.max_error, s.max_output, relative,
+        ok ? "ok" : "FAIL");
+  }
+
+  std::cout << fmt::format(
+      "filter time: double {:.3f} ms  float {:.3f} ms\n",
+      double_ns * 1e-6, float_ns * 1e-6);
+
+  return pass ? 0 : 1;
+}
+}
+
+int main(int argc, char** argv) {
+  return work(argc, argv);
+}
@@ -0,0 +1,226 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// Generate load for a FleetAggregator by replaying a capture, or a
+/// synthetic stream, as if it came from many robots at once.  Each
+/// simulated robot sends from its own socket with its own stream_id.
+
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <thread>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/udp.hpp>
+
+#include "mjlib/base/clipp.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/system_error.h"
+
+#include "base/telemetry_stream.h"
+
+#include "mech/fleet_aggregator.h"
+
+namespace {
+using namespace mjmech;
+using udp = boost::asio::ip::udp;
+
+struct Options {
+  std::string capture;
+  std::string dest = "127.0.0.1:13400";
+  int robots = 10;
+  double speed = 1.0;
+  double duration_s = 10.0;
+
+  // Used only when no capture is given.
+  double rate_hz = 400.0;
+  int record_size = 600;
+  int fec_group_size = 4;
+};
+
+uint32_t ReadSequence(const std::string& data) {
+  if (data.size() < 8) { return 0; }
+  uint32_t result = 0;
+  for (int i = 0; i < 4; i++) {
+    result |= static_cast<uint32_t>(static_cast<uint8_t>(data[4 + i])) << (8 * i);
+  }
+  return result;
+}
+
+void WriteSequence(std::string* data, uint32_t sequence) {
+  if (data->size() < 8) { return; }
+  for (int i = 0; i < 4; i++) {
+    (*data)[4 + i] = static_cast<char>((sequence >> (8 * i)) & 0xff);
+  }
+}
+
+std::vector<mech::FleetCapture::Entry> MakeSynthetic(const Options& options) {
+  std::vector<mech::FleetCapture::Entry> result;
+  int64_t now_us = 0;
+
+  base::TelemetryStreamEncoder encoder(
+      [&]() {
+        base::TelemetryStreamEncoder::Options encoder_options;
+        encoder_options.fec_group_size = options.fec_group_size;
+        return encoder_options;
+      }(),
+      [&](std::string_view datagram) {
+        mech::FleetCapture::Entry entry;
+        entry.timestamp_us = now_us;
+        entry.data = std::string(datagram);
+        result.push_back(std::move(entry));
+      });
+
+  std::string record(options.record_size, '\0');
+  const int64_t period_us = static_cast<int64_t>(1e6 / options.rate_hz);
+  const int count = static_cast<int>(options.rate_hz);
+  for (int i = 0; i < count; i++) {
+    if (i == 0) { encoder.WriteSchema(0, "synthetic", "schema"); }
+    for (size_t j = 0; j < record.size(); j++) {
+      record[j] = static_cast<char>(i + j);
+    }
+    encoder.WriteData(0, now_us, record);
+    encoder.Flush();
+    now_us += period_us;
+  }
+
+  return result;
+}
+
+int work(int argc, char** argv) {
+  Options options;
+  auto group = clipp::group(
+      (clipp::option("c", "capture") & clipp::value("", options.capture)) %
+      "replay this capture file",
+      (clipp::option("d", "dest") & clipp::value("", options.dest)) %
+      "aggregator address",
+      (clipp::option("n", "robots") & clipp::value("", options.robots)) %
+      "number of simulated robots",
+      (clipp::option("s", "speed") & clipp::value("", options.speed)) %
+      "replay speed multiplier",
+      (clipp::option("t", "duration_s") & clipp::value("", options.duration_s)),
+      (clipp::option("rate_hz") & clipp::value("", options.rate_hz)),
+      (clipp::option("record_size") & clipp::value("", options.record_size)),
+      (clipp::option("fec_group_size") &
+       clipp::value("", options.fec_group_size))
+  );
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  std::vector<mech::FleetCapture::Entry> entries;
+  if (!options.capture.empty()) {
+    std::ifstream inf(options.capture, std::ios::binary);
+    mjlib::base::system_error::throw_if(
+        !inf.is_open(), "opening " + options.capture);
+    // Only the first robot and stream in the capture are replayed.
+    mech::FleetCapture::Entry entry;
+    uint16_t stream_id = 0;
+    while (mech::FleetCapture::Read(inf, &entry)) {
+      uint16_t this_stream_id = 0;
+      if (!base::TelemetryStreamFormat::ReadStreamId(
+              entry.data, &this_stream_id)) {
+        continue;
+      }
+      if (entries.empty()) {
+        stream_id = this_stream_id;
+      } else if (entry.address != entries.front().address ||
+                 entry.port != entries.front().port ||
+                 this_stream_id != stream_id) {
+        continue;
+      }
+      entries.push_back(entry);
+    }
+  } else {
+    entries = MakeSynthetic(options);
+  }
+
+  if (entries.empty()) {
+    mjlib::base::Fail("nothing to replay");
+  }
+
+  boost::asio::io_context context;
+  const auto colon = options.dest.find(':');
+  const udp::endpoint dest(
+      boost::asio::ip::make_address(options.dest.substr(0, colon)),
+      std::stoi(options.dest.substr(colon + 1)));
+
+  std::vector<udp::socket> sockets;
+  for (int i = 0; i < options.robots; i++) {
+    sockets.emplace_back(context, udp::endpoint(udp::v4(), 0));
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  const auto end = start + std::chrono::microseconds(
+      static_cast<int64_t>(options.duration_s * 1e6));
+  const int64_t span_us =
+      entries.back().timestamp_us - entries.front().timestamp_us + 1;
+  // Each time through the capture, the sequence numbers are advanced
+  // so that receivers see one continuous stream.
+  const uint32_t sequence_span =
+      ReadSequence(entries.back().data) - ReadSequence(entries.front().data) + 1;
+
+  uint64_t sent = 0;
+  int loop = 0;
+  auto now = start;
+  while (now < end) {
+    for (const auto& entry : entries) {
+      const int64_t offset_us =
+          loop * span_us + entry.timestamp_us - entries.front().timestamp_us;
+      std::this_thread::sleep_until(
+          start + std::chrono::microseconds(
+              static_cast<int64_t>(offset_us / options.speed)));
+
+      std::string data = entry.data;
+      WriteSequence(&data, ReadSequence(data) + loop * sequence_span);
+      for (int i = 0; i < options.robots; i++) {
+        // Rewrite the stream_id so each robot is distinct.
+        if (data.size() >= 4) {
+          data[2] = static_cast<char>(i & 0xff);
+          data[3] = static_cast<char>((i >> 8) & 0xff);
+        }
+        sockets[i].send_to(boost::asio::buffer(data), dest);
+        sent++;
+      }
+
+      now = std::chrono::steady_clock::now();
+      if (now >= end) { break; }
+    }
+    loop++;
+  }
+
+  const double elapsed_s = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+  std::cout << fmt::format("sent {} datagrams from {} robots in {:.1f}s "
+                           "({:.0f}/s)\n",
+                           sent, options.robots, elapsed_s,
+                           sent / elapsed_s);
+  return 0;
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  try {
+    return work(argc, argv);
+  } catch (std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+}
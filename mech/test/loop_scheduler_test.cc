@@ -0,0 +1,96 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/loop_scheduler.h"
+
+#include <boost/asio/io_context.hpp>
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+
+BOOST_AUTO_TEST_CASE(LoopSchedulerDividerTest) {
+  boost::asio::io_context context;
+  LoopScheduler dut(context.get_executor(), 3);
+  dut.set_divider(1, 2);
+  dut.set_divider(2, 4);
+  BOOST_TEST(dut.divider(0) == 1);
+  BOOST_TEST(dut.divider(1) == 2);
+  BOOST_TEST(dut.divider(2) == 4);
+
+  for (int cycle = 0; cycle < 12; cycle++) {
+    BOOST_TEST(dut.due(0));
+    BOOST_TEST(dut.due(1) == (cycle % 2 == 0));
+    BOOST_TEST(dut.due(2) == (cycle % 4 == 0));
+    // A loop with the same phase and a multiple of another's divider
+    // is only ever due when that one is.
+    if (dut.due(2)) { BOOST_TEST(dut.due(1)); }
+    dut.Cycle();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(LoopSchedulerPhaseTest) {
+  boost::asio::io_context context;
+  LoopScheduler dut(context.get_executor(), 3);
+  dut.set_divider(0, 4);
+  dut.set_divider(1, 4);
+  dut.set_divider(2, 4);
+  dut.set_phase(1, 1);
+  dut.set_phase(2, 6);
+
+  for (int cycle = 0; cycle < 12; cycle++) {
+    BOOST_TEST(dut.due(0) == (cycle % 4 == 0));
+    BOOST_TEST(dut.due(1) == (cycle % 4 == 1));
+    // Phases wrap at the divider.
+    BOOST_TEST(dut.due(2) == (cycle % 4 == 2));
+    dut.Cycle();
+  }
+}
+
+BOOST_AUTO_TEST_CASE(LoopSchedulerTriggerTest) {
+  boost::asio::io_context context;
+  LoopScheduler dut(context.get_executor(), 2);
+  dut.set_divider(1, 5);
+  dut.set_phase(1, 3);
+
+  dut.Cycle();
+  BOOST_TEST(!dut.due(1));
+  dut.Trigger();
+  BOOST_TEST(dut.due(0));
+  BOOST_TEST(dut.due(1));
+
+  // It only lasts until the next cycle.
+  dut.Cycle();
+  BOOST_TEST(!dut.due(1));
+  dut.Cycle();
+  BOOST_TEST(dut.due(1));
+}
+
+BOOST_AUTO_TEST_CASE(LoopSchedulerRunTest) {
+  boost::asio::io_context context;
+  LoopScheduler dut(context.get_executor(), 2);
+  dut.set_divider(1, 3);
+
+  int calls[2] = {};
+  for (int cycle = 0; cycle < 9; cycle++) {
+    BOOST_TEST(dut.Run(0, [&]() { calls[0]++; }));
+    BOOST_TEST(dut.Run(1, [&]() { calls[1]++; }) == (cycle % 3 == 0));
+    dut.Cycle();
+  }
+
+  BOOST_TEST(calls[0] == 9);
+  BOOST_TEST(calls[1] == 3);
+  BOOST_TEST(dut.status(0).runs == 9);
+  BOOST_TEST(dut.status(1).runs == 3);
+  BOOST_TEST(dut.status(1).max_run_s >= dut.status(1).run_s);
+}
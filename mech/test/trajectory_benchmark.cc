@@ -0,0 +1,131 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+/// Measure the typical and worst case time to evaluate one step of
+/// the jerk limited trajectory generators.
+///
+/// Every call is timed individually from a random state with a random
+/// target, so that every branch of the profile is exercised.  For
+/// meaningful maxima, run it on an isolated core with the performance
+/// governor, as the robot does.
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <clipp/clipp.h>
+
+#include "mjlib/base/clipp.h"
+
+#include "mech/trajectory.h"
+
+namespace {
+using namespace mjmech;
+
+struct Options {
+  int samples = 1000000;
+  double period_s = 0.0025;
+};
+
+struct Sample {
+  mech::TrajectoryAxis start;
+  double target = 0.0;
+};
+
+template <typename Functor>
+void Measure(const std::string& name, const std::vector<Sample>& samples,
+             Functor f) {
+  std::vector<double> times_ns;
+  times_ns.reserve(samples.size());
+  double sink = 0.0;
+
+  for (const auto& sample : samples) {
+    const auto start = std::chrono::steady_clock::now();
+    const auto result = f(sample);
+    const auto end = std::chrono::steady_clock::now();
+
+    sink += result.acceleration_l_s2;
+    times_ns.push_back(
+        std::chrono::duration<double, std::nano>(end - start).count());
+  }
+
+  std::sort(times_ns.begin(), times_ns.end());
+  const auto percentile = [&](double p) {
+    return times_ns[std::min<size_t>(
+        times_ns.size() - 1, static_cast<size_t>(p * times_ns.size()))];
+  };
+
+  std::cout << fmt::format(
+      "{:<10} median {:6.1f} ns  99.9% {:6.1f} ns  max {:8.1f} ns  ({})\n",
+      name, percentile(0.5), percentile(0.999), times_ns.back(),
+      sink != 0.0);
+}
+
+int work(int argc, char** argv) {
+  Options options;
+
+  auto group = clipp::group(
+      (clipp::option("samples") & clipp::value("", options.samples)),
+      (clipp::option("period_s") & clipp::value("", options.period_s)));
+
+  mjlib::base::ClippParse(argc, argv, group);
+
+  mech::JerkLimits limits;
+  limits.max_velocity_l_s = 100.0;
+  limits.max_acceleration_l_s2 = 360.0;
+  limits.max_jerk_l_s3 = 3600.0;
+
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> unit(-1.0, 1.0);
+
+  std::vector<Sample> samples(options.samples);
+  for (auto& sample : samples) {
+    sample.start.pose_l = 45.0 * unit(rng);
+    sample.start.velocity_l_s = limits.max_velocity_l_s * unit(rng);
+    sample.start.acceleration_l_s2 = limits.max_acceleration_l_s2 * unit(rng);
+    sample.target = 45.0 * unit(rng);
+  }
+
+  // This shows how much of each result is just reading the clock.
+  Measure("clock", samples, [](const Sample& sample) {
+      return sample.start;
+    });
+  Measure("velocity", samples, [&](const Sample& sample) {
+      return mech::CalculateJerkLimitedVelocity(
+          sample.start, sample.target, limits, options.period_s);
+    });
+  Measure("position", samples, [&](const Sample& sample) {
+      return mech::CalculateJerkLimitedTrajectory(
+          sample.start, sample.target, limits, options.period_s);
+    });
+
+  return 0;
+}
+}
+
+extern "C" {
+int main(int argc, char** argv) {
+  try {
+    return work(argc, argv);
+  } catch (std::exception& e) {
+    std::cerr << "error: " << e.what() << "\n";
+    return 1;
+  }
+  return 0;
+}
+}
@@ -0,0 +1,154 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/trajectory.h"
+
+#include <cmath>
+#include <random>
+
+#include <boost/test/auto_unit_test.hpp>
+
+using namespace mjmech::mech;
+
+namespace {
+const double kDt = 0.0025;
+const double kEps = 1e-6;
+// The stopping profile is planned in continuous time, so the discrete
+// one can still land a few microns long.
+const double kPoseEps = 1e-5;
+
+JerkLimits MakeLimits() {
+  JerkLimits result;
+  result.max_velocity_l_s = 2.0;
+  result.max_acceleration_l_s2 = 4.0;
+  result.max_jerk_l_s3 = 40.0;
+  return result;
+}
+
+/// Check the limits for one step from @p start to @p next.
+void CheckStep(const TrajectoryAxis& start, const TrajectoryAxis& next,
+               const JerkLimits& limits) {
+  const double jerk =
+      (next.acceleration_l_s2 - start.acceleration_l_s2) / kDt;
+  BOOST_TEST(std::abs(jerk) <= limits.max_jerk_l_s3 + kEps);
+  BOOST_TEST(std::abs(next.acceleration_l_s2) <=
+             limits.max_acceleration_l_s2 + kEps);
+  BOOST_TEST(std::abs(next.velocity_l_s) <= limits.max_velocity_l_s + kEps);
+}
+}
+
+BOOST_AUTO_TEST_CASE(JerkLimitedVelocityTest) {
+  const auto limits = MakeLimits();
+
+  for (const double target : {1.5, -0.3, 5.0}) {
+    const double expected = std::max(-2.0, std::min(2.0, target));
+
+    TrajectoryAxis state;
+    int steps = 0;
+    for (; steps < 10000; steps++) {
+      const auto next =
+          CalculateJerkLimitedVelocity(state, target, limits, kDt);
+      CheckStep(state, next, limits);
+
+      // The velocity approaches from one side and never passes.
+      BOOST_TEST(std::abs(next.velocity_l_s) <= std::abs(expected) + kEps);
+      state = next;
+
+      if (state.velocity_l_s == expected &&
+          state.acceleration_l_s2 == 0.0) {
+        break;
+      }
+    }
+    BOOST_TEST(steps < 10000);
+
+    // Once there, it stays exactly there.
+    for (int i = 0; i < 100; i++) {
+      state = CalculateJerkLimitedVelocity(state, target, limits, kDt);
+      BOOST_TEST(state.velocity_l_s == expected);
+      BOOST_TEST(state.acceleration_l_s2 == 0.0);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(JerkLimitedTrajectoryTest) {
+  const auto limits = MakeLimits();
+
+  // Long enough to cruise at the velocity limit for a while.
+  for (const double target : {6.0, -6.0, 0.2}) {
+    TrajectoryAxis state;
+    int cruise_steps = 0;
+    int steps = 0;
+    for (; steps < 10000; steps++) {
+      const auto next =
+          CalculateJerkLimitedTrajectory(state, target, limits, kDt);
+      CheckStep(state, next, limits);
+
+      // Starting from rest, the target is approached without
+      // overshoot.
+      BOOST_TEST(std::abs(next.pose_l) <= std::abs(target) + kPoseEps);
+
+      if (std::abs(next.velocity_l_s) == limits.max_velocity_l_s) {
+        // While cruising, the acceleration is exactly zero, rather
+        // than alternating around it.
+        BOOST_TEST(next.acceleration_l_s2 == 0.0);
+        cruise_steps++;
+      }
+
+      state = next;
+      if (state.pose_l == target && state.velocity_l_s == 0.0 &&
+          state.acceleration_l_s2 == 0.0) {
+        break;
+      }
+    }
+    BOOST_TEST(steps < 10000);
+    if (std::abs(target) > 1.0) { BOOST_TEST(cruise_steps > 100); }
+
+    for (int i = 0; i < 100; i++) {
+      state = CalculateJerkLimitedTrajectory(state, target, limits, kDt);
+      BOOST_TEST(state.pose_l == target);
+      BOOST_TEST(state.velocity_l_s == 0.0);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(JerkLimitedTrajectoryRandomTest) {
+  const auto limits = MakeLimits();
+  std::mt19937 rng(0);
+  std::uniform_real_distribution<double> uniform(-1.0, 1.0);
+
+  for (int trial = 0; trial < 200; trial++) {
+    TrajectoryAxis state;
+    state.pose_l = 10.0 * uniform(rng);
+    state.velocity_l_s = 2.0 * uniform(rng);
+    state.acceleration_l_s2 = 4.0 * uniform(rng);
+
+    // Only starts from which the velocity limit can be kept.
+    const double committed = state.velocity_l_s +
+        state.acceleration_l_s2 * std::abs(state.acceleration_l_s2) /
+        (2.0 * limits.max_jerk_l_s3);
+    if (std::abs(committed) > limits.max_velocity_l_s) { continue; }
+
+    const double target = 20.0 * uniform(rng);
+
+    bool settled = false;
+    for (int i = 0; i < 20000 && !settled; i++) {
+      const auto next =
+          CalculateJerkLimitedTrajectory(state, target, limits, kDt);
+      CheckStep(state, next, limits);
+      state = next;
+      settled = state.pose_l == target && state.velocity_l_s == 0.0;
+    }
+    BOOST_TEST(settled);
+  }
+}
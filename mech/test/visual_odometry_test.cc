@@ -0,0 +1,139 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/visual_odometry.h"
+
+#include <cmath>
+
+#include <boost/test/auto_unit_test.hpp>
+
+#include <Eigen/Geometry>
+
+#include "base/common.h"
+
+using namespace mjmech;
+using namespace mjmech::mech;
+
+namespace {
+using CameraModel = VisualOdometry::CameraModel;
+
+const cv::Size kSize(320, 240);
+
+Eigen::Matrix3d Yaw(double degrees) {
+  return Eigen::AngleAxisd(
+      base::Radians(degrees), Eigen::Vector3d::UnitZ()).toRotationMatrix();
+}
+
+Eigen::Matrix3d Pitch(double degrees) {
+  return Eigen::AngleAxisd(
+      base::Radians(degrees), Eigen::Vector3d::UnitY()).toRotationMatrix();
+}
+}
+
+BOOST_AUTO_TEST_CASE(ProjectToGroundTest) {
+  VisualOdometry::Parameters parameters;
+  parameters.camera_forward_m = 0.05;
+  const CameraModel dut(parameters);
+
+  const double height_m =
+      parameters.axle_height_m + parameters.camera_height_m;
+
+  // The center of the image is along the optical axis, which points
+  // mount_pitch_deg below the horizon.
+  Eigen::Vector3d ground;
+  BOOST_TEST(dut.ProjectToGround(
+                 Eigen::Matrix3d::Identity(), kSize,
+                 cv::Point2f(160, 120), &ground));
+  BOOST_TEST(std::abs(
+                 ground.x() -
+                 (0.05 + height_m /
+                  std::tan(base::Radians(parameters.mount_pitch_deg)))) <
+             1e-6);
+  BOOST_TEST(std::abs(ground.y()) < 1e-6);
+  BOOST_TEST(std::abs(ground.z() - parameters.axle_height_m) < 1e-6);
+
+  // Pixels to the right are to the right on the ground.
+  BOOST_TEST(dut.ProjectToGround(
+                 Eigen::Matrix3d::Identity(), kSize,
+                 cv::Point2f(260, 200), &ground));
+  BOOST_TEST(ground.y() > 0.0);
+  BOOST_TEST(std::abs(ground.z() - parameters.axle_height_m) < 1e-6);
+
+  // Leaning forward brings the same pixel closer, but it is still on
+  // the ground.
+  Eigen::Vector3d leaning;
+  BOOST_TEST(dut.ProjectToGround(
+                 Pitch(-10), kSize, cv::Point2f(260, 200), &leaning));
+  BOOST_TEST(leaning.x() < ground.x());
+  BOOST_TEST(std::abs(leaning.z() - parameters.axle_height_m) < 1e-6);
+
+  // The top of the image is above the horizon.
+  BOOST_TEST(!dut.ProjectToGround(
+                 Eigen::Matrix3d::Identity(), kSize,
+                 cv::Point2f(160, 0), &ground));
+
+  // Just below the horizon is further than max_range_m.
+  BOOST_TEST(!dut.ProjectToGround(
+                 Eigen::Matrix3d::Identity(), kSize,
+                 cv::Point2f(160, 60), &ground));
+}
+
+BOOST_AUTO_TEST_CASE(PredictTest) {
+  VisualOdometry::Parameters parameters;
+  parameters.mount_pitch_deg = 0.0;
+  const CameraModel dut(parameters);
+
+  const double focal_px =
+      0.5 * parameters.width /
+      std::tan(0.5 * base::Radians(parameters.hfov_deg));
+
+  const std::vector<cv::Point2f> points = {
+    {160, 120}, {10, 20}, {300, 230},
+  };
+  std::vector<cv::Point2f> predicted;
+
+  // Without any rotation, nothing moves.
+  dut.Predict(Yaw(30), Yaw(30), kSize, points, &predicted);
+  BOOST_TEST(predicted.size() == points.size());
+  for (size_t i = 0; i < points.size(); i++) {
+    BOOST_TEST(std::abs(predicted[i].x - points[i].x) < 1e-3);
+    BOOST_TEST(std::abs(predicted[i].y - points[i].y) < 1e-3);
+  }
+
+  // Turning right moves everything to the left.
+  dut.Predict(Yaw(0), Yaw(5), kSize, points, &predicted);
+  BOOST_TEST(std::abs(predicted[0].x -
+                      (160 - focal_px * std::tan(base::Radians(5)))) < 1e-3);
+  BOOST_TEST(std::abs(predicted[0].y - 120) < 1e-3);
+
+  // And turning back undoes it.
+  std::vector<cv::Point2f> restored;
+  dut.Predict(Yaw(5), Yaw(0), kSize, predicted, &restored);
+  for (size_t i = 0; i < points.size(); i++) {
+    BOOST_TEST(std::abs(restored[i].x - points[i].x) < 1e-3);
+    BOOST_TEST(std::abs(restored[i].y - points[i].y) < 1e-3);
+  }
+
+  // Pitching nose down moves everything up.
+  dut.Predict(Pitch(0), Pitch(-5), kSize, points, &predicted);
+  BOOST_TEST(std::abs(predicted[0].x - 160) < 1e-3);
+  BOOST_TEST(predicted[0].y < 120);
+
+  // Points which end up behind the camera stay where they were.
+  dut.Predict(Yaw(0), Yaw(180), kSize, points, &predicted);
+  for (size_t i = 0; i < points.size(); i++) {
+    BOOST_TEST(predicted[i].x == points[i].x);
+    BOOST_TEST(predicted[i].y == points[i].y);
+  }
+}
@@ -0,0 +1,286 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/trajectory.h"
+
+#include <cmath>
+
+#include "mjlib/base/limit.h"
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+double Sign(double value) {
+  return value < 0.0 ? -1.0 : 1.0;
+}
+
+/// Return the displacement covered while bringing @p velocity_l_s
+/// and @p acceleration_l_s2 to zero as quickly as the limits allow.
+double StoppingDistance(double velocity_l_s, double acceleration_l_s2,
+                        double max_acceleration_l_s2, double max_jerk_l_s3) {
+  const double j = max_jerk_l_s3;
+
+  // Work in the frame where the velocity we end up at after ramping
+  // the acceleration to zero is positive, so that stopping always
+  // means decelerating.
+  if (velocity_l_s + acceleration_l_s2 * std::abs(acceleration_l_s2) /
+      (2.0 * j) < 0.0) {
+    return -StoppingDistance(-velocity_l_s, -acceleration_l_s2,
+                             max_acceleration_l_s2, max_jerk_l_s3);
+  }
+
+  const double v0 = velocity_l_s;
+  const double a0 = acceleration_l_s2;
+
+  // The profile ramps down to a peak deceleration, optionally holds
+  // it, then ramps back to zero just as the velocity reaches zero.
+  double peak = std::sqrt(0.5 * (2.0 * j * v0 + a0 * a0));
+  double hold_s = 0.0;
+  if (peak > max_acceleration_l_s2) {
+    peak = max_acceleration_l_s2;
+    hold_s = (v0 + (a0 * a0 - 2.0 * peak * peak) / (2.0 * j)) / peak;
+  }
+
+  const double t1 = (a0 + peak) / j;
+  const double d1 = v0 * t1 + a0 * t1 * t1 / 2.0 - j * t1 * t1 * t1 / 6.0;
+  const double v1 = v0 + a0 * t1 - j * t1 * t1 / 2.0;
+
+  const double d2 = v1 * hold_s - peak * hold_s * hold_s / 2.0;
+  const double v2 = v1 - peak * hold_s;
+
+  const double t3 = peak / j;
+  const double d3 = v2 * t3 - peak * t3 * t3 / 2.0 + j * t3 * t3 * t3 / 6.0;
+
+  return d1 + d2 + d3;
+}
+
+/// Apply a constant @p jerk_l_s3 for one step.
+TrajectoryAxis Integrate(const TrajectoryAxis& start, double jerk_l_s3,
+                         double max_acceleration_l_s2, double delta_s) {
+  TrajectoryAxis result;
+  result.acceleration_l_s2 = mjlib::base::Limit(
+      start.acceleration_l_s2 + jerk_l_s3 * delta_s,
+      -max_acceleration_l_s2, max_acceleration_l_s2);
+  result.velocity_l_s = start.velocity_l_s +
+      0.5 * (start.acceleration_l_s2 + result.acceleration_l_s2) * delta_s;
+  // Exact for an acceleration which changes linearly over the step,
+  // so that the pose agrees with StoppingDistance.
+  result.pose_l = start.pose_l + start.velocity_l_s * delta_s +
+      (2.0 * start.acceleration_l_s2 + result.acceleration_l_s2) *
+      delta_s * delta_s / 6.0;
+  return result;
+}
+
+/// Return the jerk which brings the velocity to @p target_l_s, with
+/// the acceleration reaching zero at the same time.
+double VelocityJerk(const TrajectoryAxis& start, double target_l_s,
+                    const JerkLimits& limits, double delta_s) {
+  const double max_a = limits.max_acceleration_l_s2;
+  const double max_j = limits.max_jerk_l_s3;
+  const double a0 = start.acceleration_l_s2;
+
+  // Pick the acceleration to reach at the end of this step such that
+  // this step, plus ramping that acceleration back to zero afterwards,
+  // changes the velocity by exactly what remains.  The step itself is
+  // included so that the discrete profile does not pass the target.
+  const double remaining =
+      target_l_s - start.velocity_l_s - 0.5 * a0 * delta_s;
+  const double half_step_s = 0.5 * delta_s;
+  const double desired_a =
+      Sign(remaining) *
+      std::min(max_a,
+               max_j * (std::sqrt(half_step_s * half_step_s +
+                                  2.0 * std::abs(remaining) / max_j) -
+                        half_step_s));
+
+  return mjlib::base::Limit((desired_a - a0) / delta_s, -max_j, max_j);
+}
+
+/// Once the step from @p start to @p result reaches or crosses
+/// @p target_l_s with no more acceleration left than one step of jerk
+/// can remove, hold the target exactly.  Otherwise the square root
+/// law in VelocityJerk has unbounded gain there, and dithers around
+/// it from one cycle to the next.
+void SettleVelocity(const TrajectoryAxis& start, double target_l_s,
+                    const JerkLimits& limits, double delta_s,
+                    TrajectoryAxis* result) {
+  const double max_step = limits.max_jerk_l_s3 * delta_s;
+  if ((target_l_s - start.velocity_l_s) *
+      (target_l_s - result->velocity_l_s) <= 0.0 &&
+      std::abs(start.acceleration_l_s2) <= max_step) {
+    result->velocity_l_s = target_l_s;
+    result->acceleration_l_s2 = 0.0;
+    result->pose_l =
+        start.pose_l + start.velocity_l_s * delta_s +
+        start.acceleration_l_s2 * delta_s * delta_s / 3.0;
+  }
+}
+}
+
+TrajectoryState CalculateAccelerationLimitedTrajectory(
+    const TrajectoryState& start,
+    const base::Point3D& target_l,
+    double target_velocity_l_s,
+    double max_acceleration_l_s2,
+    double delta_s) {
+  const base::Point3D error_l = target_l - start.pose_l;
+  const double distance_l = error_l.norm();
+
+  // Head straight for the target, slowing down in time to stop there.
+  base::Point3D desired_velocity_l_s = base::Point3D::Zero();
+  if (distance_l > 0.0) {
+    desired_velocity_l_s =
+        error_l / distance_l *
+        std::min(target_velocity_l_s,
+                 std::sqrt(2.0 * max_acceleration_l_s2 * distance_l));
+  }
+
+  base::Point3D acceleration_l_s2 =
+      (desired_velocity_l_s - start.velocity_l_s) / delta_s;
+  const double acceleration_norm = acceleration_l_s2.norm();
+  if (acceleration_norm > max_acceleration_l_s2) {
+    acceleration_l_s2 *= max_acceleration_l_s2 / acceleration_norm;
+  }
+
+  TrajectoryState result;
+  result.acceleration_l_s2 = acceleration_l_s2;
+  result.velocity_l_s = start.velocity_l_s + acceleration_l_s2 * delta_s;
+  result.pose_l = start.pose_l +
+      0.5 * (start.velocity_l_s + result.velocity_l_s) * delta_s;
+  return result;
+}
+
+TrajectoryAxis CalculateJerkLimitedVelocity(
+    const TrajectoryAxis& start,
+    double target_velocity_l_s,
+    const JerkLimits& limits,
+    double delta_s) {
+  const double target = mjlib::base::Limit(
+      target_velocity_l_s, -limits.max_velocity_l_s, limits.max_velocity_l_s);
+  auto result = Integrate(
+      start, VelocityJerk(start, target, limits, delta_s),
+      limits.max_acceleration_l_s2, delta_s);
+  SettleVelocity(start, target, limits, delta_s, &result);
+  return result;
+}
+
+TrajectoryAxis CalculateJerkLimitedTrajectory(
+    const TrajectoryAxis& start,
+    double target_l,
+    const JerkLimits& limits,
+    double delta_s) {
+  const double max_a = limits.max_acceleration_l_s2;
+  const double max_j = limits.max_jerk_l_s3;
+
+  // Where would we come to rest if we applied the given jerk for one
+  // step and then stopped as fast as possible?
+  struct Candidate {
+    double jerk_l_s3 = 0.0;
+    double overshoot_l = 0.0;
+  };
+  auto evaluate = [&](double jerk_l_s3) {
+    const auto next = Integrate(start, jerk_l_s3, max_a, delta_s);
+    Candidate result;
+    // The acceleration limit may have cut the jerk short.
+    result.jerk_l_s3 =
+        (next.acceleration_l_s2 - start.acceleration_l_s2) / delta_s;
+    result.overshoot_l = next.pose_l - target_l +
+        StoppingDistance(next.velocity_l_s, next.acceleration_l_s2,
+                         max_a, max_j);
+    return result;
+  };
+
+  // The rest position is monotonic in the jerk, so pick the jerk
+  // which lands on the target.  It is not linear in the jerk though,
+  // so refine the bracket a fixed number of times rather than
+  // interpolating between the extremes just once, which overshoots by
+  // tens of microns.
+  auto low = evaluate(-max_j);
+  auto high = evaluate(max_j);
+  double jerk_l_s3 = 0.0;
+  if (high.overshoot_l <= 0.0) {
+    jerk_l_s3 = high.jerk_l_s3;
+  } else if (low.overshoot_l >= 0.0) {
+    jerk_l_s3 = low.jerk_l_s3;
+  } else {
+    constexpr int kRefineSteps = 4;
+    for (int i = 0; i < kRefineSteps; i++) {
+      jerk_l_s3 = low.jerk_l_s3 +
+          (high.jerk_l_s3 - low.jerk_l_s3) *
+          low.overshoot_l / (low.overshoot_l - high.overshoot_l);
+      const auto candidate = evaluate(jerk_l_s3);
+      if (candidate.overshoot_l > 0.0) {
+        high = candidate;
+      } else {
+        low = candidate;
+      }
+    }
+  }
+
+  // Then never accelerate any faster than the velocity limit allows.
+  const double max_v = limits.max_velocity_l_s;
+  const double lower = VelocityJerk(start, -max_v, limits, delta_s);
+  const double upper = VelocityJerk(start, max_v, limits, delta_s);
+  const bool cruise_high = jerk_l_s3 >= upper;
+  const bool cruise_low = jerk_l_s3 <= lower;
+  jerk_l_s3 = mjlib::base::Limit(jerk_l_s3, lower, upper);
+
+  auto result = Integrate(start, jerk_l_s3, max_a, delta_s);
+
+  // At the velocity limit, cruise on it the same way the velocity
+  // profile settles on its target.
+  if (cruise_high) {
+    SettleVelocity(start, max_v, limits, delta_s, &result);
+  } else if (cruise_low) {
+    SettleVelocity(start, -max_v, limits, delta_s, &result);
+  }
+
+  // Once we arrive, stay exactly on target rather than dithering
+  // around it from one cycle to the next.
+  const double max_step = max_j * delta_s;
+  if (std::abs(result.pose_l - target_l) <= max_step * delta_s * delta_s &&
+      std::abs(result.velocity_l_s) <= max_step * delta_s &&
+      std::abs(start.acceleration_l_s2) <= max_step) {
+    result.pose_l = target_l;
+    result.velocity_l_s = 0.0;
+    result.acceleration_l_s2 = 0.0;
+  }
+
+  return result;
+}
+
+TrajectoryState CalculateJerkLimitedTrajectory(
+    const TrajectoryState& start,
+    const base::Point3D& target_l,
+    const JerkLimits& limits,
+    double delta_s) {
+  TrajectoryState result;
+  for (int i = 0; i < 3; i++) {
+    TrajectoryAxis axis;
+    axis.pose_l = start.pose_l(i);
+    axis.velocity_l_s = start.velocity_l_s(i);
+    axis.acceleration_l_s2 = start.acceleration_l_s2(i);
+
+    axis = CalculateJerkLimitedTrajectory(axis, target_l(i), limits, delta_s);
+
+    result.pose_l(i) = axis.pose_l;
+    result.velocity_l_s(i) = axis.velocity_l_s;
+    result.acceleration_l_s2(i) = axis.acceleration_l_s2;
+  }
+  return result;
+}
+
+}
+}
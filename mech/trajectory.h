@@ -14,6 +14,8 @@
 
 #pragma once
 
+#include "mjlib/base/visitor.h"
+
 #include "base/point3d.h"
 
 namespace mjmech {
@@ -32,5 +34,74 @@ TrajectoryState CalculateAccelerationLimitedTrajectory(
     double max_acceleration_l_s2,
     double delta_s);
 
+/// The same as TrajectoryState, but for a single quantity, like a
+/// pitch angle or a drive velocity.
+struct TrajectoryAxis {
+  double pose_l = 0.0;
+  double velocity_l_s = 0.0;
+  double acceleration_l_s2 = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(pose_l));
+    a->Visit(MJ_NVP(velocity_l_s));
+    a->Visit(MJ_NVP(acceleration_l_s2));
+  }
+};
+
+/// All limits must be positive.
+struct JerkLimits {
+  double max_velocity_l_s = 1.0;
+  double max_acceleration_l_s2 = 1.0;
+  double max_jerk_l_s3 = 1.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(max_velocity_l_s));
+    a->Visit(MJ_NVP(max_acceleration_l_s2));
+    a->Visit(MJ_NVP(max_jerk_l_s3));
+  }
+};
+
+/// Advance @p start by @p delta_s toward a constant @p
+/// target_velocity_l_s, without exceeding the acceleration or jerk
+/// limits.  The acceleration is brought back to zero just as the
+/// target is reached.
+///
+/// Each call is closed form and constant time, so it is suitable for
+/// running every control cycle with a target that changes at any
+/// time.  The one exception to the jerk limit is the final step,
+/// which settles exactly on the target once within one step of it.
+TrajectoryAxis CalculateJerkLimitedVelocity(
+    const TrajectoryAxis& start,
+    double target_velocity_l_s,
+    const JerkLimits& limits,
+    double delta_s);
+
+/// Advance @p start by @p delta_s toward coming to rest at @p
+/// target_l, without exceeding any of the limits.
+///
+/// Each step picks the jerk for which braking as hard as possible
+/// afterwards would stop exactly on the target.  The rest position is
+/// monotonic in the jerk but not linear, and has no convenient
+/// inverse, so this is not closed form.  Instead the bracket between
+/// the extreme jerks is refined by a fixed 4 steps of regula falsi.
+/// Every call therefore costs exactly 6 evaluations of the stopping
+/// distance, each one square root, which keeps it constant time, and
+/// lands within microns of the target.  It settles the same way as
+/// CalculateJerkLimitedVelocity.
+TrajectoryAxis CalculateJerkLimitedTrajectory(
+    const TrajectoryAxis& start,
+    double target_l,
+    const JerkLimits& limits,
+    double delta_s);
+
+/// Apply CalculateJerkLimitedTrajectory to each axis independently.
+TrajectoryState CalculateJerkLimitedTrajectory(
+    const TrajectoryState& start,
+    const base::Point3D& target_l,
+    const JerkLimits& limits,
+    double delta_s);
+
 }
 }
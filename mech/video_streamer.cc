@@ -0,0 +1,444 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/video_streamer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+#include <fmt/format.h>
+
+#include <boost/asio/post.hpp>
+#include <boost/signals2/signal.hpp>
+
+#include <opencv2/imgcodecs/imgcodecs.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+#include "mjlib/base/clipp_archive.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/json5_read_archive.h"
+#include "mjlib/io/now.h"
+#include "mjlib/io/repeating_timer.h"
+
+#include "base/common.h"
+#include "base/cpu_affinity.h"
+#include "base/logging.h"
+#include "base/telemetry_registry.h"
+
+namespace pl = std::placeholders;
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+constexpr uint32_t kMagic = 0x46564a4d;  // 'MJVF'
+
+template <typename T>
+void Put(std::string* out, T value) {
+  using U = std::make_unsigned_t<T>;
+  const U u = static_cast<U>(value);
+  for (size_t i = 0; i < sizeof(T); i++) {
+    out->push_back(static_cast<char>((u >> (8 * i)) & 0xff));
+  }
+}
+
+int64_t NowUs() {
+  return base::ConvertPtimeToMicroseconds(
+      boost::posix_time::microsec_clock::universal_time());
+}
+
+struct Ack {
+  int64_t capture_us = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(capture_us));
+  }
+};
+
+struct Status {
+  boost::posix_time::ptime timestamp;
+
+  int clients = 0;
+
+  uint64_t frames_captured = 0;
+  uint64_t frames_encoded = 0;
+  /// Frames the encoder skipped because a newer one was waiting.
+  uint64_t frames_stale = 0;
+  uint64_t frames_sent = 0;
+  /// Pending frames replaced by a newer one before being sent.
+  uint64_t frames_replaced = 0;
+
+  double encode_ms = 0.0;
+  int encoded_size = 0;
+
+  /// Capture to client display, over the last period.
+  double latency_mean_ms = 0.0;
+  double latency_max_ms = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(clients));
+    a->Visit(MJ_NVP(frames_captured));
+    a->Visit(MJ_NVP(frames_encoded));
+    a->Visit(MJ_NVP(frames_stale));
+    a->Visit(MJ_NVP(frames_sent));
+    a->Visit(MJ_NVP(frames_replaced));
+    a->Visit(MJ_NVP(encode_ms));
+    a->Visit(MJ_NVP(encoded_size));
+    a->Visit(MJ_NVP(latency_mean_ms));
+    a->Visit(MJ_NVP(latency_max_ms));
+  }
+};
+
+using Message = std::shared_ptr<const std::string>;
+}
+
+class VideoStreamer::Impl {
+ public:
+  Impl(base::Context& context, Camera::Getter camera_getter)
+      : executor_(context.executor),
+        camera_getter_(std::move(camera_getter)),
+        timer_(executor_) {
+    context.telemetry_registry->Register("video_stream", &status_signal_);
+  }
+
+  ~Impl() {
+    done_.store(true);
+    if (thread_.joinable()) { thread_.join(); }
+  }
+
+  void AsyncStart(mjlib::io::ErrorCallback callback) {
+    camera_ = camera_getter_();
+    if (camera_) {
+      // Room for one frame being worked on and one waiting.  Anything
+      // older is stale by the time the encoder gets to it.
+      queue_ = camera_->AddFrameQueue(2);
+
+      thread_ = std::thread(std::bind(&Impl::Run, this));
+    }
+
+    timer_.start(
+        base::ConvertSecondsToDuration(parameters_.stats_period_s),
+        std::bind(&Impl::HandleTimer, this, pl::_1));
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+  class Client : public std::enable_shared_from_this<Client> {
+   public:
+    Client(Impl* parent, WebServer::WebsocketStream stream)
+        : parent_(parent),
+          stream_(std::move(stream)),
+          executor_(stream_.get_executor()),
+          min_interval_s_(1.0 / parent->parameters_.max_fps),
+          max_interval_s_(1.0 / parent->parameters_.min_fps),
+          interval_s_(min_interval_s_) {
+      stream_.binary(true);
+    }
+
+    void Start() { StartRead(); }
+
+    boost::asio::any_io_executor executor() { return executor_; }
+
+    /// Called on our executor for every encoded frame.
+    void Offer(Message message) {
+      if (closed_) { return; }
+
+      const auto now = std::chrono::steady_clock::now();
+      if (now < next_frame_) { return; }
+
+      if (writing_) {
+        if (pending_) {
+          // We are falling behind.
+          parent_->frames_replaced_++;
+          interval_s_ = std::min(max_interval_s_, interval_s_ * 1.5);
+        }
+        pending_ = std::move(message);
+        return;
+      }
+
+      Write(std::move(message));
+    }
+
+   private:
+    void Write(Message message) {
+      writing_ = true;
+      current_ = std::move(message);
+      next_frame_ = std::chrono::steady_clock::now() +
+          std::chrono::microseconds(static_cast<int64_t>(interval_s_ * 1e6));
+
+      stream_.async_write(
+          boost::asio::buffer(*current_),
+          std::bind(&Client::HandleWrite, shared_from_this(), pl::_1));
+    }
+
+    void HandleWrite(mjlib::base::error_code ec) {
+      writing_ = false;
+      current_.reset();
+
+      if (ec) {
+        Close(ec);
+        return;
+      }
+
+      parent_->frames_sent_++;
+
+      if (pending_) {
+        Message next = std::move(pending_);
+        pending_.reset();
+        Write(std::move(next));
+        return;
+      }
+
+      // The link kept up, so try a little faster.
+      interval_s_ = std::max(min_interval_s_, interval_s_ * 0.9);
+    }
+
+    void StartRead() {
+      stream_.async_read(
+          buffer_,
+          std::bind(&Client::HandleRead, shared_from_this(), pl::_1));
+    }
+
+    void HandleRead(mjlib::base::error_code ec) {
+      if (ec) {
+        Close(ec);
+        return;
+      }
+
+      std::string message(static_cast<const char*>(buffer_.data().data()),
+                          buffer_.size());
+      buffer_.clear();
+      std::istringstream istr(message);
+
+      try {
+        using JsonRead = mjlib::base::Json5ReadArchive;
+        const auto ack = JsonRead::Read<Ack>(istr, JsonRead::Options());
+        if (ack.capture_us != 0) {
+          parent_->RecordLatency(NowUs() - ack.capture_us);
+        }
+      } catch (mjlib::base::system_error& se) {
+        log_.warn(fmt::format("Ignoring bad ack: {}", se.what()));
+      }
+
+      StartRead();
+    }
+
+    void Close(const mjlib::base::error_code& ec) {
+      if (closed_) { return; }
+      closed_ = true;
+      pending_.reset();
+      log_.warn(fmt::format("Closing video websocket: {}", ec.message()));
+    }
+
+    Impl* const parent_;
+    WebServer::WebsocketStream stream_;
+    boost::asio::any_io_executor executor_;
+
+    base::LogRef log_ = base::GetLogInstance("VideoStreamer");
+
+    const double min_interval_s_;
+    const double max_interval_s_;
+    double interval_s_;
+    std::chrono::steady_clock::time_point next_frame_;
+
+    bool closed_ = false;
+    bool writing_ = false;
+    Message current_;
+    Message pending_;
+
+    boost::beast::flat_buffer buffer_;
+  };
+
+  void HandleWebsocket(WebServer::WebsocketStream stream) {
+    auto client = std::make_shared<Client>(this, std::move(stream));
+    client->Start();
+
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    clients_.push_back(client);
+  }
+
+  void RecordLatency(int64_t latency_us) {
+    std::lock_guard<std::mutex> lock(latency_mutex_);
+    latency_sum_us_ += latency_us;
+    latency_count_++;
+    latency_max_us_ = std::max(latency_max_us_, latency_us);
+  }
+
+  /// Return the live clients, dropping any which have gone away.
+  std::vector<std::shared_ptr<Client>> Clients() {
+    std::vector<std::shared_ptr<Client>> result;
+    std::lock_guard<std::mutex> lock(clients_mutex_);
+    clients_.erase(
+        std::remove_if(clients_.begin(), clients_.end(),
+                       [&](const auto& weak) {
+                         auto client = weak.lock();
+                         if (!client) { return true; }
+                         result.push_back(std::move(client));
+                         return false;
+                       }),
+        clients_.end());
+    return result;
+  }
+
+  void Run() {
+    mjlib::base::FailIf(base::SetThreadAffinity());
+    cv::Mat scaled;
+    std::vector<uchar> jpeg;
+    const std::vector<int> params = {
+      cv::IMWRITE_JPEG_QUALITY, parameters_.jpeg_quality,
+    };
+    const auto min_interval = std::chrono::microseconds(
+        static_cast<int64_t>(1e6 / parameters_.max_fps));
+    auto last_encode = std::chrono::steady_clock::time_point();
+
+    while (!done_.load()) {
+      auto frame = queue_->Pop(std::chrono::milliseconds(100));
+      if (!frame) {
+        if (queue_->closed()) { return; }
+        continue;
+      }
+      while (auto newer = queue_->Pop(std::chrono::milliseconds(0))) {
+        frame = std::move(newer);
+        frames_stale_++;
+      }
+
+      auto clients = Clients();
+      if (clients.empty()) { continue; }
+
+      const auto start = std::chrono::steady_clock::now();
+      if (start - last_encode < min_interval) { continue; }
+      last_encode = start;
+
+      const auto& image = frame->image;
+      const int width = std::min(parameters_.width, image.cols);
+      const int height = image.rows * width / image.cols;
+      if (width == image.cols) {
+        scaled = image;
+      } else {
+        cv::resize(image, scaled, cv::Size(width, height), 0, 0,
+                   cv::INTER_AREA);
+      }
+      cv::imencode(".jpg", scaled, jpeg, params);
+
+      auto message = std::make_shared<std::string>();
+      message->reserve(32 + jpeg.size());
+      Put(message.get(), kMagic);
+      Put(message.get(), frame->frame_number);
+      Put(message.get(), base::ConvertPtimeToMicroseconds(frame->timestamp));
+      Put(message.get(), NowUs());
+      Put(message.get(), static_cast<uint16_t>(width));
+      Put(message.get(), static_cast<uint16_t>(height));
+      message->append(reinterpret_cast<const char*>(jpeg.data()),
+                      jpeg.size());
+
+      frames_encoded_++;
+      encode_us_.store(std::chrono::duration_cast<std::chrono::microseconds>(
+          std::chrono::steady_clock::now() - start).count());
+      encoded_size_.store(message->size());
+
+      Message shared = std::move(message);
+      for (auto& client : clients) {
+        boost::asio::post(
+            client->executor(),
+            [client, shared]() { client->Offer(shared); });
+      }
+    }
+  }
+
+  void HandleTimer(const mjlib::base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    mjlib::base::FailIf(ec);
+
+    status_.timestamp = mjlib::io::Now(executor_.context());
+    status_.clients = Clients().size();
+    status_.frames_captured = camera_ ? camera_->stats().frames : 0;
+    status_.frames_encoded = frames_encoded_.load();
+    status_.frames_stale = frames_stale_.load();
+    status_.frames_sent = frames_sent_.load();
+    status_.frames_replaced = frames_replaced_.load();
+    status_.encode_ms = encode_us_.load() * 1e-3;
+    status_.encoded_size = encoded_size_.load();
+
+    {
+      std::lock_guard<std::mutex> lock(latency_mutex_);
+      status_.latency_mean_ms =
+          latency_count_ ? latency_sum_us_ * 1e-3 / latency_count_ : 0.0;
+      status_.latency_max_ms = latency_max_us_ * 1e-3;
+      latency_sum_us_ = 0;
+      latency_count_ = 0;
+      latency_max_us_ = 0;
+    }
+
+    status_signal_(&status_);
+  }
+
+  boost::asio::any_io_executor executor_;
+  Camera::Getter camera_getter_;
+  Parameters parameters_;
+
+  mjlib::io::RepeatingTimer timer_;
+  Status status_;
+  boost::signals2::signal<void (const Status*)> status_signal_;
+
+  CameraDriver* camera_ = nullptr;
+  std::shared_ptr<CameraFrameQueue> queue_;
+  std::thread thread_;
+  std::atomic<bool> done_{false};
+
+  std::mutex clients_mutex_;
+  std::vector<std::weak_ptr<Client>> clients_;
+
+  std::atomic<uint64_t> frames_encoded_{0};
+  std::atomic<uint64_t> frames_stale_{0};
+  std::atomic<uint64_t> frames_sent_{0};
+  std::atomic<uint64_t> frames_replaced_{0};
+  std::atomic<int64_t> encode_us_{0};
+  std::atomic<int> encoded_size_{0};
+
+  std::mutex latency_mutex_;
+  int64_t latency_sum_us_ = 0;
+  int64_t latency_count_ = 0;
+  int64_t latency_max_us_ = 0;
+};
+
+VideoStreamer::VideoStreamer(base::Context& context,
+                             Camera::Getter camera_getter)
+    : impl_(std::make_unique<Impl>(context, std::move(camera_getter))) {}
+
+VideoStreamer::~VideoStreamer() {}
+
+void VideoStreamer::AsyncStart(mjlib::io::ErrorCallback callback) {
+  impl_->AsyncStart(std::move(callback));
+}
+
+void VideoStreamer::HandleWebsocket(WebServer::WebsocketStream stream) {
+  impl_->HandleWebsocket(std::move(stream));
+}
+
+clipp::group VideoStreamer::program_options() {
+  return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
+}
+
+}
+}
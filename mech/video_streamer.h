@@ -0,0 +1,95 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+
+#include <clipp/clipp.h>
+
+#include <boost/noncopyable.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+
+#include "base/context.h"
+
+#include "mech/camera.h"
+#include "mech/web_server.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Stream live camera video to web clients over a binary websocket.
+///
+/// Frames are downscaled and JPEG encoded on a dedicated thread,
+/// which only ever works on the newest frame.  Each client gets at
+/// most one frame in flight and one pending.  A newer frame replaces
+/// a pending one, and a client which falls behind has its frame rate
+/// reduced until it keeps up again.
+///
+/// Each message is a little endian header followed by the JPEG:
+///   u32 magic 'MJVF'
+///   u64 frame_number
+///   i64 capture timestamp, us since the epoch
+///   i64 timestamp when encoding finished, us since the epoch
+///   u16 width
+///   u16 height
+///
+/// Clients may reply with a text message
+///   {"capture_us": <capture timestamp>}
+/// once a frame is displayed, which is used to measure latency from
+/// capture to display.
+class VideoStreamer : boost::noncopyable {
+ public:
+  /// @param camera_getter will be called at AsyncStart time
+  VideoStreamer(base::Context&, Camera::Getter camera_getter);
+  ~VideoStreamer();
+
+  void AsyncStart(mjlib::io::ErrorCallback);
+
+  /// Serve video to one client.  This may be called from any thread,
+  /// the client is serviced entirely on the stream's executor.
+  void HandleWebsocket(WebServer::WebsocketStream);
+
+  struct Parameters {
+    /// Frames are scaled to this width, preserving the aspect ratio.
+    int width = 640;
+    int jpeg_quality = 70;
+
+    /// The per-client frame rate adapts between these limits.
+    double max_fps = 30.0;
+    double min_fps = 2.0;
+
+    double stats_period_s = 1.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(width));
+      a->Visit(MJ_NVP(jpeg_quality));
+      a->Visit(MJ_NVP(max_fps));
+      a->Visit(MJ_NVP(min_fps));
+      a->Visit(MJ_NVP(stats_period_s));
+    }
+  };
+
+  clipp::group program_options();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
@@ -0,0 +1,642 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "mech/visual_odometry.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include <boost/asio/post.hpp>
+
+#include <fmt/format.h>
+
+#include <Eigen/Geometry>
+
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include <opencv2/video/tracking.hpp>
+
+#include "mjlib/base/clipp_archive.h"
+#include "mjlib/base/fail.h"
+#include "mjlib/base/system_error.h"
+#include "mjlib/io/now.h"
+#include "mjlib/io/repeating_timer.h"
+
+#include "base/common.h"
+#include "base/cpu_affinity.h"
+#include "base/handler_util.h"
+#include "base/logging.h"
+#include "base/telemetry_registry.h"
+
+namespace pl = std::placeholders;
+
+namespace mjmech {
+namespace mech {
+
+namespace {
+struct StageStats {
+  int64_t frames = 0;
+  int64_t dropped = 0;
+  double fps = 0.0;
+  double process_ms = 0.0;
+  double max_process_ms = 0.0;
+
+  /// From frame capture until this stage finished with it.
+  double latency_ms = 0.0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(frames));
+    a->Visit(MJ_NVP(dropped));
+    a->Visit(MJ_NVP(fps));
+    a->Visit(MJ_NVP(process_ms));
+    a->Visit(MJ_NVP(max_process_ms));
+    a->Visit(MJ_NVP(latency_ms));
+  }
+};
+
+struct Stats {
+  boost::posix_time::ptime timestamp;
+
+  StageStats pyramid;
+  StageStats track;
+  StageStats motion;
+
+  int64_t estimates = 0;
+  int64_t estimates_valid = 0;
+
+  template <typename Archive>
+  void Serialize(Archive* a) {
+    a->Visit(MJ_NVP(timestamp));
+    a->Visit(MJ_NVP(pyramid));
+    a->Visit(MJ_NVP(track));
+    a->Visit(MJ_NVP(motion));
+    a->Visit(MJ_NVP(estimates));
+    a->Visit(MJ_NVP(estimates_valid));
+  }
+};
+
+/// Accumulates timing for one stage, which is written from the
+/// stage's thread and read periodically from the executor.
+class StageMeter {
+ public:
+  void Record(boost::posix_time::ptime capture,
+              boost::posix_time::ptime start,
+              boost::posix_time::ptime end) {
+    const double process_ms =
+        base::ConvertDurationToSeconds(end - start) * 1e3;
+    const double latency_ms =
+        base::ConvertDurationToSeconds(end - capture) * 1e3;
+
+    std::lock_guard<std::mutex> lock(mutex_);
+    total_frames_++;
+    count_++;
+    process_ms_ += process_ms;
+    max_process_ms_ = std::max(max_process_ms_, process_ms);
+    latency_ms_ += latency_ms;
+  }
+
+  /// Return statistics since the previous call.
+  StageStats Take(double period_s, int64_t dropped) {
+    std::lock_guard<std::mutex> lock(mutex_);
+    StageStats result;
+    result.frames = total_frames_;
+    result.dropped = dropped;
+    result.fps = count_ / period_s;
+    if (count_) {
+      result.process_ms = process_ms_ / count_;
+      result.latency_ms = latency_ms_ / count_;
+    }
+    result.max_process_ms = max_process_ms_;
+
+    count_ = 0;
+    process_ms_ = 0.0;
+    max_process_ms_ = 0.0;
+    latency_ms_ = 0.0;
+    return result;
+  }
+
+ private:
+  std::mutex mutex_;
+  int64_t total_frames_ = 0;
+  int64_t count_ = 0;
+  double process_ms_ = 0.0;
+  double max_process_ms_ = 0.0;
+  double latency_ms_ = 0.0;
+};
+
+boost::posix_time::ptime Now() {
+  return boost::posix_time::microsec_clock::universal_time();
+}
+
+Eigen::Matrix3d ToMatrix(const AttitudeData& attitude) {
+  return attitude.attitude.eigen().toRotationMatrix();
+}
+
+/// What the later stages need from an AlignedFrame.  The camera
+/// frame itself is released after the pyramid is built, so that these
+/// stages do not hold buffers from the camera's pool.
+struct FrameInfo {
+  boost::posix_time::ptime timestamp;
+  boost::posix_time::ptime imu_timestamp;
+  bool valid = false;
+  AttitudeData attitude;
+};
+
+struct PyramidFrame {
+  FrameInfo info;
+  std::vector<cv::Mat> pyramid;
+};
+
+using PyramidFramePtr = std::shared_ptr<const PyramidFrame>;
+
+/// Corners which were tracked from one frame to the next.
+struct TrackedPair {
+  FrameInfo previous;
+  FrameInfo current;
+  cv::Size size;
+  std::vector<cv::Point2f> previous_points;
+  std::vector<cv::Point2f> current_points;
+};
+
+using TrackedPairPtr = std::shared_ptr<const TrackedPair>;
+}
+
+VisualOdometry::CameraModel::CameraModel(const Parameters& parameters)
+    : focal_px_(0.5 * parameters.width /
+                std::tan(0.5 * base::Radians(parameters.hfov_deg))),
+      axle_height_m_(parameters.axle_height_m),
+      max_range_m_(parameters.max_range_m) {
+  const double mount_rad = base::Radians(parameters.mount_pitch_deg);
+
+  // The camera frame is +x right, +y down, +z out of the lens, and
+  // the body frame is +x forward, +y right, +z down.
+  Eigen::Matrix3d axes;
+  axes <<
+      0, 0, 1,
+      1, 0, 0,
+      0, 1, 0;
+  // A camera tilted down has its optical axis pitched nose down.
+  body_from_camera_ =
+      Eigen::AngleAxisd(-mount_rad, Eigen::Vector3d::UnitY()) * axes;
+  camera_in_body_ = Eigen::Vector3d(
+      parameters.camera_forward_m, 0.0, -parameters.camera_height_m);
+}
+
+void VisualOdometry::CameraModel::Predict(
+    const Eigen::Matrix3d& previous_attitude,
+    const Eigen::Matrix3d& current_attitude,
+    const cv::Size& size,
+    const std::vector<cv::Point2f>& points,
+    std::vector<cv::Point2f>* predicted) const {
+  predicted->assign(points.begin(), points.end());
+
+  const Eigen::Matrix3d world_from_previous =
+      previous_attitude * body_from_camera_;
+  const Eigen::Matrix3d world_from_current =
+      current_attitude * body_from_camera_;
+  const Eigen::Matrix3d current_from_previous =
+      world_from_current.transpose() * world_from_previous;
+
+  for (auto& point : *predicted) {
+    const Eigen::Vector3d ray = current_from_previous * Ray(size, point);
+    if (ray.z() <= 0.0) { continue; }
+    point = Pixel(size, ray);
+  }
+}
+
+bool VisualOdometry::CameraModel::ProjectToGround(
+    const Eigen::Matrix3d& attitude,
+    const cv::Size& size,
+    const cv::Point2f& pixel,
+    Eigen::Vector3d* ground) const {
+  const Eigen::Vector3d camera = attitude * camera_in_body_;
+  const Eigen::Vector3d ray = attitude * body_from_camera_ * Ray(size, pixel);
+
+  // The world frame has +z down, with the ground at axle_height_m.
+  const double height = axle_height_m_ - camera.z();
+  if (ray.z() <= 1e-3 || height <= 0.0) { return false; }
+
+  *ground = camera + (height / ray.z()) * ray;
+  if (ground->head<2>().norm() > max_range_m_) { return false; }
+  return true;
+}
+
+// The camera is modeled as an ideal pinhole centered in the image.
+Eigen::Vector3d VisualOdometry::CameraModel::Ray(
+    const cv::Size& size, const cv::Point2f& pixel) const {
+  return Eigen::Vector3d(
+      (pixel.x - 0.5 * size.width) / focal_px_,
+      (pixel.y - 0.5 * size.height) / focal_px_,
+      1.0);
+}
+
+cv::Point2f VisualOdometry::CameraModel::Pixel(
+    const cv::Size& size, const Eigen::Vector3d& ray) const {
+  return cv::Point2f(
+      0.5 * size.width + focal_px_ * ray.x() / ray.z(),
+      0.5 * size.height + focal_px_ * ray.y() / ray.z());
+}
+
+class VisualOdometry::Impl {
+ public:
+  Impl(base::Context& context,
+       Camera::Getter camera_getter,
+       CameraImuAlignment* alignment)
+      : executor_(context.executor),
+        camera_getter_(std::move(camera_getter)),
+        alignment_(alignment),
+        timer_(executor_) {
+    context.telemetry_registry->Register(
+        "visual_odometry", &estimate_signal_);
+    context.telemetry_registry->Register(
+        "visual_odometry_stats", &stats_signal_);
+  }
+
+  ~Impl() {
+    done_.store(true);
+    for (auto* thread : {&pyramid_thread_, &track_thread_, &motion_thread_}) {
+      if (thread->joinable()) { thread->join(); }
+    }
+  }
+
+  void AsyncStart(mjlib::io::ErrorCallback callback) {
+    // Check here, where the error can be reported, rather than in
+    // the worker threads.
+    for (const int cpu : {parameters_.pyramid_cpu, parameters_.track_cpu,
+                          parameters_.motion_cpu}) {
+      if (cpu >= 0 && !base::IsProcessCpu(cpu)) {
+        boost::asio::post(
+            executor_,
+            std::bind(std::move(callback),
+                      mjlib::base::error_code::einval(
+                          fmt::format("cpu {} is not available", cpu))));
+        return;
+      }
+    }
+
+    if (camera_getter_()) {
+      camera_model_ = CameraModel(parameters_);
+
+      input_queue_ = alignment_->AddFrameQueue(parameters_.queue_size);
+      pyramid_queue_ = std::make_shared<FrameQueue<PyramidFramePtr>>(
+          parameters_.queue_size);
+      track_queue_ = std::make_shared<FrameQueue<TrackedPairPtr>>(
+          parameters_.queue_size);
+
+      pyramid_thread_ = std::thread(std::bind(&Impl::RunPyramid, this));
+      track_thread_ = std::thread(std::bind(&Impl::RunTrack, this));
+      motion_thread_ = std::thread(std::bind(&Impl::RunMotion, this));
+    }
+
+    timer_.start(
+        base::ConvertSecondsToDuration(parameters_.stats_period_s),
+        std::bind(&Impl::HandleTimer, this, pl::_1));
+
+    boost::asio::post(
+        executor_,
+        std::bind(std::move(callback), mjlib::base::error_code()));
+  }
+
+  /// The CPU was checked in AsyncStart, but the affinity can still be
+  /// refused, in which case the stage keeps whatever it inherited.
+  void PinThread(const char* stage, int cpu) {
+    const auto error = base::SetThreadAffinity(cpu);
+    if (error) {
+      log_.warn(fmt::format("{}: could not pin to cpu {}: {}",
+                            stage, cpu, error.message()));
+    }
+  }
+
+  /// Wait for the next item on @p queue.  Return nullptr once we are
+  /// shutting down or the queue has been closed and drained.
+  template <typename Queue>
+  auto Pop(Queue& queue) -> decltype(queue->Pop(std::chrono::seconds(0))) {
+    while (!done_.load()) {
+      auto result = queue->Pop(std::chrono::milliseconds(100));
+      if (result) { return result; }
+      if (queue->closed()) { break; }
+    }
+    return {};
+  }
+
+  void RunPyramid() {
+    PinThread("pyramid", parameters_.pyramid_cpu);
+
+    cv::Mat gray;
+    cv::Mat small;
+
+    while (auto aligned = Pop(input_queue_)) {
+      const auto start = Now();
+      const auto& image = aligned->frame->image;
+
+      cv::cvtColor(image, gray, cv::COLOR_BGR2GRAY);
+      const int height = image.rows * parameters_.width / image.cols;
+      cv::resize(gray, small, cv::Size(parameters_.width, height),
+                 0, 0, cv::INTER_AREA);
+
+      auto output = std::make_shared<PyramidFrame>();
+      output->info.timestamp = aligned->frame->timestamp;
+      output->info.imu_timestamp = aligned->imu_timestamp;
+      output->info.valid = aligned->valid;
+      output->info.attitude = aligned->attitude;
+      // The level 0 image is referenced by the pyramid, so give each
+      // frame its own.
+      cv::buildOpticalFlowPyramid(
+          small.clone(), output->pyramid,
+          cv::Size(parameters_.track_window_px, parameters_.track_window_px),
+          parameters_.pyramid_levels);
+
+      const auto timestamp = output->info.timestamp;
+      aligned.reset();
+      pyramid_queue_->Push(std::move(output));
+      pyramid_meter_.Record(timestamp, start, Now());
+    }
+
+    pyramid_queue_->Close();
+  }
+
+  void RunTrack() {
+    PinThread("track", parameters_.track_cpu);
+
+    PyramidFramePtr previous;
+    std::vector<cv::Point2f> previous_points;
+
+    std::vector<cv::Point2f> predicted;
+    std::vector<uint8_t> status;
+    std::vector<float> error;
+
+    while (auto current = Pop(pyramid_queue_)) {
+      const auto start = Now();
+      std::vector<cv::Point2f> current_points;
+
+      const bool usable =
+          previous &&
+          !previous_points.empty() &&
+          base::ConvertDurationToSeconds(
+              current->info.imu_timestamp -
+              previous->info.imu_timestamp) < parameters_.max_dt_s;
+
+      if (usable) {
+        if (previous->info.valid && current->info.valid) {
+          camera_model_.Predict(
+              ToMatrix(previous->info.attitude),
+              ToMatrix(current->info.attitude),
+              current->pyramid[0].size(), previous_points, &predicted);
+        } else {
+          predicted = previous_points;
+        }
+
+        cv::calcOpticalFlowPyrLK(
+            previous->pyramid, current->pyramid,
+            previous_points, predicted, status, error,
+            cv::Size(parameters_.track_window_px,
+                     parameters_.track_window_px),
+            parameters_.pyramid_levels,
+            cv::TermCriteria(
+                cv::TermCriteria::COUNT | cv::TermCriteria::EPS, 20, 0.03),
+            cv::OPTFLOW_USE_INITIAL_FLOW);
+
+        auto pair = std::make_shared<TrackedPair>();
+        pair->previous = previous->info;
+        pair->current = current->info;
+        pair->size = current->pyramid[0].size();
+        const cv::Rect bounds(cv::Point(), current->pyramid[0].size());
+        for (size_t i = 0; i < status.size(); i++) {
+          if (!status[i] || !bounds.contains(predicted[i])) { continue; }
+          pair->previous_points.push_back(previous_points[i]);
+          pair->current_points.push_back(predicted[i]);
+        }
+        current_points = pair->current_points;
+
+        track_queue_->Push(std::move(pair));
+      }
+
+      if (static_cast<int>(current_points.size()) <
+          parameters_.min_features) {
+        Detect(current->pyramid[0], &current_points);
+      }
+
+      previous = std::move(current);
+      previous_points = std::move(current_points);
+
+      track_meter_.Record(previous->info.timestamp, start, Now());
+    }
+
+    track_queue_->Close();
+  }
+
+  void Detect(const cv::Mat& image, std::vector<cv::Point2f>* points) {
+    std::vector<cv::KeyPoint> keypoints;
+    cv::FAST(image, keypoints, parameters_.fast_threshold, true);
+    std::sort(keypoints.begin(), keypoints.end(),
+              [](const auto& lhs, const auto& rhs) {
+                return lhs.response > rhs.response;
+              });
+
+    // Keep corners spread out, and away from the ones we already
+    // have, by marking a neighborhood around each as taken.
+    cv::Mat taken = cv::Mat::zeros(image.size(), CV_8U);
+    const int radius = parameters_.min_distance_px;
+    for (const auto& point : *points) {
+      cv::circle(taken, point, radius, cv::Scalar(255), -1);
+    }
+
+    for (const auto& keypoint : keypoints) {
+      if (static_cast<int>(points->size()) >= parameters_.max_features) {
+        break;
+      }
+      const cv::Point pixel(keypoint.pt);
+      if (taken.at<uint8_t>(pixel)) { continue; }
+      points->push_back(keypoint.pt);
+      cv::circle(taken, pixel, radius, cv::Scalar(255), -1);
+    }
+  }
+
+  void RunMotion() {
+    PinThread("motion", parameters_.motion_cpu);
+
+    std::vector<Eigen::Vector2d> displacements;
+
+    while (auto pair = Pop(track_queue_)) {
+      const auto start = Now();
+
+      Estimate estimate;
+      estimate.timestamp = pair->current.imu_timestamp;
+      estimate.dt_s = base::ConvertDurationToSeconds(
+          pair->current.imu_timestamp - pair->previous.imu_timestamp);
+      estimate.tracked = pair->current_points.size();
+
+      if (pair->previous.valid && pair->current.valid &&
+          estimate.dt_s > 0.0) {
+        Measure(*pair, &displacements, &estimate);
+      }
+
+      boost::asio::post(
+          executor_,
+          lifetime_.Wrap([this, estimate]() {
+              estimates_++;
+              if (estimate.valid) { estimates_valid_++; }
+              estimate_signal_(&estimate);
+            }));
+
+      motion_meter_.Record(pair->current.timestamp, start, Now());
+    }
+  }
+
+  void Measure(const TrackedPair& pair,
+               std::vector<Eigen::Vector2d>* displacements,
+               Estimate* estimate) const {
+    const Eigen::Matrix3d previous_attitude =
+        ToMatrix(pair.previous.attitude);
+    const Eigen::Matrix3d current_attitude = ToMatrix(pair.current.attitude);
+
+    // Each ground point is fixed in the world, so how far it appears
+    // to move relative to the axle is how far the axle moved.
+    displacements->clear();
+    for (size_t i = 0; i < pair.current_points.size(); i++) {
+      Eigen::Vector3d previous_ground;
+      Eigen::Vector3d current_ground;
+      if (!camera_model_.ProjectToGround(
+              previous_attitude, pair.size,
+              pair.previous_points[i], &previous_ground) ||
+          !camera_model_.ProjectToGround(
+              current_attitude, pair.size,
+              pair.current_points[i], &current_ground)) {
+        continue;
+      }
+      displacements->push_back(
+          (previous_ground - current_ground).head<2>());
+    }
+
+    if (static_cast<int>(displacements->size()) < parameters_.min_inliers) {
+      return;
+    }
+
+    // The median is robust to the points which were mistracked or
+    // are not actually on the ground, then the inliers around it are
+    // averaged to reduce noise.
+    auto median = [&](int axis) {
+      std::vector<double> values;
+      values.reserve(displacements->size());
+      for (const auto& d : *displacements) { values.push_back(d(axis)); }
+      auto middle = values.begin() + values.size() / 2;
+      std::nth_element(values.begin(), middle, values.end());
+      return *middle;
+    };
+    const Eigen::Vector2d center(median(0), median(1));
+
+    Eigen::Vector2d sum = Eigen::Vector2d::Zero();
+    int inliers = 0;
+    for (const auto& d : *displacements) {
+      if ((d - center).norm() > parameters_.inlier_threshold_m) { continue; }
+      sum += d;
+      inliers++;
+    }
+    estimate->inliers = inliers;
+    if (inliers < parameters_.min_inliers) { return; }
+
+    const Eigen::Vector2d world_velocity = sum / inliers / estimate->dt_s;
+
+    // Rotate into the heading frame, so that yaw drift in the
+    // attitude does not matter.
+    const double yaw = base::Radians(pair.current.attitude.euler_deg.yaw);
+    const double c = std::cos(yaw);
+    const double s = std::sin(yaw);
+    estimate->velocity_mps = c * world_velocity.x() + s * world_velocity.y();
+    estimate->lateral_mps = -s * world_velocity.x() + c * world_velocity.y();
+    estimate->valid = true;
+  }
+
+  void HandleTimer(const mjlib::base::error_code& ec) {
+    if (ec == boost::asio::error::operation_aborted) { return; }
+    mjlib::base::FailIf(ec);
+
+    const double period_s = parameters_.stats_period_s;
+
+    Stats stats;
+    stats.timestamp = mjlib::io::Now(executor_.context());
+    stats.pyramid = pyramid_meter_.Take(
+        period_s, input_queue_ ? input_queue_->dropped() : 0);
+    stats.track = track_meter_.Take(
+        period_s, pyramid_queue_ ? pyramid_queue_->dropped() : 0);
+    stats.motion = motion_meter_.Take(
+        period_s, track_queue_ ? track_queue_->dropped() : 0);
+    stats.estimates = estimates_;
+    stats.estimates_valid = estimates_valid_;
+
+    stats_signal_(&stats);
+  }
+
+  boost::asio::any_io_executor executor_;
+  Camera::Getter camera_getter_;
+  CameraImuAlignment* const alignment_;
+  Parameters parameters_;
+
+  base::LogRef log_ = base::GetLogInstance("VisualOdometry");
+
+  mjlib::io::RepeatingTimer timer_;
+
+  // Fixed once the threads are started.
+  CameraModel camera_model_;
+
+  std::shared_ptr<CameraImuAlignment::AlignedFrameQueue> input_queue_;
+  std::shared_ptr<FrameQueue<PyramidFramePtr>> pyramid_queue_;
+  std::shared_ptr<FrameQueue<TrackedPairPtr>> track_queue_;
+
+  std::atomic<bool> done_{false};
+  std::thread pyramid_thread_;
+  std::thread track_thread_;
+  std::thread motion_thread_;
+
+  StageMeter pyramid_meter_;
+  StageMeter track_meter_;
+  StageMeter motion_meter_;
+
+  base::HandlerLifetime lifetime_;
+
+  // Only accessed from executor_.
+  int64_t estimates_ = 0;
+  int64_t estimates_valid_ = 0;
+  EstimateSignal estimate_signal_;
+  boost::signals2::signal<void (const Stats*)> stats_signal_;
+};
+
+VisualOdometry::VisualOdometry(base::Context& context,
+                               Camera::Getter camera_getter,
+                               CameraImuAlignment* alignment)
+    : impl_(std::make_unique<Impl>(
+                context, std::move(camera_getter), alignment)) {}
+
+VisualOdometry::~VisualOdometry() {}
+
+void VisualOdometry::AsyncStart(mjlib::io::ErrorCallback callback) {
+  impl_->AsyncStart(std::move(callback));
+}
+
+VisualOdometry::EstimateSignal* VisualOdometry::estimate_signal() {
+  return &impl_->estimate_signal_;
+}
+
+clipp::group VisualOdometry::program_options() {
+  return mjlib::base::ClippArchive().Accept(&impl_->parameters_).release();
+}
+
+}
+}
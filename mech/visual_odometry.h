@@ -0,0 +1,213 @@
+// Copyright 2020 Josh Pieper, jjp@pobox.com.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#pragma once
+
+#include <memory>
+#include <vector>
+
+#include <clipp/clipp.h>
+
+#include <Eigen/Core>
+
+#include <opencv2/core/core.hpp>
+
+#include <boost/date_time/posix_time/posix_time_types.hpp>
+#include <boost/noncopyable.hpp>
+#include <boost/signals2/signal.hpp>
+
+#include "mjlib/base/visitor.h"
+#include "mjlib/io/async_types.h"
+
+#include "base/context.h"
+
+#include "mech/camera.h"
+#include "mech/camera_imu_alignment.h"
+
+namespace mjmech {
+namespace mech {
+
+/// Estimate the planar motion of the robot from camera frames.
+///
+/// Frames which have been tagged with an attitude by
+/// CameraImuAlignment pass through three stages, each on its own
+/// thread, so that consecutive frames are processed concurrently:
+///
+///  1. pyramid: grayscale conversion, downscaling, and construction
+///     of the image pyramid.
+///  2. track: FAST corners are tracked from the previous frame with
+///     pyramidal Lucas-Kanade.  The IMU rotation between the two
+///     frames is used to predict where each corner will be, so only
+///     the translation has to be searched for.
+///  3. motion: tracked corners are projected onto the ground plane
+///     using the camera mounting and each frame's attitude, and the
+///     robot's displacement is the robust mean of how far they moved.
+///
+/// The stages exchange frames through small queues, which drop frames
+/// rather than block when a stage falls behind.
+class VisualOdometry : boost::noncopyable {
+ public:
+  /// @param camera_getter will be called at AsyncStart time
+  VisualOdometry(base::Context&,
+                 Camera::Getter camera_getter,
+                 CameraImuAlignment* alignment);
+  ~VisualOdometry();
+
+  void AsyncStart(mjlib::io::ErrorCallback);
+
+  struct Estimate {
+    /// The capture time of the later frame, in the IMU clock.
+    boost::posix_time::ptime timestamp;
+    double dt_s = 0.0;
+
+    /// In the robot's heading frame, which is level with +x forward
+    /// and +y right.
+    double velocity_mps = 0.0;
+    double lateral_mps = 0.0;
+
+    int tracked = 0;
+    int inliers = 0;
+    bool valid = false;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(timestamp));
+      a->Visit(MJ_NVP(dt_s));
+      a->Visit(MJ_NVP(velocity_mps));
+      a->Visit(MJ_NVP(lateral_mps));
+      a->Visit(MJ_NVP(tracked));
+      a->Visit(MJ_NVP(inliers));
+      a->Visit(MJ_NVP(valid));
+    }
+  };
+
+  /// Emitted on the executor for every estimate, valid or not.
+  using EstimateSignal = boost::signals2::signal<void (const Estimate*)>;
+  EstimateSignal* estimate_signal();
+
+  struct Parameters {
+    /// Frames are scaled to this width before any processing.
+    int width = 320;
+    int pyramid_levels = 3;
+    double hfov_deg = 62.2;
+
+    int fast_threshold = 20;
+    /// New corners are detected whenever fewer than min_features are
+    /// being tracked, up to max_features.
+    int max_features = 200;
+    int min_features = 100;
+    /// Corners closer than this to one already tracked are ignored.
+    int min_distance_px = 8;
+    int track_window_px = 15;
+
+    /// The camera is this far in front of and above the wheel axle,
+    /// and is tilted down by mount_pitch_deg.
+    double camera_forward_m = 0.0;
+    double camera_height_m = 0.25;
+    double mount_pitch_deg = 20.0;
+    double axle_height_m = 0.0815;
+
+    /// Points further than this on the ground are too imprecise to
+    /// use.
+    double max_range_m = 2.0;
+    double inlier_threshold_m = 0.01;
+    int min_inliers = 15;
+    /// Pairs of frames further apart than this are not used.
+    double max_dt_s = 0.2;
+
+    /// Each stage thread is pinned to this CPU if non-negative,
+    /// otherwise it may run on any CPU the process started with.
+    /// These should not include rt.cpu_affinity.
+    int pyramid_cpu = -1;
+    int track_cpu = -1;
+    int motion_cpu = -1;
+
+    int queue_size = 2;
+    double stats_period_s = 1.0;
+
+    template <typename Archive>
+    void Serialize(Archive* a) {
+      a->Visit(MJ_NVP(width));
+      a->Visit(MJ_NVP(pyramid_levels));
+      a->Visit(MJ_NVP(hfov_deg));
+      a->Visit(MJ_NVP(fast_threshold));
+      a->Visit(MJ_NVP(max_features));
+      a->Visit(MJ_NVP(min_features));
+      a->Visit(MJ_NVP(min_distance_px));
+      a->Visit(MJ_NVP(track_window_px));
+      a->Visit(MJ_NVP(camera_forward_m));
+      a->Visit(MJ_NVP(camera_height_m));
+      a->Visit(MJ_NVP(mount_pitch_deg));
+      a->Visit(MJ_NVP(axle_height_m));
+      a->Visit(MJ_NVP(max_range_m));
+      a->Visit(MJ_NVP(inlier_threshold_m));
+      a->Visit(MJ_NVP(min_inliers));
+      a->Visit(MJ_NVP(max_dt_s));
+      a->Visit(MJ_NVP(pyramid_cpu));
+      a->Visit(MJ_NVP(track_cpu));
+      a->Visit(MJ_NVP(motion_cpu));
+      a->Visit(MJ_NVP(queue_size));
+      a->Visit(MJ_NVP(stats_period_s));
+    }
+  };
+
+  /// The camera as mounted on the robot, an ideal pinhole centered in
+  /// frames which have been scaled to Parameters::width.
+  ///
+  /// Attitudes rotate the body frame, +x forward, +y right, +z down,
+  /// into a level world frame whose origin is the axle.
+  class CameraModel {
+   public:
+    CameraModel() = default;
+    CameraModel(const Parameters&);
+
+    /// Predict where each of @p points will be after the camera
+    /// rotates from @p previous_attitude to @p current_attitude.  This
+    /// is exact for distant points, and close enough for the ground
+    /// that LK only has to find the remaining translation.  Points
+    /// which rotate behind the camera are left where they were.
+    void Predict(const Eigen::Matrix3d& previous_attitude,
+                 const Eigen::Matrix3d& current_attitude,
+                 const cv::Size& size,
+                 const std::vector<cv::Point2f>& points,
+                 std::vector<cv::Point2f>* predicted) const;
+
+    /// Find where the ray through @p pixel meets the ground, relative
+    /// to the point on the ground directly beneath the axle.  Return
+    /// false if it does not, or is beyond max_range_m.
+    bool ProjectToGround(const Eigen::Matrix3d& attitude,
+                         const cv::Size& size,
+                         const cv::Point2f& pixel,
+                         Eigen::Vector3d* ground) const;
+
+   private:
+    Eigen::Vector3d Ray(const cv::Size&, const cv::Point2f&) const;
+    cv::Point2f Pixel(const cv::Size&, const Eigen::Vector3d&) const;
+
+    Eigen::Matrix3d body_from_camera_ = Eigen::Matrix3d::Identity();
+    Eigen::Vector3d camera_in_body_ = Eigen::Vector3d::Zero();
+    double focal_px_ = 1.0;
+    double axle_height_m_ = 0.0;
+    double max_range_m_ = 0.0;
+  };
+
+  clipp::group program_options();
+
+ private:
+  class Impl;
+  std::unique_ptr<Impl> impl_;
+};
+
+}
+}
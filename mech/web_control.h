@@ -15,6 +15,7 @@
 #pragma once
 
 #include <memory>
+#include <vector>
 
 #include <clipp/clipp.h>
 
@@ -42,6 +43,9 @@ class WebControl {
   struct Options {
     std::string asset_path;
     bool exclusive = true;
+
+    /// Additional websocket endpoints to serve alongside /control.
+    std::vector<WebServer::Options::Websocket> websocket_handlers;
   };
 
   using SetCommand = std::function<void (const CommandClass&)>;
@@ -83,6 +87,9 @@ class WebControl {
         {"/control",
          std::bind(&WebControl::HandleControlWebsocket, this,
                    std::placeholders::_1)});
+    for (const auto& handler : options_.websocket_handlers) {
+      server_options.websocket_handlers.push_back(handler);
+    }
 
     std::cout << "Starting web server\n";
     web_server_ = std::make_unique<WebServer>(executor_, server_options);
@@ -179,12 +179,99 @@ class Joystick {
   }
 };
 
+class VideoView {
+  // The size of the header in front of each JPEG, see
+  // mech/video_streamer.h.
+  static HEADER_SIZE = 32;
+  static MAGIC = 0x46564a4d;
+
+  constructor(canvas, stats) {
+    this._canvas = canvas;
+    this._stats = stats;
+    this._websocket = null;
+    this._decoding = false;
+    this._pending = null;
+    this._frames = 0;
+    this._lastStatsTime = performance.now();
+  }
+
+  start() {
+    this._open();
+  }
+
+  _open() {
+    this._websocket = new WebSocket("ws://" + location.host + "/video");
+    this._websocket.binaryType = "arraybuffer";
+    this._websocket.addEventListener(
+      'message', (e) => { this._handleMessage(e.data); });
+    this._websocket.addEventListener(
+      'close', () => { setTimeout(() => { this._open(); }, 1000); });
+  }
+
+  _handleMessage(data) {
+    if (this._decoding) {
+      // Only the newest frame is worth showing.
+      this._pending = data;
+      return;
+    }
+    this._show(data);
+  }
+
+  async _show(data) {
+    const view = new DataView(data);
+    if (data.byteLength < VideoView.HEADER_SIZE ||
+        view.getUint32(0, true) != VideoView.MAGIC) {
+      return;
+    }
+    const captureUs = Number(view.getBigInt64(12, true));
+
+    this._decoding = true;
+    try {
+      const blob = new Blob([data.slice(VideoView.HEADER_SIZE)],
+                            {type: "image/jpeg"});
+      const bitmap = await createImageBitmap(blob);
+      if (this._canvas.width != bitmap.width) {
+        this._canvas.width = bitmap.width;
+        this._canvas.height = bitmap.height;
+      }
+      this._canvas.getContext('2d').drawImage(bitmap, 0, 0);
+      bitmap.close();
+
+      // Let the robot measure how long this frame took to reach us.
+      if (this._websocket.readyState == WebSocket.OPEN) {
+        this._websocket.send(JSON.stringify({capture_us: captureUs}));
+      }
+      this._updateStats();
+    } finally {
+      this._decoding = false;
+    }
+
+    if (this._pending) {
+      const next = this._pending;
+      this._pending = null;
+      this._show(next);
+    }
+  }
+
+  _updateStats() {
+    this._frames++;
+    const now = performance.now();
+    const elapsed = now - this._lastStatsTime;
+    if (elapsed < 1000) { return; }
+    this._stats.innerHTML =
+      `${(this._frames * 1000 / elapsed).toFixed(0)} fps`;
+    this._frames = 0;
+    this._lastStatsTime = now;
+  }
+};
+
 class Application {
   constructor() {
     this._websocket = null;
     this._mode = "";
     this._state = null;
     this._joystick = new Joystick();
+    this._video = new VideoView(getElement('video'), getElement('video_stats'));
 
     // Initialize any state from persistent storage.
     const cookies = readCookies();
@@ -283,6 +370,7 @@ class Application {
   start() {
     setInterval(() => this._handleTimer(), 100);
     this._openWebsocket();
+    this._video.start();
     getElement("command_plot").focus();
   }
 
@@ -484,6 +572,7 @@ class Application {
 
           if (this._mode == "pitch") { return "pitch"; }
           if (this._mode == "drive") { return "drive"; }
+          if (this._mode == "balance") { return "balance"; }
           return "zero_velocity";
         })(),
       },
@@ -500,7 +589,7 @@ class Application {
         "pitch_rate_dps" : 0.0,
         "yaw_rate_dps" : (w_R[2] / Math.PI * 180.0),
       }
-    } else if (this._mode == "drive") {
+    } else if (this._mode == "drive" || this._mode == "balance") {
       command["command"]["drive"] = {
         "velocity_mps" : v_R[0],
         "accel_mps2" : 0.0,
@@ -25,6 +25,7 @@
 
 #include "mjlib/base/fail.h"
 
+#include "base/cpu_affinity.h"
 #include "base/logging.h"
 
 #include "mech/mime_type.h"
@@ -134,6 +135,7 @@ class WebServer::Impl {
   }
 
   void ChildRun() {
+    mjlib::base::FailIf(base::SetThreadAffinity());
     std::make_shared<Listener>(
         this, child_context_.get_executor(),
         tcp::endpoint(boost::asio::ip::make_address(options_.address),
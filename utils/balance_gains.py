@@ -0,0 +1,300 @@
+#!/usr/bin/env python3
+
+# Copyright 2020 Josh Pieper, jjp@pobox.com.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#     http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+'''Compute the gain table for the hoverbot "balance" mode.
+
+The robot is modeled as a wheeled inverted pendulum.  Its only
+equilibrium is upright and at rest, so rather than linearizing about
+other pitch angles, which are not equilibria, the dynamics are written
+in state dependent coefficient form, xdot = A(pitch) x + B(pitch) u,
+which is exact about that equilibrium apart from a term in the square
+of the pitch rate.  For a range of pitch angles, a discrete time LQR
+gain is found for that A and B at the control period, and the results
+are written as a JSON5 configuration fragment which HoverbotControl
+merges with the rest of its configuration:
+
+  ./balance_gains.py > configs/hoverbot_balance.cfg
+
+The state is, in the units used by HoverbotControl:
+
+  pitch_deg, pitch_rate_dps, velocity_mps, position_m, yaw_deg,
+  yaw_rate_dps
+
+where position_m is the integral of the velocity error.  Each is
+measured from the upright equilibrium, where the trim torque is zero.
+The outputs are the common and differential joint torques in Nm,
+applied as u = -K(pitch) x.
+
+This only needs the python standard library.
+'''
+
+import argparse
+import math
+import sys
+
+
+def zeros(rows, cols):
+    return [[0.0] * cols for _ in range(rows)]
+
+
+def identity(size):
+    result = zeros(size, size)
+    for i in range(size):
+        result[i][i] = 1.0
+    return result
+
+
+def transpose(a):
+    return [list(row) for row in zip(*a)]
+
+
+def mul(a, b):
+    bt = transpose(b)
+    return [[sum(x * y for x, y in zip(row, col)) for col in bt] for row in a]
+
+
+def add(a, b):
+    return [[x + y for x, y in zip(ra, rb)] for ra, rb in zip(a, b)]
+
+
+def sub(a, b):
+    return [[x - y for x, y in zip(ra, rb)] for ra, rb in zip(a, b)]
+
+
+def scale(a, s):
+    return [[x * s for x in row] for row in a]
+
+
+def inverse(a):
+    '''Gauss-Jordan elimination with partial pivoting.'''
+    size = len(a)
+    m = [list(row) + ident for row, ident in zip(a, identity(size))]
+    for col in range(size):
+        pivot = max(range(col, size), key=lambda r: abs(m[r][col]))
+        m[col], m[pivot] = m[pivot], m[col]
+        p = m[col][col]
+        m[col] = [x / p for x in m[col]]
+        for row in range(size):
+            if row == col:
+                continue
+            f = m[row][col]
+            m[row] = [x - f * y for x, y in zip(m[row], m[col])]
+    return [row[size:] for row in m]
+
+
+def expm(a):
+    '''Matrix exponential by scaling and squaring a Taylor series.'''
+    norm = max(sum(abs(x) for x in row) for row in a)
+    squarings = max(0, int(math.ceil(math.log2(norm))) + 1) if norm > 0 else 0
+    scaled = scale(a, 1.0 / (2 ** squarings))
+
+    result = identity(len(a))
+    term = identity(len(a))
+    for k in range(1, 20):
+        term = scale(mul(term, scaled), 1.0 / k)
+        result = add(result, term)
+
+    for _ in range(squarings):
+        result = mul(result, result)
+    return result
+
+
+def discretize(a, b, period_s):
+    '''Zero order hold discretization.'''
+    n = len(a)
+    m = len(b[0])
+    aug = zeros(n + m, n + m)
+    for i in range(n):
+        for j in range(n):
+            aug[i][j] = a[i][j] * period_s
+        for j in range(m):
+            aug[i][n + j] = b[i][j] * period_s
+    e = expm(aug)
+    return ([row[:n] for row in e[:n]], [row[n:] for row in e[:n]])
+
+
+def dlqr(a, b, q, r, iterations=100000, tolerance=1e-10):
+    '''Iterate the discrete Riccati equation to convergence.'''
+    p = q
+    at = transpose(a)
+    bt = transpose(b)
+    for _ in range(iterations):
+        btp = mul(bt, p)
+        k = mul(inverse(add(r, mul(btp, b))), mul(btp, a))
+        next_p = add(q, mul(mul(at, p), sub(a, mul(b, k))))
+        delta = max(abs(x - y) for rx, ry in zip(next_p, p)
+                    for x, y in zip(rx, ry))
+        p = next_p
+        if delta < tolerance * max(1.0, max(abs(x) for row in p for x in row)):
+            return k
+    raise RuntimeError('Riccati iteration did not converge')
+
+
+def sinc(x):
+    return 1.0 if x == 0.0 else math.sin(x) / x
+
+
+def model(args, pitch_rad):
+    '''Return the continuous A and B in SI units at pitch_rad.
+
+    The gravity torque, M g l sin(pitch), is written as
+    (M g l sinc(pitch)) pitch, so that A x is the true dynamics
+    relative to upright rather than a tangent at pitch_rad.  The
+    M l sin(pitch) pitch_rate^2 term is dropped.
+
+    The state is [pitch, pitch_rate, velocity, position, yaw,
+    yaw_rate] with the pitch positive leaning forward.  The inputs
+    are the common and differential joint torques per wheel.  A
+    positive common joint torque drives the robot backwards, and a
+    positive differential torque yaws it positively, matching the
+    conventions in HoverbotControl.
+    '''
+    r = args.wheel_diameter_m / 2.0
+    big_m = args.body_mass_kg
+    m = args.wheel_mass_kg
+    iw = 0.5 * m * r * r
+    l = args.com_height_m
+    i_body = args.body_pitch_inertia_kgm2
+    c = math.cos(pitch_rad)
+    s = sinc(pitch_rad)
+    g = 9.81
+
+    # [a11 a12; a21 a22] [xdd; thetadd] = [tau / r; M g l s theta - tau]
+    # where tau is the total forward torque on the wheels.
+    a11 = big_m + 2 * m + 2 * iw / (r * r)
+    a12 = big_m * l * c
+    a21 = big_m * l * c
+    a22 = i_body + big_m * l * l
+    inv = inverse([[a11, a12], [a21, a22]])
+
+    # tau = -2 * common
+    xdd_theta = inv[0][1] * big_m * g * l * s
+    thetadd_theta = inv[1][1] * big_m * g * l * s
+    xdd_u = inv[0][0] * (-2.0 / r) + inv[0][1] * 2.0
+    thetadd_u = inv[1][0] * (-2.0 / r) + inv[1][1] * 2.0
+
+    half_track = args.track_width_m / 2.0
+    yaw_inertia = (args.body_yaw_inertia_kgm2 +
+                   2 * (m + iw / (r * r)) * half_track * half_track)
+    yawdd_u = 2.0 * half_track / r / yaw_inertia
+
+    a = zeros(6, 6)
+    b = zeros(6, 2)
+
+    a[0][1] = 1.0
+    a[1][0] = thetadd_theta
+    b[1][0] = thetadd_u
+    a[2][0] = xdd_theta
+    b[2][0] = xdd_u
+    a[3][2] = 1.0
+    a[4][5] = 1.0
+    b[5][1] = yawdd_u
+
+    return a, b
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__)
+    parser.add_argument('--period_s', type=float, default=0.0025)
+    parser.add_argument('--wheel_diameter_m', type=float, default=0.163)
+    parser.add_argument('--wheel_mass_kg', type=float, default=1.0)
+    parser.add_argument('--body_mass_kg', type=float, default=4.0)
+    parser.add_argument('--com_height_m', type=float, default=0.15)
+    parser.add_argument('--body_pitch_inertia_kgm2', type=float, default=0.05)
+    parser.add_argument('--body_yaw_inertia_kgm2', type=float, default=0.04)
+    parser.add_argument('--track_width_m', type=float, default=0.38)
+
+    parser.add_argument('--min_pitch_deg', type=float, default=-30.0)
+    parser.add_argument('--max_pitch_deg', type=float, default=30.0)
+    parser.add_argument('--pitch_step_deg', type=float, default=10.0)
+
+    # Bryson's rule: the largest acceptable value of each state and
+    # input.
+    parser.add_argument('--max_pitch_error_deg', type=float, default=30.0)
+    parser.add_argument('--max_pitch_rate_dps', type=float, default=100.0)
+    parser.add_argument('--max_velocity_error_mps', type=float, default=1.0)
+    parser.add_argument('--max_position_error_m', type=float, default=2.0)
+    parser.add_argument('--max_yaw_error_deg', type=float, default=20.0)
+    parser.add_argument('--max_yaw_rate_dps', type=float, default=60.0)
+    parser.add_argument('--max_common_Nm', type=float, default=0.5)
+    parser.add_argument('--max_differential_Nm', type=float, default=0.5)
+
+    args = parser.parse_args()
+
+    d2r = math.pi / 180.0
+    state_max = [
+        args.max_pitch_error_deg * d2r,
+        args.max_pitch_rate_dps * d2r,
+        args.max_velocity_error_mps,
+        args.max_position_error_m,
+        args.max_yaw_error_deg * d2r,
+        args.max_yaw_rate_dps * d2r,
+    ]
+    input_max = [args.max_common_Nm, args.max_differential_Nm]
+
+    q = zeros(6, 6)
+    for i, value in enumerate(state_max):
+        q[i][i] = 1.0 / (value * value)
+    r = zeros(2, 2)
+    for i, value in enumerate(input_max):
+        r[i][i] = 1.0 / (value * value)
+
+    # Convert gains from SI to the units HoverbotControl uses.
+    unit = [d2r, d2r, 1.0, 1.0, d2r, d2r]
+
+    count = int(round((args.max_pitch_deg - args.min_pitch_deg) /
+                      args.pitch_step_deg)) + 1
+
+    gains = []
+    for i in range(count):
+        pitch_deg = args.min_pitch_deg + i * args.pitch_step_deg
+        a, b = model(args, pitch_deg * d2r)
+        ad, bd = discretize(a, b, args.period_s)
+        k = dlqr(ad, bd, q, r)
+
+        closed = sub(ad, mul(bd, k))
+        # A crude stability check, closed^65536 should have decayed.
+        power = closed
+        for _ in range(16):
+            power = mul(power, power)
+        if max(abs(x) for row in power for x in row) > 1e-6:
+            raise RuntimeError(f'gain at {pitch_deg} deg is not stabilizing')
+
+        gains.append((pitch_deg,
+                      [k[0][j] * unit[j] for j in range(4)],
+                      [k[1][j] * unit[j] for j in (4, 5)]))
+
+    out = sys.stdout
+    out.write('// Generated by utils/balance_gains.py')
+    if len(sys.argv) > 1:
+        out.write(' with:\n//   ' + ' '.join(sys.argv[1:]))
+    out.write('\n')
+    out.write('{\n  "balance" : {\n    "gains" : [\n')
+    for pitch_deg, common, differential in gains:
+        out.write('      {\n')
+        out.write(f'        "pitch_deg" : {pitch_deg:.1f},\n')
+        for name, value in zip(
+                ['k_pitch', 'k_pitch_rate', 'k_velocity', 'k_position'],
+                common):
+            out.write(f'        "{name}" : {value:.6g},\n')
+        for name, value in zip(['k_yaw', 'k_yaw_rate'], differential):
+            out.write(f'        "{name}" : {value:.6g},\n')
+        out.write('      },\n')
+    out.write('    ],\n  },\n}\n')
+
+
+if __name__ == '__main__':
+    main()